@@ -0,0 +1,109 @@
+/**
+ * @file globbench.cpp
+ * @brief Benchmark of the glob engine against glob(3)
+ *
+ * Fills a temporary directory with files and expands a few patterns over it with glob(3), with a fresh Glob
+ * (cold, every expansion reads the directory) and with one Glob reused (warm, the listing is cached). The
+ * directory is created before the timing, so its mtime is old enough for the cache to trust it.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Glob.hpp"
+
+namespace {
+
+/**
+ * @brief Measures the average time of a function.
+ * @param rounds Number of calls.
+ * @param function The function, returns the number of matches.
+ * @param matches Receives the number of matches of the last call.
+ * @return double Milliseconds per call.
+ */
+template <typename F>
+double measure(int rounds, F function, size_t& matches) {
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        matches = function();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / rounds;
+}
+
+}  // namespace
+
+/**
+ * @brief Runs the benchmark.
+ * @param argc Argument count.
+ * @param argv Optional number of files and number of rounds.
+ * @return int Exit status of the program.
+ */
+int main(int argc, char** argv) {
+    size_t files = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    char directory[] = "/tmp/globbench.XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+
+    for (size_t i = 0; i < files; i++) {
+        std::string name = std::string{directory} + "/file" + std::to_string(i) + (i % 10 == 0 ? ".log" : ".txt");
+        int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            std::perror("open");
+            return 1;
+        }
+        close(fd);
+    }
+
+    // the cache does not trust listings modified within the current second
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+    const std::string patterns[] = {"*.log", "file1?3*", "file[0-4]*7.txt", "*"};
+    std::printf("%zu files, %d rounds\n", files, rounds);
+    std::printf("%-20s %10s %12s %12s %12s\n", "pattern", "matches", "glob(3) ms", "cold ms", "warm ms");
+
+    Glob warm;
+    for (const std::string& suffix : patterns) {
+        std::string pattern = std::string{directory} + "/" + suffix;
+        size_t libcMatches = 0;
+        size_t coldMatches = 0;
+        size_t warmMatches = 0;
+
+        double libc = measure(
+            rounds,
+            [&]() {
+                glob_t result{};
+                ::glob(pattern.c_str(), 0, nullptr, &result);
+                size_t count = result.gl_pathc;
+                globfree(&result);
+                return count;
+            },
+            libcMatches);
+        double cold = measure(
+            rounds, [&]() { return Glob{}.expand(pattern).size(); }, coldMatches);
+        double cached = measure(
+            rounds, [&]() { return warm.expand(pattern).size(); }, warmMatches);
+
+        std::printf("%-20s %10zu %12.2f %12.2f %12.2f%s\n", suffix.c_str(), libcMatches, libc, cold, cached,
+                    libcMatches == coldMatches && coldMatches == warmMatches ? "" : "  MISMATCH");
+    }
+
+    std::string cleanup = std::string{"rm -rf "} + directory;
+    return std::system(cleanup.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file membw.cpp
+ * @brief Memory bandwidth workload for the placement benchmark
+ *
+ * Streams over a buffer much larger than the caches (triad a = b + s * c) and prints the achieved bandwidth,
+ * so the run time is dominated by memory traffic and suffers from remote NUMA accesses.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * @brief Runs the workload.
+ * @param argc Argument count.
+ * @param argv Optional buffer size in MiB and number of passes.
+ * @return int Exit status of the program.
+ */
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    int passes = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    size_t count = megabytes * 1024 * 1024 / (3 * sizeof(double));
+    std::vector<double> a(count, 0.0);
+    std::vector<double> b(count, 1.0);
+    std::vector<double> c(count, 2.0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < count; i++) {
+            a[i] = b[i] + 3.0 * c[i];
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double bytes = 3.0 * sizeof(double) * count * passes;
+    std::printf("%.2f GiB/s (checksum %.1f)\n", bytes / elapsed.count() / (1 << 30), a[count / 2]);
+    return 0;
+}
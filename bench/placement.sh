@@ -0,0 +1,26 @@
+#!/bin/sh
+# Runs JOBS memory-bound background jobs through ishell with every placement policy and prints the wall
+# time of each run. Usage: bench/placement.sh BUILD_DIR [JOBS] [MIB] [CORES]
+
+BUILD_DIR=${1:?build directory}
+JOBS=${2:-$(nproc)}
+MIB=${3:-256}
+CORES=${4:-1}
+
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+i=0
+while [ "$i" -lt "$JOBS" ]; do
+    echo "$BUILD_DIR/membw $MIB 10 &" >> "$SCRIPT"
+    i=$((i + 1))
+done
+echo "wait" >> "$SCRIPT"
+
+for policy in none "round-robin:$CORES" "least-loaded:$CORES" "round-robin:$CORES:numa"; do
+    start=$(date +%s.%N)
+    "$BUILD_DIR/ishell" --placement "$policy" "$SCRIPT" > /dev/null
+    end=$(date +%s.%N)
+    awk -v policy="$policy" -v jobs="$JOBS" -v s="$start" -v e="$end" \
+        'BEGIN { printf "%s: %.2f s for %d jobs\n", policy, e - s, jobs }'
+done
@@ -0,0 +1,127 @@
+/**
+ * @file startupbench.cpp
+ * @brief Benchmark of the one-shot execution latency of the shell
+ *
+ * Runs `ishell -c /bin/true` many times and, as the baseline, /bin/true itself. The difference of the
+ * medians is what the shell adds to every command a scheduler launches through it; the benchmark fails if
+ * it is over the budget, so a startup regression shows up as a failed run.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+extern char** environ;
+
+namespace {
+
+/**
+ * @brief Runs a program to its end, with the standard streams on /dev/null.
+ * @param argv The program and its arguments.
+ * @return double The wall time in milliseconds, negative if the program failed.
+ */
+double runOnce(char* const argv[]) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+        posix_spawn_file_actions_addopen(&actions, fd, "/dev/null", fd == STDIN_FILENO ? O_RDONLY : O_WRONLY, 0);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid;
+    int status = 0;
+    bool ran = posix_spawn(&pid, argv[0], &actions, nullptr, argv, environ) == 0 && waitpid(pid, &status, 0) == pid;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    posix_spawn_file_actions_destroy(&actions);
+    return ran && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed.count() : -1;
+}
+
+/**
+ * @brief Runs a program many times.
+ * @param argv The program and its arguments.
+ * @param runs Number of runs.
+ * @return std::vector<double> The sorted wall times in milliseconds, empty if a run failed.
+ */
+std::vector<double> measure(char* const argv[], int runs) {
+    std::vector<double> times;
+    times.reserve(runs);
+    for (int run = 0; run < runs; run++) {
+        double time = runOnce(argv);
+        if (time < 0) {
+            return {};
+        }
+        times.push_back(time);
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+/**
+ * @brief Prints the distribution of the times of a program.
+ * @param name The name to print.
+ * @param times The sorted times.
+ */
+void print(const char* name, const std::vector<double>& times) {
+    auto quantile = [&](double q) { return times[static_cast<size_t>(q * (times.size() - 1))]; };
+    std::printf("%-24s %10.3f %10.3f %10.3f %10.3f\n", name, times.front(), quantile(0.5), quantile(0.9),
+                quantile(0.99));
+}
+
+}  // namespace
+
+/**
+ * @brief Runs the benchmark.
+ * @param argc Argument count.
+ * @param argv The shell executable, optional number of runs and budget of the median overhead in ms.
+ * @return int 0 if the overhead is within the budget, 1 if it is not or a run failed.
+ */
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s ISHELL [RUNS] [BUDGET_MS]\n", argv[0]);
+        return 1;
+    }
+    int runs = argc > 2 ? std::atoi(argv[2]) : 500;
+    double budget = argc > 3 ? std::atof(argv[3]) : 2.0;
+    if (runs <= 0) {
+        std::fprintf(stderr, "RUNS must be positive\n");
+        return 1;
+    }
+
+    char truePath[] = "/bin/true";
+    char option[] = "-c";
+    char* trueArgv[] = {truePath, nullptr};
+    char* shellArgv[] = {argv[1], option, truePath, nullptr};
+
+    // the first runs bring the executables into the page cache
+    measure(trueArgv, runs / 10 + 1);
+    measure(shellArgv, runs / 10 + 1);
+
+    std::vector<double> baseline = measure(trueArgv, runs);
+    std::vector<double> shell = measure(shellArgv, runs);
+    if (baseline.empty() || shell.empty()) {
+        std::fprintf(stderr, "a run of %s failed\n", baseline.empty() ? truePath : argv[1]);
+        return 1;
+    }
+
+    std::printf("%d runs, times in ms\n", runs);
+    std::printf("%-24s %10s %10s %10s %10s\n", "command", "min", "p50", "p90", "p99");
+    print("/bin/true", baseline);
+    print("ishell -c /bin/true", shell);
+
+    double overhead = shell[shell.size() / 2] - baseline[baseline.size() / 2];
+    bool within = overhead <= budget;
+    std::printf("median overhead %.3f ms, budget %.3f ms: %s\n", overhead, budget, within ? "ok" : "EXCEEDED");
+    return within ? 0 : 1;
+}
@@ -0,0 +1,674 @@
+/**
+ * @file stressbench.cpp
+ * @brief Soak and stress harness of the spawn and reap paths of the shell
+ *
+ * Runs ishell on generated scripts and watches it from the outside. The commands of the scripts are this
+ * program again in a probe mode: a background probe sends its pid and exit time through a FIFO before it
+ * exits, and the harness watches /proc until the zombie it leaves is gone, so the time between the two is
+ * the reap delay, whether the SIGCHLD handler or the wait builtin reaped it. A checkpoint probe stops the
+ * script until the harness has looked at the shell: its open descriptors, its children left behind (a zombie
+ * there is a lost status) and its resident memory. Foreground probes exit with a given status, the script
+ * prints LOST if the shell sees another one.
+ *
+ * Scenarios:
+ * - jobs N: N short-lived background jobs, then wait.
+ * - signals N: N rounds of a background job and two foreground commands whose exit statuses are checked,
+ *   while another thread floods the shell with SIGCHLD, SIGWINCH, SIGURG and SIGCONT.
+ * - fds N: N rounds of every kind of redirect, failing ones included, then the descriptors are compared.
+ * - soak SECONDS: a loop of jobs, redirects, substitutions and function calls, with the memory sampled.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern char** environ;
+
+namespace {
+
+/// @brief What a probe reports through the FIFO, small enough to be written atomically.
+struct Record {
+    /// @brief Pid of the probe.
+    pid_t pid;
+
+    /// @brief 1 for a checkpoint, 0 for an exiting background probe.
+    int32_t checkpoint;
+
+    /// @brief Monotonic time of the report in nanoseconds.
+    uint64_t time;
+};
+
+/// @brief What the harness saw of the shell at a checkpoint.
+struct Sample {
+    /// @brief Seconds since the start of the run.
+    double elapsed;
+
+    /// @brief Targets of the open descriptors of the shell, by descriptor.
+    std::map<int, std::string> fds;
+
+    /// @brief Children of the shell other than the checkpoint probe, with their states.
+    std::vector<std::pair<pid_t, char>> children;
+
+    /// @brief Resident memory of the shell in KiB.
+    long rssKib;
+};
+
+/// @brief What a run of the shell left behind.
+struct Outcome {
+    /// @brief Samples taken at the checkpoints.
+    std::vector<Sample> samples;
+
+    /// @brief Reap delays of the background probes in nanoseconds, sorted.
+    std::vector<uint64_t> reapDelays;
+
+    /// @brief Lines of the shell reporting a wrong exit status of a foreground command.
+    size_t lostStatuses = 0;
+
+    /// @brief Background jobs the shell started.
+    size_t jobsStarted = 0;
+
+    /// @brief Seconds from the first checkpoint to the last job started.
+    double spawnSeconds = 0;
+
+    /// @brief Lines the shell printed to stderr.
+    size_t errorLines = 0;
+
+    /// @brief First line the shell printed to stderr.
+    std::string firstError;
+
+    /// @brief Wall time of the run in seconds.
+    double seconds = 0;
+};
+
+/**
+ * @brief Gives the monotonic time.
+ * @return uint64_t The time in nanoseconds.
+ */
+uint64_t now() {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000ULL + static_cast<uint64_t>(time.tv_nsec);
+}
+
+/**
+ * @brief Sends a record through the FIFO.
+ * @param fifo Path of the FIFO.
+ * @param checkpoint Whether the record is a checkpoint.
+ * @return bool true if it was sent.
+ */
+bool report(const char* fifo, bool checkpoint) {
+    int fd = open(fifo, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    Record record{getpid(), checkpoint ? 1 : 0, now()};
+    bool sent = write(fd, &record, sizeof(record)) == sizeof(record);
+    close(fd);
+    return sent;
+}
+
+/**
+ * @brief Runs the probe modes of the program.
+ * @param argc Argument count.
+ * @param argv --probe FIFO, --checkpoint FIFO or --exit STATUS.
+ * @return int The exit status, -1 if the arguments name no probe mode.
+ */
+int probe(int argc, char** argv) {
+    if (argc != 3) {
+        return -1;
+    }
+    std::string mode = argv[1];
+    if (mode == "--probe") {
+        return report(argv[2], false) ? 0 : 1;
+    }
+    if (mode == "--checkpoint") {
+        // the harness ends the checkpoint with SIGTERM once it has looked at the shell
+        if (!report(argv[2], true)) {
+            return 1;
+        }
+        alarm(600);  // not left behind if the harness is gone
+        pause();
+        return 0;
+    }
+    if (mode == "--exit") {
+        // long enough for the signal storm to hit the foreground wait
+        usleep(500);
+        return std::atoi(argv[2]);
+    }
+    return -1;
+}
+
+/**
+ * @brief Gives the targets of the open descriptors of a process.
+ * @param pid The process.
+ * @return std::map<int, std::string> The targets by descriptor.
+ */
+std::map<int, std::string> openFds(pid_t pid) {
+    std::map<int, std::string> fds;
+    std::string directory = "/proc/" + std::to_string(pid) + "/fd";
+    DIR* listing = opendir(directory.c_str());
+    if (listing == nullptr) {
+        return fds;
+    }
+    for (dirent* entry; (entry = readdir(listing)) != nullptr;) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char target[4096];
+        std::string link = directory + "/" + entry->d_name;
+        ssize_t length = readlink(link.c_str(), target, sizeof(target) - 1);
+        fds[std::atoi(entry->d_name)] = length > 0 ? std::string(target, static_cast<size_t>(length)) : "?";
+    }
+    closedir(listing);
+    return fds;
+}
+
+/**
+ * @brief Finds the children of a process by scanning /proc.
+ * @param parent The process.
+ * @param except A child to leave out.
+ * @return std::vector<std::pair<pid_t, char>> The children with their states, Z for zombies.
+ */
+std::vector<std::pair<pid_t, char>> childrenOf(pid_t parent, pid_t except) {
+    std::vector<std::pair<pid_t, char>> children;
+    DIR* listing = opendir("/proc");
+    if (listing == nullptr) {
+        return children;
+    }
+    for (dirent* entry; (entry = readdir(listing)) != nullptr;) {
+        pid_t pid = std::atoi(entry->d_name);
+        if (pid <= 0 || pid == except) {
+            continue;
+        }
+        std::ifstream stat{"/proc/" + std::to_string(pid) + "/stat"};
+        std::string line;
+        if (!std::getline(stat, line)) {
+            continue;
+        }
+        // the command name may contain spaces, the fields after it do not
+        size_t nameEnd = line.rfind(')');
+        char state = 0;
+        pid_t ppid = 0;
+        if (nameEnd != std::string::npos &&
+            std::sscanf(line.c_str() + nameEnd + 1, " %c %d", &state, &ppid) == 2 && ppid == parent) {
+            children.emplace_back(pid, state);
+        }
+    }
+    closedir(listing);
+    return children;
+}
+
+/**
+ * @brief Reads the start time of a child process that is not reaped yet.
+ * @param pid The process.
+ * @param parent Its parent.
+ * @return unsigned long long The start time in clock ticks since boot, 0 if there is no such child; a pid
+ * used again by another child gives another start time.
+ */
+unsigned long long childStartTime(pid_t pid, pid_t parent) {
+    std::ifstream stat{"/proc/" + std::to_string(pid) + "/stat"};
+    std::string line;
+    if (!std::getline(stat, line)) {
+        return 0;
+    }
+    size_t nameEnd = line.rfind(')');
+    pid_t ppid = 0;
+    unsigned long long started = 0;
+    if (nameEnd == std::string::npos ||
+        // the start time is the 22nd field
+        std::sscanf(line.c_str() + nameEnd + 1,
+                    " %*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &ppid,
+                    &started) != 2 ||
+        ppid != parent) {
+        return 0;
+    }
+    return started;
+}
+
+/**
+ * @brief Reads the resident memory of a process.
+ * @param pid The process.
+ * @return long The resident memory in KiB, -1 if unknown.
+ */
+long residentKib(pid_t pid) {
+    std::ifstream status{"/proc/" + std::to_string(pid) + "/status"};
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            return std::atol(line.c_str() + 6);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Fits a line through the resident memory of the samples.
+ * @param samples The samples, at least two at different times.
+ * @return double The slope in KiB per hour.
+ */
+double growthPerHour(const std::vector<Sample>& samples) {
+    double n = static_cast<double>(samples.size());
+    double sumT = 0;
+    double sumM = 0;
+    double sumTT = 0;
+    double sumTM = 0;
+    for (const Sample& sample : samples) {
+        double memory = static_cast<double>(sample.rssKib);
+        sumT += sample.elapsed;
+        sumM += memory;
+        sumTT += sample.elapsed * sample.elapsed;
+        sumTM += sample.elapsed * memory;
+    }
+    return (n * sumTM - sumT * sumM) / (n * sumTT - sumT * sumT) * 3600;
+}
+
+/**
+ * @brief Reads lines from a descriptor until its end or until stopped.
+ * @param fd The descriptor.
+ * @param stop Descriptor becoming readable when the reading should stop.
+ * @param line Called with every line and the time it was read.
+ */
+void readLines(int fd, int stop, const std::function<void(const std::string&, uint64_t)>& line) {
+    std::string pending;
+    char buffer[65536];
+    while (true) {
+        pollfd watched[] = {{fd, POLLIN, 0}, {stop, POLLIN, 0}};
+        if (poll(watched, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (watched[0].revents == 0) {
+            return;
+        }
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+        uint64_t time = now();
+        pending.append(buffer, static_cast<size_t>(length));
+        size_t start = 0;
+        for (size_t end; (end = pending.find('\n', start)) != std::string::npos; start = end + 1) {
+            line(pending.substr(start, end - start), time);
+        }
+        pending.erase(0, start);
+    }
+}
+
+/**
+ * @brief Runs the shell on a script and watches it.
+ * @param shell The shell executable.
+ * @param script Path of the script.
+ * @param fifo Path of the FIFO the probes report through.
+ * @param storm Whether to flood the shell with signals while it runs.
+ * @param limit Seconds after which the shell is terminated, 0 for no limit.
+ * @return Outcome What the run left behind.
+ */
+Outcome runShell(const std::string& shell, const std::string& script, const std::string& fifo, bool storm,
+                 double limit) {
+    using namespace std;
+
+    Outcome outcome;
+    int output[2];
+    int errors[2];
+    int stop[2];
+    if (pipe2(output, O_CLOEXEC) == -1 || pipe2(errors, O_CLOEXEC) == -1 || pipe2(stop, O_CLOEXEC) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    // opened for reading and writing, so the FIFO never reaches its end between two probes
+    int records = open(fifo.c_str(), O_RDWR | O_CLOEXEC);
+    if (records == -1) {
+        perror("fifo");
+        exit(1);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, output[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, errors[1], STDERR_FILENO);
+    vector<char*> argv = {const_cast<char*>(shell.c_str()), const_cast<char*>(script.c_str()), nullptr};
+
+    uint64_t start = now();
+    pid_t pid;
+    if (posix_spawn(&pid, shell.c_str(), &actions, nullptr, argv.data(), environ) != 0) {
+        perror("spawn");
+        exit(1);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(output[1]);
+    close(errors[1]);
+
+    // an exited probe stays a zombie child of the shell until it is reaped, its start time tells it from a
+    // later child with the same pid
+    struct Exit {
+        pid_t pid;
+        unsigned long long started;
+        uint64_t time;
+    };
+    mutex watching;
+    vector<Exit> exits;
+    atomic<bool> shellRunning{true};
+    auto reaped = [&](const Exit& probe) {
+        if (childStartTime(probe.pid, pid) == probe.started) {
+            return false;
+        }
+        uint64_t time = now();
+        outcome.reapDelays.push_back(time > probe.time ? time - probe.time : 0);
+        return true;
+    };
+
+    uint64_t firstCheckpoint = 0;
+    uint64_t lastJob = 0;
+    thread outputReader([&]() {
+        readLines(output[0], stop[0], [&](const string& line, uint64_t time) {
+            if (line.find("pushed to background") != string::npos) {
+                outcome.jobsStarted++;
+                lastJob = time;
+            } else if (line == "LOST") {
+                outcome.lostStatuses++;
+            }
+        });
+    });
+    thread errorReader([&]() {
+        readLines(errors[0], stop[0], [&](const string& line, uint64_t) {
+            if (outcome.errorLines++ == 0) {
+                outcome.firstError = line;
+            }
+        });
+    });
+    thread recordReader([&]() {
+        Record record;
+        while (true) {
+            pollfd watched[] = {{records, POLLIN, 0}, {stop[0], POLLIN, 0}};
+            if (poll(watched, 2, -1) == -1 && errno == EINTR) {
+                continue;
+            }
+            if (watched[1].revents != 0 || read(records, &record, sizeof(record)) != sizeof(record)) {
+                return;
+            }
+            if (record.checkpoint == 0) {
+                Exit probe{record.pid, childStartTime(record.pid, pid), record.time};
+                lock_guard<mutex> lock(watching);
+                if (probe.started != 0) {
+                    exits.push_back(probe);
+                } else if (shellRunning) {
+                    reaped(probe);  // already gone when its record was read
+                }
+                continue;
+            }
+            if (firstCheckpoint == 0) {
+                firstCheckpoint = record.time;
+            }
+            Sample sample{static_cast<double>(now() - start) / 1e9, openFds(pid), childrenOf(pid, record.pid),
+                          residentKib(pid)};
+            outcome.samples.push_back(move(sample));
+            kill(record.pid, SIGTERM);
+        }
+    });
+
+    thread reapWatcher([&]() {
+        // the zombies left when the shell exits are reaped by init, they are not counted
+        while (shellRunning) {
+            {
+                lock_guard<mutex> lock(watching);
+                exits.erase(remove_if(exits.begin(), exits.end(), reaped), exits.end());
+            }
+            usleep(100);
+        }
+    });
+
+    atomic<bool> running{true};
+    thread stormer([&]() {
+        const int signals[] = {SIGCHLD, SIGWINCH, SIGURG, SIGCONT};
+        for (size_t sent = 0; storm && running.load(); sent++) {
+            kill(pid, signals[sent % 4]);
+            usleep(20);
+        }
+    });
+
+    int status;
+    if (limit > 0) {
+        while (waitpid(pid, &status, WNOHANG) == 0) {
+            if (static_cast<double>(now() - start) / 1e9 >= limit) {
+                kill(pid, SIGTERM);
+                waitpid(pid, &status, 0);
+                break;
+            }
+            usleep(10000);
+        }
+    } else {
+        waitpid(pid, &status, 0);
+    }
+    outcome.seconds = static_cast<double>(now() - start) / 1e9;
+    running = false;
+    shellRunning = false;
+    stormer.join();
+    reapWatcher.join();
+
+    // the output still in the pipes is read before the readers stop
+    usleep(100000);
+    char one = 1;
+    if (write(stop[1], &one, 1) != 1) {
+        perror("stop");
+    }
+    outputReader.join();
+    errorReader.join();
+    recordReader.join();
+    for (int fd : {output[0], errors[0], stop[0], stop[1], records}) {
+        close(fd);
+    }
+
+    sort(outcome.reapDelays.begin(), outcome.reapDelays.end());
+    if (firstCheckpoint != 0 && lastJob > firstCheckpoint) {
+        outcome.spawnSeconds = static_cast<double>(lastJob - firstCheckpoint) / 1e9;
+    }
+    return outcome;
+}
+
+/**
+ * @brief Prints what a run left behind and judges it.
+ * @param name Name of the scenario.
+ * @param outcome The run.
+ * @param checkFds Whether descriptors opened since the first checkpoint count as leaked.
+ * @return bool true if nothing leaked or got lost.
+ */
+bool judge(const char* name, const Outcome& outcome, bool checkFds) {
+    std::printf("%s: %.2f s\n", name, outcome.seconds);
+    if (outcome.jobsStarted > 0 && outcome.spawnSeconds > 0) {
+        std::printf("  background jobs      %zu, %.0f spawns/s\n", outcome.jobsStarted,
+                    static_cast<double>(outcome.jobsStarted) / outcome.spawnSeconds);
+    }
+    const std::vector<uint64_t>& delays = outcome.reapDelays;
+    if (!delays.empty()) {
+        auto quantile = [&](double q) {
+            return static_cast<double>(delays[static_cast<size_t>(q * (delays.size() - 1))]) / 1e3;
+        };
+        std::printf("  reap delay (us)      p50 %.1f, p99 %.1f, max %.1f over %zu jobs\n", quantile(0.5),
+                    quantile(0.99), quantile(1.0), delays.size());
+    }
+    std::printf("  lost statuses        %zu\n", outcome.lostStatuses);
+    if (outcome.errorLines > 0) {
+        std::printf("  stderr lines         %zu, first: %s\n", outcome.errorLines,
+                    outcome.firstError.c_str());
+    }
+
+    size_t leakedPids = 0;
+    size_t leakedFds = 0;
+    if (!outcome.samples.empty()) {
+        const Sample& first = outcome.samples.front();
+        const Sample& last = outcome.samples.back();
+        for (const auto& [pid, state] : last.children) {
+            std::printf("  leaked pid           %d (state %c)\n", pid, state);
+            leakedPids++;
+        }
+        for (const auto& [fd, target] : last.fds) {
+            if (checkFds && first.fds.count(fd) == 0) {
+                std::printf("  leaked fd            %d -> %s\n", fd, target.c_str());
+                leakedFds++;
+            }
+        }
+        std::printf("  open fds             %zu at the first checkpoint, %zu at the last\n", first.fds.size(),
+                    last.fds.size());
+        std::printf("  rss (KiB)            %ld at the first checkpoint, %ld at the last", first.rssKib,
+                    last.rssKib);
+        if (outcome.samples.size() > 2 && last.elapsed > first.elapsed) {
+            std::printf(", trend %+.0f KiB/h over %zu samples", growthPerHour(outcome.samples),
+                        outcome.samples.size());
+        }
+        std::printf("\n");
+    } else {
+        std::printf("  no checkpoint was reached\n");
+    }
+
+    bool ok = !outcome.samples.empty() && outcome.lostStatuses == 0 && leakedPids == 0 && leakedFds == 0;
+    std::printf("  %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+}  // namespace
+
+/**
+ * @brief Runs the harness, or a probe when started by the shell.
+ * @param argc Argument count.
+ * @param argv The shell executable, the scenario (jobs, signals, fds, soak or all) and its size.
+ * @return int 0 if nothing leaked or got lost, 1 otherwise.
+ */
+int main(int argc, char** argv) {
+    int probed = probe(argc, argv);
+    if (probed != -1) {
+        return probed;
+    }
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s ISHELL [jobs|signals|fds|soak|all] [COUNT|SECONDS]\n", argv[0]);
+        return 1;
+    }
+    std::string shell = argv[1];
+    std::string scenario = argc > 2 ? argv[2] : "all";
+    long size = argc > 3 ? std::atol(argv[3]) : 0;
+
+    char directory[] = "/tmp/stressbench.XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = directory;
+    std::string fifo = dir + "/records";
+    std::string script = dir + "/script";
+    if (mkfifo(fifo.c_str(), 0600) == -1) {
+        std::perror("mkfifo");
+        return 1;
+    }
+
+    char self[4096];
+    ssize_t selfLength = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (selfLength <= 0) {
+        std::perror("readlink");
+        return 1;
+    }
+    std::string harness(self, static_cast<size_t>(selfLength));
+    std::string backgroundProbe = harness + " --probe " + fifo + " &\n";
+    std::string checkpoint = harness + " --checkpoint " + fifo + "\n";
+
+    auto writeScript = [&](const std::string& text) {
+        std::ofstream{script, std::ios::trunc} << "path /bin /usr/bin\n" << text;
+    };
+
+    bool ok = true;
+    if (scenario == "jobs" || scenario == "all") {
+        std::ostringstream text;
+        text << checkpoint;
+        for (long i = 0; i < (size > 0 ? size : 100000); i++) {
+            text << backgroundProbe;
+        }
+        text << "wait\n" << checkpoint;
+        writeScript(text.str());
+        ok = judge("jobs", runShell(shell, script, fifo, false, 0), false) && ok;
+    }
+    if (scenario == "signals" || scenario == "all") {
+        std::ostringstream text;
+        text << checkpoint;
+        for (long i = 0; i < (size > 0 ? size : 5000); i++) {
+            text << backgroundProbe;
+            text << harness << " --exit 0 || echo LOST\n";
+            text << harness << " --exit 3 && echo LOST\n";
+        }
+        text << "wait\n" << checkpoint;
+        writeScript(text.str());
+        ok = judge("signals", runShell(shell, script, fifo, true, 0), false) && ok;
+    }
+    if (scenario == "fds" || scenario == "all") {
+        // a first round opens what the shell creates on first use, the checkpoint after it is the baseline
+        std::ostringstream round;
+        round << "true > " << dir << "/out\n"
+              << "true >> " << dir << "/out 2> " << dir << "/err\n"
+              << "cat < " << dir << "/out > " << dir << "/copy\n"
+              << "true &> " << dir << "/both\n"
+              << "echo fan > " << dir << "/a > " << dir << "/b\n"
+              << "true > " << dir << "/missing/out\n"
+              << "cat < " << dir << "/missing\n"
+              << "echo job > " << dir << "/job &\n"
+              << "x=\"$(echo substituted)\"\n"
+              << "copy " << dir << "/out " << dir << "/copied\n"
+              << "wait\n";
+        std::ostringstream text;
+        text << round.str() << checkpoint;
+        for (long i = 0; i < (size > 0 ? size : 2000); i++) {
+            text << round.str();
+        }
+        text << checkpoint;
+        writeScript(text.str());
+        ok = judge("fds", runShell(shell, script, fifo, false, 0), true) && ok;
+    }
+    if (scenario == "soak" || scenario == "all") {
+        std::ostringstream text;
+        text << "refresh() { true > " << dir << "/touched; }\n"
+             << "while true; do\n"
+             << "true > " << dir << "/out\n"
+             << backgroundProbe << "x=\"$(echo substituted)\"\n"
+             << "refresh\n"
+             << "ls " << dir << "/* > " << dir << "/listing\n"
+             << "wait\n"
+             << checkpoint << "done\n";
+        writeScript(text.str());
+        // the soak ends by terminating the shell, the children left are only judged at the checkpoints
+        Outcome outcome = runShell(shell, script, fifo, false, size > 0 ? static_cast<double>(size) : 60);
+        if (!outcome.samples.empty()) {
+            outcome.samples.erase(outcome.samples.begin());  // the first round opens the lazy descriptors
+        }
+        ok = judge("soak", outcome, true) && ok;
+    }
+
+    for (const char* name : {"records", "script", "out", "err", "copy", "both", "a", "b", "job", "copied",
+                             "touched", "listing"}) {
+        unlink((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file BatchScheduler.hpp
+ * @brief Contains a BatchScheduler class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Command.hpp"
+#include "JobPriority.hpp"
+
+/**
+ * @class BatchScheduler
+ * @brief Runs the lines of a batch script that do not depend on each other at the same time.
+ *
+ * Lines are added in script order, each is a single external command. A line depends on an earlier line if
+ * it reads a path the earlier line writes, if it writes a path the earlier line reads, or if both write the
+ * same path; a path conflicts with the directories it is in and the paths below it as well. A line reads
+ * its input redirects, its options and its command name if that is a path, and writes its output redirects.
+ * Its other arguments (and the part of an argument after =) may be written by the command too, they count
+ * as writes unless the command is known to only read them, like cat or grep. Paths a command uses without
+ * naming them are not known.
+ *
+ * The dependencies form a DAG that is run on a pool of threads in topological order: of the ready lines,
+ * the one of the most urgent priority class first, then the earliest one. The output of a line is kept in a
+ * memory file and printed once all lines before it are done, so the output is the one of a sequential run.
+ * Lines that change the state of the shell (cd, path, variables, functions, ...) are never added, the shell
+ * runs them between the graphs.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class BatchScheduler {
+   public:
+    /// @brief What the shell does around the lines, called from the worker threads.
+    struct Hooks {
+        /// @brief Prints the output a line left in a file, read from its start, called in script order.
+        std::function<void(int fd)> print;
+
+        /// @brief Called once a line is spawned with its pid and start time, gives an id for finished().
+        std::function<uint64_t(pid_t pid, uint64_t start)> started;
+
+        /// @brief Called with the id once the line is reaped, true if it was terminated for taking too long.
+        std::function<bool(uint64_t id)> finished;
+
+        /// @brief Waits for a job slot for a line, gives up once giveUp returns true, returns the token.
+        std::function<int(const std::function<bool()>& giveUp)> acquire;
+
+        /// @brief Gives back the token of a finished line.
+        std::function<void(int token)> release;
+    };
+
+    /**
+     * @brief Constructs an empty graph.
+     * @param workingDirectory The absolute directory relative paths of the lines are relative to.
+     */
+    explicit BatchScheduler(std::string workingDirectory);
+
+    /**
+     * @brief Adds a line after all the lines added so far and finds what it depends on.
+     * @param command The command of the line, its background flag is ignored.
+     * @param line Number of the line in the script, for the explanations.
+     * @param priority Priority class of the line, in the queue of ready lines and when it runs.
+     */
+    void add(std::unique_ptr<Command> command, size_t line, JobPriority::Class priority);
+
+    /**
+     * @brief Gives the number of lines added.
+     * @return size_t The number of lines.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Prints every line with the lines it waits for and why.
+     * @param output The stream to print to.
+     */
+    void explain(std::ostream& output) const;
+
+    /**
+     * @brief Runs all the lines, a line with unfinished dependencies waits for them.
+     * @param workers Maximum number of lines running at once.
+     * @param searchPath Directories searched for executables.
+     * @param environment Environment of the commands as NAME=VALUE entries.
+     * @param hooks What the shell does around the lines.
+     * @return int The wait status of the last line, 127 << 8 if it could not be started, 124 << 8 if it took
+     * too long.
+     */
+    int run(size_t workers, const std::vector<std::string>& searchPath, std::vector<std::string> environment,
+            const Hooks& hooks);
+
+   private:
+    /// @brief An edge of the graph.
+    struct Dependency {
+        /// @brief Index of the line waited for.
+        size_t node;
+
+        /// @brief Why the line is waited for.
+        std::string reason;
+    };
+
+    /// @brief A line of the script.
+    struct Node {
+        /// @brief The command.
+        std::unique_ptr<Command> command;
+
+        /// @brief Number of the line in the script.
+        size_t line;
+
+        /// @brief Priority class of the line.
+        JobPriority::Class priority;
+
+        /// @brief Earlier lines this one waits for.
+        std::vector<Dependency> dependencies;
+
+        /// @brief Later lines waiting for this one.
+        std::vector<size_t> dependents;
+    };
+
+    /// @brief Who accessed a path so far.
+    struct PathAccess {
+        /// @brief The last line writing the path, npos if none.
+        size_t writer;
+
+        /// @brief Lines reading the path after the last write.
+        std::vector<size_t> readers;
+    };
+
+    /**
+     * @brief Adds an edge unless the line waits for the other one already.
+     * @param node The waiting line.
+     * @param on The line waited for.
+     * @param reason Why.
+     */
+    void depend(size_t node, size_t on, std::string reason);
+
+    /**
+     * @brief Calls a function with the access records of a path, of the directories it is in and of the
+     * paths below it.
+     * @param path The normalized path.
+     * @param visit Called with the path of every record and the record.
+     */
+    void forRelated(const std::string& path,
+                    const std::function<void(const std::string&, const PathAccess&)>& visit) const;
+
+    /**
+     * @brief Gives the access record of a path, creating an empty one.
+     * @param path The normalized path.
+     * @return PathAccess& The record.
+     */
+    PathAccess& access(const std::string& path);
+
+    /// @brief Directory relative paths are relative to.
+    const std::string workingDirectory;
+
+    /// @brief The lines in script order.
+    std::vector<Node> nodes;
+
+    /// @brief Accesses by normalized path, sorted so the paths below a directory are next to each other.
+    std::map<std::string, PathAccess> paths;
+};
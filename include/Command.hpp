@@ -8,7 +8,6 @@
 
 #pragma once
 
-#include <optional>
 #include <string>
 #include <vector>
 
@@ -16,8 +15,8 @@
  * @class Command
  * @brief The class represents a single command.
  *
- * The class contains all the information about a single command including name, arguments, file of the
- * redirected output, and flag denoting if the command was ment to run in backgroung.
+ * The class contains all the information about a single command including name, arguments, redirections of
+ * its standard streams, and flag denoting if the command was ment to run in backgroung.
  * All the methods are getters/setters, so its use case is just to passively store the data.
  *
  * @author Sukhanov Ivan
@@ -25,6 +24,26 @@
  */
 class Command {
    public:
+    /// @brief A redirection of a standard stream to or from a file.
+    struct Redirect {
+        /// @brief The redirected stream.
+        enum class Stream {
+            Input,           ///< <
+            Output,          ///< > and >>
+            Error,           ///< 2> and 2>>
+            OutputAndError,  ///< &> and &>>
+        };
+
+        /// @brief The redirected stream.
+        Stream stream;
+
+        /// @brief The file.
+        std::string target;
+
+        /// @brief Append to the file instead of truncating it.
+        bool append;
+    };
+
     /**
      * @brief Constructs a Command with a name and arguments.
      * @param name The name of the command.
@@ -45,16 +64,23 @@ class Command {
     std::vector<std::string> getArgs() const;
 
     /**
-     * @brief Sets the file to which the command's output should be redirected.
-     * @param file The output file path.
+     * @brief Adds a redirection, an output stream redirected more than once is written to every target.
+     * @param redirect The redirection.
+     */
+    void addRedirect(Redirect redirect);
+
+    /**
+     * @brief Gets the redirections in the order they were written.
+     * @return The redirections.
      */
-    void setOutputRedirect(const std::string& file);
+    std::vector<Redirect> getRedirects() const;
 
     /**
-     * @brief Gets the output redirection file, if set.
-     * @return The output file path, or std::nullopt if not set.
+     * @brief Checks if a stream of the command is redirected.
+     * @param stream Input, Output or Error, OutputAndError counts for both outputs.
+     * @return True if the stream is redirected.
      */
-    std::optional<std::string> getOutputRedirect() const;
+    bool isRedirected(Redirect::Stream stream) const;
 
     /**
      * @brief Sets whether the command should run in parallel.
@@ -68,9 +94,15 @@ class Command {
      */
     bool isParallel() const;
 
+    /**
+     * @brief Composes the command line the command was parsed from.
+     * @return The name and the arguments separated by spaces.
+     */
+    std::string toString() const;
+
    private:
     std::string name;
     std::vector<std::string> args;
-    std::optional<std::string> outputFile;
+    std::vector<Redirect> redirects;
     bool inParallel;
 };
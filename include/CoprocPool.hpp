@@ -0,0 +1,176 @@
+/**
+ * @file CoprocPool.hpp
+ * @brief Contains a CoprocPool class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Command.hpp"
+
+/**
+ * @class CoprocPool
+ * @brief Long-lived worker processes answering request lines, so a command with an expensive startup is
+ * started once instead of once per item.
+ *
+ * Every worker runs the same command with its stdin and stdout connected to the shell by pipes. A request
+ * is a single line written to the stdin of a worker, its response is every line the worker prints until a
+ * line equal to the delimiter (an empty line by default). A worker must flush its stdout after every
+ * response.
+ *
+ * Requests go to the least busy worker, the one with the fewest requests in flight, up to pipelineDepth per
+ * worker; responses are printed in the order of the requests. The pool does not reap its workers, the
+ * owner passes their exits to exited(). A worker that dies, or closes its pipes during a request, is
+ * replaced by a new one if it answered a request since it was started; one dying before its first response
+ * stays down, so a command that cannot start does not spin. The request a dead worker was answering fails,
+ * the ones queued behind it go to the other workers.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class CoprocPool {
+   public:
+    /// @brief Starts a worker with the given stdin and stdout, returns its pid or -1 with errno set.
+    using Spawner = std::function<pid_t(const Command& command, int input, int output)>;
+
+    /// @brief Receives the responses in request order.
+    using Printer = std::function<void(std::string_view response)>;
+
+    /// @brief Requests one worker may have in flight.
+    static constexpr size_t pipelineDepth = 16;
+
+    /**
+     * @brief Constructs a pool without starting the workers.
+     * @param name Name of the pool, for the messages.
+     * @param command The command every worker runs.
+     * @param size Number of workers.
+     * @param delimiter The line ending a response.
+     * @param spawner Starts the workers.
+     */
+    CoprocPool(std::string name, Command command, size_t size, std::string delimiter, Spawner spawner);
+
+    /// @brief Closes the pipes and terminates the workers, the owner reaps them.
+    ~CoprocPool();
+
+    CoprocPool(const CoprocPool&) = delete;
+    CoprocPool& operator=(const CoprocPool&) = delete;
+
+    /**
+     * @brief Starts all the workers.
+     * @throws std::runtime_error if a worker cannot be started.
+     */
+    void start();
+
+    /**
+     * @brief Replaces a worker that has exited, to be called once it is reaped.
+     * @param pid The reaped process.
+     * @return true if it was a worker of the pool.
+     */
+    bool exited(pid_t pid);
+
+    /**
+     * @brief Sends requests to the workers and prints the responses in request order.
+     *
+     * A request whose worker dies while answering it fails, the others go on.
+     *
+     * @param requests The request lines, without line breaks.
+     * @param print Receives every complete response.
+     * @param errors Stream the failed requests are reported to.
+     * @return size_t The number of failed requests.
+     */
+    size_t request(const std::vector<std::string>& requests, const Printer& print, std::ostream& errors);
+
+    /**
+     * @brief Prints the pool and the state of every worker.
+     * @param output The stream to print to.
+     */
+    void describe(std::ostream& output) const;
+
+   private:
+    /// @brief A worker process.
+    struct Worker {
+        /// @brief The process, -1 once it is reaped or replaced.
+        pid_t pid = -1;
+
+        /// @brief Write end of the stdin of the worker, -1 once the worker is lost.
+        int input = -1;
+
+        /// @brief Read end of the stdout of the worker, -1 once the worker is lost.
+        int output = -1;
+
+        /// @brief Requests in flight in the order they were sent, as indices of the current request() call.
+        std::deque<size_t> inFlight;
+
+        /// @brief Request bytes not written yet.
+        std::string pending;
+
+        /// @brief Received bytes after the last complete line.
+        std::string partial;
+
+        /// @brief Responses since the worker was started.
+        uint64_t answered = 0;
+
+        /// @brief Times the worker was restarted.
+        uint64_t restarts = 0;
+
+        /// @brief True once the worker died without being restarted, it stays down.
+        bool failed = false;
+    };
+
+    /**
+     * @brief Starts a worker in a slot.
+     * @param worker The slot, its pid and pipes are set.
+     * @throws std::runtime_error if it cannot be started.
+     */
+    void spawn(Worker& worker);
+
+    /**
+     * @brief Closes the pipes of a worker, its process is left to exit on the end of its stdin.
+     * @param worker The worker.
+     */
+    static void disconnect(Worker& worker);
+
+    /**
+     * @brief Starts a new worker in the slot of a dead one, unless it never answered a request.
+     * @param worker The slot, its pipes are closed and its pid is -1.
+     * @return true if a new worker was started.
+     */
+    bool replace(Worker& worker);
+
+    /**
+     * @brief Picks the worker with the fewest requests in flight that can take one more.
+     * @return Worker* The worker, nullptr if all are busy or lost.
+     */
+    Worker* leastBusy();
+
+    /// @brief Name of the pool.
+    const std::string name;
+
+    /// @brief Command the workers run.
+    const Command command;
+
+    /// @brief Line ending a response.
+    const std::string delimiter;
+
+    /// @brief Starts the workers.
+    Spawner spawner;
+
+    /// @brief The workers.
+    std::vector<Worker> workers;
+
+    /// @brief Workers that lost their pipes and were replaced before they were reaped.
+    std::vector<pid_t> lost;
+};
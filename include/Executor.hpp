@@ -8,11 +8,33 @@
 
 #pragma once
 
+#include <signal.h>
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "BatchScheduler.hpp"
 #include "Command.hpp"
+#include "CoprocPool.hpp"
+#include "IoEngine.hpp"
+#include "JobPriority.hpp"
+#include "Jobserver.hpp"
+#include "JobTable.hpp"
+#include "OutputMultiplexer.hpp"
+#include "PlacementPolicy.hpp"
+#include "ResourceLimits.hpp"
+#include "SyntaxTree.hpp"
+#include "TimeoutQueue.hpp"
+#include "Variables.hpp"
 
 /**
  * @class Executor
@@ -22,21 +44,188 @@
  * of built-in, the corresponding member function is called, otherwise an external executable is called by a
  * child process. Depending on Command passed, it can be executed in background, with or without redirection.
  *
+ * Aliases and functions are looked up before the builtins. An alias is split into words when it is defined
+ * and only prepended to the arguments when it is used, a function body is parsed once when it is defined and
+ * run in the shell process by the function handler.
+ *
+ * Coprocess workers are children of the shell like jobs: they are reaped by the SIGCHLD handler and their
+ * pools replace the ones that die when collectReaped() passes their exits on.
+ *
+ * With a GNU make jobserver in MAKEFLAGS, or one served with serveJobs(), a background job and a line of a
+ * batch take a token before they start and give it back once they are reaped, so the shell shares one budget
+ * of concurrent jobs with make and the other shells of the tree.
+ *
  * @author Sukhanov Ivan
  * @date 25/05/2025
  */
 class Executor {
    public:
-    /// @brief Constructs an Executor object.
-    Executor();
+    /// @brief Runs the body of a function with the arguments of the call, returns the exit status.
+    using FunctionHandler = std::function<int(const SyntaxNode& body, const Command& call)>;
+
+    /**
+     * @brief Constructs an Executor object.
+     * @param variables Shell variables, their exported part is the environment of the commands.
+     */
+    explicit Executor(Variables& variables);
 
     /**
      * @brief Executes the given command.
      * @param cmd The command to execute.
+     * @return int The exit status, 0 for a command sent to background.
+     */
+    int execute(Command& cmd);
+
+    /**
+     * @brief Sets the CPU placement policy for background jobs.
+     * @param spec The policy spec, see PlacementPolicy::configure().
+     * @throws std::invalid_argument if the spec is malformed.
+     */
+    void setPlacement(const std::string& spec);
+
+    /**
+     * @brief Sets the resource limits of jobs.
+     * @param spec The limits spec, see ResourceLimits::configure().
+     * @throws std::invalid_argument if the spec is malformed.
+     */
+    void setLimits(const std::string& spec);
+
+    /**
+     * @brief Becomes the jobserver of the commands started by the shell, see Jobserver::serve().
+     * @param slots The number of jobs that may run at once in the whole tree, at least 1.
+     * @throws std::runtime_error if the jobserver cannot be created.
+     */
+    void serveJobs(size_t slots);
+
+    /**
+     * @brief Selects the engine for the file operations of the shell.
+     * @param name "sync" or "uring".
+     * @throws std::invalid_argument if the name is unknown.
+     */
+    void setIoEngine(const std::string& name);
+
+    /**
+     * @brief Opens the redirect targets of all external commands of a line in one batch, ahead of the spawns.
+     * @param commands The commands of the line.
+     */
+    void prepareRedirects(const std::vector<std::unique_ptr<Command>>& commands);
+
+    /**
+     * @brief Sets the handler running function bodies.
+     * @param handler The handler.
+     */
+    void setFunctionHandler(FunctionHandler handler);
+
+    /**
+     * @brief Appends what the commands print to stdout to a buffer, until called again.
+     * @param buffer The buffer, nullptr to print to stdout again.
+     * @return std::string* The buffer used before, to be restored afterwards.
+     */
+    std::string* captureOutput(std::string* buffer);
+
+    /**
+     * @brief Checks if a command is external: not an alias, a function, a builtin or an assignment.
+     * @param cmd The command.
+     * @return true if it does.
+     */
+    bool isExternal(const Command& cmd) const;
+
+    /**
+     * @brief Finds the executable an external command would run, without running it.
+     * @param name The command name.
+     * @return std::string The path of the executable, empty if the command is not external or not found.
+     */
+    std::string findExecutable(const std::string& name) const;
+
+    /**
+     * @brief Gives a number that changes whenever the search path does, so lookups can be redone.
+     * @return size_t The number of changes of the search path.
+     */
+    size_t searchPathVersion() const;
+
+    /**
+     * @brief Runs the lines of a batch script scheduled by their dependencies.
+     * @param batch The lines.
+     * @param workers Maximum number of lines running at once.
+     * @return int The exit status of the last line.
+     */
+    int runBatch(BatchScheduler& batch, size_t workers);
+
+    /**
+     * @brief Sets how long every external command may run before it is terminated.
+     * @param duration The time in nanoseconds, 0 for no limit.
+     */
+    void setLineTimeout(uint64_t duration);
+
+    /**
+     * @brief Sets a deadline for all commands, after it they are terminated and new ones do not start.
+     * @param when Monotonic time of the deadline in nanoseconds, see Metrics::now().
+     */
+    void setDeadline(uint64_t when);
+
+    /**
+     * @brief Checks if the deadline has passed.
+     * @return true if there is a deadline and it has passed.
+     */
+    bool pastDeadline() const;
+
+    /**
+     * @brief Gives the priority class of the jobs started without one of their own.
+     * @return JobPriority::Class The class.
+     */
+    JobPriority::Class getPriority() const;
+
+    /**
+     * @brief Takes the class off a prio CLASS COMMAND [ARGS...] line, leaving the command.
+     * @param cmd The line, replaced by its command with the redirects and the & of the line.
+     * @return std::optional<JobPriority::Class> The class, nothing if the line is not such a prio call.
+     */
+    std::optional<JobPriority::Class> unwrapPriority(Command& cmd) const;
+
+    /**
+     * @brief Defines or redefines a function.
+     * @param name The function name.
+     * @param body The parsed body.
      */
-    void execute(Command& cmd);
+    void defineFunction(const std::string& name, std::shared_ptr<const SyntaxNode> body);
 
    private:
+    /// @brief Where the standard streams of a command go, made by routeRedirects().
+    struct StreamRoute {
+        /// @brief Descriptors for stdin, stdout and stderr, -1 to keep the ones of the shell.
+        std::array<int, 3> fds{-1, -1, -1};
+
+        /// @brief Descriptors to close once the command has them.
+        std::vector<int> owned;
+
+        /// @brief Processes writing a stream to several targets, they finish after the command.
+        std::vector<pid_t> fanOuts;
+    };
+
+    /// @brief An alias, its words are prepended to the arguments of the command.
+    struct Alias {
+        /// @brief The value as defined, for listing.
+        std::string value;
+
+        /// @brief The value split into words.
+        std::vector<std::string> words;
+    };
+
+    /**
+     * @brief Runs a command whose aliases are already resolved: a function, a builtin, an assignment or an
+     * external command.
+     * @param cmd The command.
+     * @return int The exit status.
+     */
+    int dispatch(const Command& cmd);
+
+    /**
+     * @brief Calls a function in the shell process, with the redirect of the call applied for the time.
+     * @param body The function body.
+     * @param cmd The call.
+     * @return int The exit status.
+     */
+    int callFunction(const SyntaxNode& body, const Command& cmd);
     /**
      * @brief Checks if the given command is a built-in command.
      * @param cmd The command to check.
@@ -46,48 +235,284 @@ class Executor {
     /**
      * @brief Executes a built-in command.
      * @param cmd The built-in command to execute.
+     * @return int The exit status.
      */
-    void executeBuiltin(const Command& cmd);
+    int executeBuiltin(const Command& cmd);
+
+    /**
+     * @brief Sets a shell variable if the command is a bare NAME=VALUE assignment.
+     * @param cmd The command to check.
+     * @return true if the command was an assignment.
+     */
+    bool assignVariable(const Command& cmd);
 
     /**
      * @brief Executes an external command.
      * @param cmd The external command to execute.
+     * @return int The exit status.
+     */
+    int executeExternal(const Command& cmd);
+
+    /**
+     * @brief Spawns an external command in a process group of its own, SIGCHLD must be blocked by the caller.
+     * @param cmd The command.
+     * @param foreground Give the terminal to the command.
+     * @param outputFds Descriptors to use as stdout and stderr, -1 to keep the ones of the shell.
+     * @param route The redirections of the command, applied over outputFds.
+     * @param placement CPUs the command runs on.
+     * @param childMask Signal mask the command starts with.
+     * @return pid_t The pid of the command, -1 if the spawn failed (errno is set).
      */
-    void executeExternal(const Command& cmd);
+    pid_t spawnExternal(const Command& cmd, bool foreground, std::pair<int, int> outputFds,
+                        const StreamRoute& route, const PlacementPolicy::Assignment& placement,
+                        const sigset_t& childMask);
 
     /**
-     * @brief Handles output redirection for a command.
-     * @param cmd The command with possible redirections.
+     * @brief Takes the opened redirect targets of a command, opening them now if they were not prepared.
+     * @param cmd The command.
+     * @return std::vector<int> A descriptor for every redirection of the command, -1 if it cannot be opened.
      */
-    static void handleRedirect(const Command& cmd);
+    std::vector<int> takeRedirects(const Command& cmd);
+
+    /**
+     * @brief Opens a redirect target now.
+     * @param redirect The redirection.
+     * @return int The descriptor, -1 if the target cannot be opened (the error is printed).
+     */
+    int openRedirect(const Command::Redirect& redirect);
+
+    /**
+     * @brief Reserves space for the output written to a redirect target, if REDIRECT_SIZE_HINT is set.
+     * @param fd The opened target.
+     * @param redirect The redirection.
+     */
+    void preallocate(int fd, const Command::Redirect& redirect);
+
+    /**
+     * @brief Takes the redirect targets of a command and decides where its streams go.
+     * @param cmd The command.
+     * @return std::optional<StreamRoute> The route, std::nullopt if a target cannot be opened.
+     */
+    std::optional<StreamRoute> routeRedirects(const Command& cmd);
+
+    /**
+     * @brief Points the standard streams to the route, only calls dup2() so it is safe in a forked child.
+     * @param route The route.
+     */
+    static void applyRoute(const StreamRoute& route);
+
+    /**
+     * @brief Closes the descriptors of a route once the command has them.
+     * @param route The route.
+     * @param wait Also wait for the fan-out processes, i.e. until all the output is in the targets.
+     */
+    static void releaseRoute(StreamRoute& route, bool wait);
 
     using Args = std::vector<std::string>;
-    using BuiltinFunction = void (Executor::*)(const Args&);
+    using BuiltinFunction = int (Executor::*)(const Args&);
 
     /// @brief Map of built-in command names to their corresponding member functions.
     static const std::unordered_map<std::string_view, BuiltinFunction> builtinCommands;
 
+    /// @brief The builtin being executed, for builtins that need more than the arguments (e.g. the redirect).
+    const Command* builtinCommand;
+
     /**
      * @brief Changes the current working directory.
      * @param cmd Arguments for the cd command.
+     * @return int The exit status.
      */
-    void cd(const Args& cmd);
+    int cd(const Args& cmd);
 
     /**
      * @brief Exits the shell.
-     * @param cmd Arguments for the exit command.
+     * @param cmd Optional exit status.
+     * @return int 1 if the arguments are wrong, otherwise it does not return.
+     */
+    int exit(const Args& cmd);
+
+    /**
+     * @brief Lists the jobs and forgets the finished ones.
+     * @param cmd Arguments for the jobs command (expects none).
+     * @return int The exit status.
+     */
+    int jobs(const Args& cmd);
+
+    /**
+     * @brief Waits until the given jobs finish.
+     * @param cmd Job specs to wait for, all jobs if empty.
+     * @return int The exit status.
+     */
+    int wait(const Args& cmd);
+
+    /**
+     * @brief Continues a job in foreground and waits for it.
+     * @param cmd Job spec, the latest job if empty.
+     * @return int The exit status.
      */
-    void exit(const Args& cmd);
+    int fg(const Args& cmd);
+
+    /**
+     * @brief Continues a stopped job in background.
+     * @param cmd Job spec, the latest job if empty.
+     * @return int The exit status.
+     */
+    int bg(const Args& cmd);
+
+    /**
+     * @brief Sends a signal to jobs or processes.
+     * @param cmd Optional -SIGNAL followed by job specs or pids.
+     * @return int The exit status.
+     */
+    int kill(const Args& cmd);
+
+    /**
+     * @brief Shows or sets the CPU placement policy for background jobs.
+     * @param cmd The policy spec, the current policy is printed if empty.
+     * @return int The exit status.
+     */
+    int placement(const Args& cmd);
+
+    /**
+     * @brief Shows or sets the resource limits of jobs.
+     * @param cmd The limits spec, the current limits are printed if empty.
+     * @return int The exit status.
+     */
+    int limits(const Args& cmd);
+
+    /**
+     * @brief Exports variables, optionally setting them.
+     * @param cmd NAME or NAME=VALUE entries, the exported variables are printed if empty.
+     * @return int The exit status.
+     */
+    int exportVariables(const Args& cmd);
+
+    /**
+     * @brief Removes variables, or functions with -f.
+     * @param cmd Optional -f followed by the names.
+     * @return int The exit status.
+     */
+    int unset(const Args& cmd);
+
+    /**
+     * @brief Defines or prints aliases.
+     * @param cmd NAME=VALUE or NAME entries, all aliases are printed if empty.
+     * @return int The exit status.
+     */
+    int alias(const Args& cmd);
+
+    /**
+     * @brief Removes aliases.
+     * @param cmd The alias names, or -a for all.
+     * @return int The exit status.
+     */
+    int unalias(const Args& cmd);
+
+    /**
+     * @brief Runs a command with a long argument list in as few invocations as fit into ARG_MAX.
+     * @param cmd [-j N] COMMAND [ARGS... --] ITEMS...
+     * @return int The exit status.
+     */
+    int batchargs(const Args& cmd);
+
+    /**
+     * @brief Runs a command template for every line of a file, up to -j at a time.
+     * @param cmd FILE [-j N] COMMAND [ARGS...], {} in the command is replaced by the item.
+     * @return int The exit status.
+     */
+    int foreach(const Args& cmd);
+
+    /**
+     * @brief Shows or selects the engine for the file operations of the shell.
+     * @param cmd "sync" or "uring", the current engine is printed if empty.
+     * @return int The exit status.
+     */
+    int ioengine(const Args& cmd);
+
+    /**
+     * @brief Copies a file within the shell process.
+     * @param cmd The source and the destination.
+     * @return int The exit status.
+     */
+    int copy(const Args& cmd);
+
+    /**
+     * @brief Prints the metrics of the shell, or writes them in the Prometheus text format.
+     * @param cmd Empty, or --prometheus with an optional file to write.
+     * @return int The exit status.
+     */
+    int stats(const Args& cmd);
 
     /**
      * @brief Modifies the search path.
      * @param cmd Paths to add to search path.
+     * @return int The exit status.
      */
-    void path(const Args& cmd);
+    int path(const Args& cmd);
+
+    /**
+     * @brief Runs a command that is terminated if it runs longer than a duration.
+     * @param cmd [-k GRACE] DURATION COMMAND [ARGS...]
+     * @return int The exit status of the command, 124 if it timed out.
+     */
+    int timeout(const Args& cmd);
+
+    /**
+     * @brief Runs a command in a priority class, sets the class of later jobs or of running ones.
+     * @param cmd CLASS [COMMAND [ARGS...] | JOBSPEC...], the class of later jobs is printed if empty.
+     * @return int The exit status.
+     */
+    int prio(const Args& cmd);
+
+    /**
+     * @brief Runs the command of a builtin wrapping one, timeout or prio, which may wrap each other.
+     * @param wrapper Name of the wrapping builtin, for the messages.
+     * @param cmd The command, with the redirects and the & of the line.
+     * @return int The exit status, 126 if the command is neither external nor a wrapping builtin.
+     */
+    int executeWrapped(const char* wrapper, const Command& cmd);
+
+    /**
+     * @brief Starts, lists or stops pools of coprocess workers.
+     * @param cmd [-n N] [-d DELIM] NAME COMMAND [ARGS...] or -k NAME..., the pools are listed if empty.
+     * @return int The exit status.
+     */
+    int coproc(const Args& cmd);
+
+    /**
+     * @brief Sends request lines to a coprocess pool and prints the responses.
+     * @param cmd NAME [WORDS...], the lines of the input redirect are sent if there are no words.
+     * @return int The exit status, 1 if a request failed.
+     */
+    int request(const Args& cmd);
+
+    /**
+     * @brief Spawns a coprocess worker in the background with its stdin and stdout on pipes of its pool.
+     * @param cmd The command of the worker, only its 2> redirects are applied.
+     * @param input Read end of the pipe that is the stdin of the worker.
+     * @param output Write end of the pipe that is the stdout of the worker.
+     * @return pid_t The pid of the worker, -1 if the spawn failed (errno is set).
+     */
+    pid_t spawnWorker(const Command& cmd, int input, int output);
+
+    /**
+     * @brief Sets the deadline of an external command that has just started: its own timeout, the line
+     * timeout or the global deadline, whichever comes first.
+     * @param pgid The process group of the command.
+     * @param start When the command started.
+     * @return uint64_t The id of the deadline in the timeout queue, 0 if the command has none.
+     */
+    uint64_t startTimeout(pid_t pgid, uint64_t start);
+
+    /// @brief Shell variables, the exported ones form the environment of the commands.
+    Variables& variables;
 
     /// @brief List of directories to search for executables (PATH).
     std::vector<std::string> searchPath;
 
+    /// @brief Number of changes of the search path, see searchPathVersion().
+    size_t searchPathChanges;
+
     /**
      * @brief Looks up the command path in the search path.
      * @param cmd The command to look up.
@@ -95,12 +520,134 @@ class Executor {
      */
     std::string lookupPath(const std::string& cmd) const;
 
-    /// @brief Registers the signal handler for zombie process termination.
+    /// @brief Background and stopped jobs.
+    JobTable jobTable;
+
+    /// @brief Chooses the CPUs background jobs run on.
+    PlacementPolicy jobPlacement;
+
+    /// @brief Cgroup (or setrlimit) limits and accounting of jobs.
+    ResourceLimits jobLimits;
+
+    /// @brief Shares the budget of concurrent jobs with make, see Jobserver.
+    Jobserver jobserver;
+
+    /// @brief Opens redirect targets and copies files, on io_uring if selected.
+    IoEngine ioEngine;
+
+    /// @brief Redirect targets opened by prepareRedirects() that were not taken yet, -1 for failed ones.
+    std::unordered_map<const Command*, std::vector<int>> preparedRedirects;
+
+    /// @brief Aliases by name.
+    std::unordered_map<std::string, Alias> aliases;
+
+    /// @brief Function bodies by name, a running body stays alive if its function is redefined.
+    std::unordered_map<std::string, std::shared_ptr<const SyntaxNode>> functions;
+
+    /// @brief Runs function bodies.
+    FunctionHandler functionHandler;
+
+    /// @brief True if the shell is in the foreground of a terminal and hands it over to foreground jobs.
+    bool ownsTerminal;
+
+    /// @brief Prints the output of background jobs line by line with the job id in front.
+    OutputMultiplexer backgroundOutput;
+
+    /// @brief True once the SIGCHLD handler is registered.
+    bool reaping;
+
+    /// @brief Buffer receiving the output of the commands, nullptr if they print to stdout.
+    std::string* capture;
+
+    /// @brief Terminates the commands that outlive their deadlines.
+    TimeoutQueue timeouts;
+
+    /// @brief Deadlines of the jobs by pid, cancelled when the jobs finish.
+    std::unordered_map<pid_t, uint64_t> jobTimeouts;
+
+    /// @brief How long an external command may run in nanoseconds, 0 for no limit (--line-timeout).
+    uint64_t lineTimeout;
+
+    /// @brief Monotonic time after which no command runs, 0 for none (--batch-deadline).
+    uint64_t deadline;
+
+    /// @brief Timeout given by the timeout builtin to the command it runs.
+    std::optional<uint64_t> commandTimeout;
+
+    /// @brief Time between SIGTERM and SIGKILL for commandTimeout.
+    uint64_t commandGrace;
+
+    /// @brief Priority class of the jobs started without one of their own (prio CLASS).
+    JobPriority::Class jobPriority;
+
+    /// @brief Priority class given by the prio builtin to the command it runs.
+    std::optional<JobPriority::Class> commandPriority;
+
+    /// @brief Coprocess pools by name, started by the coproc builtin.
+    std::map<std::string, std::unique_ptr<CoprocPool>> coprocs;
+
+    /// @brief Registers the signal handler for zombie process termination, before the first fork.
     void registerSignalHangler();
 
     /**
-     * @brief Signal handler for reaping child processes.
+     * @brief Signal handler for reaping child processes, runs on the shell thread only, see reapedChildren.
      * @param signal The signal number.
      */
     static void reapChildren(int signal);
+
+    /// @brief Passes the statuses collected by the signal handler to the job table and the coprocess pools.
+    void collectReaped();
+
+    /// @brief Publishes the numbers of running and stopped jobs to the metrics.
+    void publishJobCounts();
+
+    /**
+     * @brief Waits for a foreground process group, giving it the terminal for the time.
+     * @param pgid The process group, its leader is waited for.
+     * @param resume Send SIGCONT to the group before waiting.
+     * @param captureFd Pipe read into the capture buffer until its end before waiting, -1 for none.
+     * @return int The wait status of the group leader.
+     */
+    int waitForeground(pid_t pgid, bool resume, int captureFd);
+
+    /**
+     * @brief Makes the process group the foreground group of the terminal, if the shell controls one.
+     * @param pgid The process group.
+     */
+    void giveTerminal(pid_t pgid) const;
+
+    /**
+     * @brief Finds the job denoted by a job spec (%n, %%, %+ or a pid).
+     * @param spec The job spec.
+     * @return Job* The job or nullptr if there is none.
+     */
+    Job* resolveJob(const std::string& spec);
+
+    /// @brief A wait status collected by the signal handler.
+    struct ChildStatus {
+        pid_t pid;
+        int status;
+    };
+
+    /// @brief Number of statuses the signal handler can keep until they are collected.
+    static constexpr size_t reapedCapacity = 1024;
+
+    /**
+     * @brief Statuses collected by the signal handler, written by the handler and read by collectReaped().
+     *
+     * The ring has a single writer: only the shell thread may leave SIGCHLD unblocked, otherwise two handlers
+     * could write it at once and a handler on another thread would reap the commands the shell waits for.
+     * Every other thread of the shell has to be started with all signals blocked (see
+     * OutputMultiplexer::start()).
+     */
+    static std::array<ChildStatus, reapedCapacity> reapedChildren;
+
+    /// @brief Number of statuses ever written to reapedChildren.
+    static std::atomic<size_t> reapedHead;
+
+    /// @brief Number of statuses ever read from reapedChildren.
+    static std::atomic<size_t> reapedTail;
+
+    /// @brief Set when the handler had to drop a status because reapedChildren was full.
+    static std::atomic<bool> reapedOverflow;
 };
@@ -0,0 +1,108 @@
+/**
+ * @file ForeachRunner.hpp
+ * @brief Contains a ForeachRunner class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Command.hpp"
+#include "JobPriority.hpp"
+
+/**
+ * @class ForeachRunner
+ * @brief Runs a command template once for every line of a file, several at a time.
+ *
+ * The template is a parsed Command whose name, arguments and redirect may contain {} placeholders, it is
+ * cut at the placeholders once and every item only fills the gaps. If there is no placeholder at all, the
+ * item is appended as the last argument. The list file is memory-mapped and its lines are used in place.
+ * The items are spread over a pool of spawner threads, every thread runs one child at a time through a
+ * JobRunner and steals half of the remaining items of another thread when it runs out of its own.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class ForeachRunner {
+   public:
+    /// @brief An item whose command did not succeed.
+    struct Failure {
+        /// @brief Line of the item in the list file, from 1.
+        size_t line;
+
+        /// @brief The item.
+        std::string item;
+
+        /// @brief What went wrong, e.g. "exit 1".
+        std::string reason;
+    };
+
+    /**
+     * @brief Pre-parses the command template.
+     * @param command The template, its background flag is ignored.
+     * @param searchPath Directories searched for executables.
+     */
+    ForeachRunner(const Command& command, std::vector<std::string> searchPath);
+
+    /**
+     * @brief Runs the template for every non-empty line of the list file.
+     * @param listFile The file with one item per line.
+     * @param workers Maximum number of children running at once.
+     * @param environment Environment of the children as NAME=VALUE entries.
+     * @param priority Priority class of the children.
+     * @return std::vector<Failure> Failed items in the order of the list.
+     * @throws std::runtime_error if the list file cannot be read.
+     */
+    std::vector<Failure> run(const std::string& listFile, size_t workers,
+                             std::vector<std::string> environment, JobPriority::Class priority);
+
+    /**
+     * @brief Gives the number of items of the last run.
+     * @return size_t The number of items.
+     */
+    size_t itemCount() const;
+
+   private:
+    /// @brief A string cut at its {} placeholders.
+    struct Field {
+        std::vector<std::string> pieces;
+
+        /**
+         * @brief Fills the placeholders with an item.
+         * @param item The item.
+         * @return std::string The string.
+         */
+        std::string fill(std::string_view item) const;
+    };
+
+    /**
+     * @brief Cuts a string at its {} placeholders.
+     * @param text The string.
+     * @return Field The pieces.
+     */
+    static Field cut(const std::string& text);
+
+    /// @brief The command name.
+    Field name;
+
+    /// @brief The arguments.
+    std::vector<Field> args;
+
+    /// @brief The redirections with their targets.
+    std::vector<std::pair<Command::Redirect, Field>> redirects;
+
+    /// @brief Directories searched for executables.
+    std::vector<std::string> searchPath;
+
+    /// @brief Number of items of the last run.
+    size_t items;
+};
@@ -0,0 +1,104 @@
+/**
+ * @file Glob.hpp
+ * @brief Contains a Glob class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class Glob
+ * @brief Expands glob patterns (*, ?, [...] and ** for any number of directories) to file names.
+ *
+ * Directories are read with getdents64() into a single name buffer per directory and kept in a cache
+ * keyed by the directory path, so expanding many patterns over the same directory reads it once. A cached
+ * listing is used as long as the directory has the same inode and modification time. Listings younger
+ * than the timestamp granularity are not trusted, since the directory may have changed within the same
+ * tick. Matching a component is linear in the number of entries, the results are sorted once.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class Glob {
+   public:
+    /// @brief Constructs a Glob with an empty directory cache.
+    Glob();
+
+    /**
+     * @brief Expands a pattern, \ escapes the glob characters.
+     * @param pattern The pattern.
+     * @return std::vector<std::string> Matching paths sorted, empty if nothing matches.
+     */
+    std::vector<std::string> expand(const std::string& pattern);
+
+    /// @brief Drops the cached directory listings.
+    void clearCache();
+
+   private:
+    /// @brief A directory entry, its name lives in the name buffer of the listing.
+    struct Entry {
+        uint32_t offset;
+        uint32_t length;
+        unsigned char type;
+    };
+
+    /// @brief Entries of a directory as read by getdents64().
+    struct Listing {
+        dev_t device;
+        ino_t inode;
+        timespec modified;
+        time_t scanned;
+        std::vector<char> names;
+        std::vector<Entry> entries;
+    };
+
+    /**
+     * @brief Gives the listing of a directory, reading it only if the cached one is stale.
+     * @param directory The directory path.
+     * @return const Listing* The listing, nullptr if the directory cannot be read.
+     */
+    const Listing* list(const std::string& directory);
+
+    /**
+     * @brief Reads a directory with getdents64().
+     * @param directory The directory path.
+     * @param listing Receives the entries.
+     * @return true on success.
+     */
+    bool scan(const std::string& directory, Listing& listing);
+
+    /**
+     * @brief Checks if an entry is a directory, following symlinks.
+     * @param path Path of the entry.
+     * @param type The d_type of the entry.
+     * @return true if it is a directory.
+     */
+    static bool isDirectory(const std::string& path, unsigned char type);
+
+    /**
+     * @brief Appends every directory below base (and base itself) to the output, for **.
+     * @param base The directory to start from, empty for the working directory.
+     * @param output Receives the directories.
+     */
+    void collectDirectories(const std::string& base, std::vector<std::string>& output);
+
+    /// @brief Cached listings by directory path.
+    std::unordered_map<std::string, Listing> listings;
+
+    /// @brief Number of entries in all cached listings.
+    size_t cachedEntries;
+
+    /// @brief Buffer getdents64() reads into.
+    std::vector<char> scanBuffer;
+};
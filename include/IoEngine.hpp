@@ -0,0 +1,148 @@
+/**
+ * @file IoEngine.hpp
+ * @brief Contains an IoEngine class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * @class IoEngine
+ * @brief Performs the file operations of the shell itself, in batches on io_uring when enabled.
+ *
+ * The ring is set up with raw syscalls on first use, no liburing is needed. Every operation queues all of
+ * its requests first and submits them with a single io_uring_enter() call, so e.g. opening the redirect
+ * targets of all jobs of a line costs one syscall no matter how slow the file system is. If the engine is
+ * disabled or io_uring is not available (old kernel, seccomp, sysctl), the same operations are done with
+ * plain blocking syscalls.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class IoEngine {
+   public:
+    /// @brief A file to open.
+    struct OpenRequest {
+        std::string path;
+        int flags;
+        mode_t mode;
+    };
+
+    /// @brief Constructs a disabled IoEngine.
+    IoEngine();
+
+    /// @brief Tears the ring down.
+    ~IoEngine();
+
+    IoEngine(const IoEngine&) = delete;
+    IoEngine& operator=(const IoEngine&) = delete;
+
+    /**
+     * @brief Enables or disables the io_uring path.
+     * @param name "uring" or "sync".
+     * @throws std::invalid_argument if the name is unknown.
+     */
+    void select(const std::string& name);
+
+    /**
+     * @brief Describes the engine in use.
+     * @return std::string "uring", "sync", or "sync (io_uring unavailable: ...)".
+     */
+    std::string describe() const;
+
+    /**
+     * @brief Opens all the files at once.
+     * @param requests The files to open.
+     * @return std::vector<int> Descriptor or -errno for every request, in order.
+     */
+    std::vector<int> openAll(const std::vector<OpenRequest>& requests);
+
+    /**
+     * @brief Copies the whole content of one file to another.
+     * @param source Descriptor to read from.
+     * @param destination Descriptor to write to.
+     * @return long long Number of bytes copied.
+     * @throws std::runtime_error on read or write errors.
+     */
+    long long copy(int source, int destination);
+
+   private:
+    /// @brief Sets the ring up, returns false (and remembers why) if io_uring is not available.
+    bool setupRing();
+
+    /**
+     * @brief Takes the next free submission entry.
+     * @return io_uring_sqe* The cleared entry, nullptr if the queue is full.
+     */
+    io_uring_sqe* nextSqe();
+
+    /**
+     * @brief Submits the queued entries and waits for completions.
+     * @param waitFor Number of completions to wait for.
+     * @return int 0 on success, -errno otherwise.
+     */
+    int submit(unsigned waitFor);
+
+    /**
+     * @brief Takes the next completion, if there is one.
+     * @param userData Receives the user data of the request.
+     * @param result Receives the result of the request.
+     * @return true if a completion was taken.
+     */
+    bool nextCqe(uint64_t& userData, int& result);
+
+    /**
+     * @brief Copies a regular file through the ring, keeping several reads and writes in flight.
+     * @param source Descriptor to read from.
+     * @param destination Descriptor to write to.
+     * @param size Size of the source file.
+     * @return long long Number of bytes copied.
+     * @throws std::runtime_error on read or write errors.
+     */
+    long long copyOnRing(int source, int destination, off_t size);
+
+    /// @brief Whether io_uring is wanted.
+    bool useRing;
+
+    /// @brief Ring descriptor, -1 if not set up.
+    int ringFd;
+
+    /// @brief Why the ring could not be set up, empty if it was not tried or succeeded.
+    std::string unavailableReason;
+
+    /// @brief Mapped rings and entries.
+    void* sqRing;
+    void* cqRing;
+    io_uring_sqe* sqes;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    size_t sqesSize;
+
+    /// @brief Pointers into the submission ring.
+    std::atomic<unsigned>* sqHead;
+    std::atomic<unsigned>* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned sqEntries;
+
+    /// @brief Pointers into the completion ring.
+    std::atomic<unsigned>* cqHead;
+    std::atomic<unsigned>* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    /// @brief Entries queued since the last submit.
+    unsigned queued;
+};
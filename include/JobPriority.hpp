@@ -0,0 +1,88 @@
+/**
+ * @file JobPriority.hpp
+ * @brief Contains a JobPriority class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+
+/**
+ * @class JobPriority
+ * @brief Priority classes of jobs: CPU nice value, I/O priority and scheduling policy together.
+ *
+ * high runs at nice -5 with the best I/O priority of the best-effort class, normal keeps what the shell has,
+ * batch runs at nice 10 under SCHED_BATCH with the worst best-effort I/O priority, and idle runs under
+ * SCHED_IDLE with idle I/O, getting the CPU and the disk only when nobody else wants them. Raising a
+ * priority above the one of the shell needs CAP_SYS_NICE, without it the setting is silently kept.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class JobPriority {
+   public:
+    /// @brief The classes, the more urgent first, so they compare in dispatch order.
+    enum class Class { High, Normal, Batch, Idle };
+
+    /**
+     * @brief Gives the class of a name.
+     * @param name high, normal, batch or idle.
+     * @return Class The class.
+     * @throws std::invalid_argument if the name is unknown.
+     */
+    static Class parse(const std::string& name);
+
+    /**
+     * @brief Gives the name of a class.
+     * @param priority The class.
+     * @return const char* The name.
+     */
+    static const char* name(Class priority);
+
+    /**
+     * @brief Applies a class to the calling process, only async-signal-safe calls are made.
+     *
+     * Meant for the child between fork and exec, normal leaves the inherited settings alone. A setting that
+     * cannot be applied, such as the negative nice value of high without CAP_SYS_NICE, is reported on stderr
+     * and the command runs anyway.
+     *
+     * @param priority The class.
+     */
+    static void apply(Class priority);
+
+    /**
+     * @brief Applies a class to a running process group, the scheduling policy to its leader only.
+     * @param pgid The group, its leader has the same pid.
+     * @param priority The class, normal resets the group to nice 0 and the default I/O priority.
+     * @return true if every setting was applied, false otherwise with errno set.
+     */
+    static bool applyTo(pid_t pgid, Class priority);
+
+   private:
+    /// @brief What a class sets.
+    struct Settings {
+        /// @brief Nice value.
+        int nice;
+
+        /// @brief I/O scheduling class, 0 to derive it from the nice value.
+        int ioClass;
+
+        /// @brief Level within the I/O class, 0 is the best.
+        int ioLevel;
+
+        /// @brief CPU scheduling policy.
+        int policy;
+    };
+
+    /**
+     * @brief Gives the settings of a class.
+     * @param priority The class.
+     * @return const Settings& The settings.
+     */
+    static const Settings& settings(Class priority);
+};
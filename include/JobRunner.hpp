@@ -0,0 +1,146 @@
+/**
+ * @file JobRunner.hpp
+ * @brief Contains a JobRunner class, the embedding API of libishell
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Command.hpp"
+#include "JobPriority.hpp"
+
+/**
+ * @class JobRunner
+ * @brief Runs commands on behalf of a program that embeds the shell, from any number of threads.
+ *
+ * Unlike Executor, the runner does not touch any process-wide state: it does not install signal handlers,
+ * does not change the working directory of the process and keeps no static data. Every command is spawned
+ * with posix_spawn() using its own working directory, environment and redirection, and the caller gets a
+ * future with its wait status and resource usage. A single reaper thread waits for all the children with
+ * epoll on their pidfds. The embedding program must not reap children it did not start itself (e.g. with
+ * waitpid(-1, ...)), otherwise the runner loses their statuses. The redirections of a command are applied
+ * in order, a stream redirected more than once goes to its last target, as the runner starts no helper
+ * processes to write a stream to several files.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class JobRunner {
+   public:
+    /// @brief How a single command is spawned.
+    struct SpawnOptions {
+        /// @brief Working directory of the command, the one of the process if not set.
+        std::optional<std::string> workingDirectory;
+
+        /// @brief Environment of the command as NAME=VALUE entries, the one of the process if not set.
+        std::optional<std::vector<std::string>> environment;
+
+        /// @brief File receiving stdout and stderr of the command, overrides the redirect of the command.
+        std::optional<std::string> outputRedirect;
+
+        /// @brief Descriptor receiving stdout and stderr of the command, its own redirects still apply.
+        std::optional<int> outputFd;
+
+        /// @brief Called with the pid of the command right after the spawn, before it can be reaped.
+        std::function<void(pid_t pid)> spawned;
+
+        /// @brief Priority class of the command, set right after the spawn as posix_spawn() cannot set it.
+        std::optional<JobPriority::Class> priority;
+    };
+
+    /// @brief Outcome of a finished command.
+    struct Result {
+        /// @brief Pid the command ran with.
+        pid_t pid;
+
+        /// @brief Wait status of the command.
+        int status;
+
+        /// @brief Resources used by the command.
+        rusage usage;
+    };
+
+    /**
+     * @brief Constructs a JobRunner, the reaper thread is started on the first submit.
+     * @param searchPath Directories searched for executables given without a slash.
+     */
+    explicit JobRunner(std::vector<std::string> searchPath = {});
+
+    /// @brief Waits for all submitted commands to finish and stops the reaper thread.
+    ~JobRunner();
+
+    JobRunner(const JobRunner&) = delete;
+    JobRunner& operator=(const JobRunner&) = delete;
+
+    /**
+     * @brief Parses a script, one command line per line.
+     * @param script The script text.
+     * @return std::vector<std::unique_ptr<Command>> Parsed commands, in order.
+     * @throws std::invalid_argument if a line cannot be parsed.
+     */
+    static std::vector<std::unique_ptr<Command>> parse(const std::string& script);
+
+    /**
+     * @brief Spawns a command, the background flag of the command is ignored.
+     * @param cmd The command to run.
+     * @param options Working directory, environment and redirection of the command.
+     * @return std::future<Result> Future becoming ready when the command finishes.
+     * @throws std::runtime_error if the command cannot be spawned.
+     */
+    std::future<Result> submit(const Command& cmd, const SpawnOptions& options = {});
+
+   private:
+    /// @brief A spawned command that has not finished yet.
+    struct Pending {
+        pid_t pid;
+        std::promise<Result> promise;
+    };
+
+    /// @brief Creates the epoll instance and starts the reaper thread if it is not running yet.
+    void start();
+
+    /// @brief Reaper thread body, waits for the children and fulfills their promises.
+    void loop();
+
+    /**
+     * @brief Reaps a finished child and fulfills its promise.
+     * @param pidfd The pidfd of the child.
+     */
+    void reap(int pidfd);
+
+    /// @brief Directories searched for executables.
+    const std::vector<std::string> searchPath;
+
+    /// @brief Epoll instance watching the pidfds.
+    int epollFd;
+
+    /// @brief Eventfd used to wake the reaper thread up.
+    int wakeFd;
+
+    /// @brief Set when the reaper thread has to exit once no commands are pending.
+    bool stopping;
+
+    /// @brief Commands that have not finished yet by their pidfd.
+    std::unordered_map<int, Pending> pending;
+
+    /// @brief Guards pending, stopping and the start of the reaper thread.
+    std::mutex mutex;
+
+    /// @brief The thread reaping the children.
+    std::thread reaper;
+};
@@ -0,0 +1,166 @@
+/**
+ * @file JobTable.hpp
+ * @brief Contains a JobTable class and the Job record it stores
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @struct Job
+ * @brief A process started by the shell that is running in background or was stopped.
+ *
+ * Every job runs in its own process group, whose id equals the pid of the job. The pidfd refers to the
+ * process while it is alive and lets the shell wait for it with epoll.
+ */
+struct Job {
+    /// @brief State of a job.
+    enum class State { Running, Stopped, Done };
+
+    /// @brief Job number shown to the user and used in %n job specs.
+    int id;
+
+    /// @brief Pid of the job process, also the id of its process group.
+    pid_t pid;
+
+    /// @brief Pidfd of the job process, -1 if not available or the job is done.
+    int pidfd;
+
+    /// @brief The command line the job was started with.
+    std::string commandLine;
+
+    /// @brief Current state of the job.
+    State state;
+
+    /// @brief Wait status of the job, valid when the job is done (-1 if it is unknown).
+    int status;
+
+    /// @brief CPU time used by the job in microseconds, -1 if unknown.
+    long long cpuUsec;
+
+    /// @brief Peak memory usage of the job in bytes, -1 if unknown.
+    long long memoryPeak;
+};
+
+/**
+ * @class JobTable
+ * @brief Stores the jobs of the shell by their job number.
+ *
+ * The table only keeps the records, the Executor starts the processes and feeds the wait statuses back to
+ * the table with update(). Finished jobs stay in the table until they are reported to the user, but only
+ * the most recent of them are remembered, so a batch starting lots of jobs does not grow the table.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class JobTable {
+   public:
+    /// @brief Maximum number of finished jobs remembered until they are reported.
+    static constexpr size_t maxDoneJobs = 1024;
+
+    /// @brief Callback invoked when a job becomes done.
+    using FinishHandler = std::function<void(Job&)>;
+
+    /// @brief Constructs an empty JobTable.
+    JobTable();
+
+    /// @brief Closes the pidfds of the remaining jobs.
+    ~JobTable();
+
+    JobTable(const JobTable&) = delete;
+    JobTable& operator=(const JobTable&) = delete;
+
+    /**
+     * @brief Takes the number for the next job.
+     * @return int The job number.
+     */
+    int reserveId();
+
+    /**
+     * @brief Adds a running job.
+     * @param id Job number taken with reserveId().
+     * @param pid Pid of the job process.
+     * @param commandLine The command line the job was started with.
+     * @return Job& The added job.
+     */
+    Job& add(int id, pid_t pid, const std::string& commandLine);
+
+    /**
+     * @brief Finds a job by its number.
+     * @param id The job number.
+     * @return Job* The job or nullptr if there is none.
+     */
+    Job* find(int id);
+
+    /**
+     * @brief Finds a job by its process id.
+     * @param pid The process id.
+     * @return Job* The job or nullptr if there is none.
+     */
+    Job* findByPid(pid_t pid);
+
+    /**
+     * @brief Finds the most recently started job that is not done.
+     * @return Job* The job or nullptr if there is none.
+     */
+    Job* latest();
+
+    /**
+     * @brief Updates the job of a process with a status returned by waitpid().
+     * @param pid The process id.
+     * @param status The wait status.
+     * @return Job* The updated job or nullptr if the process is not a job.
+     */
+    Job* update(pid_t pid, int status);
+
+    /**
+     * @brief Marks a job done with the given status.
+     * @param job The job.
+     * @param status The wait status, -1 if it is unknown.
+     */
+    void finish(Job& job, int status);
+
+    /**
+     * @brief Sets the callback invoked when a job becomes done.
+     * @param handler The callback.
+     */
+    void setFinishHandler(FinishHandler handler);
+
+    /**
+     * @brief Removes a job from the table.
+     * @param id The job number.
+     */
+    void remove(int id);
+
+    /// @brief Returns an iterator to the first job.
+    std::map<int, Job>::iterator begin();
+
+    /// @brief Returns an iterator past the last job.
+    std::map<int, Job>::iterator end();
+
+   private:
+    /// @brief Jobs by their number.
+    std::map<int, Job> jobs;
+
+    /// @brief Numbers of the jobs that are not done by their process id.
+    std::unordered_map<pid_t, int> idsByPid;
+
+    /// @brief Numbers of the finished jobs, oldest first.
+    std::deque<int> doneJobs;
+
+    /// @brief Number given to the next job.
+    int nextId;
+
+    /// @brief Callback invoked when a job becomes done.
+    FinishHandler finishHandler;
+};
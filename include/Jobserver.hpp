@@ -0,0 +1,153 @@
+/**
+ * @file Jobserver.hpp
+ * @brief Contains a Jobserver class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * @class Jobserver
+ * @brief Shares a host-wide budget of concurrent jobs with make and other shells, by the GNU make jobserver
+ * protocol.
+ *
+ * A jobserver is a pipe (or a named fifo) holding one byte, a token, per job slot beyond the first. Every
+ * process of the tree has one implicit slot of its own; to run one more job at once it reads a token, and it
+ * writes the same byte back once that job is done. The pipe is announced to the children in MAKEFLAGS as
+ * "--jobserver-auth=R,W" (the inherited descriptors) or "--jobserver-auth=fifo:PATH".
+ *
+ * As a client, the shell uses the jobserver found in its MAKEFLAGS; as a server (serve()), it creates a pipe
+ * of its own and gives its children a MAKEFLAGS naming it, so make and shells started below share the budget.
+ * The shell reads tokens through a non-blocking descriptor of its own, reopened from /proc/self/fd, so the
+ * blocking reads of the other clients are not disturbed and a token taken by another client in between does
+ * not block the shell.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class Jobserver {
+   public:
+    /// @brief Token of a job on the implicit slot of the shell.
+    static constexpr int ownSlot = -1;
+
+    /// @brief Token of a job that runs without a slot: the jobserver is off or the job did not wait for one.
+    static constexpr int noToken = -2;
+
+    /// @brief Longest time acquire() waits before it asks its caller whether to go on.
+    static constexpr int pollInterval = 100;
+
+    /// @brief Constructs a disabled Jobserver, every job runs without a token.
+    Jobserver();
+
+    /// @brief Closes the descriptors of the shell, the tokens of running jobs are not given back.
+    ~Jobserver();
+
+    Jobserver(const Jobserver&) = delete;
+    Jobserver& operator=(const Jobserver&) = delete;
+
+    /**
+     * @brief Becomes a client of the jobserver announced in MAKEFLAGS, if there is one.
+     * @param makeflags The value of MAKEFLAGS.
+     * @return std::optional<std::string> A warning if a jobserver is announced but cannot be used, the jobs
+     * are not limited then.
+     */
+    std::optional<std::string> connect(std::string_view makeflags);
+
+    /**
+     * @brief Creates a jobserver with a number of slots, replacing the one the shell was a client of. To be
+     * called before any job is started.
+     * @param slots The number of jobs that may run at once in the whole tree, at least 1.
+     * @param makeflags The value of MAKEFLAGS, "" if it is not set.
+     * @return std::string MAKEFLAGS for the children, the -j and jobserver flags replaced.
+     * @throws std::runtime_error if the pipe cannot be created.
+     */
+    std::string serve(size_t slots, std::string_view makeflags);
+
+    /**
+     * @brief Checks if the jobs are limited by a jobserver.
+     * @return true if they are.
+     */
+    bool enabled() const;
+
+    /**
+     * @brief Takes a slot if one is free, without waiting. Safe to call from any thread.
+     * @param token Receives the token: ownSlot, a byte read from the jobserver or noToken if it is disabled.
+     * @return true if a slot was taken or the jobserver is disabled.
+     */
+    bool tryAcquire(int& token);
+
+    /**
+     * @brief Waits for a slot. Safe to call from any thread.
+     *
+     * The caller is asked whether to give up before every wait, and at least every pollInterval milliseconds
+     * while it lasts, so it can collect the slots of its own finished jobs or stop at a deadline.
+     *
+     * @param token Receives the token, noToken if the wait was given up.
+     * @param giveUp Returns true to stop waiting.
+     * @return true if a slot was taken or the jobserver is disabled.
+     */
+    bool acquire(int& token, const std::function<bool()>& giveUp);
+
+    /**
+     * @brief Records the token a job holds, given back by release().
+     * @param pid The job process.
+     * @param token The token from tryAcquire() or acquire().
+     */
+    void commit(pid_t pid, int token);
+
+    /**
+     * @brief Gives back the token of a finished job, nothing if it holds none.
+     * @param pid The job process.
+     */
+    void release(pid_t pid);
+
+    /**
+     * @brief Gives back a token. Safe to call from any thread.
+     * @param token The token from tryAcquire() or acquire().
+     */
+    void giveBack(int token);
+
+   private:
+    /**
+     * @brief Opens a non-blocking read descriptor of the shell on a jobserver pipe or fifo.
+     * @param fd A descriptor of the pipe, the new one gets a file description of its own.
+     * @return int The descriptor, -1 if it cannot be opened.
+     */
+    static int reopen(int fd);
+
+    /// @brief Closes the descriptors of the shell and forgets the jobserver.
+    void disconnect();
+
+    /// @brief Non-blocking descriptor the shell reads tokens from, -1 if disabled.
+    int input;
+
+    /// @brief Descriptor the shell writes tokens back to, -1 if disabled.
+    int output;
+
+    /// @brief True if output is a descriptor of the shell only and is closed by disconnect().
+    bool ownsOutput;
+
+    /// @brief Both ends of the pipe the shell serves, inherited by the children, -1 if it is not a server.
+    int served[2];
+
+    /// @brief True while no job runs on the implicit slot of the shell.
+    bool ownSlotFree;
+
+    /// @brief Tokens held by running jobs, by pid.
+    std::unordered_map<pid_t, int> held;
+
+    /// @brief Guards ownSlotFree and held, taken by the batch worker threads as well.
+    std::mutex stateMutex;
+};
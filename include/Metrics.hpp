@@ -0,0 +1,163 @@
+/**
+ * @file Metrics.hpp
+ * @brief Contains a Metrics class, the process-wide registry of counters, gauges and histograms
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class Metrics
+ * @brief Counts what the shell does, cheaply enough for the hot paths of Parser, Executor and Shell.
+ *
+ * Every thread updates a shard of its own, created on its first update, so an update is a plain load and
+ * store of a relaxed atomic without locks or contended cache lines. Readers sum the shards under a mutex
+ * that only thread start, thread exit and the readers take; the shard of an exiting thread is added to a
+ * retired total. Gauges are single atomics shared by all threads.
+ *
+ * Histograms are log-linear like HDR histograms: 8 buckets per power of two, so a quantile is off by at
+ * most 12.5%, for any value from 1 ns to centuries, in a fixed 4 KiB per histogram and thread.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class Metrics {
+   public:
+    /// @brief Monotonic counters.
+    enum class Counter : size_t {
+        LinesRead,         ///< input lines handed to the shell
+        ScriptsParsed,     ///< complete scripts (lines or blocks) parsed into a tree
+        ParseErrors,       ///< scripts rejected by the parser
+        CommandsComposed,  ///< commands composed from the tree, i.e. expanded
+        CommandsSpawned,   ///< external commands started
+        SpawnFailures,     ///< external commands that could not be started
+        BuiltinsRun,       ///< builtins run
+        FunctionCalls,     ///< shell functions called
+        ChildrenReaped,    ///< children whose exit was collected from the SIGCHLD handler
+        GlobCacheHits,     ///< directory listings served from the glob cache
+        GlobCacheMisses,   ///< directory listings read from the file system
+        CommandsTimedOut,  ///< process groups signalled because their timeout or the deadline passed
+        CoprocRequests,    ///< request lines sent to coprocess workers
+        CoprocRestarts,    ///< coprocess workers started in place of dead ones
+        JobserverWaits,    ///< jobs that waited for a jobserver token before they started
+        PrefetchHits,      ///< files of a batch line read into the page cache before the line ran
+        PrefetchMisses,    ///< files of a batch line still waiting to be prefetched when the line ran
+        Count,
+    };
+
+    /// @brief Values that go up and down.
+    enum class Gauge : size_t {
+        RunningJobs,  ///< background jobs running
+        StoppedJobs,  ///< jobs stopped
+        QueuedItems,  ///< foreach items waiting for a worker
+        Count,
+    };
+
+    /// @brief Distributions of durations in nanoseconds.
+    enum class Histogram : size_t {
+        ParseLatency,     ///< parsing a script into a tree
+        SpawnLatency,     ///< fork/clone and exec setup of a command, as seen by the parent
+        CommandDuration,  ///< wall time of foreground external commands
+        Count,
+    };
+
+    /// @brief Number of buckets of a histogram.
+    static constexpr size_t bucketCount = 496;
+
+    /// @brief Sums of all the threads at one point in time.
+    struct Snapshot {
+        std::array<uint64_t, static_cast<size_t>(Counter::Count)> counters;
+        std::array<int64_t, static_cast<size_t>(Gauge::Count)> gauges;
+        std::array<std::array<uint64_t, bucketCount>, static_cast<size_t>(Histogram::Count)> buckets;
+        std::array<uint64_t, static_cast<size_t>(Histogram::Count)> sums;
+    };
+
+    /**
+     * @brief Adds to a counter of the calling thread.
+     * @param counter The counter.
+     * @param amount The amount.
+     */
+    static void add(Counter counter, uint64_t amount = 1);
+
+    /**
+     * @brief Records a value in a histogram of the calling thread.
+     * @param histogram The histogram.
+     * @param nanoseconds The value.
+     */
+    static void record(Histogram histogram, uint64_t nanoseconds);
+
+    /**
+     * @brief Sets a gauge.
+     * @param gauge The gauge.
+     * @param value The value.
+     */
+    static void set(Gauge gauge, int64_t value);
+
+    /**
+     * @brief Changes a gauge.
+     * @param gauge The gauge.
+     * @param delta The change.
+     */
+    static void change(Gauge gauge, int64_t delta);
+
+    /**
+     * @brief Gives the monotonic clock, for measuring the values of the histograms.
+     * @return uint64_t Nanoseconds since an arbitrary point.
+     */
+    static uint64_t now();
+
+    /**
+     * @brief Sums the shards of all the threads.
+     * @return Snapshot The sums.
+     */
+    static Snapshot snapshot();
+
+    /**
+     * @brief Sums a single counter over all the threads, without the cost of a snapshot.
+     * @param counter The counter.
+     * @return uint64_t The sum.
+     */
+    static uint64_t total(Counter counter);
+
+    /**
+     * @brief Sums the values recorded in a histogram over all the threads, without the cost of a snapshot.
+     * @param histogram The histogram.
+     * @return uint64_t The sum of the values.
+     */
+    static uint64_t total(Histogram histogram);
+
+    /**
+     * @brief Formats a snapshot for people: the counters, the gauges and quantiles of the histograms.
+     * @param snapshot The snapshot.
+     * @return std::string The report.
+     */
+    static std::string report(const Snapshot& snapshot);
+
+    /**
+     * @brief Formats a snapshot in the Prometheus text exposition format, durations in seconds.
+     * @param snapshot The snapshot.
+     * @return std::string The exposition.
+     */
+    static std::string prometheus(const Snapshot& snapshot);
+
+    /**
+     * @brief Maps a value to its histogram bucket.
+     * @param value The value.
+     * @return size_t The bucket.
+     */
+    static size_t bucketOf(uint64_t value);
+
+    /**
+     * @brief Gives the smallest value of a histogram bucket.
+     * @param bucket The bucket.
+     * @return uint64_t The value.
+     */
+    static uint64_t bucketFloor(size_t bucket);
+};
@@ -0,0 +1,62 @@
+/**
+ * @file MetricsExporter.hpp
+ * @brief Contains a MetricsExporter class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <string>
+#include <thread>
+
+/**
+ * @class MetricsExporter
+ * @brief Serves the metrics of the shell in the Prometheus text format on a Unix socket.
+ *
+ * A worker thread accepts connections and answers every one with a fresh snapshot, then closes it. A client
+ * that starts with an HTTP request (curl --unix-socket PATH http://localhost/metrics) gets an HTTP response,
+ * any other (socat - UNIX-CONNECT:PATH) gets the bare exposition. The socket is only accessible to the owner
+ * of the shell and is removed when the exporter is destroyed.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class MetricsExporter {
+   public:
+    /**
+     * @brief Binds the socket and starts the worker thread.
+     * @param path Path of the socket, a stale socket there is replaced.
+     * @throws std::runtime_error if the socket cannot be set up.
+     */
+    explicit MetricsExporter(const std::string& path);
+
+    /// @brief Stops the worker thread and removes the socket.
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+   private:
+    /// @brief Accepts and answers connections until woken up by the destructor.
+    void serve();
+
+    /**
+     * @brief Answers a single connection.
+     * @param client The accepted connection.
+     */
+    static void answer(int client);
+
+    /// @brief Path of the socket.
+    std::string path;
+
+    /// @brief The listening socket.
+    int listenFd;
+
+    /// @brief Eventfd waking the worker up to stop.
+    int wakeFd;
+
+    /// @brief The worker thread.
+    std::thread worker;
+};
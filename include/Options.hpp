@@ -0,0 +1,89 @@
+/**
+ * @file Options.hpp
+ * @brief Contains an Options structure with the command line options of the shell
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <optional>
+#include <string>
+
+/**
+ * @struct Options
+ * @brief Command line options of the shell.
+ *
+ * Options start with "--" (or are -c) and may come in any order, the only positional argument is the batch
+ * file.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+struct Options {
+    /// @brief File to run in batch mode, interactive mode if not set.
+    std::optional<std::string> batchFile;
+
+    /// @brief Commands to run instead of a batch file (-c).
+    std::optional<std::string> command;
+
+    /// @brief Whether to read the script from stdin (-s), also done without it when stdin is not a terminal.
+    bool readStdin = false;
+
+    /// @brief CPU placement policy spec for background jobs (--placement).
+    std::optional<std::string> placement;
+
+    /// @brief Resource limits spec for jobs (--limits).
+    std::optional<std::string> limits;
+
+    /// @brief Engine for the file operations of the shell, sync or uring (--io-engine).
+    std::optional<std::string> ioEngine;
+
+    /// @brief Unix socket serving the metrics in the Prometheus text format (--metrics-socket).
+    std::optional<std::string> metricsSocket;
+
+    /// @brief Whether to print the phases of the startup (--startup-profile).
+    bool startupProfile = false;
+
+    /// @brief Number of independent batch lines run at once and slots of the jobserver served (--jobs).
+    std::optional<std::string> jobs;
+
+    /// @brief Whether to print the dependencies found between batch lines (--explain-deps).
+    bool explainDependencies = false;
+
+    /// @brief Time every command of a line may run before it is terminated (--line-timeout).
+    std::optional<std::string> lineTimeout;
+
+    /// @brief Time the whole batch may run, from the start of the shell (--batch-deadline).
+    std::optional<std::string> batchDeadline;
+
+    /// @brief File every handled line is logged to with its timing and outcome (--record).
+    std::optional<std::string> record;
+
+    /// @brief Session log whose lines are run again instead of a script (--replay).
+    std::optional<std::string> replay;
+
+    /// @brief Speed of the replay relative to the recording, e.g. 2x, or max (--speed).
+    std::optional<std::string> speed;
+
+    /// @brief Number of lines of a batch file whose files are prefetched ahead of them (--prefetch).
+    std::optional<std::string> prefetch;
+
+    /**
+     * @brief Parses the command line.
+     * @param argc Argument count.
+     * @param argv Argument vector.
+     * @return Options The parsed options.
+     * @throws std::invalid_argument if an option is unknown, misses its value, there are extra arguments or
+     * more than one of -c, -s, --replay and a batch file are given.
+     */
+    static Options parse(int argc, char** argv);
+
+    /**
+     * @brief Composes the usage message.
+     * @param executable The executable name.
+     * @return std::string The usage message.
+     */
+    static std::string usage(const std::string& executable);
+};
@@ -0,0 +1,58 @@
+/**
+ * @file OutputFanOut.hpp
+ * @brief Contains an OutputFanOut class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <vector>
+
+/**
+ * @class OutputFanOut
+ * @brief Writes everything a command writes to a stream to several files, like tee(1) inside the shell.
+ *
+ * The command writes to a pipe read by a small process forked from the shell. The process duplicates the
+ * data at the front of the pipe into one more pipe per extra target with tee(2) and moves every pipe to its
+ * target with splice(2), so the data never reaches user space. Only a target splice() refuses (e.g. a file
+ * opened with O_APPEND on older kernels) is written with read() and write(). A target that fails is dropped,
+ * the others go on. The process exits when the last writer of the pipe is gone.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class OutputFanOut {
+   public:
+    /**
+     * @brief Starts a process copying a new pipe to all the targets.
+     * @param targets Descriptors to write to, at least two, the caller keeps them.
+     * @param writeEnd Receives the write end of the pipe (close-on-exec), the caller closes it.
+     * @return pid_t The pid of the process, a child of the caller.
+     * @throws std::runtime_error if the pipes or the process cannot be created.
+     */
+    static pid_t start(const std::vector<int>& targets, int& writeEnd);
+
+   private:
+    /**
+     * @brief Copies the input to the targets until the end of the input, runs in the forked process.
+     * @param input Read end of the pipe the command writes to.
+     * @param targets The targets, a failed one is set to -1.
+     * @param pipes Pipes for the targets but the first, as pairs of read and write ends.
+     * @param sink Descriptor of /dev/null, receives the data nobody takes.
+     */
+    static void pump(int input, std::vector<int>& targets, const std::vector<int>& pipes, int sink);
+
+    /**
+     * @brief Moves a number of bytes from a pipe to a target.
+     * @param from The pipe.
+     * @param to The target, -1 if it failed before.
+     * @param length Number of bytes, all of them are taken from the pipe.
+     * @param sink Descriptor of /dev/null.
+     * @return bool False if the target failed.
+     */
+    static bool transfer(int from, int to, size_t length, int sink);
+};
@@ -0,0 +1,125 @@
+/**
+ * @file OutputMultiplexer.hpp
+ * @brief Contains an OutputMultiplexer class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "RingBuffer.hpp"
+
+/**
+ * @class OutputMultiplexer
+ * @brief Collects the output of background jobs and prints it line by line.
+ *
+ * Every captured job gets a pair of pipes for its stdout and stderr. A single worker thread waits on all the
+ * read ends with epoll, reads the data into a bounded ring buffer per stream and writes every complete line
+ * to the shell's own stdout/stderr with one write call, prefixed with the job id. A line longer than the
+ * buffer is broken at the buffer size, so the memory used per job never grows. When the shell cannot print
+ * as fast as a job writes, the job's pipe fills up and the job blocks on write.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class OutputMultiplexer {
+   public:
+    /// @brief Default size of the buffer kept for each captured stream.
+    static constexpr size_t defaultStreamCapacity = 64 * 1024;
+
+    /**
+     * @brief Constructs an OutputMultiplexer, the worker thread is started on the first capture.
+     * @param streamCapacity Size of the buffer kept for each captured stream.
+     */
+    explicit OutputMultiplexer(size_t streamCapacity = defaultStreamCapacity);
+
+    /// @brief Prints the remaining buffered output and stops the worker thread.
+    ~OutputMultiplexer();
+
+    OutputMultiplexer(const OutputMultiplexer&) = delete;
+    OutputMultiplexer& operator=(const OutputMultiplexer&) = delete;
+
+    /**
+     * @brief Creates capture pipes for a job.
+     * @param jobId The id printed in front of every line of the job.
+     * @return std::pair<int, int> Write ends for the job's stdout and stderr (close-on-exec).
+     * @throws std::runtime_error if the pipes cannot be created.
+     */
+    std::pair<int, int> capture(int jobId);
+
+   private:
+    /// @brief A single captured stream of a job.
+    struct Stream {
+        Stream(int fd, int sink, std::string prefix, size_t capacity);
+
+        /// @brief Read end of the capture pipe.
+        int fd;
+
+        /// @brief Descriptor the lines are written to.
+        int sink;
+
+        /// @brief Text printed in front of every line.
+        std::string prefix;
+
+        /// @brief Data read from the pipe that is not printed yet.
+        utils::RingBuffer buffer;
+    };
+
+    /// @brief Creates the epoll instance and starts the worker thread if it is not running yet.
+    void start();
+
+    /// @brief Worker thread body, waits for data and prints it until stopped.
+    void loop();
+
+    /**
+     * @brief Reads as much data as fits in the stream buffer.
+     * @param stream The stream to read.
+     * @return ssize_t Number of bytes read, 0 if the write end was closed, -1 if there is nothing to read.
+     */
+    static ssize_t fill(Stream& stream);
+
+    /**
+     * @brief Prints the complete lines of the stream buffer.
+     * @param stream The stream to print.
+     * @param flush Print the incomplete last line as well.
+     */
+    static void emit(Stream& stream, bool flush);
+
+    /**
+     * @brief Prints the rest of the stream and forgets it.
+     * @param fd Read end of the stream pipe.
+     */
+    void release(int fd);
+
+    /// @brief Size of the buffer kept for each captured stream.
+    const size_t streamCapacity;
+
+    /// @brief Epoll instance watching the read ends.
+    int epollFd;
+
+    /// @brief Eventfd used to wake the worker thread up for stopping.
+    int wakeFd;
+
+    /// @brief Set when the worker thread has to print everything it has and exit.
+    std::atomic<bool> stopping;
+
+    /// @brief Captured streams by the read end of their pipe.
+    std::unordered_map<int, std::unique_ptr<Stream>> streams;
+
+    /// @brief Guards streams and the start of the worker thread.
+    std::mutex mutex;
+
+    /// @brief The thread draining the pipes.
+    std::thread worker;
+};
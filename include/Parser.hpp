@@ -8,27 +8,50 @@
 
 #pragma once
 
-#include <regex>
+#include <deque>
+#include <functional>
+#include <initializer_list>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "Command.hpp"
+#include "Glob.hpp"
+#include "SyntaxTree.hpp"
+#include "Variables.hpp"
 
 /**
  * @class Parser
  * @brief The class parses a string into instances of class Command
  *
  * The main purpose of the class is to get a line and parse it, dealing with parallel symbols (&), redirection
- * symbols (>), executable name and args, respecting quotes (both ' and "), and escape sequences (like \")
+ * symbols (<, >, >>, 2>, 2>>, &>, &>>), executable name and args, respecting quotes (both ' and "), and
+ * escape sequences (like \")
+ *
+ * $(COMMANDS) is replaced by what the commands print, they are run by the substitution handler.
+ *
+ * Scripts with control flow (if, while, until, for, && and ||, statements separated by ; or new lines) are
+ * parsed into a SyntaxNode tree once, the commands of the tree are composed from it every time they run,
+ * which only expands their words.
  *
  * @author Sukhanov Ivan
  * @date 25/05/2025
  */
 class Parser {
    public:
-    /// @brief Constructs a Parser object.
+    /// @brief Runs the commands of a command substitution, appending what they print to the output.
+    using SubstitutionHandler = std::function<void(const std::string& commands, std::string& output)>;
+
+    /// @brief Constructs a Parser object that leaves $ as it is.
     Parser();
 
+    /**
+     * @brief Constructs a Parser object performing the shell expansions: $NAME, ${NAME} and $(COMMANDS)
+     * outside of single quotes, then unquoted glob patterns.
+     * @param variables The variables to expand, must outlive the parser.
+     */
+    explicit Parser(const Variables& variables);
+
     /**
      * @brief Parses the input string and returns a vector of Command objects.
      * @param input The command line string to parse.
@@ -36,22 +59,129 @@ class Parser {
      */
     std::vector<std::unique_ptr<Command>> parse(const std::string&);
 
+    /**
+     * @brief Parses a script, possibly of many lines, into a syntax tree.
+     * @param script The script.
+     * @return SyntaxNode The list of the statements of the script.
+     */
+    static SyntaxNode parseScript(const std::string& script);
+
+    /**
+     * @brief Counts the blocks a line opens (if, while, until, for) less the blocks it closes (fi, done).
+     * @param line The line.
+     * @return int The difference, a script is complete when the sum over its lines is 0.
+     */
+    static int nesting(const std::string& line);
+
+    /**
+     * @brief Composes the commands of a line of a syntax tree, expanding their words.
+     * @param line A node of kind Line.
+     * @return std::vector<std::unique_ptr<Command>> The commands.
+     */
+    std::vector<std::unique_ptr<Command>> compose(const SyntaxNode& line);
+
+    /**
+     * @brief Expands words, e.g. the ones a for iterates over.
+     * @param words The words.
+     * @return std::vector<std::string> The expanded words.
+     */
+    std::vector<std::string> expandWords(const std::vector<SyntaxNode::Word>& words);
+
+    /**
+     * @brief Sets the handler running command substitutions, without one they are an error.
+     * @param handler The handler.
+     */
+    void setSubstitutionHandler(SubstitutionHandler handler);
+
     /// @brief String containing whitespace and space-like symbols for parsing.
     static std::string spaceSymbols;
 
    private:
+    /// @brief A statement of a script or a keyword starting or ending a block.
+    struct Token {
+        /// @brief The keyword, empty for a statement.
+        std::string keyword;
+
+        /// @brief The statement, or the header of a for.
+        std::string text;
+    };
+
     /**
-     * @brief Composes a Command object from the given job string.
+     * @brief Splits a script into statements and keywords.
+     * @param script The script.
+     * @return std::vector<Token> The tokens.
+     */
+    static std::vector<Token> tokenize(const std::string& script);
+
+    /**
+     * @brief Parses statements until one of the terminators.
+     * @param tokens The tokens.
+     * @param pos Position in the tokens, left at the terminator.
+     * @param terminators Keywords ending the list, the last one is the one closing the block.
+     * @return SyntaxNode The list.
+     */
+    static SyntaxNode parseList(const std::vector<Token>& tokens, size_t& pos,
+                                std::initializer_list<std::string_view> terminators);
+
+    /**
+     * @brief Parses a statement of commands joined by && and ||.
+     * @param text The statement.
+     * @return SyntaxNode The tree of the statement.
+     */
+    static SyntaxNode parseAndOr(const std::string& text);
+
+    /**
+     * @brief Splits a line into its commands and their words.
+     * @param line The line.
+     * @return SyntaxNode A node of kind Line.
+     */
+    static SyntaxNode lexLine(const std::string& line);
+
+    /**
+     * @brief Splits a job string into words and redirections.
      * @param job The job string to parse.
-     * @param redirect Indicates if output redirection is present.
      * @param parallel Indicates if the command should be run in parallel.
+     * @return SyntaxNode::Job The job.
+     */
+    static SyntaxNode::Job lexJob(const std::string& job, bool parallel);
+
+    /**
+     * @brief Makes a word, marking it literal if there is nothing to expand in it.
+     * @param text The word as written.
+     * @return SyntaxNode::Word The word.
+     */
+    static SyntaxNode::Word lexWord(std::string text);
+
+    /**
+     * @brief Composes a Command object from a job.
+     * @param job The job.
      * @return std::unique_ptr<Command> The composed Command object.
      */
-    std::unique_ptr<Command> composeCommand(const std::string& job, bool redirect, bool parallel);
+    std::unique_ptr<Command> composeCommand(const SyntaxNode::Job& job);
+
+    /**
+     * @brief Expands a word, performing the expansions if the parser has variables.
+     * @param word The word.
+     * @param output Receives the resulting words.
+     */
+    void expandWord(const SyntaxNode::Word& word, std::vector<std::string>& output);
+
+    /// @brief Variables to expand, nullptr if $ is left as it is.
+    const Variables* variables;
+
+    /// @brief Expands glob patterns, its directory cache lives as long as the parser.
+    Glob glob;
 
-    /// @brief Regular expression for detecting parallel execution symbols.
-    static std::regex parallelSymb;
+    /// @brief Runs command substitutions.
+    SubstitutionHandler substitutionHandler;
+
+    /**
+     * @brief Output buffers of the command substitutions, one per level of nesting, reused from word to word.
+     *
+     * A deque, so a nested substitution adding a level does not move the buffer of the one it is nested in.
+     */
+    std::deque<std::string> substitutionBuffers;
 
-    /// @brief Regular expression for detecting output redirection symbols.
-    static std::regex redirectSymb;
+    /// @brief Number of command substitutions running, i.e. of buffers in use.
+    size_t substitutionDepth;
 };
@@ -0,0 +1,119 @@
+/**
+ * @file PlacementPolicy.hpp
+ * @brief Contains a PlacementPolicy class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sched.h>
+#include <sys/types.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class PlacementPolicy
+ * @brief Chooses the CPUs (and optionally the NUMA node) a background job runs on.
+ *
+ * The CPUs the shell is allowed to run on are grouped by NUMA node and cut into core sets of the configured
+ * size, a core set never spans two nodes. Round-robin hands the sets out in turn, alternating the nodes,
+ * least-loaded picks the set with the fewest running jobs. With node binding the job memory is allocated on
+ * the node of its core set only. The policy is described by a spec "POLICY[:CORES][:numa]", e.g.
+ * "round-robin:4:numa".
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class PlacementPolicy {
+   public:
+    /// @brief How the core sets are chosen.
+    enum class Mode { None, RoundRobin, LeastLoaded };
+
+    /// @brief Where a single job is placed, applied in the child between fork and exec.
+    struct Assignment {
+        /// @brief Index of the chosen core set, -1 if the job is not placed.
+        int slot;
+
+        /// @brief CPUs of the core set.
+        cpu_set_t cpus;
+
+        /// @brief Bit mask of the NUMA node of the core set, 0 if the memory is not bound.
+        unsigned long nodeMask;
+    };
+
+    /// @brief Constructs a disabled PlacementPolicy.
+    PlacementPolicy();
+
+    /**
+     * @brief Configures the policy from a spec.
+     * @param spec "none" or "POLICY[:CORES][:numa]" with POLICY being round-robin or least-loaded.
+     * @throws std::invalid_argument if the spec is malformed.
+     */
+    void configure(const std::string& spec);
+
+    /**
+     * @brief Describes the current configuration as a spec.
+     * @return std::string The spec.
+     */
+    std::string describe() const;
+
+    /**
+     * @brief Chooses the core set for the next job.
+     * @return Assignment The placement, with slot -1 if the policy is disabled.
+     */
+    Assignment assign();
+
+    /**
+     * @brief Records that a job was placed according to an assignment.
+     * @param pid The job process.
+     * @param assignment The placement returned by assign().
+     */
+    void commit(pid_t pid, const Assignment& assignment);
+
+    /**
+     * @brief Forgets a finished job, freeing its core set for the least-loaded policy.
+     * @param pid The job process.
+     */
+    void release(pid_t pid);
+
+    /**
+     * @brief Applies an assignment to the calling process, only async-signal-safe calls are made.
+     * @param assignment The placement.
+     */
+    static void apply(const Assignment& assignment);
+
+   private:
+    /// @brief Discovers the allowed CPUs and their nodes, then cuts them into core sets.
+    void buildSlots();
+
+    /// @brief Chosen mode.
+    Mode mode;
+
+    /// @brief Number of CPUs in a core set.
+    size_t coresPerJob;
+
+    /// @brief Whether the job memory is bound to the node of its core set.
+    bool bindMemory;
+
+    /// @brief A core set: the CPUs and their NUMA node.
+    struct Slot {
+        std::vector<int> cpus;
+        int node;
+    };
+
+    /// @brief Core sets in the order the round-robin policy hands them out.
+    std::vector<Slot> slots;
+
+    /// @brief Number of running jobs on each core set.
+    std::vector<unsigned> load;
+
+    /// @brief Index of the next core set for the round-robin policy.
+    size_t next;
+
+    /// @brief Core set of every running placed job.
+    std::unordered_map<pid_t, int> placedJobs;
+};
@@ -0,0 +1,86 @@
+/**
+ * @file Prefetcher.hpp
+ * @brief Contains a Prefetcher class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @class Prefetcher
+ * @brief Reads files into the page cache on a thread of its own, ahead of the commands that need them.
+ *
+ * The shell names the executables and input files of the lines it is about to run with prefetch(), the thread
+ * reads every regular file once with readahead(2) (posix_fadvise(WILLNEED) where readahead is not supported)
+ * while the current command runs. When a line runs, used() counts its files that were read in time as hits
+ * and the ones still queued or being read as misses; files that do not exist or are not regular are not
+ * counted.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class Prefetcher {
+   public:
+    /// @brief Bytes read ahead from the start of a single file at most.
+    static constexpr size_t fileLimit = 64 << 20;
+
+    /// @brief Starts the thread.
+    Prefetcher();
+
+    /// @brief Stops the thread, the files still queued are not read.
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    /**
+     * @brief Queues a file to be read, unless it was queued before.
+     * @param path The absolute path of the file.
+     */
+    void prefetch(const std::string& path);
+
+    /**
+     * @brief Counts a file of a line about to run as a hit or a miss.
+     * @param path The path given to prefetch().
+     */
+    void used(const std::string& path);
+
+   private:
+    /// @brief What became of a queued file.
+    enum class State {
+        Queued,   ///< waiting for the thread or being read
+        Loaded,   ///< read into the page cache
+        Skipped,  ///< missing, not a regular file or not readable
+    };
+
+    /// @brief Reads the queued files until the Prefetcher is destroyed.
+    void work();
+
+    /// @brief Files waiting for the thread, in the order they were queued.
+    std::deque<std::string> queue;
+
+    /// @brief Every file ever queued.
+    std::unordered_map<std::string, State> states;
+
+    /// @brief Set by the destructor to stop the thread.
+    bool stopping;
+
+    /// @brief Guards queue, states and stopping.
+    std::mutex stateMutex;
+
+    /// @brief Wakes the thread up when a file is queued or the Prefetcher is destroyed.
+    std::condition_variable queued;
+
+    /// @brief Reads the files.
+    std::thread worker;
+};
@@ -0,0 +1,170 @@
+/**
+ * @file ResourceLimits.hpp
+ * @brief Contains a ResourceLimits class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class ResourceLimits
+ * @brief Limits and accounts the resources of jobs with cgroup v2, falling back to setrlimit().
+ *
+ * When the cgroup v2 hierarchy of the shell is writable, the shell creates its own cgroup and places every
+ * job into a child cgroup (or all the jobs into a single "lane" cgroup) with memory.max, cpu.max and
+ * pids.max set. Jobs are spawned straight into their cgroup with clone3(CLONE_INTO_CGROUP), so they never
+ * run outside of it. When a job finishes, its cpu.stat and memory.peak are read back. Limits whose
+ * controller is not available are applied with setrlimit() in the child instead (memory as RLIMIT_AS).
+ * cpu.max and pids.max have no such equivalent and are not enforced without cgroups: RLIMIT_NPROC counts
+ * every process of the user, not the ones of the job. The limits are described by a spec
+ * "memory=SIZE:cpu=PERCENT%:pids=COUNT[:lane]", every part is optional, e.g. "memory=512M:cpu=50%".
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class ResourceLimits {
+   public:
+    /// @brief Where a single job is placed, prepared before the spawn.
+    struct Assignment {
+        /// @brief Descriptor of the cgroup directory to spawn into, -1 if none.
+        int cgroupFd;
+
+        /// @brief Path of cgroup.procs of the cgroup, used if clone3() is not available.
+        std::string procsPath;
+
+        /// @brief Path of the job's own cgroup, empty for the lane or without cgroups.
+        std::string jobCgroup;
+
+        /// @brief RLIMIT_AS to set in the child, if any.
+        std::optional<rlimit> memory;
+    };
+
+    /// @brief Resources used by a finished job, -1 if unknown.
+    struct Usage {
+        long long cpuUsec;
+        long long memoryPeak;
+    };
+
+    /// @brief Constructs ResourceLimits without any limits.
+    ResourceLimits();
+
+    /// @brief Removes the cgroups created by the shell.
+    ~ResourceLimits();
+
+    ResourceLimits(const ResourceLimits&) = delete;
+    ResourceLimits& operator=(const ResourceLimits&) = delete;
+
+    /**
+     * @brief Configures the limits from a spec.
+     * @param spec "none" or "memory=SIZE:cpu=PERCENT%:pids=COUNT[:lane]".
+     * @throws std::invalid_argument if the spec is malformed.
+     */
+    void configure(const std::string& spec);
+
+    /**
+     * @brief Describes the current configuration and how it is enforced.
+     * @return std::string The description.
+     */
+    std::string describe() const;
+
+    /**
+     * @brief Prepares the placement of the next job, creating its cgroup if needed.
+     * @return Assignment The placement, with cgroupFd -1 if cgroups are not used.
+     */
+    Assignment prepare();
+
+    /**
+     * @brief Spawns a child process into the assigned cgroup, like fork() does.
+     * @param assignment The placement returned by prepare().
+     * @return pid_t 0 in the child, the child pid in the parent, -1 on error.
+     */
+    static pid_t spawn(const Assignment& assignment);
+
+    /**
+     * @brief Applies the setrlimit() fallbacks to the calling process, only async-signal-safe calls are made.
+     * @param assignment The placement returned by prepare().
+     */
+    static void apply(const Assignment& assignment);
+
+    /**
+     * @brief Records the spawned job and releases the cgroup descriptor.
+     * @param pid The job process, -1 if the spawn failed and the job cgroup is to be removed.
+     * @param assignment The placement returned by prepare().
+     */
+    void commit(pid_t pid, Assignment& assignment);
+
+    /**
+     * @brief Reads the resources used by a finished job and removes its cgroup.
+     * @param pid The job process.
+     * @return Usage The used resources.
+     */
+    Usage release(pid_t pid);
+
+   private:
+    /**
+     * @brief Finds the cgroup of the shell and creates the cgroup of the shell below it.
+     * @return true if cgroups can be used.
+     */
+    bool setupHierarchy();
+
+    /**
+     * @brief Creates a cgroup with the configured limits.
+     * @param path Path of the cgroup.
+     * @return true on success.
+     */
+    bool createLimited(const std::string& path) const;
+
+    /// @brief Limit of memory.max in bytes.
+    std::optional<long long> memoryMax;
+
+    /// @brief Limit of cpu.max in percent of a single CPU.
+    std::optional<long long> cpuPercent;
+
+    /// @brief Limit of pids.max.
+    std::optional<long long> pidsMax;
+
+    /// @brief Whether all jobs share a single lane cgroup.
+    bool lane;
+
+    /// @brief Whether any limit is configured.
+    bool enabled;
+
+    /// @brief Whether the cgroup hierarchy was already probed.
+    bool probed;
+
+    /// @brief Cgroup of the shell, parent of all job cgroups, empty if cgroups are not usable.
+    std::string shellCgroup;
+
+    /// @brief The cgroup the shell was moved out of to enable controllers, empty if it was not moved.
+    std::string originalCgroup;
+
+    /// @brief The leaf cgroup the shell was moved into to enable controllers, empty if it was not moved.
+    std::string shellLeaf;
+
+    /// @brief Whether the memory controller is enabled for the job cgroups.
+    bool hasMemory;
+
+    /// @brief Whether the cpu controller is enabled for the job cgroups.
+    bool hasCpu;
+
+    /// @brief Whether the pids controller is enabled for the job cgroups.
+    bool hasPids;
+
+    /// @brief Path of the lane cgroup, empty if not created yet.
+    std::string laneCgroup;
+
+    /// @brief Number used in the name of the next job cgroup.
+    int nextCgroupId;
+
+    /// @brief Own cgroup of every running job.
+    std::unordered_map<pid_t, std::string> jobCgroups;
+};
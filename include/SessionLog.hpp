@@ -0,0 +1,113 @@
+/**
+ * @file SessionLog.hpp
+ * @brief Contains a SessionLog class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class SessionLog
+ * @brief Records the lines a shell handles, with their timing and outcome, so the workload can be replayed.
+ *
+ * The file starts with an 8-byte magic and is only ever appended to. Every record is a varint length
+ * followed by varints for the time since the previous record, the outcome, the duration, the number of
+ * spawns, their summed latency, the exit status and the line, and is written with a single write(2): a
+ * shell killed while recording leaves at most a torn last record, which load() drops.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class SessionLog {
+   public:
+    /// @brief What became of a line.
+    enum class Outcome : uint8_t {
+        Ran,         ///< parsed and run
+        Pending,     ///< kept, it leaves a block open
+        ParseError,  ///< rejected by the parser
+    };
+
+    /// @brief A handled line.
+    struct Record {
+        /// @brief When the line was handled, in nanoseconds since the start of the session.
+        uint64_t offset;
+
+        /// @brief What became of the line.
+        Outcome outcome;
+
+        /// @brief Wall time of handling the line in nanoseconds.
+        uint64_t duration;
+
+        /// @brief Number of external commands the line started.
+        uint64_t spawns;
+
+        /// @brief Summed spawn latency of those commands in nanoseconds.
+        uint64_t spawnLatency;
+
+        /// @brief Exit status of the shell after the line.
+        uint32_t status;
+
+        /// @brief The line.
+        std::string line;
+    };
+
+    /**
+     * @brief Creates or truncates a log and writes its magic.
+     * @param path The file.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    explicit SessionLog(const std::string& path);
+
+    /// @brief Closes the file.
+    ~SessionLog();
+
+    SessionLog(const SessionLog&) = delete;
+    SessionLog& operator=(const SessionLog&) = delete;
+
+    /**
+     * @brief Appends a record, its offset must not be below the one of the previous record.
+     * @param record The record.
+     * @throws std::runtime_error if the record cannot be written.
+     */
+    void append(const Record& record);
+
+    /**
+     * @brief Reads all the records of a log.
+     * @param path The file.
+     * @return std::vector<Record> The records in the order they were written.
+     * @throws std::runtime_error if the file cannot be read or is not a session log.
+     */
+    static std::vector<Record> load(const std::string& path);
+
+    /**
+     * @brief Compares the latencies of a replay with the ones of the recording.
+     * @param recorded The records of the log.
+     * @param replayed The records of the replay, in the same order.
+     * @return std::string The report: line and spawn latency quantiles, the total time and the lines whose
+     * outcome or status differ.
+     */
+    static std::string compare(const std::vector<Record>& recorded, const std::vector<Record>& replayed);
+
+   private:
+    /// @brief First bytes of a log, the last one is the version of the format.
+    static constexpr char magic[8] = {'i', 's', 'h', 'e', 'l', 'l', 'S', 1};
+
+    /// @brief Number of lines with a different outcome or status listed by compare().
+    static constexpr size_t listedDifferences = 10;
+
+    /// @brief The file.
+    int fd;
+
+    /// @brief Offset of the previous record, records keep the difference to it.
+    uint64_t previousOffset;
+
+    /// @brief Encoded record, kept to reuse its memory.
+    std::string encoded;
+};
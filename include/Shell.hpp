@@ -8,12 +8,23 @@
 
 #pragma once
 
+#include <cstdint>
+#include <istream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "BatchScheduler.hpp"
 #include "Executor.hpp"
+#include "MetricsExporter.hpp"
+#include "Options.hpp"
 #include "Parser.hpp"
+#include "Prefetcher.hpp"
+#include "SessionLog.hpp"
+#include "SyntaxTree.hpp"
+#include "Variables.hpp"
 
 /**
  * @class Shell
@@ -22,7 +33,8 @@
  * The Shell class provides functionality to run commands either interactively through user input or by
  * reading commands from a specified file. It uses a parser to interpret the commands and an executor to run
  * them. It displays a prompt to the user and handles input lines, processing them into commands that can be
- * executed.
+ * executed. Lines opening a block (if, while, until, for) are collected until the block is closed, the block
+ * is parsed into a syntax tree once and run from the tree.
  *
  * @author Sukhanov Ivan
  * @date 25/05/2025
@@ -35,18 +47,59 @@ class Shell {
     /// @brief Constructs a new Shell instance with an executable name prompt title.
     Shell(const char* prompt);
 
-    /// @brief Runs the shell interactively.
+    /**
+     * @brief Applies the command line options.
+     * @param options The parsed options.
+     * @throws std::invalid_argument if an option value is invalid.
+     * @throws std::runtime_error if the metrics socket cannot be set up.
+     */
+    void configure(const Options& options);
+
+    /// @brief Runs the shell interactively, until the end of the input.
     void run();
 
     /**
      * @brief Runs the shell with commands from the specified file.
      * @param filename The path to the file containing shell commands.
+     * @return int The exit status of the last command, 1 if the file cannot be read or ends inside a block.
+     */
+    int run(const std::string& filename);
+
+    /**
+     * @brief Runs the shell with commands given as a string, like sh -c.
+     * @param commands The commands, lines are separated by newlines.
+     * @return int The exit status of the last command, 1 if the commands end inside a block.
+     */
+    int runCommand(const std::string& commands);
+
+    /**
+     * @brief Runs the shell with a script read from stdin, like sh -s, without prompts.
+     * @return int The exit status of the last command, 1 if the script ends inside a block.
      */
-    void run(const std::string& filename);
+    int runStdin();
+
+    /**
+     * @brief Runs the lines of a session log again, then compares their latencies with the recorded ones.
+     * @param filename The log written by --record.
+     * @return int The exit status of the last command, 1 if the log cannot be read or ends inside a block.
+     */
+    int replay(const std::string& filename);
 
    private:
     /// @brief The prompt title displayed to the user.
-    static const char* PROMPT_TITLE;
+    const char* promptTitle;
+
+    /// @brief What a break, continue or return asks the enclosing loop or function to do.
+    enum class LoopControl { None, Break, Continue, Return };
+
+    /// @brief Deepest nesting of function calls, deeper calls fail instead of overflowing the stack.
+    static constexpr size_t maxFunctionDepth = 256;
+
+    /// @brief Number of cached substitution trees after which the cache is dropped.
+    static constexpr size_t maxSubstitutionTrees = 1024;
+
+    /// @brief Exit status of a script stopped by the batch deadline, like timeout(1).
+    static constexpr int timedOutStatus = 124;
 
     /**
      * @brief Handles a single line of user input.
@@ -55,17 +108,167 @@ class Shell {
     void handleInputLine(const std::string& line);
 
     /**
-     * @brief Reads a line of input from the user.
-     * @return The input line as a string.
+     * @brief Parses and runs a line, or keeps it if it leaves a block open.
+     * @param line The input line.
+     * @return SessionLog::Outcome What became of the line.
+     */
+    SessionLog::Outcome evaluateInput(const std::string& line);
+
+    /**
+     * @brief Adds a line to the pending block and parses the block once it is closed.
+     * @param line The input line.
+     * @return std::optional<SyntaxNode> The tree, nothing while the block is open or if it cannot be parsed.
+     */
+    std::optional<SyntaxNode> parseInput(const std::string& line);
+
+    /**
+     * @brief Runs the lines of a stream one by one.
+     * @param input The stream.
+     * @return int The exit status of the last command, 1 if the stream ends inside a block, 124 if the batch
+     * deadline passed.
+     */
+    int runScript(std::istream& input);
+
+    /**
+     * @brief Runs the lines of a stream one by one, prefetching the files of the lines ahead of them.
+     * @param input The stream.
+     * @return int The exit status of the last command, 1 if the stream ends inside a block, 124 if the batch
+     * deadline passed.
+     */
+    int runPrefetching(std::istream& input);
+
+    /**
+     * @brief Queues the executables and the literal argument paths of a line for prefetching.
+     * @param line The line, it is not expanded: words with quotes, variables, substitutions or globs are left
+     * out.
+     * @return std::vector<std::string> The queued paths, absolute.
      */
-    static std::string readInput();
+    std::vector<std::string> prefetchLine(const std::string& line);
 
-    /// @brief Displays the shell prompt to the user.
-    static void displayPrompt();
+    /**
+     * @brief Runs the lines of a stream, the independent ones at the same time.
+     * @param input The stream.
+     * @return int The exit status of the last command, 1 if the stream ends inside a block.
+     */
+    int runScheduled(std::istream& input);
+
+    /**
+     * @brief Composes the command of a tree if the tree can run next to other lines.
+     * @param tree The parsed lines.
+     * @param reason Receives why it cannot.
+     * @param priority Receives the priority class of the command, of prio CLASS COMMAND or of later jobs.
+     * @return std::unique_ptr<Command> The command, nullptr if the tree has to run alone.
+     */
+    std::unique_ptr<Command> schedulable(const SyntaxNode& tree, std::string& reason,
+                                         JobPriority::Class& priority);
+
+    /**
+     * @brief Runs a node of a syntax tree.
+     * @param node The node.
+     * @return int The exit status of the node.
+     */
+    int evaluate(const SyntaxNode& node);
+
+    /**
+     * @brief Runs the commands of a line.
+     * @param line A node of kind Line.
+     * @return int The exit status of the last command.
+     */
+    int evaluateLine(const SyntaxNode& line);
+
+    /**
+     * @brief Runs a loop body and consumes a break or continue coming out of it.
+     * @param body The body.
+     * @param status Receives the exit status of the body.
+     * @return true if the loop goes on.
+     */
+    bool evaluateBody(const SyntaxNode& body, int& status);
+
+    /**
+     * @brief Runs a function body with the arguments of the call as the positional parameters.
+     * @param body The body.
+     * @param call The call.
+     * @return int The exit status of the function.
+     */
+    int callFunction(const SyntaxNode& body, const Command& call);
+
+    /**
+     * @brief Runs the commands of a $(...) substitution and collects what they print.
+     * @param commands The commands between the parentheses.
+     * @param output Receives the output.
+     */
+    void substitute(const std::string& commands, std::string& output);
+
+    /**
+     * @brief Reads a line of input from the user, or all the lines of a bracketed paste.
+     * @return std::optional<std::string> The input, the lines of a paste separated by newlines, nothing at
+     * the end of the input.
+     */
+    std::optional<std::string> readInput() const;
+
+    /// @brief Displays the shell prompt to the user, a continuation prompt inside a block.
+    void displayPrompt() const;
+
+    /// @brief Lines of a block that is not closed yet.
+    std::string pendingScript;
+
+    /// @brief Number of blocks pendingScript leaves open.
+    int pendingDepth;
+
+    /// @brief Number of loops being run.
+    size_t loopDepth;
+
+    /// @brief Number of functions being run.
+    size_t functionDepth;
+
+    /// @brief Set by break, continue and return until the enclosing loop or function takes it.
+    LoopControl loopControl;
+
+    /// @brief Status given to return.
+    int returnStatus;
+
+    /// @brief Exit status of the last command.
+    int lastStatus;
+
+    /// @brief Number of independent lines of a script run at once, 1 runs them one by one.
+    size_t batchWorkers;
+
+    /// @brief Print why the lines of a script wait for each other.
+    bool explainDependencies;
+
+    /// @brief Whether the terminal is asked to mark pasted text, so a paste is read as a whole.
+    bool bracketedPaste;
+
+    /// @brief Log of the handled lines, if asked for (--record).
+    std::unique_ptr<SessionLog> sessionLog;
+
+    /// @brief Monotonic time the offsets of the logged and replayed lines are relative to.
+    uint64_t sessionStart;
+
+    /// @brief Speed of a replay relative to the recording, 0 for as fast as possible (--speed).
+    double replaySpeed;
+
+    /// @brief Receives the measurements of the lines of a running replay, nullptr otherwise.
+    std::vector<SessionLog::Record>* replayedLines;
+
+    /// @brief Number of lines of a batch file read ahead for prefetching, 0 for none (--prefetch).
+    size_t prefetchWindow;
+
+    /// @brief Reads the files of the lines ahead, if asked for.
+    std::unique_ptr<Prefetcher> prefetcher;
+
+    /// @brief Syntax trees of the substituted commands, a substitution in a loop is parsed once.
+    std::unordered_map<std::string, std::shared_ptr<const SyntaxNode>> substitutionTrees;
+
+    /// @brief Shell variables, shared by the parser (expansion) and the executor (environment).
+    std::unique_ptr<Variables> variables;
 
     /// @brief Parser for interpreting user input.
     std::unique_ptr<Parser> parser;
 
     /// @brief Executor for running parsed commands.
     std::unique_ptr<Executor> executor;
+
+    /// @brief Serves the metrics on a Unix socket, if asked for.
+    std::unique_ptr<MetricsExporter> metricsExporter;
 };
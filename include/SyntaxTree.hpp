@@ -0,0 +1,92 @@
+/**
+ * @file SyntaxTree.hpp
+ * @brief Contains a SyntaxNode structure, the parsed form of a script
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Command.hpp"
+
+/**
+ * @struct SyntaxNode
+ * @brief A node of the syntax tree of a script: a line of commands, a list of statements, a && or ||, an
+ * if, while, until or for block, or a function definition.
+ *
+ * The tree keeps the words of the commands as they were written, split and with their quotes, so running a
+ * node again (e.g. a loop body) only expands the words and never splits the text again. Words without
+ * anything to expand are marked literal and are used as they are.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+struct SyntaxNode {
+    /// @brief A word as written, with its quotes and escapes.
+    struct Word {
+        /// @brief The text of the word.
+        std::string text;
+
+        /// @brief True if the word has no quotes, escapes, variables or glob characters.
+        bool literal = false;
+    };
+
+    /// @brief A redirection of a command, its target is expanded like the words.
+    struct Redirect {
+        /// @brief The redirected stream.
+        Command::Redirect::Stream stream;
+
+        /// @brief Append to the target instead of truncating it.
+        bool append = false;
+
+        /// @brief The target as written.
+        Word target;
+    };
+
+    /// @brief A command of a line, the commands of a line are separated by &.
+    struct Job {
+        /// @brief The name and the arguments.
+        std::vector<Word> words{};
+
+        /// @brief The redirections in the order they were written.
+        std::vector<Redirect> redirects{};
+
+        /// @brief Run the command in background.
+        bool parallel = false;
+    };
+
+    /// @brief Kind of a node, tells which of the fields are used.
+    enum class Kind {
+        Line,      ///< jobs
+        List,      ///< children, run one after another
+        And,       ///< children, the second runs if the first succeeds
+        Or,        ///< children, the second runs if the first fails
+        If,        ///< children, pairs of a condition and a body, optionally followed by the else body
+        While,     ///< children, the condition and the body
+        Until,     ///< children, the condition and the body
+        For,       ///< variable, words and children, the only child is the body
+        Break,     ///< nothing
+        Continue,  ///< nothing
+        Function,  ///< variable is the name, the only child is the body
+        Return,    ///< words, the optional status
+    };
+
+    /// @brief Kind of the node.
+    Kind kind = Kind::List;
+
+    /// @brief Commands of a line.
+    std::vector<Job> jobs{};
+
+    /// @brief Nested nodes.
+    std::vector<SyntaxNode> children{};
+
+    /// @brief Loop variable of a for, name of a function.
+    std::string variable{};
+
+    /// @brief Words a for iterates over, status of a return.
+    std::vector<Word> words{};
+};
@@ -0,0 +1,137 @@
+/**
+ * @file TimeoutQueue.hpp
+ * @brief Contains a TimeoutQueue class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class TimeoutQueue
+ * @brief Terminates process groups that outlive their deadlines.
+ *
+ * All deadlines share a single timerfd armed to the earliest of them, kept in a min-heap, so adding a
+ * deadline costs O(log n) however many are pending. A worker thread sleeps on the timerfd; when a deadline
+ * passes, the group gets SIGTERM (and SIGCONT, so a stopped group can act on it) and, if it is still alive
+ * after the grace period, SIGKILL. A pidfd of the group leader tells whether the leader is still alive, so a
+ * group whose leader has exited is never signalled, even if its pid is reused before the deadline is
+ * cancelled.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class TimeoutQueue {
+   public:
+    /// @brief Time a group has between SIGTERM and SIGKILL by default, in nanoseconds.
+    static constexpr uint64_t defaultGrace = 5000000000ULL;
+
+    /// @brief Constructs an empty queue, the worker thread is started with the first deadline.
+    TimeoutQueue();
+
+    /// @brief Stops the worker thread, the pending deadlines are dropped.
+    ~TimeoutQueue();
+
+    TimeoutQueue(const TimeoutQueue&) = delete;
+    TimeoutQueue& operator=(const TimeoutQueue&) = delete;
+
+    /**
+     * @brief Sets a deadline for a process group.
+     * @param pgid The group, its leader has the same pid.
+     * @param deadline Monotonic time of the deadline in nanoseconds, see Metrics::now().
+     * @param grace Time between SIGTERM and SIGKILL in nanoseconds.
+     * @return uint64_t The id to cancel the deadline with, never 0.
+     * @throws std::runtime_error if the timer cannot be set up.
+     */
+    uint64_t add(pid_t pgid, uint64_t deadline, uint64_t grace = defaultGrace);
+
+    /**
+     * @brief Drops a deadline, to be called once the group leader is reaped.
+     * @param id The id given by add(), 0 is ignored.
+     * @return true if the group was signalled because of the deadline.
+     */
+    bool cancel(uint64_t id);
+
+   private:
+    /// @brief A pending deadline.
+    struct Timeout {
+        /// @brief The process group.
+        pid_t pgid;
+
+        /// @brief Pidfd of the group leader, -1 if not available.
+        int pidfd;
+
+        /// @brief Time between SIGTERM and SIGKILL.
+        uint64_t grace;
+
+        /// @brief When the next signal is due, 0 once SIGKILL was sent.
+        uint64_t due;
+
+        /// @brief Whether SIGTERM was sent.
+        bool terminated;
+    };
+
+    /// @brief An entry of the heap, stale once its timeout is cancelled or due at another time.
+    struct Expiry {
+        uint64_t due;
+        uint64_t id;
+
+        bool operator>(const Expiry& other) const { return due > other.due; }
+    };
+
+    /**
+     * @brief Creates the descriptors and starts the worker thread if it is not running yet.
+     * @throws std::runtime_error if the descriptors cannot be created.
+     */
+    void start();
+
+    /// @brief Worker thread body, signals the groups whose deadlines passed.
+    void loop();
+
+    /**
+     * @brief Signals the groups whose deadlines passed, the mutex must be held.
+     * @param now The current time.
+     */
+    void expire(uint64_t now);
+
+    /// @brief Arms the timerfd to the earliest deadline, the mutex must be held.
+    void arm();
+
+    /// @brief Rebuilds the heap without its stale entries once they outnumber the live ones.
+    void compact();
+
+    /// @brief Pending deadlines by id.
+    std::unordered_map<uint64_t, Timeout> timeouts;
+
+    /// @brief Deadlines ordered by time, with stale entries skipped when they come up.
+    std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry>> heap;
+
+    /// @brief Id of the next deadline.
+    uint64_t nextId;
+
+    /// @brief Time the timerfd is armed to, 0 if it is disarmed.
+    uint64_t armed;
+
+    /// @brief The timerfd.
+    int timerFd;
+
+    /// @brief Eventfd waking the worker thread up to exit.
+    int wakeFd;
+
+    /// @brief Guards all of the above.
+    std::mutex mutex;
+
+    /// @brief The worker thread.
+    std::thread worker;
+};
@@ -0,0 +1,120 @@
+/**
+ * @file Variables.hpp
+ * @brief Contains a Variables class
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ * @version 1.0
+ */
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class Variables
+ * @brief Shell variables and the environment exported to commands.
+ *
+ * The variables are initialized from the environment of the shell, all of them exported. The envp block
+ * passed to execve() is built once and shared until an exported variable changes, so spawning a command
+ * costs the same however many variables are set. A block that is in use stays valid when the variables
+ * change, the next one is built on the side (copy-on-write).
+ *
+ * The arguments of the running function are the positional parameters $1, $2, ... and $#, a call swaps
+ * them in and back out.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/05/2025
+ */
+class Variables {
+   public:
+    /// @brief An envp block, NAME=VALUE entries and a null-terminated array pointing into them.
+    struct Environment {
+        std::vector<std::string> entries;
+        std::vector<char*> envp;
+    };
+
+    /// @brief A single variable.
+    struct Variable {
+        std::string value;
+        bool exported;
+    };
+
+    /// @brief Constructs Variables holding the environment of the process.
+    Variables();
+
+    /**
+     * @brief Looks a variable up.
+     * @param name The variable name, digits for a positional parameter or # for their number.
+     * @return const std::string* The value, nullptr if the variable is not set.
+     */
+    const std::string* get(std::string_view name) const;
+
+    /**
+     * @brief Replaces the positional parameters.
+     * @param arguments The new parameters, $1 first.
+     * @return std::vector<std::string> The previous parameters.
+     */
+    std::vector<std::string> swapArguments(std::vector<std::string> arguments);
+
+    /**
+     * @brief Gives the positional parameters.
+     * @return const std::vector<std::string>& The parameters, $1 first.
+     */
+    const std::vector<std::string>& arguments() const;
+
+    /**
+     * @brief Sets a variable, keeping it exported if it was.
+     * @param name The variable name.
+     * @param value The value.
+     * @throws std::invalid_argument if the name is not a valid variable name.
+     */
+    void set(const std::string& name, std::string value);
+
+    /**
+     * @brief Marks a variable as exported, creating it empty if it is not set.
+     * @param name The variable name.
+     * @throws std::invalid_argument if the name is not a valid variable name.
+     */
+    void exportVariable(const std::string& name);
+
+    /**
+     * @brief Removes a variable.
+     * @param name The variable name.
+     */
+    void unset(const std::string& name);
+
+    /**
+     * @brief Gives the envp block of the exported variables, building it only if they changed.
+     * @return std::shared_ptr<const Environment> The block, valid for as long as it is held.
+     */
+    std::shared_ptr<const Environment> environment();
+
+    /**
+     * @brief Checks if a string is a valid variable name ([A-Za-z_][A-Za-z0-9_]*).
+     * @param name The string to check.
+     * @return true if it is.
+     */
+    static bool isValidName(std::string_view name);
+
+    /// @brief Iterators over the variables, sorted by name.
+    std::map<std::string, Variable, std::less<>>::const_iterator begin() const;
+    std::map<std::string, Variable, std::less<>>::const_iterator end() const;
+
+   private:
+    /// @brief The variables by name.
+    std::map<std::string, Variable, std::less<>> variables;
+
+    /// @brief The envp block of the exported variables, nullptr if it has to be rebuilt.
+    std::shared_ptr<const Environment> cachedEnvironment;
+
+    /// @brief The positional parameters.
+    std::vector<std::string> positional;
+
+    /// @brief Number of the positional parameters, the value of $#.
+    std::string positionalCount;
+};
@@ -0,0 +1,50 @@
+/**
+ * @file FdStreamBuffer.hpp
+ * @brief Contains a stream buffer reading a file descriptor in large blocks
+ *
+ * std::cin synchronized with stdio takes its input a character at a time. This buffer reads a descriptor
+ * with read() in blocks of a fixed size and hands the blocks to std::getline() as its get area, which
+ * splits them into lines with memchr() instead.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#pragma once
+
+#include <cstddef>
+#include <streambuf>
+#include <vector>
+
+/// @brief Namespace for utility functions.
+namespace utils {
+
+/// @brief Input stream buffer over a file descriptor, filled a block at a time.
+class FdStreamBuffer : public std::streambuf {
+   public:
+    /// @brief Size of a block by default.
+    static constexpr size_t defaultBlockSize = 1 << 20;
+
+    /**
+     * @brief Constructs a buffer reading a descriptor, which stays open afterwards.
+     * @param fd The descriptor.
+     * @param blockSize Maximum number of bytes read at once.
+     */
+    explicit FdStreamBuffer(int fd, size_t blockSize = defaultBlockSize);
+
+   protected:
+    /**
+     * @brief Reads the next block once the current one is consumed.
+     * @return int_type The next character, eof at the end of the input or on an error.
+     */
+    int_type underflow() override;
+
+   private:
+    /// @brief The descriptor.
+    int fd;
+
+    /// @brief The current block.
+    std::vector<char> block;
+};
+
+}  // namespace utils
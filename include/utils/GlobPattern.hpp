@@ -0,0 +1,86 @@
+/**
+ * @file GlobPattern.hpp
+ * @brief Contains a compiled glob pattern of a single path component
+ *
+ * This file contains a glob pattern (*, ?, [...] with ranges, negation and character classes, \ escapes)
+ * compiled once into tokens, so matching many names does not parse the pattern again.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#pragma once
+
+#include <bitset>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief Namespace for utility functions.
+namespace utils {
+
+/// @brief Glob pattern of a single path component.
+class GlobPattern {
+   public:
+    /**
+     * @brief Compiles a pattern, an unclosed [ is taken literally.
+     * @param pattern The pattern, must not contain /.
+     */
+    explicit GlobPattern(std::string_view pattern);
+
+    /**
+     * @brief Matches a name against the pattern, a leading dot must be matched literally.
+     * @param name The name.
+     * @return true if the name matches.
+     */
+    bool matches(std::string_view name) const;
+
+    /**
+     * @brief Checks if a string has unescaped glob characters.
+     * @param text The string.
+     * @return true if it has *, ? or [.
+     */
+    static bool hasMagic(std::string_view text);
+
+    /**
+     * @brief Removes the \ escapes from a string.
+     * @param text The string.
+     * @return std::string The string without the escapes.
+     */
+    static std::string unescape(std::string_view text);
+
+   private:
+    /// @brief A piece of the compiled pattern.
+    struct Token {
+        enum class Kind { Literal, AnyOne, AnyMany, Set } kind;
+
+        /// @brief The text of a Literal.
+        std::string literal;
+
+        /// @brief The accepted bytes of a Set.
+        std::bitset<256> set;
+    };
+
+    /**
+     * @brief Compiles a bracket expression starting at pos.
+     * @param pattern The pattern.
+     * @param pos Position of [, moved past ] on success.
+     * @param set Receives the accepted bytes.
+     * @return true if the expression is closed.
+     */
+    static bool compileSet(std::string_view pattern, size_t& pos, std::bitset<256>& set);
+
+    /// @brief The compiled pattern.
+    std::vector<Token> tokens;
+
+    /// @brief Literal the names must start with, checked before the tokens.
+    std::string prefix;
+
+    /// @brief Literal the names must end with, checked before the tokens.
+    std::string suffix;
+
+    /// @brief Whether the pattern starts with a literal dot and so may match hidden names.
+    bool matchesHidden;
+};
+
+}  // namespace utils
@@ -10,8 +10,11 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cctype>
 #include <regex>
 #include <sstream>
+#include <string_view>
 
 /// @brief Namespace for utility functions.
 namespace utils {
@@ -62,6 +65,65 @@ class ParseUtils {
     template <typename OutIt>
     static void splitRespectingQuotes(const std::string& input, OutIt outputIter);
 
+    /**
+     * @brief Finds the quote closing a quoted part of a token, skipping escaped characters and, in double
+     * quotes, command substitutions.
+     *
+     * @param input The input string.
+     * @param pos Position right after the opening quote.
+     * @param quote The quote character.
+     * @return size_t Position of the closing quote, std::string::npos if there is none.
+     */
+    static size_t findClosingQuote(const std::string& input, size_t pos, char quote);
+
+    /**
+     * @brief Finds the parenthesis closing a command substitution, skipping quoted parts, escaped characters
+     * and nested parentheses.
+     *
+     * @param input The input string.
+     * @param pos Position right after the opening $(.
+     * @return size_t Position of the closing parenthesis, std::string::npos if there is none.
+     */
+    static size_t findSubstitutionEnd(const std::string& input, size_t pos);
+
+    /**
+     * @brief Splits a string into tokens at the same places as splitExpanding(), leaving the quotes and
+     * escapes in the tokens, so every token can be expanded on its own later.
+     *
+     * @tparam OutIt Output iterator type.
+     * @param input The input string to split.
+     * @param outputIter Output iterator to write tokens.
+     */
+    template <typename OutIt>
+    static void splitKeepingQuotes(const std::string& input, OutIt outputIter);
+
+    /**
+     * @brief Splits a string into tokens, expanding $NAME, ${NAME} and $(COMMANDS) on the way.
+     *
+     * Unlike in splitRespectingQuotes(), a quoted part may start anywhere in a token and the token goes on
+     * after it (NAME='a b'), as in sh. A quote that is never closed is an ordinary character. The positional
+     * parameters are $1 to $9, ${N} and $#. Variables are expanded outside of single quotes in the same pass
+     * that splits the tokens, the values are appended to the token being built. The result of a variable
+     * is not split any further, the output of a command substitution loses its trailing new lines and, out
+     * of double quotes, is split into tokens at white space. An unquoted token that expands to nothing is
+     * dropped. A $( that is never closed is ordinary characters.
+     *
+     * @tparam OutIt Output iterator type.
+     * @tparam Lookup Callable taking a std::string_view name and returning const std::string*, nullptr if unset.
+     * @tparam Substitute Callable taking the const std::string& commands of a substitution and returning a
+     * const std::string& with their output.
+     * @param input The input string to split.
+     * @param outputIter Output iterator to write tokens.
+     * @param lookup Gives the value of a variable.
+     * @param substitute Runs the commands of a substitution.
+     * @param keepGlobQuoting Escape *, ?, [ and \ with \ where they are quoted or come from a variable, so
+     * only the unquoted ones are glob characters of the token.
+     * @throws std::invalid_argument if a ${ is not closed or encloses an invalid name.
+     */
+    template <typename OutIt, typename Lookup, typename Substitute>
+    static void splitExpanding(const std::string& input, OutIt outputIter, Lookup lookup, Substitute substitute,
+                               bool keepGlobQuoting = false);
+
     /**
      * @brief Splits an input range into two substrings at the first match of a regex pattern.
      *
@@ -187,6 +249,228 @@ void ParseUtils::splitRespectingQuotes(const std::string& input, OutIt outputIte
     }
 }
 
+/**
+ * @brief Finds the quote closing a quoted part of a token, skipping escaped characters and, in double quotes,
+ * command substitutions, which may have quotes of their own ("$(basename "$f")").
+ *
+ * @param input The input string.
+ * @param pos Position right after the opening quote.
+ * @param quote The quote character.
+ * @return size_t Position of the closing quote, std::string::npos if there is none.
+ */
+inline size_t ParseUtils::findClosingQuote(const std::string& input, size_t pos, char quote) {
+    for (; pos < input.size(); pos++) {
+        size_t close;
+        if (input[pos] == '\\') {
+            pos++;
+        } else if (input[pos] == quote) {
+            return pos;
+        } else if (quote == '"' && input[pos] == '$' && pos + 1 < input.size() && input[pos + 1] == '(' &&
+                   (close = findSubstitutionEnd(input, pos + 2)) != std::string::npos) {
+            pos = close;
+        }
+    }
+    return std::string::npos;
+}
+
+/**
+ * @brief Finds the parenthesis closing a command substitution, skipping quoted parts, escaped characters and
+ * nested parentheses.
+ *
+ * @param input The input string.
+ * @param pos Position right after the opening $(.
+ * @return size_t Position of the closing parenthesis, std::string::npos if there is none.
+ */
+inline size_t ParseUtils::findSubstitutionEnd(const std::string& input, size_t pos) {
+    size_t depth = 1;
+    for (; pos < input.size(); pos++) {
+        char currChar = input[pos];
+        size_t close;
+        if (currChar == '\\') {
+            pos++;
+        } else if ((currChar == '"' || currChar == '\'') &&
+                   (close = findClosingQuote(input, pos + 1, currChar)) != std::string::npos) {
+            pos = close;
+        } else if (currChar == '(') {
+            depth++;
+        } else if (currChar == ')' && --depth == 0) {
+            return pos;
+        }
+    }
+    return std::string::npos;
+}
+
+/**
+ * @brief Splits a string into tokens at the same places as splitExpanding(), leaving the quotes and escapes
+ * in the tokens.
+ *
+ * @tparam OutIt Output iterator type.
+ * @param input The input string to split.
+ * @param outputIter Output iterator to write tokens.
+ */
+template <typename OutIt>
+void ParseUtils::splitKeepingQuotes(const std::string& input, OutIt outputIter) {
+    size_t pos = 0;
+    while (true) {
+        while (pos < input.size() && std::isspace(static_cast<unsigned char>(input[pos]))) {
+            pos++;
+        }
+        if (pos == input.size()) {
+            break;
+        }
+
+        size_t begin = pos;
+        while (pos < input.size() && !std::isspace(static_cast<unsigned char>(input[pos]))) {
+            char currChar = input[pos++];
+            size_t close;
+            if (currChar == '\\' && pos < input.size()) {
+                pos++;
+            } else if ((currChar == '"' || currChar == '\'') &&
+                       (close = findClosingQuote(input, pos, currChar)) != std::string::npos) {
+                pos = close + 1;
+            } else if (currChar == '$' && pos < input.size() && input[pos] == '(' &&
+                       (close = findSubstitutionEnd(input, pos + 1)) != std::string::npos) {
+                pos = close + 1;
+            }
+        }
+
+        *outputIter++ = input.substr(begin, pos - begin);
+    }
+}
+
+/**
+ * @brief Splits a string into tokens, expanding $NAME, ${NAME} and $(COMMANDS) on the way.
+ *
+ * @tparam OutIt Output iterator type.
+ * @tparam Lookup Callable taking a std::string_view name and returning const std::string*, nullptr if unset.
+ * @tparam Substitute Callable taking the const std::string& commands of a substitution and returning a const
+ * std::string& with their output.
+ * @param input The input string to split.
+ * @param outputIter Output iterator to write tokens.
+ * @param lookup Gives the value of a variable.
+ * @param substitute Runs the commands of a substitution.
+ * @param keepGlobQuoting Escape *, ?, [ and \ with \ where they are quoted or come from a variable, so
+ * only the unquoted ones are glob characters of the token.
+ * @throws std::invalid_argument if a ${ is not closed or encloses an invalid name.
+ */
+template <typename OutIt, typename Lookup, typename Substitute>
+void ParseUtils::splitExpanding(const std::string& input, OutIt outputIter, Lookup lookup, Substitute substitute,
+                                bool keepGlobQuoting) {
+    auto isNameChar = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+
+    // appends a character that must not act as a glob character
+    auto appendQuoted = [keepGlobQuoting](std::string& tocken, char c) {
+        if (keepGlobQuoting && (c == '*' || c == '?' || c == '[' || c == '\\')) {
+            tocken += '\\';
+        }
+        tocken += c;
+    };
+
+    auto isDigit = [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; };
+
+    // appends the value of the variable whose name starts at pos, pos is moved past the name
+    auto expand = [&](size_t& pos, std::string& tocken) {
+        std::string_view name;
+        if (pos < input.size() && input[pos] == '{') {
+            size_t close = input.find('}', pos);
+            if (close == std::string::npos) {
+                throw std::invalid_argument("missing } after ${");
+            }
+            name = std::string_view{input}.substr(pos + 1, close - pos - 1);
+            bool positional = !name.empty() && (name == "#" || std::all_of(begin(name), end(name), isDigit));
+            if (!positional && (name.empty() || isDigit(name.front()) ||
+                                std::find_if_not(begin(name), end(name), isNameChar) != end(name))) {
+                throw std::invalid_argument("bad substitution ${" + std::string{name} + "}");
+            }
+            pos = close + 1;
+        } else if (pos < input.size() && (isDigit(input[pos]) || input[pos] == '#')) {
+            name = std::string_view{input}.substr(pos++, 1);
+        } else {
+            size_t nameEnd = pos;
+            while (nameEnd < input.size() && isNameChar(input[nameEnd]) &&
+                   !(nameEnd == pos && std::isdigit(static_cast<unsigned char>(input[nameEnd])))) {
+                nameEnd++;
+            }
+            if (nameEnd == pos) {
+                tocken += '$';  // not a variable, e.g. a lone $
+                return;
+            }
+            name = std::string_view{input}.substr(pos, nameEnd - pos);
+            pos = nameEnd;
+        }
+
+        if (const std::string* value = lookup(name)) {
+            for (char c : *value) {
+                appendQuoted(tocken, c);
+            }
+        }
+    };
+
+    std::string tocken;
+    size_t pos = 0;
+    while (true) {
+        while (pos < input.size() && std::isspace(static_cast<unsigned char>(input[pos]))) {
+            pos++;
+        }
+        if (pos == input.size()) {
+            break;
+        }
+
+        // a quoted part ends at its closing quote, the token ends at an unquoted space
+        char quote = '\0';
+        bool quoted = false;
+        bool expanded = false;
+        while (pos < input.size()) {
+            char currChar = input[pos++];
+            size_t close;
+            if (currChar == '\\' && pos < input.size()) {
+                appendQuoted(tocken, input[pos++]);
+            } else if (currChar == '$' && quote != '\'' && pos < input.size() && input[pos] == '(' &&
+                       (close = findSubstitutionEnd(input, pos + 1)) != std::string::npos) {
+                const std::string& output = substitute(input.substr(pos + 1, close - pos - 1));
+                pos = close + 1;
+                expanded = true;
+
+                size_t length = output.size();
+                while (length > 0 && output[length - 1] == '\n') {
+                    length--;
+                }
+                for (size_t i = 0; i < length; i++) {
+                    if (quote == '\0' && std::isspace(static_cast<unsigned char>(output[i]))) {
+                        if (!tocken.empty() || quoted) {
+                            *outputIter++ = move(tocken);
+                            tocken.clear();
+                            quoted = false;
+                        }
+                    } else {
+                        appendQuoted(tocken, output[i]);
+                    }
+                }
+            } else if (quote != '\0' && currChar == quote) {
+                quote = '\0';
+            } else if (quote == '\0' && std::isspace(static_cast<unsigned char>(currChar))) {
+                break;
+            } else if (quote == '\0' && (currChar == '"' || currChar == '\'') &&
+                       findClosingQuote(input, pos, currChar) != std::string::npos) {
+                quote = currChar;
+                quoted = true;
+            } else if (currChar == '$' && quote != '\'') {
+                expand(pos, tocken);
+                expanded = true;
+            } else if (quote != '\0') {
+                appendQuoted(tocken, currChar);
+            } else {
+                tocken += currChar;
+            }
+        }
+
+        if (!tocken.empty() || !expanded || quoted) {
+            *outputIter++ = move(tocken);
+        }
+        tocken.clear();
+    }
+}
+
 /**
  * @brief Splits an input range into two substrings at the first match of a regex pattern.
  *
@@ -0,0 +1,41 @@
+/**
+ * @file PathUtils.hpp
+ * @brief Contains utility functions related to file system paths
+ *
+ * This file contains generic utility functions related to file system paths.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+/// @brief Namespace for utility functions.
+namespace utils {
+
+/// @brief Utility class for path operations.
+class PathUtils {
+   public:
+    /**
+     * @brief Looks up the full path of an executable in the search path, a name with a slash is not looked up.
+     *
+     * @param searchPath Directories to search, in order.
+     * @param cmd The command name to look up.
+     * @return std::string The full path to the executable if found, otherwise the command name.
+     */
+    static std::string lookup(const std::vector<std::string>& searchPath, const std::string& cmd);
+
+    /**
+     * @brief Makes a path absolute and removes ., .. and repeated slashes from it, without touching the disk.
+     *
+     * @param base The absolute directory a relative path is relative to.
+     * @param path The path.
+     * @return std::string The path without a trailing slash, "/" for the root.
+     */
+    static std::string normalize(const std::string& base, const std::string& path);
+};
+
+}  // namespace utils
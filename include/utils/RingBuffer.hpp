@@ -0,0 +1,84 @@
+/**
+ * @file RingBuffer.hpp
+ * @brief Contains a fixed capacity byte ring buffer
+ *
+ * This file contains a byte ring buffer that exposes its free and used space as iovec regions, so the data
+ * can be moved in and out with readv()/writev() without intermediate copies.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+/// @brief Namespace for utility functions.
+namespace utils {
+
+/// @brief Fixed capacity byte ring buffer.
+class RingBuffer {
+   public:
+    /**
+     * @brief Constructs a ring buffer that can hold up to capacity bytes.
+     * @param capacity Maximum number of bytes stored at once.
+     */
+    explicit RingBuffer(size_t capacity);
+
+    /// @brief Returns the number of stored bytes.
+    size_t size() const;
+
+    /// @brief Returns the maximum number of stored bytes.
+    size_t capacity() const;
+
+    /// @brief Checks if there is no free space left.
+    bool full() const;
+
+    /// @brief Checks if there are no stored bytes.
+    bool empty() const;
+
+    /**
+     * @brief Describes the free space as up to two regions.
+     * @param regions Array receiving the regions.
+     * @return int Number of filled regions (0 if the buffer is full).
+     */
+    int writableRegions(iovec regions[2]);
+
+    /**
+     * @brief Marks bytes written into the writable regions as stored.
+     * @param length Number of bytes written.
+     */
+    void commit(size_t length);
+
+    /**
+     * @brief Describes the first length stored bytes as up to two regions.
+     * @param length Number of bytes to describe, must not exceed size().
+     * @param regions Array receiving the regions.
+     * @return int Number of filled regions.
+     */
+    int readableRegions(size_t length, iovec regions[2]) const;
+
+    /**
+     * @brief Drops the first length stored bytes.
+     * @param length Number of bytes to drop.
+     */
+    void consume(size_t length);
+
+    /**
+     * @brief Finds the first occurrence of a byte in the stored data.
+     * @param byte The byte to look for.
+     * @return std::optional<size_t> Offset of the byte from the beginning of the stored data.
+     */
+    std::optional<size_t> find(char byte) const;
+
+   private:
+    std::vector<char> storage;
+    size_t head;
+    size_t used;
+};
+
+}  // namespace utils
@@ -11,6 +11,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <string>
 
 /// @brief Namespace for utility functions.
@@ -46,6 +47,32 @@ class StringUtils {
      * @return std::string The trimmed string.
      */
     static std::string trim(const std::string& str, std::string_view unwantedSynbols);
+
+    /**
+     * @brief Parses a size with an optional K, M or G suffix.
+     *
+     * @param value The size.
+     * @return long long The size in bytes.
+     * @throws std::invalid_argument if the size is malformed.
+     */
+    static long long parseSize(const std::string& value);
+
+    /**
+     * @brief Parses a duration in seconds, with an optional fraction and an ms, s, m or h suffix.
+     *
+     * @param value The duration, e.g. 1.5, 500ms or 2m.
+     * @return uint64_t The duration in nanoseconds.
+     * @throws std::invalid_argument if the duration is malformed or zero.
+     */
+    static uint64_t parseDuration(const std::string& value);
+
+    /**
+     * @brief Formats a duration with a unit that keeps it short.
+     *
+     * @param nanoseconds The duration.
+     * @return std::string e.g. "850ns", "12.3us", "4.56ms" or "1.20s".
+     */
+    static std::string formatDuration(double nanoseconds);
 };
 
 /**
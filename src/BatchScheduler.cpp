@@ -0,0 +1,411 @@
+/**
+ * @file BatchScheduler.cpp
+ * @brief File implemets BatchScheduler class
+ *
+ * Every path keeps its last writer and the readers since that write, so a new reader waits for the last
+ * writer only and a new writer for the last writer and those readers: the older accesses are ordered
+ * before them already. An access also conflicts with the accesses of the directories the path is in and of
+ * the paths below it. Paths are normalized lexically against the working directory, device files are not
+ * tracked, writing /dev/null from many lines does not order them.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "BatchScheduler.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+
+#include "JobRunner.hpp"
+#include "Metrics.hpp"
+#include "PathUtils.hpp"
+
+namespace {
+
+/// @brief Wait status of a line that could not be started, like exit 127.
+constexpr int notStarted = 127 << 8;
+
+/// @brief Wait status of a line terminated for taking too long, like exit 124 of timeout(1).
+constexpr int timedOut = 124 << 8;
+
+/// @brief Commands that only read the paths they are given, their arguments are not writes.
+const std::unordered_set<std::string> readOnlyCommands = {
+    "cat", "cmp", "diff", "du", "echo", "egrep", "fgrep", "file", "grep", "head", "ls", "md5sum", "printf",
+    "sha1sum", "sha256sum", "sha512sum", "stat", "tail", "test", "wc",
+};
+
+/**
+ * @brief Checks if a path is worth tracking.
+ * @param path The normalized path.
+ * @return true unless it is a device or a process file.
+ */
+bool tracked(const std::string& path) {
+    return path.rfind("/dev/", 0) != 0 && path.rfind("/proc/", 0) != 0;
+}
+
+/**
+ * @brief Adds a path to a list unless it is there already.
+ * @param paths The list.
+ * @param path The path.
+ */
+void addUnique(std::vector<std::string>& paths, std::string path) {
+    if (tracked(path) && std::find(paths.begin(), paths.end(), path) == paths.end()) {
+        paths.push_back(std::move(path));
+    }
+}
+
+/**
+ * @brief Gives the symbol a redirection is written with.
+ * @param redirect The redirection.
+ * @return const char* The symbol, e.g. 2>>.
+ */
+const char* redirectSymbol(const Command::Redirect& redirect) {
+    switch (redirect.stream) {
+        case Command::Redirect::Stream::Input:
+            return "<";
+        case Command::Redirect::Stream::Output:
+            return redirect.append ? ">>" : ">";
+        case Command::Redirect::Stream::Error:
+            return redirect.append ? "2>>" : "2>";
+        case Command::Redirect::Stream::OutputAndError:
+            return redirect.append ? "&>>" : "&>";
+    }
+    return ">";
+}
+
+}  // namespace
+
+/**
+ * @brief Constructs an empty graph.
+ * @param workingDirectory The absolute directory relative paths of the lines are relative to.
+ */
+BatchScheduler::BatchScheduler(std::string workingDirectory) : workingDirectory(std::move(workingDirectory)) {
+}
+
+/**
+ * @brief Adds a line after all the lines added so far and finds what it depends on.
+ * @param command The command of the line, its background flag is ignored.
+ * @param line Number of the line in the script, for the explanations.
+ * @param priority Priority class of the line, in the queue of ready lines and when it runs.
+ */
+void BatchScheduler::add(std::unique_ptr<Command> command, size_t line, JobPriority::Class priority) {
+    using namespace std;
+
+    auto normalize = [&](const string& path) { return utils::PathUtils::normalize(workingDirectory, path); };
+
+    // any command may write the paths it is given, unless it is known not to; options are only read
+    const string& name = command->getName();
+    bool readOnly = readOnlyCommands.count(name.substr(name.rfind('/') + 1)) != 0;
+    vector<string> reads;
+    vector<string> writes;
+    if (name.find('/') != string::npos) {
+        addUnique(reads, normalize(name));
+    }
+    for (const string& arg : command->getArgs()) {
+        if (arg.empty()) {
+            continue;
+        }
+        addUnique(readOnly || arg.front() == '-' ? reads : writes, normalize(arg));
+
+        size_t equals = arg.find('=');
+        if (equals != string::npos && equals + 1 < arg.size()) {
+            addUnique(readOnly ? reads : writes, normalize(arg.substr(equals + 1)));
+        }
+    }
+    for (const Command::Redirect& redirect : command->getRedirects()) {
+        bool input = redirect.stream == Command::Redirect::Stream::Input;
+        addUnique(input ? reads : writes, normalize(redirect.target));
+    }
+    // a path the line writes waits for its readers as well, it is not read on top
+    auto written = [&](const string& path) {
+        return find(writes.begin(), writes.end(), path) != writes.end();
+    };
+    reads.erase(remove_if(reads.begin(), reads.end(), written), reads.end());
+
+    size_t index = nodes.size();
+    nodes.push_back({move(command), line, priority, {}, {}});
+
+    auto relation = [](const string& path, const string& other) {
+        if (other == path) {
+            return string{};
+        }
+        return (other.size() < path.size() ? " in " : " with ") + other;
+    };
+
+    for (const string& path : reads) {
+        forRelated(path, [&](const string& other, const PathAccess& previous) {
+            if (previous.writer != string::npos) {
+                depend(index, previous.writer, "reads " + path + relation(path, other) + " written by line ");
+            }
+        });
+    }
+
+    for (const string& path : writes) {
+        forRelated(path, [&](const string& other, const PathAccess& previous) {
+            string where = relation(path, other);
+            if (previous.writer != string::npos) {
+                depend(index, previous.writer,
+                       "writes " + path + (where.empty() ? " also" : where) + " written by line ");
+            }
+            for (size_t reader : previous.readers) {
+                depend(index, reader, "writes " + path + where + " read by line ");
+            }
+        });
+    }
+
+    for (const string& path : reads) {
+        access(path).readers.push_back(index);
+    }
+    for (const string& path : writes) {
+        PathAccess& written = access(path);
+        written.writer = index;
+        written.readers.clear();
+    }
+}
+
+/**
+ * @brief Gives the number of lines added.
+ * @return size_t The number of lines.
+ */
+size_t BatchScheduler::size() const {
+    return nodes.size();
+}
+
+/**
+ * @brief Prints every line with the lines it waits for and why.
+ * @param output The stream to print to.
+ */
+void BatchScheduler::explain(std::ostream& output) const {
+    for (const Node& node : nodes) {
+        output << "line " << node.line << ": " << node.command->toString();
+        for (const Command::Redirect& redirect : node.command->getRedirects()) {
+            output << ' ' << redirectSymbol(redirect) << ' ' << redirect.target;
+        }
+        if (node.priority != JobPriority::Class::Normal) {
+            output << " (" << JobPriority::name(node.priority) << ')';
+        }
+        output << '\n';
+        if (node.dependencies.empty()) {
+            output << "  no dependencies\n";
+        }
+        for (const Dependency& dependency : node.dependencies) {
+            output << "  after line " << nodes[dependency.node].line << ": " << dependency.reason << '\n';
+        }
+    }
+}
+
+/**
+ * @brief Runs all the lines, a line with unfinished dependencies waits for them.
+ *
+ * The first line whose output is not printed yet writes to the stdout of the shell directly, the others
+ * into memory files. A line that fails does not stop the lines depending on it, as in a sequential run.
+ *
+ * @param workers Maximum number of lines running at once.
+ * @param searchPath Directories searched for executables.
+ * @param environment Environment of the commands as NAME=VALUE entries.
+ * @param hooks What the shell does around the lines.
+ * @return int The wait status of the last line, 127 << 8 if it could not be started, 124 << 8 if it took too
+ * long.
+ */
+int BatchScheduler::run(size_t workers, const std::vector<std::string>& searchPath,
+                        std::vector<std::string> environment, const Hooks& hooks) {
+    using namespace std;
+
+    if (nodes.empty()) {
+        return 0;
+    }
+
+    // the most urgent ready line first, then the earliest, so a single worker runs the lines of a class in
+    // script order
+    using Ready = pair<JobPriority::Class, size_t>;
+    priority_queue<Ready, vector<Ready>, greater<Ready>> ready;
+    vector<size_t> waiting(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        waiting[i] = nodes[i].dependencies.size();
+        if (waiting[i] == 0) {
+            ready.push({nodes[i].priority, i});
+        }
+    }
+
+    vector<int> outputs(nodes.size(), -1);
+    vector<int> statuses(nodes.size(), 0);
+    vector<string> errors(nodes.size());
+    vector<bool> done(nodes.size(), false);
+    size_t finished = 0;
+    size_t running = 0;
+    size_t head = 0;
+    mutex stateMutex;
+    condition_variable changed;
+
+    JobRunner runner(searchPath);
+    JobRunner::SpawnOptions baseOptions;
+    baseOptions.environment = move(environment);
+
+    auto worker = [&]() {
+        unique_lock<mutex> lock(stateMutex);
+        while (true) {
+            changed.wait(lock, [&]() { return !ready.empty() || finished == nodes.size(); });
+            if (ready.empty()) {
+                return;
+            }
+            size_t index = ready.top().second;
+            ready.pop();
+            bool direct = index == head;
+            lock.unlock();
+
+            // a line waits for a job slot unless no other line runs: the slots may all be held by background
+            // jobs of the shell, which are not reaped before the batch is done
+            bool alone = false;
+            int token = hooks.acquire([&]() {
+                lock_guard<mutex> guard(stateMutex);
+                alone = running == 0;
+                running += alone;
+                return alone;
+            });
+            if (!alone) {
+                lock_guard<mutex> guard(stateMutex);
+                running++;
+            }
+
+            // the lines share the stdin of the shell with nobody, unless they redirect it
+            Command command = *nodes[index].command;
+            if (!command.isRedirected(Command::Redirect::Stream::Input)) {
+                command.addRedirect({Command::Redirect::Stream::Input, "/dev/null", false});
+            }
+            JobRunner::SpawnOptions options = baseOptions;
+            if (nodes[index].priority != JobPriority::Class::Normal) {
+                options.priority = nodes[index].priority;
+            }
+            if (!direct) {
+                outputs[index] = memfd_create("batch", MFD_CLOEXEC);
+                if (outputs[index] != -1) {
+                    options.outputFd = outputs[index];
+                }
+            }
+
+            int status;
+            uint64_t spawnStart = Metrics::now();
+            uint64_t timeout = 0;
+            options.spawned = [&](pid_t pid) { timeout = hooks.started(pid, spawnStart); };
+            try {
+                future<JobRunner::Result> result = runner.submit(command, options);
+                Metrics::record(Metrics::Histogram::SpawnLatency, Metrics::now() - spawnStart);
+                Metrics::add(Metrics::Counter::CommandsSpawned);
+                status = result.get().status;
+                if (hooks.finished(timeout)) {
+                    errors[index] = command.getName() + ": timed out";
+                    status = timedOut;
+                }
+            } catch (exception& e) {
+                Metrics::add(Metrics::Counter::SpawnFailures);
+                errors[index] = e.what();
+                status = notStarted;
+            }
+
+            hooks.release(token);
+
+            lock.lock();
+            running--;
+            statuses[index] = status;
+            done[index] = true;
+            finished++;
+            for (size_t dependent : nodes[index].dependents) {
+                if (--waiting[dependent] == 0) {
+                    ready.push({nodes[dependent].priority, dependent});
+                }
+            }
+
+            for (; head < nodes.size() && done[head]; head++) {
+                if (outputs[head] != -1) {
+                    hooks.print(outputs[head]);
+                    close(outputs[head]);
+                }
+                if (!errors[head].empty()) {
+                    const char* prefix = statuses[head] == timedOut ? "" : "error executing the command: ";
+                    cerr << prefix << errors[head] << '\n';
+                }
+            }
+            changed.notify_all();
+        }
+    };
+
+    size_t threadCount = min(max<size_t>(workers, 1), nodes.size());
+    vector<thread> threads;
+    threads.reserve(threadCount);
+    for (size_t t = 0; t < threadCount; t++) {
+        threads.emplace_back(worker);
+    }
+    for (thread& workerThread : threads) {
+        workerThread.join();
+    }
+
+    return statuses.back();
+}
+
+/**
+ * @brief Adds an edge unless the line waits for the other one already.
+ * @param node The waiting line.
+ * @param on The line waited for.
+ * @param reason Why, the number of the line waited for is appended to it.
+ */
+void BatchScheduler::depend(size_t node, size_t on, std::string reason) {
+    if (node == on) {
+        return;
+    }
+
+    std::vector<Dependency>& dependencies = nodes[node].dependencies;
+    bool known = std::any_of(dependencies.begin(), dependencies.end(),
+                             [on](const Dependency& dependency) { return dependency.node == on; });
+    if (!known) {
+        dependencies.push_back({on, std::move(reason) + std::to_string(nodes[on].line)});
+        nodes[on].dependents.push_back(node);
+    }
+}
+
+/**
+ * @brief Calls a function with the access records of a path, of the directories it is in and of the paths
+ * below it.
+ * @param path The normalized path.
+ * @param visit Called with the path of every record and the record.
+ */
+void BatchScheduler::forRelated(
+    const std::string& path, const std::function<void(const std::string&, const PathAccess&)>& visit) const {
+    auto same = paths.find(path);
+    if (same != paths.end()) {
+        visit(same->first, same->second);
+    }
+
+    for (size_t slash = path.rfind('/'); slash != std::string::npos && slash > 0;
+         slash = path.rfind('/', slash - 1)) {
+        auto directory = paths.find(path.substr(0, slash));
+        if (directory != paths.end()) {
+            visit(directory->first, directory->second);
+        }
+    }
+
+    // '0' follows '/', the paths below a directory sort between the two
+    std::string last = path + "0";
+    for (auto below = paths.lower_bound(path + "/"); below != paths.end() && below->first < last; ++below) {
+        visit(below->first, below->second);
+    }
+}
+
+/**
+ * @brief Gives the access record of a path, creating an empty one.
+ * @param path The normalized path.
+ * @return PathAccess& The record.
+ */
+BatchScheduler::PathAccess& BatchScheduler::access(const std::string& path) {
+    return paths.try_emplace(path, PathAccess{std::string::npos, {}}).first->second;
+}
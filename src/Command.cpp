@@ -46,21 +46,36 @@ std::vector<std::string> Command::getArgs() const {
 }
 
 /**
- * @brief Sets the file to which the command's output should be redirected.
- * @param file The output file path.
+ * @brief Adds a redirection, an output stream redirected more than once is written to every target.
+ * @param redirect The redirection.
  */
-void Command::setOutputRedirect(const std::string& file) {
-    assert(!file.empty());
+void Command::addRedirect(Redirect redirect) {
+    assert(!redirect.target.empty());
 
-    this->outputFile = file;
+    this->redirects.push_back(std::move(redirect));
 }
 
 /**
- * @brief Gets the output redirection file, if set.
- * @return An optional string containing the output file path.
+ * @brief Gets the redirections in the order they were written.
+ * @return A vector of redirections.
  */
-std::optional<std::string> Command::getOutputRedirect() const {
-    return this->outputFile;
+std::vector<Command::Redirect> Command::getRedirects() const {
+    return this->redirects;
+}
+
+/**
+ * @brief Checks if a stream of the command is redirected.
+ * @param stream Input, Output or Error, OutputAndError counts for both outputs.
+ * @return True if the stream is redirected.
+ */
+bool Command::isRedirected(Redirect::Stream stream) const {
+    for (const Redirect& redirect : this->redirects) {
+        bool both = redirect.stream == Redirect::Stream::OutputAndError && stream != Redirect::Stream::Input;
+        if (redirect.stream == stream || both) {
+            return true;
+        }
+    }
+    return false;
 }
 
 /**
@@ -78,3 +93,16 @@ void Command::setParallel(bool inParallel) {
 bool Command::isParallel() const {
     return this->inParallel;
 }
+
+/**
+ * @brief Composes the command line the command was parsed from.
+ * @return The name and the arguments separated by spaces.
+ */
+std::string Command::toString() const {
+    std::string line = this->name;
+    for (const std::string& arg : this->args) {
+        line += ' ';
+        line += arg;
+    }
+    return line;
+}
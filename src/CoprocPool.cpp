@@ -0,0 +1,379 @@
+/**
+ * @file CoprocPool.cpp
+ * @brief File implemets CoprocPool class
+ *
+ * The shell ends of the pipes are non-blocking and a request() call polls all of them, so a worker that is
+ * slow to read its requests never stops the responses of the others from being read. SIGPIPE is blocked for
+ * the time of a call, a worker that went away shows up as EPIPE or as the end of its stdout.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "CoprocPool.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "Metrics.hpp"
+
+namespace {
+
+/// @brief Size of the reads from the stdout of a worker.
+constexpr size_t readChunk = 1 << 16;
+
+}  // namespace
+
+/**
+ * @brief Constructs a pool without starting the workers.
+ * @param name Name of the pool, for the messages.
+ * @param command The command every worker runs.
+ * @param size Number of workers.
+ * @param delimiter The line ending a response.
+ * @param spawner Starts the workers.
+ */
+CoprocPool::CoprocPool(std::string name, Command command, size_t size, std::string delimiter, Spawner spawner)
+    : name(std::move(name)),
+      command(std::move(command)),
+      delimiter(std::move(delimiter)),
+      spawner(std::move(spawner)),
+      workers(size) {
+}
+
+/// @brief Closes the pipes and terminates the workers, the owner reaps them.
+CoprocPool::~CoprocPool() {
+    for (Worker& worker : workers) {
+        disconnect(worker);
+        if (worker.pid != -1) {
+            ::kill(-worker.pid, SIGTERM);
+            ::kill(-worker.pid, SIGCONT);
+        }
+    }
+}
+
+/**
+ * @brief Starts all the workers.
+ * @throws std::runtime_error if a worker cannot be started.
+ */
+void CoprocPool::start() {
+    for (Worker& worker : workers) {
+        spawn(worker);
+    }
+}
+
+/**
+ * @brief Replaces a worker that has exited, to be called once it is reaped.
+ * @param pid The reaped process.
+ * @return true if it was a worker of the pool.
+ */
+bool CoprocPool::exited(pid_t pid) {
+    auto replaced = std::find(lost.begin(), lost.end(), pid);
+    if (replaced != lost.end()) {
+        lost.erase(replaced);
+        return true;
+    }
+
+    auto worker =
+        std::find_if(workers.begin(), workers.end(), [pid](const Worker& each) { return each.pid == pid; });
+    if (worker == workers.end()) {
+        return false;
+    }
+
+    disconnect(*worker);
+    worker->pid = -1;
+    replace(*worker);
+    return true;
+}
+
+/**
+ * @brief Sends requests to the workers and prints the responses in request order.
+ *
+ * A request whose worker dies while answering it fails, the others go on.
+ *
+ * @param requests The request lines, without line breaks.
+ * @param print Receives every complete response.
+ * @param errors Stream the failed requests are reported to.
+ * @return size_t The number of failed requests.
+ */
+size_t CoprocPool::request(const std::vector<std::string>& requests, const Printer& print,
+                           std::ostream& errors) {
+    using namespace std;
+
+    sigset_t pipeSignal;
+    sigset_t previousMask;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &previousMask);
+
+    vector<string> responses(requests.size());
+    vector<const char*> failures(requests.size(), nullptr);
+    vector<bool> complete(requests.size(), false);
+    size_t next = 0;
+    size_t head = 0;
+    size_t failed = 0;
+
+    // the request a lost worker was answering fails, it may be what the worker died of, the ones queued
+    // behind it are sent again
+    deque<size_t> retried;
+    auto lose = [&](Worker& worker) {
+        if (!worker.inFlight.empty()) {
+            failures[worker.inFlight.front()] = "worker exited";
+            complete[worker.inFlight.front()] = true;
+            retried.insert(retried.end(), std::next(worker.inFlight.begin()), worker.inFlight.end());
+        }
+        worker.inFlight.clear();
+        disconnect(worker);
+        if (worker.pid != -1) {
+            lost.push_back(worker.pid);
+            worker.pid = -1;
+        }
+        replace(worker);
+    };
+
+    // splits what a worker printed into lines, a delimiter line completes its oldest request
+    auto receive = [&](Worker& worker) {
+        size_t start = 0;
+        for (size_t end; (end = worker.partial.find('\n', start)) != string::npos; start = end + 1) {
+            string_view line{worker.partial.data() + start, end - start};
+            if (worker.inFlight.empty()) {
+                continue;  // nothing was asked
+            }
+            size_t index = worker.inFlight.front();
+            if (line == delimiter) {
+                complete[index] = true;
+                worker.inFlight.pop_front();
+                worker.answered++;
+            } else {
+                responses[index].append(line);
+                responses[index] += '\n';
+            }
+        }
+        worker.partial.erase(0, start);
+    };
+
+    vector<pollfd> watched;
+    vector<Worker*> owners;
+    vector<bool> lostNow;
+    char chunk[readChunk];
+    while (head < requests.size()) {
+        for (Worker* worker;
+             (!retried.empty() || next < requests.size()) && (worker = leastBusy()) != nullptr;) {
+            size_t index = next;
+            if (retried.empty()) {
+                next++;
+            } else {
+                index = retried.front();
+                retried.pop_front();
+            }
+            worker->pending += requests[index];
+            worker->pending += '\n';
+            worker->inFlight.push_back(index);
+        }
+
+        watched.clear();
+        owners.clear();
+        for (Worker& worker : workers) {
+            if (worker.output != -1 && !worker.inFlight.empty()) {
+                watched.push_back({worker.output, POLLIN, 0});
+                owners.push_back(&worker);
+            }
+            if (worker.input != -1 && !worker.pending.empty()) {
+                watched.push_back({worker.input, POLLOUT, 0});
+                owners.push_back(&worker);
+            }
+        }
+
+        if (watched.empty()) {
+            // every worker is down, nothing can answer the rest
+            for (size_t index : retried) {
+                failures[index] = "no workers running";
+                complete[index] = true;
+            }
+            retried.clear();
+            for (; next < requests.size(); next++) {
+                failures[next] = "no workers running";
+                complete[next] = true;
+            }
+        } else if (poll(watched.data(), watched.size(), -1) == -1) {
+            if (errno != EINTR) {
+                for (Worker* worker : owners) {
+                    lose(*worker);
+                }
+                for (; next < requests.size(); next++) {
+                    failures[next] = "poll failed";
+                    complete[next] = true;
+                }
+            }
+            watched.clear();
+        }
+
+        // a worker lost on one pipe may be replaced by one whose pipes have the numbers of the watched ones
+        lostNow.assign(workers.size(), false);
+        for (size_t i = 0; i < watched.size(); i++) {
+            Worker& worker = *owners[i];
+            size_t slot = static_cast<size_t>(&worker - workers.data());
+            if (watched[i].revents == 0 || lostNow[slot]) {
+                continue;
+            }
+
+            if (watched[i].fd == worker.input) {
+                ssize_t put = write(worker.input, worker.pending.data(), worker.pending.size());
+                if (put > 0) {
+                    worker.pending.erase(0, static_cast<size_t>(put));
+                } else if (errno != EAGAIN && errno != EINTR) {
+                    lose(worker);
+                    lostNow[slot] = true;
+                }
+                continue;
+            }
+
+            ssize_t got = read(worker.output, chunk, sizeof(chunk));
+            if (got > 0) {
+                worker.partial.append(chunk, static_cast<size_t>(got));
+                receive(worker);
+            } else if (got == 0 || (errno != EAGAIN && errno != EINTR)) {
+                lose(worker);
+                lostNow[slot] = true;
+            }
+        }
+
+        for (; head < requests.size() && complete[head]; head++) {
+            if (failures[head] == nullptr) {
+                print(responses[head]);
+            } else {
+                errors << name << ": request " << head + 1 << " (" << requests[head]
+                       << "): " << failures[head] << '\n';
+                failed++;
+            }
+            string{}.swap(responses[head]);
+        }
+    }
+    Metrics::add(Metrics::Counter::CoprocRequests, requests.size());
+
+    // a SIGPIPE of a lost worker must not reach the shell once it is unblocked
+    timespec noWait{0, 0};
+    while (sigtimedwait(&pipeSignal, nullptr, &noWait) == SIGPIPE) {
+    }
+    pthread_sigmask(SIG_SETMASK, &previousMask, nullptr);
+    return failed;
+}
+
+/**
+ * @brief Prints the pool and the state of every worker.
+ * @param output The stream to print to.
+ */
+void CoprocPool::describe(std::ostream& output) const {
+    output << name << ": " << command.toString() << '\n';
+    for (size_t i = 0; i < workers.size(); i++) {
+        const Worker& worker = workers[i];
+        output << "  worker " << i + 1 << ": ";
+        if (worker.failed || worker.pid == -1) {
+            output << "down";
+        } else {
+            output << "pid " << worker.pid << ", " << worker.answered << " answered";
+        }
+        if (worker.restarts != 0) {
+            output << ", " << worker.restarts << (worker.restarts == 1 ? " restart" : " restarts");
+        }
+        output << '\n';
+    }
+}
+
+/**
+ * @brief Starts a worker in a slot.
+ * @param worker The slot, its pid and pipes are set.
+ * @throws std::runtime_error if it cannot be started.
+ */
+void CoprocPool::spawn(Worker& worker) {
+    using namespace std;
+
+    int toWorker[2];
+    int fromWorker[2];
+    if (pipe2(toWorker, O_CLOEXEC) == -1) {
+        throw runtime_error(name + ": pipe: " + strerror(errno));
+    }
+    if (pipe2(fromWorker, O_CLOEXEC) == -1) {
+        int error = errno;
+        close(toWorker[0]);
+        close(toWorker[1]);
+        throw runtime_error(name + ": pipe: " + strerror(error));
+    }
+
+    pid_t pid = spawner(command, toWorker[0], fromWorker[1]);
+    int error = errno;
+    close(toWorker[0]);
+    close(fromWorker[1]);
+    if (pid == -1) {
+        close(toWorker[1]);
+        close(fromWorker[0]);
+        throw runtime_error(name + ": " + strerror(error));
+    }
+
+    fcntl(toWorker[1], F_SETFL, O_NONBLOCK);
+    fcntl(fromWorker[0], F_SETFL, O_NONBLOCK);
+    worker.pid = pid;
+    worker.input = toWorker[1];
+    worker.output = fromWorker[0];
+    worker.pending.clear();
+    worker.partial.clear();
+    worker.answered = 0;
+}
+
+/**
+ * @brief Closes the pipes of a worker, its process is left to exit on the end of its stdin.
+ * @param worker The worker.
+ */
+void CoprocPool::disconnect(Worker& worker) {
+    if (worker.input != -1) {
+        close(worker.input);
+        worker.input = -1;
+    }
+    if (worker.output != -1) {
+        close(worker.output);
+        worker.output = -1;
+    }
+}
+
+/**
+ * @brief Starts a new worker in the slot of a dead one, unless it never answered a request.
+ * @param worker The slot, its pipes are closed and its pid is -1.
+ * @return true if a new worker was started.
+ */
+bool CoprocPool::replace(Worker& worker) {
+    if (worker.answered == 0) {
+        worker.failed = true;
+        return false;
+    }
+
+    try {
+        spawn(worker);
+    } catch (std::runtime_error&) {
+        worker.failed = true;
+        return false;
+    }
+    worker.restarts++;
+    Metrics::add(Metrics::Counter::CoprocRestarts);
+    return true;
+}
+
+/**
+ * @brief Picks the worker with the fewest requests in flight that can take one more.
+ * @return Worker* The worker, nullptr if all are busy or lost.
+ */
+CoprocPool::Worker* CoprocPool::leastBusy() {
+    Worker* best = nullptr;
+    for (Worker& worker : workers) {
+        if (worker.input != -1 && worker.inFlight.size() < pipelineDepth &&
+            (best == nullptr || worker.inFlight.size() < best->inFlight.size())) {
+            best = &worker;
+        }
+    }
+    return best;
+}
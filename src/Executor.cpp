@@ -13,217 +13,2623 @@
 #include "Executor.hpp"
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <csignal>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <map>
+
+#include "FdStreamBuffer.hpp"
+#include "ForeachRunner.hpp"
+#include "Metrics.hpp"
+#include "OutputFanOut.hpp"
+#include "ParseUtils.hpp"
+#include "PathUtils.hpp"
+#include "StartupProfile.hpp"
+#include "StringUtils.hpp"
+
+namespace {
+
+/// @brief Signals the shell ignores while it controls a terminal, children get the default actions back.
+constexpr int jobControlSignals[] = {SIGTSTP, SIGTTIN, SIGTTOU};
+
+/// @brief Signal names accepted by the kill builtin.
+const std::unordered_map<std::string_view, int> signalNames = {
+    {"HUP", SIGHUP},   {"INT", SIGINT},   {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+    {"USR2", SIGUSR2}, {"TERM", SIGTERM}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP},
+};
+
+/**
+ * @brief Describes the state of a job the way the jobs builtin prints it.
+ * @param job The job.
+ * @return std::string The description.
+ */
+std::string describeState(const Job& job) {
+    switch (job.state) {
+        case Job::State::Running:
+            return "Running";
+        case Job::State::Stopped:
+            return "Stopped";
+        case Job::State::Done:
+            break;
+    }
+
+    if (job.status == -1) {
+        return "Done";
+    }
+    if (WIFSIGNALED(job.status)) {
+        return std::string{"Killed ("} + strsignal(WTERMSIG(job.status)) + ")";
+    }
+    if (WEXITSTATUS(job.status) != 0) {
+        return "Exit " + std::to_string(WEXITSTATUS(job.status));
+    }
+    return "Done";
+}
+
+/**
+ * @brief Converts a wait status to the exit status of a command as sh reports it.
+ * @param status The wait status, -1 if it is unknown.
+ * @return int The exit code, 128 + the signal number if the command was killed or stopped.
+ */
+int exitStatus(int status) {
+    if (status == -1) {
+        return 0;
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/// @brief Room left in the argument space for the auxiliary vector and alignment, as POSIX xargs does.
+constexpr size_t argumentHeadroom = 2048;
+
+/// @brief Longest single argument the kernel accepts (MAX_ARG_STRLEN).
+constexpr size_t maxArgumentLength = 32 * 4096;
+
+/**
+ * @brief Computes the space one argument takes in the argument space of a new program.
+ * @param arg The argument.
+ * @return size_t The string, its terminator and its pointer.
+ */
+size_t argumentCost(const std::string& arg) {
+    return arg.size() + 1 + sizeof(char*);
+}
+
+/// @brief Size of the reads from a capture pipe.
+constexpr size_t captureChunk = 1 << 16;
+
+/// @brief Size a capture pipe is grown to, so a fast writer is not stopped every few pages.
+constexpr int capturePipeSize = 1 << 20;
+
+/// @brief Exit status of a command terminated for taking too long, as timeout(1) reports it.
+constexpr int timedOutStatus = 124;
+
+/**
+ * @brief Stream buffer appending to a string, lets builtins print into a capture without a pipe.
+ */
+class CaptureBuffer : public std::streambuf {
+   public:
+    /**
+     * @brief Constructs a CaptureBuffer.
+     * @param output The string to append to.
+     */
+    explicit CaptureBuffer(std::string& output) : output(output) {
+    }
+
+   protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            output += traits_type::to_char_type(c);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        output.append(data, static_cast<size_t>(count));
+        return count;
+    }
+
+   private:
+    /// @brief The string appended to.
+    std::string& output;
+};
+
+/**
+ * @brief Reads a file or a pipe until its end in large chunks.
+ * @param fd The descriptor.
+ * @param output The string to append to, its capacity is kept from one capture to the next.
+ */
+void readAll(int fd, std::string& output) {
+    char chunk[captureChunk];
+    ssize_t got;
+    while ((got = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (got > 0) {
+            output.append(chunk, static_cast<size_t>(got));
+        } else if (errno != EINTR) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Writes the content of a file to stdout or to a capture.
+ * @param fd The file, read from its start.
+ * @param capture The capture, nullptr for stdout.
+ * @param target The descriptor written to instead of a capture, stdout by default.
+ */
+void dumpOutput(int fd, std::string* capture, int target = STDOUT_FILENO) {
+    if (capture != nullptr) {
+        lseek(fd, 0, SEEK_SET);
+        readAll(fd, *capture);
+        return;
+    }
+
+    std::cout << std::flush;
+
+    off_t offset = 0;
+    off_t size = lseek(fd, 0, SEEK_END);
+    while (offset < size && sendfile(target, fd, &offset, size - offset) > 0) {
+    }
+
+    // sendfile() may not support stdout, the rest is copied by hand
+    char buffer[16384];
+    ssize_t got;
+    while (offset < size && (got = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+        for (ssize_t written = 0; written < got;) {
+            ssize_t put = write(target, buffer + written, got - written);
+            if (put <= 0 && errno != EINTR) {
+                return;
+            }
+            written += put > 0 ? put : 0;
+        }
+        offset += got;
+    }
+}
+
+/**
+ * @brief Describes how a redirect target is opened.
+ * @param redirect The redirection.
+ * @return IoEngine::OpenRequest The request, close-on-exec as the child only duplicates the descriptor.
+ */
+IoEngine::OpenRequest redirectRequest(const Command::Redirect& redirect) {
+    const int permissions = 0644;
+    if (redirect.stream == Command::Redirect::Stream::Input) {
+        return {redirect.target, O_RDONLY | O_CLOEXEC, 0};
+    }
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (redirect.append ? O_APPEND : O_TRUNC);
+    return {redirect.target, flags, permissions};
+}
+
+/**
+ * @brief Closes the descriptors that are set.
+ * @param fds The descriptors, -1 for the ones that are not.
+ */
+void closeAll(const std::vector<int>& fds) {
+    for (int fd : fds) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+}  // namespace
+
+std::array<Executor::ChildStatus, Executor::reapedCapacity> Executor::reapedChildren{};
+std::atomic<size_t> Executor::reapedHead{0};
+std::atomic<size_t> Executor::reapedTail{0};
+std::atomic<bool> Executor::reapedOverflow{false};
+
+/**
+ * @brief Constructs an Executor, the SIGCHLD signal handler is registered when the first child is forked.
+ * @param variables Shell variables, their exported part is the environment of the commands.
+ */
+Executor::Executor(Variables& variables)
+    : builtinCommand(nullptr),
+      variables(variables),
+      searchPathChanges(0),
+      reaping(false),
+      capture(nullptr),
+      lineTimeout(0),
+      deadline(0),
+      commandGrace(TimeoutQueue::defaultGrace),
+      jobPriority(JobPriority::Class::Normal) {
+    ownsTerminal = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+    if (ownsTerminal) {
+        for (int signum : jobControlSignals) {
+            signal(signum, SIG_IGN);
+        }
+    }
+
+    // a shell started by make with a jobserver takes its tokens like any other recursive make
+    if (const std::string* makeflags = variables.get("MAKEFLAGS")) {
+        if (std::optional<std::string> warning = jobserver.connect(*makeflags)) {
+            std::cerr << *warning << '\n';
+        }
+    }
+
+    jobTable.setFinishHandler([this](Job& job) {
+        jobPlacement.release(job.pid);
+        jobserver.release(job.pid);
+
+        ResourceLimits::Usage usage = jobLimits.release(job.pid);
+        job.cpuUsec = usage.cpuUsec;
+        job.memoryPeak = usage.memoryPeak;
+
+        auto timeout = jobTimeouts.find(job.pid);
+        if (timeout != end(jobTimeouts)) {
+            timeouts.cancel(timeout->second);
+            jobTimeouts.erase(timeout);
+        }
+    });
+}
+
+/**
+ * @brief Executes a command, resolving an alias first.
+ *
+ * The words of an alias are prepended to the arguments, the first of them is not looked up as an alias
+ * again, so an alias may refer to the command it shadows (alias ls='ls -F').
+ *
+ * @param cmd The command to execute.
+ * @return int The exit status, 0 for a command sent to background.
+ */
+int Executor::execute(Command& cmd) {
+    using namespace std;
+
+    collectReaped();
+
+    auto alias = aliases.find(cmd.getName());
+    if (alias == end(aliases)) {
+        int status = dispatch(cmd);
+        publishJobCounts();
+        return status;
+    }
+
+    vector<string> words = alias->second.words;
+    const vector<string>& args = cmd.getArgs();
+    words.insert(end(words), begin(args), end(args));
+    if (words.empty()) {
+        return 0;
+    }
+
+    Command expanded{words.front(), vector<string>{next(begin(words)), end(words)}};
+    for (Command::Redirect& redirect : cmd.getRedirects()) {
+        expanded.addRedirect(move(redirect));
+    }
+    expanded.setParallel(cmd.isParallel());
+
+    // the redirect targets prepared for the command are the ones of the expansion, they must not outlive it
+    auto prepared = preparedRedirects.find(&cmd);
+    if (prepared != end(preparedRedirects)) {
+        preparedRedirects.emplace(&expanded, move(prepared->second));
+        preparedRedirects.erase(prepared);
+    }
+
+    int status = dispatch(expanded);
+    publishJobCounts();
+
+    auto untaken = preparedRedirects.find(&expanded);
+    if (untaken != end(preparedRedirects)) {
+        closeAll(untaken->second);
+        preparedRedirects.erase(untaken);
+    }
+    return status;
+}
+
+/**
+ * @brief Runs a command whose aliases are already resolved.
+ * @param cmd The command.
+ * @return int The exit status.
+ */
+int Executor::dispatch(const Command& cmd) {
+    auto function = functions.find(cmd.getName());
+    if (function != end(functions)) {
+        std::shared_ptr<const SyntaxNode> body = function->second;
+        return callFunction(*body, cmd);
+    }
+
+    if (isBuiltin(cmd)) {
+        return executeBuiltin(cmd);
+    }
+    if (assignVariable(cmd)) {
+        return 0;
+    }
+    return executeExternal(cmd);
+}
+
+/**
+ * @brief Sets the handler running function bodies.
+ * @param handler The handler.
+ */
+void Executor::setFunctionHandler(FunctionHandler handler) {
+    functionHandler = std::move(handler);
+}
+
+/**
+ * @brief Appends what the commands print to stdout to a buffer, until called again.
+ *
+ * Builtins print into the buffer directly, foreground external commands through a pipe of their own that is
+ * read until its end. Commands sent to background print through the multiplexer as always.
+ *
+ * @param buffer The buffer, nullptr to print to stdout again.
+ * @return std::string* The buffer used before, to be restored afterwards.
+ */
+std::string* Executor::captureOutput(std::string* buffer) {
+    std::string* previous = capture;
+    capture = buffer;
+    return previous;
+}
+
+/**
+ * @brief Checks if a command is external: not an alias, a function, a builtin or an assignment.
+ * @param cmd The command.
+ * @return true if it does.
+ */
+bool Executor::isExternal(const Command& cmd) const {
+    const std::string name = cmd.getName();
+    if (aliases.count(name) != 0 || functions.count(name) != 0 || isBuiltin(cmd)) {
+        return false;
+    }
+
+    size_t separator = name.find('=');
+    return separator == std::string::npos || !cmd.getArgs().empty() ||
+           !Variables::isValidName(std::string_view{name}.substr(0, separator));
+}
+
+/**
+ * @brief Finds the executable an external command would run, without running it.
+ * @param name The command name.
+ * @return std::string The path of the executable, empty if the command is not external or not found.
+ */
+std::string Executor::findExecutable(const std::string& name) const {
+    if (!isExternal(Command{name, {}})) {
+        return "";
+    }
+    std::string executable = lookupPath(name);
+    return executable == name && name.find('/') == std::string::npos ? "" : executable;
+}
+
+/**
+ * @brief Gives a number that changes whenever the search path does, so lookups can be redone.
+ * @return size_t The number of changes of the search path.
+ */
+size_t Executor::searchPathVersion() const {
+    return searchPathChanges;
+}
+
+/**
+ * @brief Runs the lines of a batch script scheduled by their dependencies.
+ *
+ * SIGCHLD stays blocked while the lines run, so the handler does not reap the children of the scheduler.
+ * The lines get neither a placement nor limits, they are not jobs of the shell.
+ *
+ * @param batch The lines.
+ * @param workers Maximum number of lines running at once.
+ * @return int The exit status of the last line.
+ */
+int Executor::runBatch(BatchScheduler& batch, size_t workers) {
+    sigset_t childSignal;
+    sigset_t previousMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+
+    BatchScheduler::Hooks hooks;
+    hooks.print = [this](int fd) { dumpOutput(fd, capture); };
+    hooks.started = [this](pid_t pid, uint64_t start) { return startTimeout(pid, start); };
+    hooks.finished = [this](uint64_t id) { return timeouts.cancel(id); };
+    hooks.acquire = [this](const std::function<bool()>& alone) {
+        int token;
+        jobserver.acquire(token, alone);
+        return token;
+    };
+    hooks.release = [this](int token) { jobserver.giveBack(token); };
+
+    std::cout << std::flush;
+    int status = batch.run(workers, searchPath, variables.environment()->entries, hooks);
+
+    sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+    return exitStatus(status);
+}
+
+/**
+ * @brief Sets how long every external command may run before it is terminated.
+ * @param duration The time in nanoseconds, 0 for no limit.
+ */
+void Executor::setLineTimeout(uint64_t duration) {
+    lineTimeout = duration;
+}
+
+/**
+ * @brief Sets a deadline for all commands, after it they are terminated and new ones do not start.
+ * @param when Monotonic time of the deadline in nanoseconds, see Metrics::now().
+ */
+void Executor::setDeadline(uint64_t when) {
+    deadline = when;
+}
+
+/**
+ * @brief Checks if the deadline has passed.
+ * @return true if there is a deadline and it has passed.
+ */
+bool Executor::pastDeadline() const {
+    return deadline != 0 && Metrics::now() >= deadline;
+}
+
+/**
+ * @brief Gives the priority class of the jobs started without one of their own.
+ * @return JobPriority::Class The class.
+ */
+JobPriority::Class Executor::getPriority() const {
+    return jobPriority;
+}
+
+/**
+ * @brief Takes the class off a prio CLASS COMMAND [ARGS...] line, leaving the command.
+ * @param cmd The line, replaced by its command with the redirects and the & of the line.
+ * @return std::optional<JobPriority::Class> The class, nothing if the line is not such a prio call.
+ */
+std::optional<JobPriority::Class> Executor::unwrapPriority(Command& cmd) const {
+    using namespace std;
+
+    const string name = cmd.getName();
+    vector<string> args = cmd.getArgs();
+    if (name != "prio" || aliases.count(name) != 0 || functions.count(name) != 0 || args.size() < 2 ||
+        args[1].empty() || args[1].front() == '%') {
+        return nullopt;
+    }
+
+    JobPriority::Class priority;
+    try {
+        priority = JobPriority::parse(args[0]);
+    } catch (invalid_argument&) {
+        return nullopt;
+    }
+
+    Command prioritized{args[1], vector<string>{begin(args) + 2, end(args)}};
+    for (Command::Redirect& redirect : cmd.getRedirects()) {
+        prioritized.addRedirect(move(redirect));
+    }
+    prioritized.setParallel(cmd.isParallel());
+    cmd = move(prioritized);
+    return priority;
+}
+
+/**
+ * @brief Sets the deadline of an external command that has just started: its own timeout, the line timeout
+ * or the global deadline, whichever comes first.
+ *
+ * Safe to call from the threads of the batch scheduler, the settings are not changed while it runs.
+ *
+ * @param pgid The process group of the command.
+ * @param start When the command started.
+ * @return uint64_t The id of the deadline in the timeout queue, 0 if the command has none.
+ */
+uint64_t Executor::startTimeout(pid_t pgid, uint64_t start) {
+    uint64_t limit = commandTimeout ? start + *commandTimeout : lineTimeout != 0 ? start + lineTimeout : 0;
+    if (deadline != 0 && (limit == 0 || deadline < limit)) {
+        limit = deadline;
+    }
+    if (limit == 0) {
+        return 0;
+    }
+
+    try {
+        return timeouts.add(pgid, limit, commandTimeout ? commandGrace : TimeoutQueue::defaultGrace);
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << '\n';
+        return 0;
+    }
+}
+
+/**
+ * @brief Defines or redefines a function.
+ * @param name The function name.
+ * @param body The parsed body.
+ */
+void Executor::defineFunction(const std::string& name, std::shared_ptr<const SyntaxNode> body) {
+    functions[name] = std::move(body);
+}
+
+/**
+ * @brief Calls a function in the shell process, with the redirect of the call applied for the time.
+ *
+ * Nothing is forked: the redirected streams of the shell are pointed to the targets while the body runs and
+ * restored afterwards. A function cannot run in background, as that would need a process of its own.
+ *
+ * @param body The function body.
+ * @param cmd The call.
+ * @return int The exit status.
+ */
+int Executor::callFunction(const SyntaxNode& body, const Command& cmd) {
+    assert(functionHandler);
+
+    Metrics::add(Metrics::Counter::FunctionCalls);
+
+    std::optional<StreamRoute> route = routeRedirects(cmd);
+    if (!route) {
+        return 1;
+    }
+    if (cmd.isParallel()) {
+        std::cerr << cmd.getName() << ": functions cannot run in background\n";
+        releaseRoute(*route, true);
+        return 1;
+    }
+
+    // the streams of the shell are kept aside for the time of the call
+    std::array<int, 3> saved{-1, -1, -1};
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    for (int stream = 0; stream < 3; stream++) {
+        if (route->fds[stream] != -1) {
+            saved[stream] = fcntl(stream, F_DUPFD_CLOEXEC, 0);
+        }
+    }
+    applyRoute(*route);
+    releaseRoute(*route, false);
+
+    // a body whose output is redirected does not print into a capture around the call
+    std::string* outerCapture = capture;
+    if (saved[STDOUT_FILENO] != -1) {
+        capture = nullptr;
+    }
+
+    // the fan-outs finish once the streams are back, the SIGCHLD handler must not take them first
+    auto restore = [&]() {
+        sigset_t childSignal;
+        sigset_t previousMask;
+        sigemptyset(&childSignal);
+        sigaddset(&childSignal, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+
+        std::cout << std::flush;
+        std::cerr << std::flush;
+        for (int stream = 0; stream < 3; stream++) {
+            if (saved[stream] != -1) {
+                dup2(saved[stream], stream);
+                close(saved[stream]);
+            }
+        }
+        capture = outerCapture;
+        releaseRoute(*route, true);
+        sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+    };
+
+    int status;
+    try {
+        status = functionHandler(body, cmd);
+    } catch (...) {
+        restore();
+        throw;
+    }
+    restore();
+    return status;
+}
+
+/**
+ * @brief Sets the CPU placement policy for background jobs.
+ * @param spec The policy spec, see PlacementPolicy::configure().
+ * @throws std::invalid_argument if the spec is malformed.
+ */
+void Executor::setPlacement(const std::string& spec) {
+    jobPlacement.configure(spec);
+}
+
+/**
+ * @brief Sets the resource limits of jobs.
+ * @param spec The limits spec, see ResourceLimits::configure().
+ * @throws std::invalid_argument if the spec is malformed.
+ */
+void Executor::setLimits(const std::string& spec) {
+    jobLimits.configure(spec);
+}
+
+/**
+ * @brief Becomes the jobserver of the commands started by the shell, see Jobserver::serve().
+ *
+ * MAKEFLAGS is exported with the new jobserver, so make and shells started below take their tokens from it.
+ *
+ * @param slots The number of jobs that may run at once in the whole tree, at least 1.
+ * @throws std::runtime_error if the jobserver cannot be created.
+ */
+void Executor::serveJobs(size_t slots) {
+    const std::string* makeflags = variables.get("MAKEFLAGS");
+    std::string flags = jobserver.serve(slots, makeflags != nullptr ? *makeflags : "");
+    variables.set("MAKEFLAGS", std::move(flags));
+    variables.exportVariable("MAKEFLAGS");
+}
+
+/**
+ * @brief Selects the engine for the file operations of the shell.
+ * @param name "sync" or "uring".
+ * @throws std::invalid_argument if the name is unknown.
+ */
+void Executor::setIoEngine(const std::string& name) {
+    ioEngine.select(name);
+}
+
+/**
+ * @brief Opens the redirect targets of all external commands of a line in one batch, ahead of the spawns.
+ *
+ * With many jobs on a line writing to a slow file system, the opens no longer stall one spawn after another,
+ * the engine issues them together. Targets left over from the previous line are closed.
+ *
+ * @param commands The commands of the line.
+ */
+void Executor::prepareRedirects(const std::vector<std::unique_ptr<Command>>& commands) {
+    for (auto& [command, fds] : preparedRedirects) {
+        closeAll(fds);
+    }
+    preparedRedirects.clear();
+
+    std::vector<std::pair<const Command*, Command::Redirect>> targets;
+    std::vector<IoEngine::OpenRequest> requests;
+    for (const auto& command : commands) {
+        if (isBuiltin(*command)) {
+            continue;
+        }
+        for (Command::Redirect& redirect : command->getRedirects()) {
+            requests.push_back(redirectRequest(redirect));
+            targets.emplace_back(command.get(), std::move(redirect));
+        }
+    }
+    if (requests.empty()) {
+        return;
+    }
+
+    std::vector<int> opened = ioEngine.openAll(requests);
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (opened[i] < 0) {
+            std::cerr << "file redirection failed: " << requests[i].path << ": " << strerror(-opened[i]) << '\n';
+        } else {
+            preallocate(opened[i], targets[i].second);
+        }
+        preparedRedirects[targets[i].first].push_back(opened[i] < 0 ? -1 : opened[i]);
+    }
+}
+
+/**
+ * @brief Takes the opened redirect targets of a command, opening them now if they were not prepared.
+ * @param cmd The command.
+ * @return std::vector<int> A descriptor for every redirection of the command, -1 if it cannot be opened.
+ */
+std::vector<int> Executor::takeRedirects(const Command& cmd) {
+    auto prepared = preparedRedirects.find(&cmd);
+    if (prepared != end(preparedRedirects)) {
+        std::vector<int> fds = std::move(prepared->second);
+        preparedRedirects.erase(prepared);
+        return fds;
+    }
+
+    std::vector<int> fds;
+    for (const Command::Redirect& redirect : cmd.getRedirects()) {
+        fds.push_back(openRedirect(redirect));
+    }
+    return fds;
+}
+
+/**
+ * @brief Opens a redirect target now.
+ * @param redirect The redirection.
+ * @return int The descriptor, -1 if the target cannot be opened (the error is printed).
+ */
+int Executor::openRedirect(const Command::Redirect& redirect) {
+    IoEngine::OpenRequest request = redirectRequest(redirect);
+    int fd = open(request.path.c_str(), request.flags, request.mode);
+    if (fd == -1) {
+        std::cerr << "file redirection failed: " << request.path << ": " << strerror(errno) << '\n';
+        return -1;
+    }
+    preallocate(fd, redirect);
+    return fd;
+}
+
+/**
+ * @brief Reserves space for the output written to a redirect target, if REDIRECT_SIZE_HINT is set.
+ *
+ * The blocks are allocated past the end of the file without changing its size (FALLOC_FL_KEEP_SIZE), so
+ * a log written in small pieces is not fragmented and a full disk shows up before the command runs. File
+ * systems without fallocate() just skip the hint.
+ *
+ * @param fd The opened target.
+ * @param redirect The redirection.
+ */
+void Executor::preallocate(int fd, const Command::Redirect& redirect) {
+    const std::string* hint = variables.get("REDIRECT_SIZE_HINT");
+    if (hint == nullptr || hint->empty() || redirect.stream == Command::Redirect::Stream::Input) {
+        return;
+    }
+
+    long long size;
+    try {
+        size = utils::StringUtils::parseSize(*hint);
+    } catch (std::invalid_argument& e) {
+        std::cerr << "REDIRECT_SIZE_HINT: " << e.what() << '\n';
+        return;
+    }
+
+    off_t offset = redirect.append ? lseek(fd, 0, SEEK_END) : 0;
+    if (size > 0 && offset != -1) {
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, size);
+    }
+}
+
+/**
+ * @brief Takes the redirect targets of a command and decides where its streams go.
+ *
+ * The last < of the command is its stdin. An output stream with a single target writes to it directly, one
+ * with more targets writes to an OutputFanOut process copying it to all of them. stdout and stderr with the
+ * same targets (&> only) share the process.
+ *
+ * @param cmd The command.
+ * @return std::optional<StreamRoute> The route, std::nullopt if a target cannot be opened.
+ */
+std::optional<Executor::StreamRoute> Executor::routeRedirects(const Command& cmd) {
+    using namespace std;
+    using Stream = Command::Redirect::Stream;
+
+    vector<int> fds = takeRedirects(cmd);
+    if (find(begin(fds), end(fds), -1) != end(fds)) {
+        closeAll(fds);
+        return nullopt;
+    }
+
+    StreamRoute route;
+    route.owned = fds;
+
+    vector<Command::Redirect> redirects = cmd.getRedirects();
+    vector<int> outputTargets;
+    vector<int> errorTargets;
+    for (size_t i = 0; i < redirects.size(); i++) {
+        Stream stream = redirects[i].stream;
+        if (stream == Stream::Input) {
+            route.fds[STDIN_FILENO] = fds[i];
+        }
+        if (stream == Stream::Output || stream == Stream::OutputAndError) {
+            outputTargets.push_back(fds[i]);
+        }
+        if (stream == Stream::Error || stream == Stream::OutputAndError) {
+            errorTargets.push_back(fds[i]);
+        }
+    }
+
+    try {
+        for (int stream : {STDOUT_FILENO, STDERR_FILENO}) {
+            const vector<int>& targets = stream == STDOUT_FILENO ? outputTargets : errorTargets;
+            if (targets.size() == 1) {
+                route.fds[stream] = targets.front();
+            } else if (stream == STDERR_FILENO && targets == outputTargets && !targets.empty()) {
+                route.fds[stream] = route.fds[STDOUT_FILENO];
+            } else if (!targets.empty()) {
+                int writeEnd;
+                registerSignalHangler();
+                route.fanOuts.push_back(OutputFanOut::start(targets, writeEnd));
+                route.owned.push_back(writeEnd);
+                route.fds[stream] = writeEnd;
+            }
+        }
+    } catch (runtime_error& e) {
+        cerr << e.what() << '\n';
+        releaseRoute(route, true);
+        return nullopt;
+    }
+    return route;
+}
+
+/**
+ * @brief Points the standard streams to the route, only calls dup2() so it is safe in a forked child.
+ * @param route The route.
+ */
+void Executor::applyRoute(const StreamRoute& route) {
+    for (int stream = 0; stream < 3; stream++) {
+        if (route.fds[stream] != -1 && dup2(route.fds[stream], stream) == -1) {
+            perror("file redirection failed");
+        }
+    }
+}
+
+/**
+ * @brief Closes the descriptors of a route once the command has them.
+ * @param route The route.
+ * @param wait Also wait for the fan-out processes, i.e. until all the output is in the targets.
+ */
+void Executor::releaseRoute(StreamRoute& route, bool wait) {
+    closeAll(route.owned);
+    route.owned.clear();
+    if (!wait) {
+        return;
+    }
+
+    // a fan-out reaped by the SIGCHLD handler already finished
+    for (pid_t pid : route.fanOuts) {
+        while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR) {
+        }
+    }
+    route.fanOuts.clear();
+}
+
+/**
+ * @brief Checks if a command is a builtin command.
+ * @param cmd The command to check.
+ * @return true if the command is builtin, false otherwise.
+ */
+bool Executor::isBuiltin(const Command& cmd) {
+    return builtinCommands.find(cmd.getName()) != end(builtinCommands);
+}
+
+/**
+ * @brief Executes a builtin command.
+ * @param cmd The builtin command to execute.
+ * @return int The exit status.
+ * @throws std::invalid_argument if the command is not a known builtin.
+ */
+int Executor::executeBuiltin(const Command& cmd) {
+    auto builtin = builtinCommands.find(cmd.getName());
+    if (builtin == end(builtinCommands)) {
+        throw std::invalid_argument("unknown builtin command");
+    }
+
+    Metrics::add(Metrics::Counter::BuiltinsRun);
+
+    BuiltinFunction function = builtin->second;
+    const std::vector<std::string>& args = cmd.getArgs();
+
+    // a captured builtin prints into the buffer, nothing is forked
+    std::optional<CaptureBuffer> captured;
+    std::streambuf* printing = nullptr;
+    if (capture != nullptr) {
+        captured.emplace(*capture);
+        printing = std::cout.rdbuf(&*captured);
+    }
+
+    builtinCommand = &cmd;
+    int status;
+    try {
+        status = (this->*function)(args);
+    } catch (...) {
+        builtinCommand = nullptr;
+        if (printing != nullptr) {
+            std::cout.rdbuf(printing);
+        }
+        throw;
+    }
+    builtinCommand = nullptr;
+    if (printing != nullptr) {
+        std::cout.rdbuf(printing);
+    }
+    return status;
+}
+
+/**
+ * @brief Sets a shell variable if the command is a bare NAME=VALUE assignment.
+ * @param cmd The command to check.
+ * @return true if the command was an assignment.
+ */
+bool Executor::assignVariable(const Command& cmd) {
+    const std::string name = cmd.getName();
+    size_t separator = name.find('=');
+    if (separator == std::string::npos || !cmd.getArgs().empty() ||
+        !Variables::isValidName(std::string_view{name}.substr(0, separator))) {
+        return false;
+    }
+
+    variables.set(name.substr(0, separator), name.substr(separator + 1));
+    return true;
+}
+
+/**
+ * @brief Executes an external command by forking and exec'ing.
+ * @param cmd The external command to execute.
+ * @return int The exit status, 0 for a command sent to background.
+ * @throws std::runtime_error if fork fails.
+ */
+int Executor::executeExternal(const Command& cmd) {
+    using namespace std;
+
+    if (pastDeadline()) {
+        cerr << cmd.getName() << ": deadline passed, not started" << '\n';
+        return timedOutStatus;
+    }
+
+    // a background job waits for a slot of the jobserver, the jobs of the shell that finish meanwhile give
+    // theirs back
+    int token = Jobserver::noToken;
+    if (cmd.isParallel() && !jobserver.acquire(token, [this]() {
+            collectReaped();
+            return pastDeadline();
+        })) {
+        cerr << cmd.getName() << ": deadline passed, not started" << '\n';
+        return timedOutStatus;
+    }
+
+    // the targets are opened by the parent (close-on-exec), the child only duplicates them
+    optional<StreamRoute> route = routeRedirects(cmd);
+    if (!route) {
+        jobserver.giveBack(token);
+        return 1;
+    }
+
+    // a captured foreground command prints into a pipe of its own, read until its end
+    int captureFd = -1;
+    if (capture != nullptr && !cmd.isParallel() && !cmd.isRedirected(Command::Redirect::Stream::Output)) {
+        int ends[2];
+        if (pipe2(ends, O_CLOEXEC) == -1) {
+            cerr << cmd.getName() << ": pipe: " << strerror(errno) << '\n';
+            releaseRoute(*route, true);
+            return 1;
+        }
+        fcntl(ends[1], F_SETPIPE_SZ, capturePipeSize);
+        captureFd = ends[0];
+        route->fds[STDOUT_FILENO] = ends[1];
+        route->owned.push_back(ends[1]);
+    }
+
+    // background jobs print through the multiplexer, unless their output goes to files anyway
+    int jobId = 0;
+    pair<int, int> captureFds{-1, -1};
+    PlacementPolicy::Assignment assignment{};
+    assignment.slot = -1;
+    if (cmd.isParallel()) {
+        jobId = jobTable.reserveId();
+        assignment = jobPlacement.assign();
+        if (!cmd.isRedirected(Command::Redirect::Stream::Output) ||
+            !cmd.isRedirected(Command::Redirect::Stream::Error)) {
+            captureFds = backgroundOutput.capture(jobId);
+        }
+    }
+
+    // SIGCHLD stays blocked until the child is either in the job table or waited for, otherwise the
+    // handler could reap it first and its status would be lost
+    sigset_t childSignal;
+    sigset_t previousMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+
+    uint64_t start = Metrics::now();
+    pid_t pid = spawnExternal(cmd, !cmd.isParallel(), captureFds, *route, assignment, previousMask);
+    int spawnError = errno;
+    Metrics::record(Metrics::Histogram::SpawnLatency, Metrics::now() - start);
+    Metrics::add(pid < 0 ? Metrics::Counter::SpawnFailures : Metrics::Counter::CommandsSpawned);
+    StartupProfile::mark(StartupProfile::Phase::Exec);
+
+    if (captureFds.first != -1) {
+        close(captureFds.first);
+        close(captureFds.second);
+    }
+    releaseRoute(*route, pid < 0);
+
+    if (pid < 0) {
+        // if fork did not succeed
+        if (captureFd != -1) {
+            close(captureFd);
+        }
+        jobserver.giveBack(token);
+        sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+        throw runtime_error("fork: "s + strerror(spawnError));
+    }
+    uint64_t timeout = startTimeout(pid, start);
+
+    // we do not wait for child if the process is run in background
+    if (cmd.isParallel()) {
+        jobTable.add(jobId, pid, cmd.toString());
+        jobPlacement.commit(pid, assignment);
+        jobserver.commit(pid, token);
+        if (timeout != 0) {
+            jobTimeouts.emplace(pid, timeout);
+        }
+        sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+
+        std::cout << "[" << jobId << "]"
+                  << "[" << cmd.getName() << "]"
+                  << "[" << pid << "]"
+                  << " pushed to background" << endl;
+        return 0;
+    }
+
+    // otherwise wait, a stopped command becomes a job, and its output is complete once the fan-outs are done
+    int status = waitForeground(pid, false, captureFd);
+    if (captureFd != -1) {
+        close(captureFd);
+    }
+    releaseRoute(*route, !WIFSTOPPED(status));
+    Metrics::record(Metrics::Histogram::CommandDuration, Metrics::now() - start);
+    if (WIFSTOPPED(status)) {
+        Job& job = jobTable.add(jobTable.reserveId(), pid, cmd.toString());
+        job.state = Job::State::Stopped;
+        if (timeout != 0) {
+            jobTimeouts.emplace(pid, timeout);
+        }
+        std::cout << "\n[" << job.id << "] Stopped " << job.commandLine << endl;
+    } else {
+        jobLimits.release(pid);
+        if (timeouts.cancel(timeout)) {
+            cerr << cmd.getName() << ": timed out" << '\n';
+            sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+            return timedOutStatus;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+    return exitStatus(status);
+}
+
+/**
+ * @brief Spawns an external command in a process group of its own, SIGCHLD must be blocked by the caller.
+ * @param cmd The command.
+ * @param foreground Give the terminal to the command.
+ * @param outputFds Descriptors to use as stdout and stderr, -1 to keep the ones of the shell.
+ * @param route The redirections of the command, applied over outputFds.
+ * @param placement CPUs the command runs on.
+ * @param childMask Signal mask the command starts with.
+ * @return pid_t The pid of the command, -1 if the spawn failed (errno is set).
+ */
+pid_t Executor::spawnExternal(const Command& cmd, bool foreground, std::pair<int, int> outputFds,
+                              const StreamRoute& route, const PlacementPolicy::Assignment& placement,
+                              const sigset_t& childMask) {
+    using namespace std;
 
-/// @brief Constructs an Executor and registers the SIGCHLD signal handler to reap exited children.
-Executor::Executor() {
     registerSignalHangler();
+
+    // the exec image is prepared before the spawn, the child only makes async-signal-safe calls
+    string executableName = lookupPath(cmd.getName());
+    vector<string> commandArgs(cmd.getArgs());
+
+    // transforming args to c-like style (char**)
+    vector<char*> executableArgs;
+    executableArgs.reserve(commandArgs.size() + 2);
+
+    executableArgs.push_back(const_cast<char*>(executableName.c_str()));
+    for (const string& arg : commandArgs) {
+        executableArgs.push_back(const_cast<char*>(arg.c_str()));
+    }
+    executableArgs.push_back(nullptr);  // null terminator
+
+    // the block is shared with later spawns until an exported variable changes
+    shared_ptr<const Variables::Environment> environment = variables.environment();
+
+    ResourceLimits::Assignment limits = jobLimits.prepare();
+    JobPriority::Class priority = commandPriority.value_or(jobPriority);
+
+    pid_t pid = ResourceLimits::spawn(limits);
+
+    if (pid == 0) {
+        // child actions
+
+        // every job gets its own process group, a foreground one gets the terminal as well
+        setpgid(0, 0);
+        if (foreground) {
+            giveTerminal(getpid());
+        }
+        for (int signum : jobControlSignals) {
+            signal(signum, SIG_DFL);
+        }
+        sigprocmask(SIG_SETMASK, &childMask, nullptr);
+        PlacementPolicy::apply(placement);
+        ResourceLimits::apply(limits);
+        JobPriority::apply(priority);
+
+        // handling redirect
+        if (outputFds.first != -1) {
+            dup2(outputFds.first, STDOUT_FILENO);
+            dup2(outputFds.second, STDERR_FILENO);
+        }
+        applyRoute(route);
+
+        // executing the command
+        execve(executableName.c_str(), executableArgs.data(), environment->envp.data());
+
+        // if this code was reached, exec failed -> error
+        std::perror("error executing the command");
+        _exit(127);
+    }
+
+    int spawnError = errno;
+    jobLimits.commit(pid, limits);
+
+    if (pid < 0) {
+        errno = spawnError;
+        return -1;
+    }
+
+    // parent actions
+    setpgid(pid, pid);
+    return pid;
+}
+
+/**
+ * @brief Waits for a foreground process group, giving it the terminal for the time.
+ * @param pgid The process group, its leader is waited for.
+ * @param resume Send SIGCONT to the group before waiting.
+ * @param captureFd Pipe read into the capture buffer until its end before waiting, -1 for none.
+ * @return int The wait status of the group leader.
+ */
+int Executor::waitForeground(pid_t pgid, bool resume, int captureFd) {
+    giveTerminal(pgid);
+    if (resume) {
+        ::kill(-pgid, SIGCONT);
+    }
+    if (captureFd != -1) {
+        readAll(captureFd, *capture);
+    }
+
+    int status = 0;
+    while (waitpid(pgid, &status, WUNTRACED) == -1 && errno == EINTR) {
+    }
+
+    giveTerminal(getpgrp());
+    return status;
+}
+
+/**
+ * @brief Makes the process group the foreground group of the terminal, if the shell controls one.
+ * @param pgid The process group.
+ */
+void Executor::giveTerminal(pid_t pgid) const {
+    if (ownsTerminal) {
+        tcsetpgrp(STDIN_FILENO, pgid);
+    }
+}
+
+/**
+ * @brief Registers the SIGCHLD signal handler to reap child processes, the first call only.
+ */
+void Executor::registerSignalHangler() {
+    if (reaping) {
+        return;
+    }
+    reaping = true;
+
+    struct sigaction signalAction {};
+    signalAction.sa_handler = reapChildren;
+    sigemptyset(&signalAction.sa_mask);
+    signalAction.sa_flags = SA_RESTART;
+
+    if (sigaction(SIGCHLD, &signalAction, nullptr) == -1) {
+        perror("sigactoi");
+    }
+}
+
+/**
+ * @brief Signal handler to reap terminated child processes.
+ *
+ * Runs on the shell thread only: every other thread starts with all signals blocked, so the handler is the
+ * single writer of reapedChildren. Only async-signal-safe calls are made, collectReaped() prints the notices.
+ *
+ * @param signum The signal number (unused).
+ */
+void Executor::reapChildren(int signum) {
+    assert(signum == SIGCHLD);
+
+    int savedErrno = errno;
+
+    pid_t currPid;
+    int status;
+    while ((currPid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+        // the statuses are handed over to collectReaped(), the handler is the only writer
+        size_t head = reapedHead.load(std::memory_order_relaxed);
+        if (head - reapedTail.load(std::memory_order_acquire) < reapedCapacity) {
+            reapedChildren[head % reapedCapacity] = {currPid, status};
+            reapedHead.store(head + 1, std::memory_order_release);
+        } else {
+            reapedOverflow.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    errno = savedErrno;
+}
+
+/**
+ * @brief Passes the statuses collected by the signal handler to the job table and the coprocess pools.
+ *
+ * A coprocess worker that exited is replaced by its pool here, so a dead worker is back before the next
+ * command runs. The reap notices are printed here too, on the shell thread between two commands, so they
+ * do not split the lines of the jobs the multiplexer prints.
+ */
+void Executor::collectReaped() {
+    size_t head = reapedHead.load(std::memory_order_acquire);
+    for (size_t tail = reapedTail.load(std::memory_order_relaxed); tail != head; tail++) {
+        const ChildStatus& child = reapedChildren[tail % reapedCapacity];
+        bool exited = !WIFSTOPPED(child.status) && !WIFCONTINUED(child.status);
+        if (jobTable.update(child.pid, child.status) == nullptr && exited) {
+            jobLimits.release(child.pid);
+            for (auto& [name, pool] : coprocs) {
+                if (pool->exited(child.pid)) {
+                    break;
+                }
+            }
+        }
+        if (exited) {
+            Metrics::add(Metrics::Counter::ChildrenReaped);
+            std::cout << "Reaped chiled with pid: " << child.pid << '\n' << std::flush;
+        }
+    }
+    reapedTail.store(head, std::memory_order_release);
+
+    if (!reapedOverflow.exchange(false)) {
+        return;
+    }
+
+    // some statuses were dropped, the jobs whose processes are gone are done with an unknown status
+    std::vector<Job*> gone;
+    for (auto& [id, job] : jobTable) {
+        pollfd exited{job.pidfd, POLLIN, 0};
+        if (job.state != Job::State::Done && job.pidfd != -1 && poll(&exited, 1, 0) == 1) {
+            gone.push_back(&job);
+        }
+    }
+    for (Job* job : gone) {
+        jobTable.finish(*job, -1);
+    }
+}
+
+/// @brief Publishes the numbers of running and stopped jobs to the metrics.
+void Executor::publishJobCounts() {
+    int64_t running = 0;
+    int64_t stopped = 0;
+    for (const auto& [id, job] : jobTable) {
+        running += job.state == Job::State::Running;
+        stopped += job.state == Job::State::Stopped;
+    }
+    Metrics::set(Metrics::Gauge::RunningJobs, running);
+    Metrics::set(Metrics::Gauge::StoppedJobs, stopped);
+}
+
+/**
+ * @brief Map of builtin command names to their corresponding member function pointers.
+ */
+const std::unordered_map<std::string_view, Executor::BuiltinFunction> Executor::builtinCommands = {
+    {"cd", &Executor::cd},
+    {"exit", &Executor::exit},
+    {"path", &Executor::path},
+    {"jobs", &Executor::jobs},
+    {"wait", &Executor::wait},
+    {"fg", &Executor::fg},
+    {"bg", &Executor::bg},
+    {"kill", &Executor::kill},
+    {"placement", &Executor::placement},
+    {"limits", &Executor::limits},
+    {"ioengine", &Executor::ioengine},
+    {"export", &Executor::exportVariables},
+    {"unset", &Executor::unset},
+    {"alias", &Executor::alias},
+    {"unalias", &Executor::unalias},
+    {"batchargs", &Executor::batchargs},
+    {"foreach", &Executor::foreach},
+    {"copy", &Executor::copy},
+    {"stats", &Executor::stats},
+    {"timeout", &Executor::timeout},
+    {"prio", &Executor::prio},
+    {"coproc", &Executor::coproc},
+    {"request", &Executor::request},
+};
+
+/**
+ * @brief Changes the current working directory.
+ * @param cmd Arguments for the cd command (expects exactly one argument).
+ * @return int The exit status.
+ */
+int Executor::cd(const Args& cmd) {
+    if (cmd.size() != 1) {
+        std::cerr << "cd: wrong number of arguments\n";
+        return 1;
+    }
+
+    if (chdir(cmd[0].c_str()) != 0) {
+        std::perror("cd");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sets the executable search path.
+ * @param cmd Arguments for the path command (list of absolute paths).
+ * @return int The exit status.
+ */
+int Executor::path(const Args& cmd) {
+    searchPathChanges++;
+    if (cmd.empty()) {
+        searchPath.clear();
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 0; i < cmd.size(); i++) {
+        const std::string& path = cmd[i];
+
+        if (path.empty() || path.front() != '/' || path.back() == '/') {
+            std::cerr << "path: invalid path at " << i << " position (ignored)\n";
+            status = 1;
+            continue;
+        }
+
+        searchPath.push_back(path);
+    }
+    return status;
+}
+
+/**
+ * @brief Exits the shell.
+ * @param cmd Optional exit status (0-255), 0 if empty.
+ * @return int 1 if the arguments are wrong, otherwise it does not return.
+ */
+int Executor::exit(const Args& cmd) {
+    if (cmd.size() > 1 || (!cmd.empty() && (cmd[0].empty() || cmd[0].size() > 3 ||
+                                            cmd[0].find_first_not_of("0123456789") != std::string::npos))) {
+        std::cerr << "exit: wrong arguments\n";
+        return 1;
+    }
+
+    std::cout << "Exiting...\n" << std::flush;
+    std::exit(cmd.empty() ? 0 : std::stoi(cmd[0]) & 0xff);
+}
+
+/**
+ * @brief Lists the jobs and forgets the finished ones.
+ * @param cmd Arguments for the jobs command (expects none).
+ * @return int The exit status.
+ */
+int Executor::jobs(const Args& cmd) {
+    if (!cmd.empty()) {
+        std::cerr << "jobs: wrong number of arguments\n";
+        return 1;
+    }
+
+    std::vector<int> reported;
+    for (auto& [id, job] : jobTable) {
+        std::cout << "[" << id << "] " << job.pid << " " << describeState(job) << " " << job.commandLine;
+        if (job.cpuUsec >= 0) {
+            std::cout << " (cpu " << job.cpuUsec / 1000 << "ms";
+            if (job.memoryPeak >= 0) {
+                std::cout << ", memory peak " << job.memoryPeak / 1024 << "K";
+            }
+            std::cout << ")";
+        }
+        std::cout << '\n';
+        if (job.state == Job::State::Done) {
+            reported.push_back(id);
+        }
+    }
+    std::cout << std::flush;
+
+    for (int id : reported) {
+        jobTable.remove(id);
+    }
+    return 0;
+}
+
+/**
+ * @brief Waits until the given jobs finish.
+ *
+ * The jobs are waited for with epoll on their pidfds, so any subset of jobs is waited for exactly without
+ * polling. SIGCHLD is blocked for the time, so the handler cannot reap the jobs and they are reaped here.
+ *
+ * @param cmd Job specs to wait for, all jobs if empty.
+ * @return int The exit status.
+ */
+int Executor::wait(const Args& cmd) {
+    sigset_t childSignal;
+    sigset_t previousMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+
+    collectReaped();
+
+    int result = 0;
+    // jobs are kept by number, finish() may drop the records of other done jobs from the table
+    std::vector<int> targets;
+    if (cmd.empty()) {
+        for (auto& [id, job] : jobTable) {
+            targets.push_back(id);
+        }
+    }
+    for (const std::string& spec : cmd) {
+        Job* job = resolveJob(spec);
+        if (job == nullptr) {
+            std::cerr << "wait: no such job " << spec << '\n';
+            result = 127;
+            continue;
+        }
+        if (std::find(begin(targets), end(targets), job->id) == end(targets)) {
+            targets.push_back(job->id);
+        }
+    }
+
+    // the status of the last job is taken when it finishes, its record may be gone by the end
+    int lastStatus = -1;
+    bool lastDone = false;
+    auto finished = [&](Job& job, int status) {
+        jobTable.finish(job, status);
+        if (!targets.empty() && job.id == targets.back()) {
+            lastStatus = job.status;
+            lastDone = true;
+        }
+    };
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    std::unordered_map<int, int> pending;
+    for (int id : targets) {
+        Job* job = jobTable.find(id);
+        if (job == nullptr) {
+            continue;
+        }
+        if (job->state == Job::State::Stopped) {
+            std::cerr << "wait: job " << job->id << " is stopped\n";
+            result = 1;
+            continue;
+        }
+        if (job->state == Job::State::Done) {
+            if (id == targets.back()) {
+                lastStatus = job->status;
+                lastDone = true;
+            }
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = job->pidfd;
+        if (epollFd != -1 && job->pidfd != -1 && epoll_ctl(epollFd, EPOLL_CTL_ADD, job->pidfd, &event) == 0) {
+            pending.emplace(job->pidfd, id);
+        } else {
+            // no pidfd, waiting for this one alone; its pidfd is not registered, finish() may close it
+            int status = 0;
+            while (waitpid(job->pid, &status, 0) == -1 && errno == EINTR) {
+            }
+            finished(*job, status);
+        }
+    }
+
+    const int maxEvents = 64;
+    epoll_event events[maxEvents];
+    while (!pending.empty()) {
+        int ready = epoll_wait(epollFd, events, maxEvents, -1);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::perror("wait");
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            auto found = pending.find(events[i].data.fd);
+            if (found == end(pending)) {
+                continue;
+            }
+
+            // unregistered before finish() closes the pidfd, the number may be reused by the next pidfd
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, found->first, nullptr);
+            Job* job = jobTable.find(found->second);
+            pending.erase(found);
+            if (job == nullptr) {
+                continue;
+            }
+
+            int status = -1;
+            if (waitpid(job->pid, &status, WNOHANG) <= 0) {
+                status = -1;
+            }
+            finished(*job, status);
+        }
+    }
+
+    if (epollFd != -1) {
+        close(epollFd);
+    }
+
+    // like in sh, waiting for given jobs gives the status of the last one
+    if (!cmd.empty() && result == 0 && lastDone) {
+        result = exitStatus(lastStatus);
+    }
+
+    for (int id : targets) {
+        Job* job = jobTable.find(id);
+        if (job != nullptr && job->state == Job::State::Done) {
+            jobTable.remove(id);
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+    return result;
+}
+
+/**
+ * @brief Continues a job in foreground and waits for it.
+ * @param cmd Job spec, the latest job if empty.
+ * @return int The exit status.
+ */
+int Executor::fg(const Args& cmd) {
+    if (cmd.size() > 1) {
+        std::cerr << "fg: wrong number of arguments\n";
+        return 1;
+    }
+
+    Job* job = cmd.empty() ? jobTable.latest() : resolveJob(cmd[0]);
+    if (job == nullptr || job->state == Job::State::Done) {
+        std::cerr << "fg: no such job\n";
+        return 1;
+    }
+
+    sigset_t childSignal;
+    sigset_t previousMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+
+    std::cout << job->commandLine << std::endl;
+
+    int status = waitForeground(job->pid, true, -1);
+    if (WIFSTOPPED(status)) {
+        job->state = Job::State::Stopped;
+        std::cout << "\n[" << job->id << "] Stopped " << job->commandLine << std::endl;
+    } else {
+        jobTable.finish(*job, status);
+        jobTable.remove(job->id);
+    }
+
+    sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+    return exitStatus(status);
+}
+
+/**
+ * @brief Continues a stopped job in background.
+ * @param cmd Job spec, the latest job if empty.
+ * @return int The exit status.
+ */
+int Executor::bg(const Args& cmd) {
+    if (cmd.size() > 1) {
+        std::cerr << "bg: wrong number of arguments\n";
+        return 1;
+    }
+
+    Job* job = cmd.empty() ? jobTable.latest() : resolveJob(cmd[0]);
+    if (job == nullptr || job->state == Job::State::Done) {
+        std::cerr << "bg: no such job\n";
+        return 1;
+    }
+
+    if (::kill(-job->pid, SIGCONT) == -1) {
+        std::perror("bg");
+        return 1;
+    }
+
+    job->state = Job::State::Running;
+    std::cout << "[" << job->id << "] " << job->commandLine << " &" << std::endl;
+    return 0;
+}
+
+/**
+ * @brief Sends a signal to jobs or processes.
+ *
+ * A job spec signals the whole process group of the job, a stopped job is continued afterwards so it can
+ * handle the signal.
+ *
+ * @param cmd Optional -SIGNAL (name or number) followed by job specs or pids.
+ * @return int The exit status.
+ */
+int Executor::kill(const Args& cmd) {
+    int signum = SIGTERM;
+    auto target = begin(cmd);
+
+    if (target != end(cmd) && target->size() > 1 && target->front() == '-') {
+        std::string name = target->substr(1);
+        if (name.rfind("SIG", 0) == 0) {
+            name = name.substr(3);
+        }
+
+        auto found = signalNames.find(name);
+        if (found != end(signalNames)) {
+            signum = found->second;
+        } else if (name.find_first_not_of("0123456789") == std::string::npos) {
+            signum = std::stoi(name);
+        } else {
+            std::cerr << "kill: unknown signal " << *target << '\n';
+            return 1;
+        }
+        target++;
+    }
+
+    if (target == end(cmd)) {
+        std::cerr << "kill: wrong number of arguments\n";
+        return 1;
+    }
+
+    int status = 0;
+    for (; target != end(cmd); target++) {
+        if (target->empty() || target->front() != '%') {
+            if (target->empty() || target->find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "kill: invalid pid " << *target << '\n';
+                status = 1;
+            } else if (::kill(std::stoi(*target), signum) == -1) {
+                std::perror("kill");
+                status = 1;
+            }
+            continue;
+        }
+
+        Job* job = resolveJob(*target);
+        if (job == nullptr || job->state == Job::State::Done) {
+            std::cerr << "kill: no such job " << *target << '\n';
+            status = 1;
+            continue;
+        }
+
+        if (::kill(-job->pid, signum) == -1) {
+            std::perror("kill");
+            status = 1;
+            continue;
+        }
+        if (job->state == Job::State::Stopped && signum != SIGSTOP && signum != SIGTSTP) {
+            ::kill(-job->pid, SIGCONT);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Shows or sets the CPU placement policy for background jobs.
+ * @param cmd The policy spec (e.g. round-robin:2:numa), the current policy is printed if empty.
+ * @return int The exit status.
+ */
+int Executor::placement(const Args& cmd) {
+    if (cmd.size() > 1) {
+        std::cerr << "placement: wrong number of arguments\n";
+        return 1;
+    }
+
+    if (cmd.empty()) {
+        std::cout << jobPlacement.describe() << std::endl;
+        return 0;
+    }
+
+    try {
+        jobPlacement.configure(cmd[0]);
+    } catch (std::invalid_argument& e) {
+        std::cerr << "placement: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Shows or sets the resource limits of jobs.
+ * @param cmd The limits spec (e.g. memory=512M:cpu=50%:pids=64), the current limits are printed if empty.
+ * @return int The exit status.
+ */
+int Executor::limits(const Args& cmd) {
+    if (cmd.size() > 1) {
+        std::cerr << "limits: wrong number of arguments\n";
+        return 1;
+    }
+
+    if (cmd.empty()) {
+        std::cout << jobLimits.describe() << std::endl;
+        return 0;
+    }
+
+    try {
+        jobLimits.configure(cmd[0]);
+    } catch (std::invalid_argument& e) {
+        std::cerr << "limits: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Exports variables, optionally setting them.
+ * @param cmd NAME or NAME=VALUE entries, the exported variables are printed if empty.
+ * @return int The exit status.
+ */
+int Executor::exportVariables(const Args& cmd) {
+    if (cmd.empty()) {
+        for (const auto& [name, variable] : variables) {
+            if (variable.exported) {
+                std::cout << "export " << name << "=\"" << variable.value << "\"\n";
+            }
+        }
+        std::cout << std::flush;
+        return 0;
+    }
+
+    int status = 0;
+    for (const std::string& entry : cmd) {
+        size_t separator = entry.find('=');
+        std::string name = entry.substr(0, separator);
+        try {
+            if (separator != std::string::npos) {
+                variables.set(name, entry.substr(separator + 1));
+            }
+            variables.exportVariable(name);
+        } catch (std::invalid_argument& e) {
+            std::cerr << "export: " << e.what() << '\n';
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Removes variables, or functions with -f.
+ * @param cmd Optional -f followed by the names.
+ * @return int The exit status.
+ */
+int Executor::unset(const Args& cmd) {
+    bool removeFunctions = !cmd.empty() && cmd.front() == "-f";
+    for (auto name = begin(cmd) + (removeFunctions ? 1 : 0); name != end(cmd); name++) {
+        if (removeFunctions) {
+            functions.erase(*name);
+        } else {
+            variables.unset(*name);
+        }
+    }
+    return 0;
 }
 
 /**
- * @brief Executes a command, dispatching to either a builtin or external handler.
- * @param cmd The command to execute.
+ * @brief Defines or prints aliases.
+ *
+ * The value of an alias is split into words here, respecting quotes, so using the alias costs a lookup.
+ * Variables in the value are not expanded.
+ *
+ * @param cmd NAME=VALUE or NAME entries, all aliases are printed (sorted) if empty.
+ * @return int The exit status.
  */
-void Executor::execute(Command& cmd) {
-    if (isBuiltin(cmd)) {
-        executeBuiltin(cmd);
-    } else {
-        executeExternal(cmd);
+int Executor::alias(const Args& cmd) {
+    auto print = [](const std::string& name, const Alias& alias) {
+        std::cout << "alias " << name << "='" << alias.value << "'\n";
+    };
+
+    if (cmd.empty()) {
+        std::map<std::string_view, const Alias*> sorted;
+        for (const auto& [name, alias] : aliases) {
+            sorted.emplace(name, &alias);
+        }
+        for (const auto& [name, alias] : sorted) {
+            print(std::string{name}, *alias);
+        }
+        std::cout << std::flush;
+        return 0;
+    }
+
+    int status = 0;
+    for (const std::string& entry : cmd) {
+        size_t separator = entry.find('=');
+        std::string name = entry.substr(0, separator);
+        if (name.empty() || name.find('/') != std::string::npos) {
+            std::cerr << "alias: invalid alias name '" << name << "'\n";
+            status = 1;
+            continue;
+        }
+
+        if (separator == std::string::npos) {
+            auto found = aliases.find(name);
+            if (found == end(aliases)) {
+                std::cerr << "alias: " << name << ": not found\n";
+                status = 1;
+            } else {
+                print(name, found->second);
+            }
+            continue;
+        }
+
+        Alias& alias = aliases[name];
+        alias.value = entry.substr(separator + 1);
+        alias.words.clear();
+        utils::ParseUtils::splitRespectingQuotes(alias.value, back_inserter(alias.words));
     }
+    std::cout << std::flush;
+    return status;
 }
 
 /**
- * @brief Checks if a command is a builtin command.
- * @param cmd The command to check.
- * @return true if the command is builtin, false otherwise.
+ * @brief Removes aliases.
+ * @param cmd The alias names, or -a for all.
+ * @return int The exit status.
  */
-bool Executor::isBuiltin(const Command& cmd) {
-    return builtinCommands.find(cmd.getName()) != end(builtinCommands);
+int Executor::unalias(const Args& cmd) {
+    if (cmd.empty()) {
+        std::cerr << "unalias: usage: unalias [-a] NAME...\n";
+        return 1;
+    }
+    if (cmd.size() == 1 && cmd.front() == "-a") {
+        aliases.clear();
+        return 0;
+    }
+
+    int status = 0;
+    for (const std::string& name : cmd) {
+        if (aliases.erase(name) == 0) {
+            std::cerr << "unalias: " << name << ": not found\n";
+            status = 1;
+        }
+    }
+    return status;
 }
 
 /**
- * @brief Executes a builtin command.
- * @param cmd The builtin command to execute.
- * @throws std::invalid_argument if the command is not a known builtin.
+ * @brief Shows or selects the engine for the file operations of the shell.
+ * @param cmd "sync" or "uring", the current engine is printed if empty.
+ * @return int The exit status.
  */
-void Executor::executeBuiltin(const Command& cmd) {
-    auto builtin = builtinCommands.find(cmd.getName());
-    if (builtin != end(builtinCommands)) {
-        BuiltinFunction function = builtin->second;
-        const std::vector<std::string>& args = cmd.getArgs();
-        (this->*function)(args);
-    } else {
-        throw std::invalid_argument("unknown builtin command");
+int Executor::ioengine(const Args& cmd) {
+    if (cmd.size() > 1) {
+        std::cerr << "ioengine: wrong number of arguments\n";
+        return 1;
     }
+
+    if (cmd.empty()) {
+        std::cout << ioEngine.describe() << std::endl;
+        return 0;
+    }
+
+    try {
+        ioEngine.select(cmd[0]);
+    } catch (std::invalid_argument& e) {
+        std::cerr << "ioengine: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
 }
 
 /**
- * @brief Executes an external command by forking and exec'ing.
- * @param cmd The external command to execute.
- * @throws std::runtime_error if fork fails.
+ * @brief Copies a file within the shell process, both files are opened in one batch.
+ * @param cmd The source and the destination.
+ * @return int The exit status.
  */
-void Executor::executeExternal(const Command& cmd) {
-    using namespace std;
+int Executor::copy(const Args& cmd) {
+    if (cmd.size() != 2) {
+        std::cerr << "copy: wrong number of arguments\n";
+        return 1;
+    }
 
-    pid_t pid = fork();
+    const int permissions = 0644;
+    std::vector<int> opened = ioEngine.openAll({
+        {cmd[0], O_RDONLY | O_CLOEXEC, 0},
+        {cmd[1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, permissions},
+    });
 
-    if (pid == 0) {
-        // child actions
+    int status = 0;
+    for (size_t i = 0; i < opened.size(); i++) {
+        if (opened[i] < 0) {
+            std::cerr << "copy: " << cmd[i] << ": " << strerror(-opened[i]) << '\n';
+            status = 1;
+        }
+    }
+
+    if (opened[0] >= 0 && opened[1] >= 0) {
+        try {
+            ioEngine.copy(opened[0], opened[1]);
+        } catch (std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            status = 1;
+        }
+    }
+
+    for (int fd : opened) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Prints the metrics of the shell, or writes them in the Prometheus text format.
+ *
+ * With a file the exposition is written next to it and renamed over it, so a collector reading the file
+ * (the node exporter textfile collector, for one) never sees a partial write.
+ *
+ * @param cmd Empty, or --prometheus with an optional file to write.
+ * @return int The exit status.
+ */
+int Executor::stats(const Args& cmd) {
+    if (cmd.empty()) {
+        std::cout << Metrics::report(Metrics::snapshot()) << std::flush;
+        return 0;
+    }
+    if (cmd[0] != "--prometheus" || cmd.size() > 2) {
+        std::cerr << "stats: usage: stats [--prometheus [FILE]]\n";
+        return 1;
+    }
+
+    std::string exposition = Metrics::prometheus(Metrics::snapshot());
+    if (cmd.size() == 1) {
+        std::cout << exposition << std::flush;
+        return 0;
+    }
 
-        // transforming args to c-like style (char**)
-        string executableName = lookupPath(cmd.getName());
-        vector<string> commandArgs(cmd.getArgs());
+    std::string temporary = cmd[1] + ".tmp";
+    std::ofstream file(temporary, std::ios::trunc);
+    file << exposition;
+    file.close();
+    if (!file || rename(temporary.c_str(), cmd[1].c_str()) == -1) {
+        std::cerr << "stats: " << cmd[1] << ": " << strerror(errno) << '\n';
+        unlink(temporary.c_str());
+        return 1;
+    }
+    return 0;
+}
 
-        vector<char*> executableArgs;
-        executableArgs.reserve(commandArgs.size() + 2);
+/**
+ * @brief Runs a command with a long argument list in as few invocations as fit into ARG_MAX.
+ *
+ * The items are packed greedily in order, which gives the fewest invocations for contiguous batches. The
+ * space of an invocation is sysconf(_SC_ARG_MAX) less the environment, the command and its fixed
+ * arguments, and some headroom. Up to -j invocations run at once. The first unfinished one writes to the
+ * terminal directly, the others into memory files that are printed in order once everything before them
+ * is done, so the output is the same as of sequential runs. The redirects of the line apply to every
+ * invocation, the buffered output is replayed into their targets. The status is 0 if all invocations
+ * succeeded, 125 if any was killed by a signal and 123 if any failed otherwise, like in xargs.
+ *
+ * @param cmd [-j N] COMMAND [ARGS... --] ITEMS..., without -- all arguments after COMMAND are items.
+ * @return int The exit status.
+ */
+int Executor::batchargs(const Args& cmd) {
+    using namespace std;
 
-        executableArgs.push_back(const_cast<char*>(executableName.c_str()));
-        for (const string& arg : commandArgs) {
-            executableArgs.push_back(const_cast<char*>(arg.c_str()));
+    auto arg = begin(cmd);
+    size_t workers = 1;
+    if (arg != end(cmd) && *arg == "-j") {
+        if (++arg == end(cmd) || arg->empty() || arg->size() > 4 ||
+            arg->find_first_not_of("0123456789") != string::npos || stoul(*arg) == 0) {
+            cerr << "batchargs: -j needs a positive number\n";
+            return 1;
         }
-        executableArgs.push_back(nullptr);  // null terminator
+        workers = stoul(*arg++);
+    }
+    if (arg == end(cmd)) {
+        cerr << "batchargs: usage: batchargs [-j N] COMMAND [ARGS... --] ITEMS...\n";
+        return 1;
+    }
 
-        // handling redirect
-        handleRedirect(cmd);
+    const string& name = *arg++;
+    auto separator = find(arg, end(cmd), "--");
+    vector<string> fixed;
+    vector<string> items;
+    if (separator == end(cmd)) {
+        items.assign(arg, end(cmd));
+    } else {
+        fixed.assign(arg, separator);
+        items.assign(next(separator), end(cmd));
+    }
 
-        // executing the command
-        execv(executableName.c_str(), executableArgs.data());
+    // the space every invocation has for the items
+    long argMax = sysconf(_SC_ARG_MAX);
+    size_t budget = argMax > 0 ? static_cast<size_t>(argMax) : 131072;
+    shared_ptr<const Variables::Environment> environment = variables.environment();
+    size_t used = argumentHeadroom + sizeof(char*) * 2 + argumentCost(lookupPath(name));
+    for (const string& entry : environment->entries) {
+        used += argumentCost(entry);
+    }
+    for (const string& fixedArg : fixed) {
+        used += argumentCost(fixedArg);
+    }
+    if (used >= budget) {
+        cerr << "batchargs: the environment and the command leave no room for arguments\n";
+        return 1;
+    }
+    budget -= used;
 
-        // if this code was reached, exec failed -> error
-        std::perror("error executing the command");
-        _exit(1);
-    } else if (pid > 0) {
-        // parent actions
-
-        // we do not wait for child if the process is run in background
-        if (cmd.isParallel()) {
-            std::cout << "[" << cmd.getName() << "]"
-                      << "[" << pid << "]"
-                      << " pushed to background" << endl;
+    vector<pair<size_t, size_t>> ranges;
+    size_t space = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        size_t cost = argumentCost(items[i]);
+        if (items[i].size() >= maxArgumentLength || cost > budget) {
+            cerr << "batchargs: argument " << i + 1 << " is too long\n";
+            return 1;
+        }
+        if (ranges.empty() || space + cost > budget) {
+            ranges.emplace_back(i, i);
+            space = 0;
+        }
+        ranges.back().second = i + 1;
+        space += cost;
+    }
+    if (ranges.empty()) {
+        ranges.emplace_back(0, 0);  // a command without items still runs once
+    }
+
+    optional<StreamRoute> route = builtinCommand != nullptr ? routeRedirects(*builtinCommand) : StreamRoute{};
+    if (!route) {
+        return 1;
+    }
+    // a buffered invocation writes into its memory files, only the input redirect is applied to it
+    StreamRoute inputOnly;
+    inputOnly.fds[STDIN_FILENO] = route->fds[STDIN_FILENO];
+    int outputTarget = route->fds[STDOUT_FILENO];
+    int errorTarget = route->fds[STDERR_FILENO];
+    bool sharedErrors = errorTarget == outputTarget;
+
+    struct Invocation {
+        pid_t pid;
+        int pidfd;
+        int output;
+        int errors;
+        int status;
+        bool done;
+        uint64_t timeout;
+    };
+    vector<Invocation> invocations(ranges.size(), Invocation{-1, -1, -1, -1, 0, false, 0});
+    uint64_t lineStart = Metrics::now();
+
+    sigset_t childSignal;
+    sigset_t previousMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+
+    auto start = [&](size_t index, bool direct) {
+        Invocation& invocation = invocations[index];
+        vector<string> args{fixed};
+        args.insert(end(args), make_move_iterator(begin(items) + ranges[index].first),
+                    make_move_iterator(begin(items) + ranges[index].second));
+        Command batch{name, args};
+
+        if (!direct) {
+            invocation.output = memfd_create("batchargs", MFD_CLOEXEC);
+            // stderr shares the file with stdout unless the two go to different places
+            invocation.errors = sharedErrors ? -1 : memfd_create("batchargs", MFD_CLOEXEC);
+        }
+        pair<int, int> outputFds{invocation.output, sharedErrors ? invocation.output : invocation.errors};
+
+        PlacementPolicy::Assignment placement = jobPlacement.assign();
+        uint64_t spawnStart = Metrics::now();
+        invocation.pid =
+            spawnExternal(batch, false, outputFds, direct ? *route : inputOnly, placement, previousMask);
+        Metrics::record(Metrics::Histogram::SpawnLatency, Metrics::now() - spawnStart);
+        Metrics::add(invocation.pid < 0 ? Metrics::Counter::SpawnFailures : Metrics::Counter::CommandsSpawned);
+        if (invocation.pid < 0) {
+            cerr << "batchargs: fork: " << strerror(errno) << '\n';
+            invocation.status = 127 << 8;
+            invocation.done = true;
             return;
         }
 
-        // otherwise wait
-        waitpid(pid, nullptr, 0);
+        jobPlacement.commit(invocation.pid, placement);
+        invocation.pidfd = static_cast<int>(syscall(SYS_pidfd_open, invocation.pid, 0));
+        invocation.timeout = startTimeout(invocation.pid, lineStart);
+    };
 
-    } else {
-        // if fork did not succeed
-        throw runtime_error("fork: "s + strerror(errno));
+    auto finish = [&](Invocation& invocation, int status) {
+        invocation.status = status;
+        invocation.done = true;
+        jobPlacement.release(invocation.pid);
+        jobLimits.release(invocation.pid);
+        timeouts.cancel(invocation.timeout);
+        if (invocation.pidfd != -1) {
+            close(invocation.pidfd);
+        }
+    };
+
+    size_t next = 0;
+    size_t head = 0;
+    vector<size_t> running;
+    while (head < invocations.size()) {
+        while (running.size() < workers && next < invocations.size()) {
+            start(next, next == head && (capture == nullptr || outputTarget != -1));
+            if (!invocations[next].done) {
+                running.push_back(next);
+            }
+            next++;
+        }
+
+        // waits for any of the running invocations, one by one if there are no pidfds
+        vector<pollfd> watched;
+        for (size_t index : running) {
+            watched.push_back({invocations[index].pidfd, POLLIN, 0});
+        }
+        bool pollable = all_of(begin(watched), end(watched), [](const pollfd& fd) { return fd.fd != -1; });
+        if (pollable && !watched.empty() && poll(watched.data(), watched.size(), -1) == -1 && errno != EINTR) {
+            pollable = false;
+        }
+
+        for (size_t i = 0; i < running.size();) {
+            Invocation& invocation = invocations[running[i]];
+            int status = 0;
+            pid_t waited = waitpid(invocation.pid, &status, pollable ? WNOHANG : 0);
+            if (waited == invocation.pid || (waited == -1 && errno == ECHILD)) {
+                finish(invocation, waited == invocation.pid ? status : -1);
+                running.erase(begin(running) + i);
+                if (!pollable) {
+                    break;
+                }
+            } else {
+                i++;
+            }
+        }
+
+        // the output of finished invocations is printed in order
+        for (; head < invocations.size() && invocations[head].done; head++) {
+            if (invocations[head].output != -1) {
+                dumpOutput(invocations[head].output, outputTarget == -1 ? capture : nullptr,
+                           outputTarget == -1 ? STDOUT_FILENO : outputTarget);
+                close(invocations[head].output);
+            }
+            if (invocations[head].errors != -1) {
+                dumpOutput(invocations[head].errors, nullptr,
+                           errorTarget == -1 ? STDERR_FILENO : errorTarget);
+                close(invocations[head].errors);
+            }
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+    releaseRoute(*route, true);
+
+    size_t failed = 0;
+    int status = 0;
+    for (const Invocation& invocation : invocations) {
+        bool killed = invocation.status == -1 || WIFSIGNALED(invocation.status);
+        if (killed) {
+            status = 125;
+        } else if (WEXITSTATUS(invocation.status) != 0 && status != 125) {
+            status = 123;
+        }
+        if (killed || WEXITSTATUS(invocation.status) != 0) {
+            failed++;
+        }
     }
+    if (failed != 0) {
+        cerr << "batchargs: " << failed << " of " << invocations.size() << " invocations failed (status "
+             << status << ")\n";
+    }
+    return status;
 }
 
 /**
- * @brief Handles output redirection for a command.
- * @param cmd The command whose output should be redirected.
+ * @brief Runs a command template for every line of a file, up to -j at a time.
+ *
+ * The template is the rest of the command line including its redirect, {} in it is replaced by the item,
+ * e.g. foreach hosts.txt -j 8 ping -c 1 {} > ping_{}.log. SIGCHLD stays blocked while the items run, so
+ * the handler does not reap the children of the runner.
+ *
+ * @param cmd FILE [-j N] COMMAND [ARGS...]
+ * @return int The exit status.
  */
-void Executor::handleRedirect(const Command& cmd) {
-    if (const std::string& file = cmd.getOutputRedirect().value_or(""); !file.empty()) {
-        const int permissions = 0644;
-        const int fileDescriptior = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, permissions);
+int Executor::foreach(const Args& cmd) {
+    using namespace std;
 
-        if (fileDescriptior == -1 || dup2(fileDescriptior, STDOUT_FILENO) == -1 ||
-            dup2(fileDescriptior, STDERR_FILENO) == -1) {
-            perror("file redirection failed");
-        } else {
-            close(fileDescriptior);
+    auto arg = begin(cmd);
+    if (arg == end(cmd)) {
+        cerr << "foreach: usage: foreach FILE [-j N] COMMAND [ARGS...]\n";
+        return 1;
+    }
+    const string& listFile = *arg++;
+
+    size_t workers = 1;
+    if (arg != end(cmd) && *arg == "-j") {
+        if (++arg == end(cmd) || arg->empty() || arg->size() > 4 ||
+            arg->find_first_not_of("0123456789") != string::npos || stoul(*arg) == 0) {
+            cerr << "foreach: -j needs a positive number\n";
+            return 1;
+        }
+        workers = stoul(*arg++);
+    }
+    if (arg == end(cmd)) {
+        cerr << "foreach: missing command\n";
+        return 1;
+    }
+
+    Command templateCommand{*arg, vector<string>{next(arg), end(cmd)}};
+    if (builtinCommand != nullptr) {
+        for (Command::Redirect& redirect : builtinCommand->getRedirects()) {
+            templateCommand.addRedirect(move(redirect));
         }
     }
+
+    sigset_t childSignal;
+    sigset_t previousMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+
+    ForeachRunner runner{templateCommand, searchPath};
+    vector<ForeachRunner::Failure> failures;
+    try {
+        failures = runner.run(listFile, workers, variables.environment()->entries, jobPriority);
+    } catch (runtime_error& e) {
+        cerr << "foreach: " << e.what() << '\n';
+        sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+        return 1;
+    }
+
+    sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+
+    for (const ForeachRunner::Failure& failure : failures) {
+        cerr << "foreach: line " << failure.line << " (" << failure.item << "): " << failure.reason << '\n';
+    }
+    if (!failures.empty()) {
+        cerr << "foreach: " << failures.size() << " of " << runner.itemCount() << " items failed\n";
+    }
+    return failures.empty() ? 0 : 1;
 }
 
 /**
- * @brief Registers the SIGCHLD signal handler to reap child processes.
+ * @brief Runs a command that is terminated if it runs longer than a duration.
+ *
+ * The command gets SIGTERM when the duration passes and SIGKILL after the grace period (-k, 5s by default)
+ * if it is still running, e.g. timeout -k 1 30s make > make.log &. The redirect and the & of the line are
+ * the ones of the command. Aliases, functions and builtins other than prio cannot be limited, they run in the
+ * shell.
+ *
+ * @param cmd [-k GRACE] DURATION COMMAND [ARGS...]
+ * @return int The exit status of the command, 124 if it timed out.
  */
-void Executor::registerSignalHangler() {
-    struct sigaction signalAction {};
-    signalAction.sa_handler = reapChildren;
-    sigemptyset(&signalAction.sa_mask);
-    signalAction.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+int Executor::timeout(const Args& cmd) {
+    using namespace std;
 
-    if (sigaction(SIGCHLD, &signalAction, nullptr) == -1) {
-        perror("sigactoi");
+    auto arg = begin(cmd);
+    uint64_t grace = TimeoutQueue::defaultGrace;
+    uint64_t duration = 0;
+    try {
+        if (arg != end(cmd) && *arg == "-k" && next(arg) != end(cmd)) {
+            grace = utils::StringUtils::parseDuration(*next(arg));
+            arg += 2;
+        }
+        if (arg != end(cmd)) {
+            duration = utils::StringUtils::parseDuration(*arg++);
+        }
+    } catch (invalid_argument& e) {
+        cerr << "timeout: " << e.what() << '\n';
+        return 1;
+    }
+    if (arg == end(cmd)) {
+        cerr << "timeout: usage: timeout [-k GRACE] DURATION COMMAND [ARGS...]\n";
+        return 1;
+    }
+
+    Command limited{*arg, vector<string>{next(arg), end(cmd)}};
+    if (builtinCommand != nullptr) {
+        for (Command::Redirect& redirect : builtinCommand->getRedirects()) {
+            limited.addRedirect(move(redirect));
+        }
+        limited.setParallel(builtinCommand->isParallel());
     }
+
+    optional<uint64_t> outerTimeout = commandTimeout;
+    uint64_t outerGrace = commandGrace;
+    commandTimeout = duration;
+    commandGrace = grace;
+    int status;
+    try {
+        status = executeWrapped("timeout", limited);
+    } catch (...) {
+        commandTimeout = outerTimeout;
+        commandGrace = outerGrace;
+        throw;
+    }
+    commandTimeout = outerTimeout;
+    commandGrace = outerGrace;
+    return status;
 }
 
 /**
- * @brief Signal handler to reap terminated child processes.
- * @param signum The signal number (unused).
+ * @brief Runs a command in a priority class, sets the class of later jobs or of running ones.
+ *
+ * prio batch make > make.log & runs make at nice 10 under SCHED_BATCH, prio idle sets the class of the jobs
+ * started later without a class of their own, and prio high %1 %2 changes the class of running jobs. Lines
+ * of --jobs run in the order of their classes when more lines are ready than there are workers.
+ *
+ * @param cmd CLASS [COMMAND [ARGS...] | JOBSPEC...], the class of later jobs is printed if empty.
+ * @return int The exit status.
  */
-void Executor::reapChildren(int signum) {
-    assert(signum == SIGCHLD);
+int Executor::prio(const Args& cmd) {
+    using namespace std;
 
-    pid_t currPid;
-    while ((currPid = waitpid(-1, nullptr, WNOHANG)) > 0) {
-        std::string str = "Reaped chiled with pid: " + std::to_string(currPid) + "\n";
-        str.shrink_to_fit();
-        char* buf = str.data();
-        size_t length = str.length();
-        write(STDOUT_FILENO, buf, length * sizeof(char));
+    if (cmd.empty()) {
+        cout << JobPriority::name(jobPriority) << endl;
+        return 0;
+    }
+
+    JobPriority::Class priority;
+    try {
+        priority = JobPriority::parse(cmd.front());
+    } catch (invalid_argument& e) {
+        cerr << "prio: " << e.what() << '\n';
+        cerr << "prio: usage: prio high|normal|batch|idle [COMMAND [ARGS...] | JOBSPEC...]\n";
+        return 1;
+    }
+    if (cmd.size() == 1) {
+        jobPriority = priority;
+        return 0;
+    }
+
+    if (!cmd[1].empty() && cmd[1].front() == '%') {
+        int status = 0;
+        for (auto spec = next(begin(cmd)); spec != end(cmd); ++spec) {
+            Job* job = resolveJob(*spec);
+            if (job == nullptr) {
+                cerr << "prio: " << *spec << ": no such job\n";
+                status = 1;
+            } else if (!JobPriority::applyTo(job->pid, priority)) {
+                cerr << "prio: " << *spec << ": " << strerror(errno) << '\n';
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    Command prioritized{cmd[1], vector<string>{begin(cmd) + 2, end(cmd)}};
+    if (builtinCommand != nullptr) {
+        for (Command::Redirect& redirect : builtinCommand->getRedirects()) {
+            prioritized.addRedirect(move(redirect));
+        }
+        prioritized.setParallel(builtinCommand->isParallel());
     }
+
+    optional<JobPriority::Class> outerPriority = commandPriority;
+    commandPriority = priority;
+    int status;
+    try {
+        status = executeWrapped("prio", prioritized);
+    } catch (...) {
+        commandPriority = outerPriority;
+        throw;
+    }
+    commandPriority = outerPriority;
+    return status;
 }
 
 /**
- * @brief Map of builtin command names to their corresponding member function pointers.
+ * @brief Runs the command of a builtin wrapping one, timeout or prio, which may wrap each other.
+ * @param wrapper Name of the wrapping builtin, for the messages.
+ * @param cmd The command, with the redirects and the & of the line.
+ * @return int The exit status, 126 if the command is neither external nor a wrapping builtin.
  */
-const std::unordered_map<std::string_view, Executor::BuiltinFunction> Executor::builtinCommands = {
-    {"cd", &Executor::cd},
-    {"exit", &Executor::exit},
-    {"path", &Executor::path},
-};
+int Executor::executeWrapped(const char* wrapper, const Command& cmd) {
+    const std::string& name = cmd.getName();
+    bool shadowed = aliases.count(name) != 0 || functions.count(name) != 0;
+    if (!shadowed && (name == "timeout" || name == "prio")) {
+        // the wrapped builtin takes the redirects and the & from the line as well
+        return (this->*builtinCommands.at(name))(cmd.getArgs());
+    }
+    if (!isExternal(cmd)) {
+        std::cerr << wrapper << ": " << name << ": not an external command\n";
+        return 126;
+    }
+    return executeExternal(cmd);
+}
 
 /**
- * @brief Changes the current working directory.
- * @param cmd Arguments for the cd command (expects exactly one argument).
+ * @brief Starts, lists or stops pools of coprocess workers.
+ *
+ * coproc -n 4 py python3 worker.py 2>> worker.log starts four workers running worker.py, which then answer
+ * the requests of request py ...; a 2> redirect of the line is the stderr of the workers, -d sets the line
+ * ending a response (an empty line by default). coproc -k py closes the stdin of the workers and sends them
+ * SIGTERM, the SIGCHLD handler reaps them.
+ *
+ * @param cmd [-n N] [-d DELIM] NAME COMMAND [ARGS...] or -k NAME..., the pools are listed if empty.
+ * @return int The exit status.
  */
-void Executor::cd(const Args& cmd) {
-    if (cmd.size() != 1) {
-        std::cerr << "cd: wrong number of arguments\n";
-        return;
+int Executor::coproc(const Args& cmd) {
+    using namespace std;
+
+    if (cmd.empty()) {
+        for (const auto& [name, pool] : coprocs) {
+            pool->describe(cout);
+        }
+        return 0;
     }
 
-    if (chdir(cmd[0].c_str()) != 0) {
-        std::perror("cd");
+    if (cmd.front() == "-k") {
+        if (cmd.size() == 1) {
+            cerr << "coproc: -k needs a name\n";
+            return 1;
+        }
+        int status = 0;
+        for (auto name = next(begin(cmd)); name != end(cmd); ++name) {
+            if (coprocs.erase(*name) == 0) {
+                cerr << "coproc: " << *name << ": no such coproc\n";
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    size_t size = 1;
+    string delimiter;
+    auto arg = begin(cmd);
+    while (arg != end(cmd) && (*arg == "-n" || *arg == "-d")) {
+        bool count = *arg == "-n";
+        if (++arg == end(cmd)) {
+            cerr << "coproc: " << (count ? "-n" : "-d") << " needs a value\n";
+            return 1;
+        }
+        if (!count) {
+            delimiter = *arg++;
+            continue;
+        }
+        if (arg->empty() || arg->size() > 4 || arg->find_first_not_of("0123456789") != string::npos ||
+            stoul(*arg) == 0) {
+            cerr << "coproc: -n needs a positive number\n";
+            return 1;
+        }
+        size = stoul(*arg++);
+    }
+    if (arg == end(cmd) || next(arg) == end(cmd)) {
+        cerr << "coproc: usage: coproc [-n N] [-d DELIM] NAME COMMAND [ARGS...]\n";
+        return 1;
+    }
+
+    const string& name = *arg++;
+    if (!Variables::isValidName(name)) {
+        cerr << "coproc: " << name << ": not a valid name\n";
+        return 1;
+    }
+    if (coprocs.count(name) != 0) {
+        cerr << "coproc: " << name << ": already running\n";
+        return 1;
     }
+
+    // stdin and stdout are the pipes, only the stderr of the workers can go elsewhere
+    Command command{*arg, vector<string>{next(arg), end(cmd)}};
+    if (builtinCommand != nullptr) {
+        for (Command::Redirect& redirect : builtinCommand->getRedirects()) {
+            if (redirect.stream == Command::Redirect::Stream::Error) {
+                command.addRedirect(move(redirect));
+            }
+        }
+    }
+
+    auto pool = make_unique<CoprocPool>(
+        name, move(command), size, delimiter,
+        [this](const Command& worker, int input, int output) { return spawnWorker(worker, input, output); });
+    try {
+        pool->start();
+    } catch (runtime_error& e) {
+        cerr << "coproc: " << e.what() << '\n';
+        return 1;
+    }
+    coprocs.emplace(name, move(pool));
+    return 0;
 }
 
 /**
- * @brief Sets the executable search path.
- * @param cmd Arguments for the path command (list of absolute paths).
+ * @brief Sends request lines to a coprocess pool and prints the responses.
+ *
+ * request py 'sum 1 2' sends the words as one line and waits for its response. request py < items.txt >
+ * out.txt sends every non-empty line of items.txt instead, spread over the workers and pipelined, the
+ * responses are printed in the order of the lines. Failed requests are reported to stderr.
+ *
+ * @param cmd NAME [WORDS...], the lines of the input redirect are sent if there are no words.
+ * @return int The exit status, 1 if a request failed.
  */
-void Executor::path(const Args& cmd) {
+int Executor::request(const Args& cmd) {
+    using namespace std;
+
     if (cmd.empty()) {
-        searchPath.clear();
-        return;
+        cerr << "request: usage: request NAME [WORDS...] [< FILE]\n";
+        return 1;
+    }
+    auto pool = coprocs.find(cmd.front());
+    if (pool == end(coprocs)) {
+        cerr << "request: " << cmd.front() << ": no such coproc\n";
+        return 1;
     }
 
-    for (int i = 0; i < cmd.size(); i++) {
-        const std::string& path = cmd[i];
+    optional<StreamRoute> route = builtinCommand != nullptr ? routeRedirects(*builtinCommand) : StreamRoute{};
+    if (!route) {
+        return 1;
+    }
 
-        if (path.empty() || path.front() != '/' || path.back() == '/') {
-            std::cerr << "path: invalid path at " << i << " position (ignored)\n";
-            continue;
+    vector<string> requests;
+    int input = route->fds[STDIN_FILENO];
+    if (input != -1) {
+        utils::FdStreamBuffer buffer{input};
+        istream lines{&buffer};
+        for (string line; getline(lines, line);) {
+            if (!line.empty()) {
+                requests.push_back(move(line));
+            }
+        }
+    } else {
+        string line;
+        for (auto word = next(begin(cmd)); word != end(cmd); ++word) {
+            line += (word == next(begin(cmd)) ? "" : " ") + *word;
+        }
+        if (line.find('\n') != string::npos) {
+            cerr << "request: a request is a single line\n";
+            releaseRoute(*route, true);
+            return 1;
+        }
+        requests.push_back(move(line));
+    }
+
+    int output = route->fds[STDOUT_FILENO];
+    auto print = [&](string_view response) {
+        if (output == -1) {
+            cout << response;
+            return;
+        }
+        for (size_t written = 0; written < response.size();) {
+            ssize_t put = write(output, response.data() + written, response.size() - written);
+            if (put <= 0 && errno != EINTR) {
+                return;
+            }
+            written += put > 0 ? static_cast<size_t>(put) : 0;
         }
+    };
+    size_t failed = pool->second->request(requests, print, cerr);
 
-        searchPath.push_back(path);
+    releaseRoute(*route, true);
+    return failed == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Spawns a coprocess worker in the background with its stdin and stdout on pipes of its pool.
+ *
+ * The worker gets a process group of its own, the resource limits and the priority class of later jobs.
+ * It may be started in the middle of a request, with SIGPIPE blocked, which the worker does not inherit.
+ *
+ * @param cmd The command of the worker, only its 2> redirects are applied.
+ * @param input Read end of the pipe that is the stdin of the worker.
+ * @param output Write end of the pipe that is the stdout of the worker.
+ * @return pid_t The pid of the worker, -1 if the spawn failed (errno is set).
+ */
+pid_t Executor::spawnWorker(const Command& cmd, int input, int output) {
+    std::optional<StreamRoute> route = routeRedirects(cmd);
+    if (!route) {
+        return -1;
     }
+    route->fds[STDIN_FILENO] = input;
+    route->fds[STDOUT_FILENO] = output;
+
+    sigset_t childSignal;
+    sigset_t previousMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+
+    sigset_t childMask = previousMask;
+    sigdelset(&childMask, SIGCHLD);
+    sigdelset(&childMask, SIGPIPE);
+    PlacementPolicy::Assignment assignment{};
+    assignment.slot = -1;
+
+    pid_t pid = spawnExternal(cmd, false, {-1, -1}, *route, assignment, childMask);
+    int spawnError = errno;
+    Metrics::add(pid < 0 ? Metrics::Counter::SpawnFailures : Metrics::Counter::CommandsSpawned);
+    releaseRoute(*route, pid < 0);
+
+    sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+    errno = spawnError;
+    return pid;
 }
 
 /**
- * @brief Exits the shell.
- * @param cmd Arguments for the exit command (expects none), is needed only to satisfy the function pointer in
- * the map.
+ * @brief Finds the job denoted by a job spec (%n, %%, %+ or a pid).
+ * @param spec The job spec.
+ * @return Job* The job or nullptr if there is none.
  */
-void Executor::exit(const Args& cmd) {
-    if (!cmd.empty()) {
-        std::cerr << "exit: wrong number of arguments\n";
-        return;
+Job* Executor::resolveJob(const std::string& spec) {
+    if (spec == "%%" || spec == "%+") {
+        return jobTable.latest();
     }
 
-    std::cout << "Exiting...\n" << std::flush;
-    std::exit(0);
+    bool isJobNumber = !spec.empty() && spec.front() == '%';
+    std::string number = isJobNumber ? spec.substr(1) : spec;
+    if (number.empty() || number.size() > 9 || number.find_first_not_of("0123456789") != std::string::npos) {
+        return nullptr;
+    }
+
+    return isJobNumber ? jobTable.find(std::stoi(number)) : jobTable.findByPid(std::stoi(number));
 }
 
 /**
@@ -232,13 +2638,5 @@ void Executor::exit(const Args& cmd) {
  * @return The full path to the executable if found, otherwise returns the command name.
  */
 std::string Executor::lookupPath(const std::string& cmd) const {
-    assert(!cmd.empty());
-
-    for (const auto& path : searchPath) {
-        std::string fullPath = path + "/" + cmd;
-        if (access(fullPath.c_str(), X_OK) == 0) {
-            return fullPath;
-        }
-    }
-    return cmd;
+    return utils::PathUtils::lookup(searchPath, cmd);
 }
@@ -0,0 +1,299 @@
+/**
+ * @file ForeachRunner.cpp
+ * @brief File implemets ForeachRunner class
+ *
+ * Every spawner thread owns a contiguous range of items and takes them from its front. A thread whose range
+ * is empty takes the back half of the largest range of the others, so the threads stay busy until the very
+ * end without a shared queue every item would have to go through.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "ForeachRunner.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "JobRunner.hpp"
+#include "Metrics.hpp"
+#include "PathUtils.hpp"
+
+namespace {
+
+/// @brief The placeholder items are substituted for.
+constexpr std::string_view placeholder = "{}";
+
+/// @brief Items of a single spawner thread, [next, end) are left.
+struct WorkRange {
+    std::mutex mutex;
+    size_t next;
+    size_t end;
+};
+
+/**
+ * @brief Describes a wait status.
+ * @param status The status.
+ * @return std::string e.g. "exit 1" or "killed by signal 9".
+ */
+std::string describeStatus(int status) {
+    if (WIFSIGNALED(status)) {
+        return "killed by signal " + std::to_string(WTERMSIG(status));
+    }
+    return "exit " + std::to_string(WEXITSTATUS(status));
+}
+
+}  // namespace
+
+/**
+ * @brief Pre-parses the command template.
+ * @param command The template, its background flag is ignored.
+ * @param searchPath Directories searched for executables.
+ */
+ForeachRunner::ForeachRunner(const Command& command, std::vector<std::string> searchPath)
+    : name(cut(command.getName())), searchPath(std::move(searchPath)), items(0) {
+    bool hasPlaceholder = name.pieces.size() > 1;
+    for (const std::string& arg : command.getArgs()) {
+        args.push_back(cut(arg));
+        hasPlaceholder = hasPlaceholder || args.back().pieces.size() > 1;
+    }
+    for (Command::Redirect& redirect : command.getRedirects()) {
+        Field target = cut(redirect.target);
+        hasPlaceholder = hasPlaceholder || target.pieces.size() > 1;
+        redirects.emplace_back(std::move(redirect), std::move(target));
+    }
+
+    if (!hasPlaceholder) {
+        args.push_back(Field{{"", ""}});
+    }
+
+    // a fixed name is looked up once, not for every item
+    if (name.pieces.size() == 1) {
+        name.pieces.front() = utils::PathUtils::lookup(this->searchPath, name.pieces.front());
+    }
+}
+
+/**
+ * @brief Runs the template for every non-empty line of the list file.
+ * @param listFile The file with one item per line.
+ * @param workers Maximum number of children running at once.
+ * @param environment Environment of the children as NAME=VALUE entries.
+ * @param priority Priority class of the children.
+ * @return std::vector<Failure> Failed items in the order of the list.
+ * @throws std::runtime_error if the list file cannot be read.
+ */
+std::vector<ForeachRunner::Failure> ForeachRunner::run(const std::string& listFile, size_t workers,
+                                                       std::vector<std::string> environment,
+                                                       JobPriority::Class priority) {
+    using namespace std;
+
+    int fd = open(listFile.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info {};
+    if (fd == -1 || fstat(fd, &info) == -1) {
+        int error = errno;
+        if (fd != -1) {
+            close(fd);
+        }
+        throw runtime_error(listFile + ": " + strerror(error));
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    const char* data = nullptr;
+    if (size > 0) {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            throw runtime_error(listFile + ": " + strerror(error));
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapping);
+    }
+    close(fd);
+
+    // the items point into the mapping
+    vector<pair<string_view, size_t>> lines;
+    size_t lineNumber = 0;
+    for (size_t begin = 0; begin < size;) {
+        const char* newline = static_cast<const char*>(memchr(data + begin, '\n', size - begin));
+        size_t end = newline != nullptr ? static_cast<size_t>(newline - data) : size;
+        lineNumber++;
+
+        string_view line{data + begin, end - begin};
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!line.empty()) {
+            lines.emplace_back(line, lineNumber);
+        }
+        begin = end + 1;
+    }
+    items = lines.size();
+
+    size_t threadCount = min(max<size_t>(workers, 1), lines.size());
+    vector<WorkRange> ranges(threadCount);
+    for (size_t t = 0; t < threadCount; t++) {
+        ranges[t].next = lines.size() * t / threadCount;
+        ranges[t].end = lines.size() * (t + 1) / threadCount;
+    }
+
+    // takes the next item of a thread, stealing from the fullest other range if its own is empty
+    auto take = [&](size_t self) -> optional<size_t> {
+        {
+            lock_guard<mutex> lock(ranges[self].mutex);
+            if (ranges[self].next < ranges[self].end) {
+                return ranges[self].next++;
+            }
+        }
+
+        while (true) {
+            size_t victim = self;
+            size_t most = 0;
+            for (size_t t = 0; t < threadCount; t++) {
+                lock_guard<mutex> lock(ranges[t].mutex);
+                if (t != self && ranges[t].end - ranges[t].next > most) {
+                    most = ranges[t].end - ranges[t].next;
+                    victim = t;
+                }
+            }
+            if (victim == self) {
+                return nullopt;
+            }
+
+            size_t first;
+            size_t last;
+            {
+                lock_guard<mutex> lock(ranges[victim].mutex);
+                size_t left = ranges[victim].end - ranges[victim].next;
+                if (left == 0) {
+                    continue;  // somebody was faster
+                }
+                last = ranges[victim].end;
+                first = last - (left + 1) / 2;
+                ranges[victim].end = first;
+            }
+
+            lock_guard<mutex> lock(ranges[self].mutex);
+            ranges[self].next = first + 1;
+            ranges[self].end = last;
+            return first;
+        }
+    };
+
+    JobRunner runner(searchPath);
+    vector<Failure> failures;
+    mutex failuresMutex;
+
+    auto spawner = [&](size_t self) {
+        JobRunner::SpawnOptions options;
+        options.environment = environment;
+        if (priority != JobPriority::Class::Normal) {
+            options.priority = priority;
+        }
+
+        for (optional<size_t> index; (index = take(self));) {
+            Metrics::change(Metrics::Gauge::QueuedItems, -1);
+            string_view item = lines[*index].first;
+
+            vector<string> itemArgs;
+            itemArgs.reserve(args.size());
+            for (const Field& arg : args) {
+                itemArgs.push_back(arg.fill(item));
+            }
+            Command command{name.fill(item), itemArgs};
+            for (const auto& [redirect, target] : redirects) {
+                command.addRedirect({redirect.stream, target.fill(item), redirect.append});
+            }
+
+            string reason;
+            try {
+                JobRunner::Result result = runner.submit(command, options).get();
+                Metrics::add(Metrics::Counter::CommandsSpawned);
+                if (!WIFEXITED(result.status) || WEXITSTATUS(result.status) != 0) {
+                    reason = describeStatus(result.status);
+                }
+            } catch (exception& e) {
+                Metrics::add(Metrics::Counter::SpawnFailures);
+                reason = e.what();
+            }
+
+            if (!reason.empty()) {
+                lock_guard<mutex> lock(failuresMutex);
+                failures.push_back({lines[*index].second, string{item}, move(reason)});
+            }
+        }
+    };
+
+    Metrics::change(Metrics::Gauge::QueuedItems, static_cast<int64_t>(lines.size()));
+    vector<thread> threads;
+    threads.reserve(threadCount);
+    for (size_t t = 0; t < threadCount; t++) {
+        threads.emplace_back(spawner, t);
+    }
+    for (thread& spawnerThread : threads) {
+        spawnerThread.join();
+    }
+
+    if (data != nullptr) {
+        munmap(const_cast<char*>(data), size);
+    }
+
+    sort(begin(failures), end(failures), [](const Failure& a, const Failure& b) { return a.line < b.line; });
+    return failures;
+}
+
+/**
+ * @brief Gives the number of items of the last run.
+ * @return size_t The number of items.
+ */
+size_t ForeachRunner::itemCount() const {
+    return items;
+}
+
+/**
+ * @brief Fills the placeholders with an item.
+ * @param item The item.
+ * @return std::string The string.
+ */
+std::string ForeachRunner::Field::fill(std::string_view item) const {
+    size_t length = item.size() * (pieces.size() - 1);
+    for (const std::string& piece : pieces) {
+        length += piece.size();
+    }
+
+    std::string result;
+    result.reserve(length);
+    result += pieces.front();
+    for (size_t i = 1; i < pieces.size(); i++) {
+        result += item;
+        result += pieces[i];
+    }
+    return result;
+}
+
+/**
+ * @brief Cuts a string at its {} placeholders.
+ * @param text The string.
+ * @return Field The pieces.
+ */
+ForeachRunner::Field ForeachRunner::cut(const std::string& text) {
+    Field field;
+    size_t begin = 0;
+    for (size_t found; (found = text.find(placeholder, begin)) != std::string::npos;) {
+        field.pieces.push_back(text.substr(begin, found - begin));
+        begin = found + placeholder.size();
+    }
+    field.pieces.push_back(text.substr(begin));
+    return field;
+}
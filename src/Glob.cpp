@@ -0,0 +1,313 @@
+/**
+ * @file Glob.cpp
+ * @brief File implemets Glob class
+ *
+ * A pattern is expanded one path component at a time: literal components are appended to every path found
+ * so far, a component with glob characters is compiled once and matched against the listing of every such
+ * path, and ** is replaced by the path itself and all directories below it (without following symlinks).
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "Glob.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "GlobPattern.hpp"
+#include "Metrics.hpp"
+
+namespace {
+
+/// @brief Size of the buffer getdents64() reads into, large directories are read in few calls.
+constexpr size_t scanBufferSize = 1 << 20;
+
+/// @brief Number of cached entries after which the cache is dropped.
+constexpr size_t maxCachedEntries = 4 << 20;
+
+/**
+ * @brief Appends a name to a directory path.
+ * @param base The directory, empty for the working directory.
+ * @param name The name.
+ * @return std::string The path.
+ */
+std::string join(const std::string& base, std::string_view name) {
+    std::string path;
+    path.reserve(base.size() + name.size() + 1);
+    path += base;
+    if (!base.empty() && base.back() != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+/**
+ * @brief Checks if a name is . or ..
+ * @param name The name.
+ * @return true if it is.
+ */
+bool isDotOrDotDot(std::string_view name) {
+    return name == "." || name == "..";
+}
+
+}  // namespace
+
+/// @brief Constructs a Glob with an empty directory cache.
+Glob::Glob() : cachedEntries(0) {
+}
+
+/**
+ * @brief Expands a pattern, \ escapes the glob characters.
+ * @param pattern The pattern.
+ * @return std::vector<std::string> Matching paths sorted, empty if nothing matches.
+ */
+std::vector<std::string> Glob::expand(const std::string& pattern) {
+    using namespace std;
+
+    if (pattern.empty()) {
+        return {};
+    }
+
+    vector<string> components;
+    for (size_t begin = 0; begin < pattern.size();) {
+        size_t end = pattern.find('/', begin);
+        if (end == string::npos) {
+            end = pattern.size();
+        }
+        if (end > begin) {
+            components.push_back(pattern.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    bool trailingSlash = pattern.back() == '/';
+
+    vector<string> paths{pattern.front() == '/' ? "/" : ""};
+    bool lastLiteral = false;
+    for (size_t i = 0; i < components.size() && !paths.empty(); i++) {
+        const string& component = components[i];
+        bool last = i + 1 == components.size();
+        bool onlyDirectories = !last || trailingSlash;
+        vector<string> found;
+
+        if (component == "**") {
+            for (const string& base : paths) {
+                collectDirectories(base, found);
+            }
+            if (last && !trailingSlash) {
+                // a trailing ** also matches the files in all those directories
+                vector<string> files;
+                for (const string& directory : found) {
+                    const Listing* listing = list(directory.empty() ? "." : directory);
+                    for (size_t e = 0; listing != nullptr && e < listing->entries.size(); e++) {
+                        const Entry& entry = listing->entries[e];
+                        string_view name{listing->names.data() + entry.offset, entry.length};
+                        if (name.front() != '.' && entry.type != DT_DIR) {
+                            files.push_back(join(directory, name));
+                        }
+                    }
+                }
+                found.insert(found.end(), make_move_iterator(files.begin()), make_move_iterator(files.end()));
+            }
+            if (last) {
+                found.erase(remove(found.begin(), found.end(), ""), found.end());
+            }
+            lastLiteral = false;
+        } else if (!utils::GlobPattern::hasMagic(component)) {
+            string literal = utils::GlobPattern::unescape(component);
+            for (const string& base : paths) {
+                found.push_back(join(base, literal));
+            }
+            lastLiteral = true;
+        } else {
+            utils::GlobPattern compiled{component};
+            for (const string& base : paths) {
+                const Listing* listing = list(base.empty() ? "." : base);
+                if (listing == nullptr) {
+                    continue;
+                }
+
+                // names are sorted before they become paths, comparing them is cheaper than whole paths
+                vector<pair<string_view, unsigned char>> matched;
+                for (const Entry& entry : listing->entries) {
+                    string_view name{listing->names.data() + entry.offset, entry.length};
+                    if (!isDotOrDotDot(name) && compiled.matches(name)) {
+                        matched.emplace_back(name, entry.type);
+                    }
+                }
+                sort(matched.begin(), matched.end());
+
+                found.reserve(found.size() + matched.size());
+                for (const auto& [name, type] : matched) {
+                    string path = join(base, name);
+                    if (!onlyDirectories || isDirectory(path, type)) {
+                        found.push_back(move(path));
+                    }
+                }
+            }
+            lastLiteral = false;
+        }
+
+        paths = move(found);
+    }
+
+    // literal components were not checked against the file system yet
+    if (lastLiteral) {
+        paths.erase(remove_if(paths.begin(), paths.end(),
+                              [&](const string& path) {
+                                  struct stat info {};
+                                  return lstat(path.c_str(), &info) != 0 ||
+                                         (trailingSlash && !isDirectory(path, DT_UNKNOWN));
+                              }),
+                    paths.end());
+    }
+
+    // paths from a single directory come sorted already
+    if (!is_sorted(paths.begin(), paths.end())) {
+        sort(paths.begin(), paths.end());
+    }
+    paths.erase(unique(paths.begin(), paths.end()), paths.end());
+    if (trailingSlash) {
+        for (string& path : paths) {
+            if (path.back() != '/') {
+                path += '/';
+            }
+        }
+    }
+    return paths;
+}
+
+/// @brief Drops the cached directory listings.
+void Glob::clearCache() {
+    listings.clear();
+    cachedEntries = 0;
+}
+
+/**
+ * @brief Gives the listing of a directory, reading it only if the cached one is stale.
+ * @param directory The directory path.
+ * @return const Listing* The listing, nullptr if the directory cannot be read.
+ */
+const Glob::Listing* Glob::list(const std::string& directory) {
+    struct stat info {};
+    if (stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+        return nullptr;
+    }
+
+    auto cached = listings.find(directory);
+    if (cached != listings.end()) {
+        const Listing& listing = cached->second;
+        if (listing.device == info.st_dev && listing.inode == info.st_ino &&
+            listing.modified.tv_sec == info.st_mtim.tv_sec && listing.modified.tv_nsec == info.st_mtim.tv_nsec &&
+            listing.scanned > info.st_mtim.tv_sec) {
+            Metrics::add(Metrics::Counter::GlobCacheHits);
+            return &listing;
+        }
+
+        cachedEntries -= listing.entries.size();
+        listings.erase(cached);
+    }
+
+    // the scan time is taken first, a change during the scan makes the listing stale by its mtime
+    Metrics::add(Metrics::Counter::GlobCacheMisses);
+    Listing listing{info.st_dev, info.st_ino, info.st_mtim, time(nullptr), {}, {}};
+    if (!scan(directory, listing)) {
+        return nullptr;
+    }
+
+    if (cachedEntries + listing.entries.size() > maxCachedEntries) {
+        clearCache();
+    }
+    cachedEntries += listing.entries.size();
+    return &listings.insert_or_assign(directory, std::move(listing)).first->second;
+}
+
+/**
+ * @brief Reads a directory with getdents64().
+ * @param directory The directory path.
+ * @param listing Receives the entries.
+ * @return true on success.
+ */
+bool Glob::scan(const std::string& directory, Listing& listing) {
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    scanBuffer.resize(scanBufferSize);
+
+    long got;
+    while ((got = syscall(SYS_getdents64, fd, scanBuffer.data(), scanBuffer.size())) > 0) {
+        for (long pos = 0; pos < got;) {
+            const auto* record = reinterpret_cast<const dirent64*>(scanBuffer.data() + pos);
+            size_t length = std::strlen(record->d_name);
+
+            listing.entries.push_back({static_cast<uint32_t>(listing.names.size()), static_cast<uint32_t>(length),
+                                       record->d_type});
+            listing.names.insert(listing.names.end(), record->d_name, record->d_name + length);
+            pos += record->d_reclen;
+        }
+    }
+
+    close(fd);
+    return got == 0;
+}
+
+/**
+ * @brief Checks if an entry is a directory, following symlinks.
+ * @param path Path of the entry.
+ * @param type The d_type of the entry.
+ * @return true if it is a directory.
+ */
+bool Glob::isDirectory(const std::string& path, unsigned char type) {
+    if (type == DT_DIR) {
+        return true;
+    }
+    if (type != DT_LNK && type != DT_UNKNOWN) {
+        return false;
+    }
+
+    struct stat info {};
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+/**
+ * @brief Appends every directory below base (and base itself) to the output, for **.
+ * @param base The directory to start from, empty for the working directory.
+ * @param output Receives the directories.
+ */
+void Glob::collectDirectories(const std::string& base, std::vector<std::string>& output) {
+    std::vector<std::string> pending{base};
+    while (!pending.empty()) {
+        std::string directory = std::move(pending.back());
+        pending.pop_back();
+
+        const Listing* listing = list(directory.empty() ? "." : directory);
+        output.push_back(directory);
+        if (listing == nullptr) {
+            continue;
+        }
+
+        for (const Entry& entry : listing->entries) {
+            std::string_view name{listing->names.data() + entry.offset, entry.length};
+            if (name.front() == '.') {
+                continue;
+            }
+
+            // symlinks are not followed, so a link to a parent does not loop
+            std::string path = join(directory, name);
+            struct stat info {};
+            if (entry.type == DT_DIR || (entry.type == DT_UNKNOWN && lstat(path.c_str(), &info) == 0 &&
+                                         S_ISDIR(info.st_mode))) {
+                pending.push_back(std::move(path));
+            }
+        }
+    }
+}
@@ -0,0 +1,493 @@
+/**
+ * @file IoEngine.cpp
+ * @brief File implemets IoEngine class
+ *
+ * The ring is driven with the raw io_uring_setup() and io_uring_enter() syscalls. Entries are written to the
+ * shared submission queue and published with a release store of its tail, completions are taken from the
+ * completion queue after an acquire load of its tail. The engine is used from the thread running the
+ * commands only, so the queues need no locking.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "IoEngine.hpp"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+/// @brief Number of submission queue entries of the ring.
+constexpr unsigned ringEntries = 64;
+
+/// @brief Number of chunks a copy keeps in flight.
+constexpr size_t copySlots = 4;
+
+/// @brief Size of a single chunk of a copy.
+constexpr size_t copyChunk = 128 * 1024;
+
+/**
+ * @brief Copies the rest of a file with plain syscalls.
+ * @param source Descriptor to read from.
+ * @param destination Descriptor to write to.
+ * @return long long Number of bytes copied.
+ * @throws std::runtime_error on read or write errors.
+ */
+long long copySync(int source, int destination) {
+    using namespace std;
+
+    long long copied = 0;
+
+    // copy_file_range() keeps the data in the kernel and works for most pairs of regular files
+    while (true) {
+        ssize_t moved = copy_file_range(source, nullptr, destination, nullptr, copyChunk, 0);
+        if (moved > 0) {
+            copied += moved;
+            continue;
+        }
+        if (moved == 0) {
+            return copied;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP && errno != EBADF) {
+            throw runtime_error("copy: "s + strerror(errno));
+        }
+        break;
+    }
+
+    unique_ptr<char[]> buffer{new char[copyChunk]};
+    while (true) {
+        ssize_t got = read(source, buffer.get(), copyChunk);
+        if (got == -1 && errno == EINTR) {
+            continue;
+        }
+        if (got == -1) {
+            throw runtime_error("copy: read: "s + strerror(errno));
+        }
+        if (got == 0) {
+            return copied;
+        }
+
+        for (ssize_t written = 0; written < got;) {
+            ssize_t put = write(destination, buffer.get() + written, got - written);
+            if (put == -1 && errno == EINTR) {
+                continue;
+            }
+            if (put == -1) {
+                throw runtime_error("copy: write: "s + strerror(errno));
+            }
+            written += put;
+        }
+        copied += got;
+    }
+}
+
+}  // namespace
+
+/// @brief Constructs a disabled IoEngine.
+IoEngine::IoEngine()
+    : useRing(false),
+      ringFd(-1),
+      sqRing(MAP_FAILED),
+      cqRing(MAP_FAILED),
+      sqes(nullptr),
+      sqRingSize(0),
+      cqRingSize(0),
+      sqesSize(0),
+      sqHead(nullptr),
+      sqTail(nullptr),
+      sqMask(nullptr),
+      sqArray(nullptr),
+      sqEntries(0),
+      cqHead(nullptr),
+      cqTail(nullptr),
+      cqMask(nullptr),
+      cqes(nullptr),
+      queued(0) {
+}
+
+/// @brief Tears the ring down.
+IoEngine::~IoEngine() {
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (ringFd != -1) {
+        close(ringFd);
+    }
+}
+
+/**
+ * @brief Enables or disables the io_uring path.
+ * @param name "uring" or "sync".
+ * @throws std::invalid_argument if the name is unknown.
+ */
+void IoEngine::select(const std::string& name) {
+    if (name == "uring") {
+        useRing = true;
+    } else if (name == "sync") {
+        useRing = false;
+    } else {
+        throw std::invalid_argument("unknown io engine " + name);
+    }
+}
+
+/**
+ * @brief Describes the engine in use.
+ * @return std::string "uring", "sync", or "sync (io_uring unavailable: ...)".
+ */
+std::string IoEngine::describe() const {
+    if (!useRing) {
+        return "sync";
+    }
+    if (!unavailableReason.empty()) {
+        return "sync (io_uring unavailable: " + unavailableReason + ")";
+    }
+    return "uring";
+}
+
+/**
+ * @brief Opens all the files at once.
+ * @param requests The files to open.
+ * @return std::vector<int> Descriptor or -errno for every request, in order.
+ */
+std::vector<int> IoEngine::openAll(const std::vector<OpenRequest>& requests) {
+    using namespace std;
+
+    vector<int> result(requests.size(), -EIO);
+
+    if (!useRing || !setupRing()) {
+        for (size_t i = 0; i < requests.size(); i++) {
+            int fd = open(requests[i].path.c_str(), requests[i].flags, requests[i].mode);
+            result[i] = fd == -1 ? -errno : fd;
+        }
+        return result;
+    }
+
+    for (size_t first = 0; first < requests.size();) {
+        // as many opens as fit into the queue go with a single io_uring_enter()
+        size_t count = 0;
+        for (io_uring_sqe* sqe; first + count < requests.size() && (sqe = nextSqe()) != nullptr; count++) {
+            const OpenRequest& request = requests[first + count];
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(request.path.c_str());
+            sqe->open_flags = static_cast<uint32_t>(request.flags);
+            sqe->len = request.mode;
+            sqe->user_data = first + count;
+        }
+
+        int error = submit(count);
+        for (size_t done = 0; done < count && error == 0;) {
+            uint64_t index;
+            int opened;
+            if (nextCqe(index, opened)) {
+                result[index] = opened;
+                done++;
+            } else {
+                error = submit(1);
+            }
+        }
+        if (error != 0) {
+            throw runtime_error("io_uring: "s + strerror(-error));
+        }
+
+        first += count;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Copies the whole content of one file to another.
+ * @param source Descriptor to read from.
+ * @param destination Descriptor to write to.
+ * @return long long Number of bytes copied.
+ * @throws std::runtime_error on read or write errors.
+ */
+long long IoEngine::copy(int source, int destination) {
+    struct stat info {};
+    if (useRing && fstat(source, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 && setupRing()) {
+        return copyOnRing(source, destination, info.st_size);
+    }
+    return copySync(source, destination);
+}
+
+/// @brief Sets the ring up, returns false (and remembers why) if io_uring is not available.
+bool IoEngine::setupRing() {
+    using namespace std;
+
+    if (ringFd != -1) {
+        return true;
+    }
+    if (!unavailableReason.empty()) {
+        return false;
+    }
+
+    io_uring_params params{};
+    int fd = static_cast<int>(syscall(SYS_io_uring_setup, ringEntries, &params));
+    if (fd == -1) {
+        unavailableReason = strerror(errno);
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) {
+        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cqRing = singleMap || sqRing == MAP_FAILED
+                 ? sqRing
+                 : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* entries = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || entries == MAP_FAILED) {
+        unavailableReason = "mmap: "s + strerror(errno);
+        if (entries != MAP_FAILED) {
+            munmap(entries, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            munmap(sqRing, sqRingSize);
+        }
+        sqRing = cqRing = MAP_FAILED;
+        close(fd);
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<atomic<unsigned>*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<atomic<unsigned>*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqEntries = params.sq_entries;
+
+    char* cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<atomic<unsigned>*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<atomic<unsigned>*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    sqes = static_cast<io_uring_sqe*>(entries);
+    ringFd = fd;
+    return true;
+}
+
+/**
+ * @brief Takes the next free submission entry.
+ * @return io_uring_sqe* The cleared entry, nullptr if the queue is full.
+ */
+io_uring_sqe* IoEngine::nextSqe() {
+    unsigned tail = sqTail->load(std::memory_order_relaxed);
+    if (tail - sqHead->load(std::memory_order_acquire) >= sqEntries) {
+        return nullptr;
+    }
+
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+
+    // the kernel only looks at the entries on io_uring_enter(), so the tail can be published right away
+    sqTail->store(tail + 1, std::memory_order_release);
+    queued++;
+    return sqe;
+}
+
+/**
+ * @brief Submits the queued entries and waits for completions.
+ * @param waitFor Number of completions to wait for.
+ * @return int 0 on success, -errno otherwise.
+ */
+int IoEngine::submit(unsigned waitFor) {
+    while (true) {
+        unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+        long submitted = syscall(SYS_io_uring_enter, ringFd, queued, waitFor, flags, nullptr, 0);
+        if (submitted >= 0) {
+            queued -= static_cast<unsigned>(submitted);
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+}
+
+/**
+ * @brief Takes the next completion, if there is one.
+ * @param userData Receives the user data of the request.
+ * @param result Receives the result of the request.
+ * @return true if a completion was taken.
+ */
+bool IoEngine::nextCqe(uint64_t& userData, int& result) {
+    unsigned head = cqHead->load(std::memory_order_relaxed);
+    if (head == cqTail->load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    const io_uring_cqe& cqe = cqes[head & *cqMask];
+    userData = cqe.user_data;
+    result = cqe.res;
+    cqHead->store(head + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Copies a regular file through the ring, keeping several reads and writes in flight.
+ *
+ * The file is cut into chunks and every slot carries one chunk at a time: it is read at its offset and
+ * then written at the same offset, short reads and writes are resumed. When a slot has written its chunk
+ * it takes the next one, so reads of some chunks overlap with writes of others.
+ *
+ * @param source Descriptor to read from.
+ * @param destination Descriptor to write to.
+ * @param size Size of the source file.
+ * @return long long Number of bytes copied.
+ * @throws std::runtime_error on read or write errors.
+ */
+long long IoEngine::copyOnRing(int source, int destination, off_t size) {
+    using namespace std;
+
+    struct Slot {
+        unique_ptr<char[]> buffer;
+        off_t offset;
+        size_t length;
+        size_t filled;
+        size_t written;
+        bool writing;
+    };
+
+    Slot slots[copySlots];
+    off_t nextOffset = 0;
+    long long copied = 0;
+    unsigned inFlight = 0;
+
+    auto queue = [&](size_t index) {
+        Slot& slot = slots[index];
+        io_uring_sqe* sqe = nextSqe();
+        if (slot.writing) {
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = destination;
+            sqe->addr = reinterpret_cast<uint64_t>(slot.buffer.get() + slot.written);
+            sqe->len = static_cast<uint32_t>(slot.filled - slot.written);
+            sqe->off = static_cast<uint64_t>(slot.offset) + slot.written;
+        } else {
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = source;
+            sqe->addr = reinterpret_cast<uint64_t>(slot.buffer.get() + slot.filled);
+            sqe->len = static_cast<uint32_t>(slot.length - slot.filled);
+            sqe->off = static_cast<uint64_t>(slot.offset) + slot.filled;
+        }
+        sqe->user_data = index;
+        inFlight++;
+    };
+
+    auto takeChunk = [&](size_t index) {
+        if (nextOffset >= size) {
+            return;
+        }
+        Slot& slot = slots[index];
+        slot.offset = nextOffset;
+        slot.length = static_cast<size_t>(min<off_t>(copyChunk, size - nextOffset));
+        slot.filled = slot.written = 0;
+        slot.writing = false;
+        nextOffset += static_cast<off_t>(slot.length);
+        queue(index);
+    };
+
+    for (size_t i = 0; i < copySlots; i++) {
+        slots[i].buffer.reset(new char[copyChunk]);
+        takeChunk(i);
+    }
+
+    string error;
+    while (inFlight > 0) {
+        int submitError = submit(1);
+        if (submitError != 0) {
+            // what is in flight still points to the buffers, they must outlive it
+            error = "io_uring: "s + strerror(-submitError);
+            break;
+        }
+
+        uint64_t index;
+        int result;
+        while (nextCqe(index, result)) {
+            inFlight--;
+            Slot& slot = slots[index];
+
+            if (result == -EINTR || result == -EAGAIN) {
+                queue(index);
+                continue;
+            }
+            if (result < 0 || (result == 0 && slot.writing)) {
+                if (error.empty()) {
+                    error = (slot.writing ? "copy: write: "s : "copy: read: "s) + strerror(result < 0 ? -result : EIO);
+                }
+                continue;
+            }
+            if (!error.empty()) {
+                continue;
+            }
+
+            if (!slot.writing) {
+                slot.filled += static_cast<size_t>(result);
+                if (result == 0) {
+                    // the file got shorter since fstat()
+                    slot.length = slot.filled;
+                    nextOffset = size;
+                }
+                slot.writing = slot.filled == slot.length;
+                if (slot.writing && slot.length == 0) {
+                    continue;
+                }
+                queue(index);
+                continue;
+            }
+
+            slot.written += static_cast<size_t>(result);
+            if (slot.written < slot.filled) {
+                queue(index);
+                continue;
+            }
+            copied += static_cast<long long>(slot.written);
+            takeChunk(index);
+        }
+    }
+
+    if (!error.empty()) {
+        if (inFlight > 0) {
+            // the buffers cannot be released while the kernel may still use them
+            for (Slot& slot : slots) {
+                slot.buffer.release();
+            }
+        }
+        throw runtime_error(error);
+    }
+
+    // the copied part is at the start of the destination, the file position is moved past it
+    lseek(destination, static_cast<off_t>(copied), SEEK_SET);
+    return copied;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file JobPriority.cpp
+ * @brief File implemets JobPriority class
+ *
+ * glibc has no wrapper for ioprio_set(2), it is called through syscall() with the constants of
+ * linux/ioprio.h, which older kernel headers do not ship.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "JobPriority.hpp"
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+/// @brief I/O scheduling classes of ioprio_set(2).
+constexpr int ioClassNone = 0;
+constexpr int ioClassBestEffort = 2;
+constexpr int ioClassIdle = 3;
+
+/// @brief Targets of ioprio_set(2).
+constexpr int ioWhoProcess = 1;
+constexpr int ioWhoGroup = 2;
+
+/// @brief Bit the I/O class starts at in an I/O priority.
+constexpr int ioClassShift = 13;
+
+/**
+ * @brief Sets the I/O priority of a process or a process group.
+ * @param who ioWhoProcess or ioWhoGroup.
+ * @param id The pid or the pgid, 0 for the calling one.
+ * @param ioClass The I/O class.
+ * @param level The level within the class.
+ * @return true on success.
+ */
+bool setIoPriority(int who, pid_t id, int ioClass, int level) {
+    return syscall(SYS_ioprio_set, who, id, (ioClass << ioClassShift) | level) == 0;
+}
+
+}  // namespace
+
+/**
+ * @brief Gives the class of a name.
+ * @param name high, normal, batch or idle.
+ * @return Class The class.
+ * @throws std::invalid_argument if the name is unknown.
+ */
+JobPriority::Class JobPriority::parse(const std::string& name) {
+    for (Class priority : {Class::High, Class::Normal, Class::Batch, Class::Idle}) {
+        if (name == JobPriority::name(priority)) {
+            return priority;
+        }
+    }
+    throw std::invalid_argument("unknown priority class \"" + name + "\"");
+}
+
+/**
+ * @brief Gives the name of a class.
+ * @param priority The class.
+ * @return const char* The name.
+ */
+const char* JobPriority::name(Class priority) {
+    switch (priority) {
+        case Class::High:
+            return "high";
+        case Class::Normal:
+            return "normal";
+        case Class::Batch:
+            return "batch";
+        case Class::Idle:
+            return "idle";
+    }
+    return "normal";
+}
+
+/**
+ * @brief Applies a class to the calling process, only async-signal-safe calls are made. A failure is
+ * reported on stderr.
+ * @param priority The class.
+ */
+void JobPriority::apply(Class priority) {
+    if (priority == Class::Normal) {
+        return;
+    }
+
+    const Settings& wanted = settings(priority);
+    sched_param parameters{};
+    bool applied = sched_setscheduler(0, wanted.policy, &parameters) == 0;
+    // raising the priority takes CAP_SYS_NICE, the command still runs then
+    applied = setpriority(PRIO_PROCESS, 0, wanted.nice) == 0 && applied;
+    applied = setIoPriority(ioWhoProcess, 0, wanted.ioClass, wanted.ioLevel) && applied;
+    if (!applied) {
+        const char prefix[] = "prio: cannot apply class ";
+        const char* className = name(priority);
+        const char suffix[] = ", the command runs without it\n";
+        write(STDERR_FILENO, prefix, sizeof(prefix) - 1);
+        write(STDERR_FILENO, className, strlen(className));
+        write(STDERR_FILENO, suffix, sizeof(suffix) - 1);
+    }
+}
+
+/**
+ * @brief Applies a class to a running process group, the scheduling policy to its leader only.
+ * @param pgid The group, its leader has the same pid.
+ * @param priority The class, normal resets the group to nice 0 and the default I/O priority.
+ * @return true if every setting was applied, false otherwise with errno set.
+ */
+bool JobPriority::applyTo(pid_t pgid, Class priority) {
+    const Settings& wanted = settings(priority);
+    sched_param parameters{};
+    bool applied = sched_setscheduler(pgid, wanted.policy, &parameters) == 0;
+    applied = setpriority(PRIO_PGRP, static_cast<id_t>(pgid), wanted.nice) == 0 && applied;
+    return setIoPriority(ioWhoGroup, pgid, wanted.ioClass, wanted.ioLevel) && applied;
+}
+
+/**
+ * @brief Gives the settings of a class.
+ * @param priority The class.
+ * @return const Settings& The settings.
+ */
+const JobPriority::Settings& JobPriority::settings(Class priority) {
+    static constexpr Settings high{-5, ioClassBestEffort, 0, SCHED_OTHER};
+    static constexpr Settings normal{0, ioClassNone, 0, SCHED_OTHER};
+    static constexpr Settings batch{10, ioClassBestEffort, 7, SCHED_BATCH};
+    static constexpr Settings idle{19, ioClassIdle, 0, SCHED_IDLE};
+
+    switch (priority) {
+        case Class::High:
+            return high;
+        case Class::Normal:
+            return normal;
+        case Class::Batch:
+            return batch;
+        case Class::Idle:
+            return idle;
+    }
+    return normal;
+}
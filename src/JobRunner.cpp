@@ -0,0 +1,336 @@
+/**
+ * @file JobRunner.cpp
+ * @brief File implemets JobRunner class
+ *
+ * Commands are spawned with posix_spawn(), which is safe to call from many threads at once and does not
+ * copy the address space of the embedding program. The working directory, the redirection and the process
+ * group are set up by spawn file actions and attributes in the child, so nothing changes in the parent.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "JobRunner.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "Parser.hpp"
+#include "PathUtils.hpp"
+
+extern char** environ;
+
+namespace {
+
+/// @brief Maximum number of events handled by one epoll_wait call.
+constexpr int maxEvents = 64;
+
+/**
+ * @brief Waits for a child and collects its resource usage.
+ * @param pid The child.
+ * @return JobRunner::Result The outcome.
+ * @throws std::runtime_error if the child was reaped by somebody else.
+ */
+JobRunner::Result waitChild(pid_t pid) {
+    using namespace std;
+
+    JobRunner::Result result{pid, 0, {}};
+    pid_t waited;
+    while ((waited = wait4(pid, &result.status, 0, &result.usage)) == -1 && errno == EINTR) {
+    }
+    if (waited == -1) {
+        throw runtime_error("wait4: "s + strerror(errno));
+    }
+    return result;
+}
+
+}  // namespace
+
+/**
+ * @brief Constructs a JobRunner, the reaper thread is started on the first submit.
+ * @param searchPath Directories searched for executables given without a slash.
+ */
+JobRunner::JobRunner(std::vector<std::string> searchPath)
+    : searchPath(std::move(searchPath)), epollFd(-1), wakeFd(-1), stopping(false) {
+}
+
+/// @brief Waits for all submitted commands to finish and stops the reaper thread.
+JobRunner::~JobRunner() {
+    if (reaper.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) == sizeof(one)) {
+            reaper.join();
+        } else {
+            reaper.detach();
+        }
+    }
+
+    if (epollFd != -1) {
+        close(epollFd);
+    }
+    if (wakeFd != -1) {
+        close(wakeFd);
+    }
+}
+
+/**
+ * @brief Parses a script, one command line per line.
+ * @param script The script text.
+ * @return std::vector<std::unique_ptr<Command>> Parsed commands, in order.
+ * @throws std::invalid_argument if a line cannot be parsed.
+ */
+std::vector<std::unique_ptr<Command>> JobRunner::parse(const std::string& script) {
+    using namespace std;
+
+    Parser parser;
+    vector<unique_ptr<Command>> commands;
+
+    size_t lineBegin = 0;
+    while (lineBegin < script.size()) {
+        size_t lineEnd = script.find('\n', lineBegin);
+        if (lineEnd == string::npos) {
+            lineEnd = script.size();
+        }
+
+        string line = script.substr(lineBegin, lineEnd - lineBegin);
+        lineBegin = lineEnd + 1;
+        if (line.find_first_not_of(Parser::spaceSymbols) == string::npos) {
+            continue;
+        }
+
+        for (unique_ptr<Command>& command : parser.parse(line)) {
+            commands.push_back(move(command));
+        }
+    }
+
+    return commands;
+}
+
+/**
+ * @brief Spawns a command, the background flag of the command is ignored.
+ * @param cmd The command to run.
+ * @param options Working directory, environment and redirection of the command.
+ * @return std::future<Result> Future becoming ready when the command finishes.
+ * @throws std::runtime_error if the command cannot be spawned.
+ */
+std::future<JobRunner::Result> JobRunner::submit(const Command& cmd, const SpawnOptions& options) {
+    using namespace std;
+
+    start();
+
+    // transforming args to c-like style (char**)
+    string executableName = utils::PathUtils::lookup(searchPath, cmd.getName());
+    vector<string> commandArgs(cmd.getArgs());
+
+    vector<char*> executableArgs;
+    executableArgs.reserve(commandArgs.size() + 2);
+    executableArgs.push_back(const_cast<char*>(executableName.c_str()));
+    for (const string& arg : commandArgs) {
+        executableArgs.push_back(const_cast<char*>(arg.c_str()));
+    }
+    executableArgs.push_back(nullptr);
+
+    vector<char*> environment;
+    if (options.environment) {
+        environment.reserve(options.environment->size() + 1);
+        for (const string& entry : *options.environment) {
+            environment.push_back(const_cast<char*>(entry.c_str()));
+        }
+        environment.push_back(nullptr);
+    }
+
+    // the child changes directory first, so a relative redirect is relative to the new directory
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (options.workingDirectory) {
+        posix_spawn_file_actions_addchdir_np(&actions, options.workingDirectory->c_str());
+    }
+
+    if (options.outputFd) {
+        posix_spawn_file_actions_adddup2(&actions, *options.outputFd, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, *options.outputFd, STDERR_FILENO);
+    }
+
+    // the redirections are applied in order, the last target of a stream wins
+    vector<Command::Redirect> redirects = cmd.getRedirects();
+    if (options.outputRedirect) {
+        redirects = {{Command::Redirect::Stream::OutputAndError, *options.outputRedirect, false}};
+    }
+    for (const Command::Redirect& redirect : redirects) {
+        const int permissions = 0644;
+        int flags = O_WRONLY | O_CREAT | (redirect.append ? O_APPEND : O_TRUNC);
+        switch (redirect.stream) {
+            case Command::Redirect::Stream::Input:
+                posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, redirect.target.c_str(), O_RDONLY, 0);
+                break;
+            case Command::Redirect::Stream::Output:
+                posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, redirect.target.c_str(), flags,
+                                                 permissions);
+                break;
+            case Command::Redirect::Stream::Error:
+                posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, redirect.target.c_str(), flags,
+                                                 permissions);
+                break;
+            case Command::Redirect::Stream::OutputAndError:
+                posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, redirect.target.c_str(), flags,
+                                                 permissions);
+                posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+                break;
+        }
+    }
+
+    // a process group of its own and a clean signal state, whatever the calling thread has
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t noSignals;
+    sigset_t allSignals;
+    sigemptyset(&noSignals);
+    sigfillset(&allSignals);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    posix_spawnattr_setsigmask(&attributes, &noSignals);
+    posix_spawnattr_setsigdefault(&attributes, &allSignals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int error = posix_spawn(&pid, executableName.c_str(), &actions, &attributes, executableArgs.data(),
+                            options.environment ? environment.data() : environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+
+    if (error != 0) {
+        throw runtime_error("spawn " + cmd.getName() + ": " + strerror(error));
+    }
+    if (options.priority) {
+        JobPriority::applyTo(pid, *options.priority);
+    }
+    if (options.spawned) {
+        options.spawned(pid);
+    }
+
+    promise<Result> finished;
+    future<Result> result = finished.get_future();
+
+    int pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd == -1) {
+        // no pidfds on this kernel, the child gets a waiting thread of its own
+        thread([pid, finished = move(finished)]() mutable {
+            try {
+                finished.set_value(waitChild(pid));
+            } catch (...) {
+                finished.set_exception(current_exception());
+            }
+        }).detach();
+        return result;
+    }
+
+    lock_guard<std::mutex> lock(mutex);
+    pending.emplace(pidfd, Pending{pid, move(finished)});
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = pidfd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, pidfd, &event);
+
+    return result;
+}
+
+/// @brief Creates the epoll instance and starts the reaper thread if it is not running yet.
+void JobRunner::start() {
+    using namespace std;
+
+    lock_guard<std::mutex> lock(mutex);
+    if (reaper.joinable()) {
+        return;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd == -1 || wakeFd == -1) {
+        throw runtime_error("job runner: "s + strerror(errno));
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+    // signals are left to the threads of the embedding program
+    sigset_t allSignals;
+    sigset_t previous;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &previous);
+    reaper = thread(&JobRunner::loop, this);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+/// @brief Reaper thread body, waits for the children and fulfills their promises.
+void JobRunner::loop() {
+    epoll_event events[maxEvents];
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping && pending.empty()) {
+                return;
+            }
+        }
+
+        int ready = epoll_wait(epollFd, events, maxEvents, -1);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.fd == wakeFd) {
+                uint64_t count;
+                read(wakeFd, &count, sizeof(count));
+                continue;
+            }
+            reap(events[i].data.fd);
+        }
+    }
+}
+
+/**
+ * @brief Reaps a finished child and fulfills its promise.
+ * @param pidfd The pidfd of the child.
+ */
+void JobRunner::reap(int pidfd) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto found = pending.find(pidfd);
+    if (found == end(pending)) {
+        return;
+    }
+
+    Pending child = std::move(found->second);
+    pending.erase(found);
+    lock.unlock();
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, pidfd, nullptr);
+    close(pidfd);
+
+    try {
+        child.promise.set_value(waitChild(child.pid));
+    } catch (...) {
+        child.promise.set_exception(std::current_exception());
+    }
+}
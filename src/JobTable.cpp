@@ -0,0 +1,180 @@
+/**
+ * @file JobTable.cpp
+ * @brief File implemets JobTable class
+ *
+ * Jobs are kept in a map ordered by their number, which is the order they are listed in. A second index by
+ * pid makes the status updates from the SIGCHLD handler cheap no matter how many jobs there are.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "JobTable.hpp"
+
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cassert>
+
+/// @brief Constructs an empty JobTable.
+JobTable::JobTable() : nextId(1) {
+}
+
+/// @brief Closes the pidfds of the remaining jobs.
+JobTable::~JobTable() {
+    for (auto& [id, job] : jobs) {
+        if (job.pidfd != -1) {
+            close(job.pidfd);
+        }
+    }
+}
+
+/**
+ * @brief Takes the number for the next job.
+ * @return int The job number.
+ */
+int JobTable::reserveId() {
+    return nextId++;
+}
+
+/**
+ * @brief Adds a running job.
+ * @param id Job number taken with reserveId().
+ * @param pid Pid of the job process.
+ * @param commandLine The command line the job was started with.
+ * @return Job& The added job.
+ */
+Job& JobTable::add(int id, pid_t pid, const std::string& commandLine) {
+    assert(jobs.find(id) == jobs.end());
+
+    int pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+
+    idsByPid[pid] = id;
+    return jobs[id] = Job{id, pid, pidfd, commandLine, Job::State::Running, -1, -1, -1};
+}
+
+/**
+ * @brief Finds a job by its number.
+ * @param id The job number.
+ * @return Job* The job or nullptr if there is none.
+ */
+Job* JobTable::find(int id) {
+    auto found = jobs.find(id);
+    return found != jobs.end() ? &found->second : nullptr;
+}
+
+/**
+ * @brief Finds a job by its process id.
+ * @param pid The process id.
+ * @return Job* The job or nullptr if there is none.
+ */
+Job* JobTable::findByPid(pid_t pid) {
+    auto found = idsByPid.find(pid);
+    return found != idsByPid.end() ? find(found->second) : nullptr;
+}
+
+/**
+ * @brief Finds the most recently started job that is not done.
+ * @return Job* The job or nullptr if there is none.
+ */
+Job* JobTable::latest() {
+    for (auto job = jobs.rbegin(); job != jobs.rend(); job++) {
+        if (job->second.state != Job::State::Done) {
+            return &job->second;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Updates the job of a process with a status returned by waitpid().
+ * @param pid The process id.
+ * @param status The wait status.
+ * @return Job* The updated job or nullptr if the process is not a job.
+ */
+Job* JobTable::update(pid_t pid, int status) {
+    Job* job = findByPid(pid);
+    if (job == nullptr) {
+        return nullptr;
+    }
+
+    if (WIFSTOPPED(status)) {
+        job->state = Job::State::Stopped;
+    } else if (WIFCONTINUED(status)) {
+        job->state = Job::State::Running;
+    } else {
+        finish(*job, status);
+    }
+    return job;
+}
+
+/**
+ * @brief Marks a job done with the given status.
+ * @param job The job.
+ * @param status The wait status, -1 if it is unknown.
+ */
+void JobTable::finish(Job& job, int status) {
+    if (job.state == Job::State::Done) {
+        return;
+    }
+
+    job.state = Job::State::Done;
+    job.status = status;
+    if (job.pidfd != -1) {
+        close(job.pidfd);
+        job.pidfd = -1;
+    }
+    idsByPid.erase(job.pid);
+
+    if (finishHandler) {
+        finishHandler(job);
+    }
+
+    // the oldest unreported jobs are forgotten, nobody is going to ask for them anymore
+    doneJobs.push_back(job.id);
+    while (doneJobs.size() > maxDoneJobs) {
+        auto oldest = jobs.find(doneJobs.front());
+        if (oldest != jobs.end() && oldest->second.state == Job::State::Done) {
+            jobs.erase(oldest);
+        }
+        doneJobs.pop_front();
+    }
+}
+
+/**
+ * @brief Sets the callback invoked when a job becomes done.
+ * @param handler The callback.
+ */
+void JobTable::setFinishHandler(FinishHandler handler) {
+    finishHandler = std::move(handler);
+}
+
+/**
+ * @brief Removes a job from the table.
+ * @param id The job number.
+ */
+void JobTable::remove(int id) {
+    auto found = jobs.find(id);
+    if (found == jobs.end()) {
+        return;
+    }
+
+    if (found->second.pidfd != -1) {
+        close(found->second.pidfd);
+    }
+    if (found->second.state != Job::State::Done) {
+        idsByPid.erase(found->second.pid);
+    }
+    jobs.erase(found);
+}
+
+/// @brief Returns an iterator to the first job.
+std::map<int, Job>::iterator JobTable::begin() {
+    return jobs.begin();
+}
+
+/// @brief Returns an iterator past the last job.
+std::map<int, Job>::iterator JobTable::end() {
+    return jobs.end();
+}
@@ -0,0 +1,315 @@
+/**
+ * @file Jobserver.cpp
+ * @brief File implemets Jobserver class
+ *
+ * Only the last jobserver flag of MAKEFLAGS counts, as for make. Both the "--jobserver-auth=" flag of make
+ * 4.2 and later and the "--jobserver-fds=" one of older versions are understood.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "Jobserver.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "Metrics.hpp"
+
+namespace {
+
+/**
+ * @brief Splits MAKEFLAGS into its words.
+ * @param makeflags The value of MAKEFLAGS.
+ * @return std::vector<std::string_view> The words.
+ */
+std::vector<std::string_view> splitFlags(std::string_view makeflags) {
+    std::vector<std::string_view> words;
+    size_t start = 0;
+    while ((start = makeflags.find_first_not_of(' ', start)) != std::string_view::npos) {
+        size_t end = std::min(makeflags.find(' ', start), makeflags.size());
+        words.push_back(makeflags.substr(start, end - start));
+        start = end;
+    }
+    return words;
+}
+
+/**
+ * @brief Parses an inherited descriptor of a "R,W" jobserver.
+ * @param text The number.
+ * @return int The descriptor, -1 if it is not a number or the descriptor is not an open pipe.
+ */
+int inheritedPipe(std::string_view text) {
+    int fd = -1;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), fd);
+    struct stat status {};
+    if (error != std::errc{} || end != text.data() + text.size() || fd < 0 || fstat(fd, &status) == -1 ||
+        !S_ISFIFO(status.st_mode)) {
+        return -1;
+    }
+    return fd;
+}
+
+}  // namespace
+
+/// @brief Constructs a disabled Jobserver, every job runs without a token.
+Jobserver::Jobserver() : input(-1), output(-1), ownsOutput(false), served{-1, -1}, ownSlotFree(true) {
+}
+
+/// @brief Closes the descriptors of the shell, the tokens of running jobs are not given back.
+Jobserver::~Jobserver() {
+    disconnect();
+}
+
+/**
+ * @brief Becomes a client of the jobserver announced in MAKEFLAGS, if there is one.
+ * @param makeflags The value of MAKEFLAGS.
+ * @return std::optional<std::string> A warning if a jobserver is announced but cannot be used, the jobs are
+ * not limited then.
+ */
+std::optional<std::string> Jobserver::connect(std::string_view makeflags) {
+    using namespace std;
+
+    string_view auth;
+    for (string_view word : splitFlags(makeflags)) {
+        for (string_view flag : {"--jobserver-auth=", "--jobserver-fds="}) {
+            if (word.substr(0, flag.size()) == flag) {
+                auth = word.substr(flag.size());
+            }
+        }
+    }
+    if (auth.empty()) {
+        return nullopt;
+    }
+    disconnect();
+
+    constexpr string_view fifoPrefix = "fifo:";
+    if (auth.substr(0, fifoPrefix.size()) == fifoPrefix) {
+        string path{auth.substr(fifoPrefix.size())};
+        // the reading end is opened first, so opening the writing one does not wait for a reader
+        input = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        output = input == -1 ? -1 : open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        ownsOutput = true;
+        if (output == -1) {
+            string reason = strerror(errno);
+            disconnect();
+            return "jobserver unavailable: " + path + ": " + reason;
+        }
+    } else {
+        size_t comma = auth.find(',');
+        int readFd = comma == string_view::npos ? -1 : inheritedPipe(auth.substr(0, comma));
+        int writeFd = comma == string_view::npos ? -1 : inheritedPipe(auth.substr(comma + 1));
+        if (readFd == -1 || writeFd == -1) {
+            // make closes the descriptors for the commands it does not consider recursive
+            return "jobserver unavailable: descriptors " + string{auth} +
+                   " are not open, add '+' to the make rule";
+        }
+        input = reopen(readFd);
+        output = writeFd;
+        ownsOutput = false;
+        if (input == -1) {
+            return "jobserver unavailable: cannot reopen descriptor " + to_string(readFd) + ": " +
+                   strerror(errno);
+        }
+    }
+
+    lock_guard<mutex> lock(stateMutex);
+    ownSlotFree = true;
+    return nullopt;
+}
+
+/**
+ * @brief Creates a jobserver with a number of slots, replacing the one the shell was a client of. To be
+ * called before any job is started.
+ * @param slots The number of jobs that may run at once in the whole tree, at least 1.
+ * @param makeflags The value of MAKEFLAGS, "" if it is not set.
+ * @return std::string MAKEFLAGS for the children, the -j and jobserver flags replaced.
+ * @throws std::runtime_error if the pipe cannot be created.
+ */
+std::string Jobserver::serve(size_t slots, std::string_view makeflags) {
+    using namespace std;
+
+    disconnect();
+
+    // the ends are inherited by every child, like the ones of make
+    if (pipe(served) == -1) {
+        served[0] = served[1] = -1;
+        throw runtime_error("jobserver: pipe: "s + strerror(errno));
+    }
+    input = reopen(served[0]);
+    string tokens(slots - 1, '+');
+    if (input == -1 ||
+        write(served[1], tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size())) {
+        string reason = strerror(errno);
+        disconnect();
+        throw runtime_error("jobserver: " + reason);
+    }
+    output = served[1];
+    ownsOutput = false;
+    {
+        lock_guard<mutex> lock(stateMutex);
+        ownSlotFree = true;
+    }
+
+    string flags;
+    for (string_view word : splitFlags(makeflags)) {
+        if (word.substr(0, 2) != "-j" && word.substr(0, 12) != "--jobserver-") {
+            flags.append(word);
+            flags += ' ';
+        }
+    }
+    return flags + "-j" + to_string(slots) + " --jobserver-auth=" + to_string(served[0]) + ',' +
+           to_string(served[1]);
+}
+
+/**
+ * @brief Checks if the jobs are limited by a jobserver.
+ * @return true if they are.
+ */
+bool Jobserver::enabled() const {
+    return input != -1;
+}
+
+/**
+ * @brief Takes a slot if one is free, without waiting. Safe to call from any thread.
+ * @param token Receives the token: ownSlot, a byte read from the jobserver or noToken if it is disabled.
+ * @return true if a slot was taken or the jobserver is disabled.
+ */
+bool Jobserver::tryAcquire(int& token) {
+    if (input == -1) {
+        token = noToken;
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (ownSlotFree) {
+            ownSlotFree = false;
+            token = ownSlot;
+            return true;
+        }
+    }
+
+    // another client may have taken the token since the descriptor was readable
+    unsigned char byte;
+    if (read(input, &byte, 1) != 1) {
+        return false;
+    }
+    token = byte;
+    return true;
+}
+
+/**
+ * @brief Waits for a slot. Safe to call from any thread.
+ *
+ * The caller is asked whether to give up before every wait, and at least every pollInterval milliseconds
+ * while it lasts, so it can collect the slots of its own finished jobs or stop at a deadline.
+ *
+ * @param token Receives the token, noToken if the wait was given up.
+ * @param giveUp Returns true to stop waiting.
+ * @return true if a slot was taken or the jobserver is disabled.
+ */
+bool Jobserver::acquire(int& token, const std::function<bool()>& giveUp) {
+    for (bool waited = false; !tryAcquire(token); waited = true) {
+        if (!waited) {
+            Metrics::add(Metrics::Counter::JobserverWaits);
+        }
+        if (giveUp()) {
+            token = noToken;
+            return false;
+        }
+        pollfd tokens{input, POLLIN, 0};
+        poll(&tokens, 1, pollInterval);
+    }
+    return true;
+}
+
+/**
+ * @brief Records the token a job holds, given back by release().
+ * @param pid The job process.
+ * @param token The token from tryAcquire() or acquire().
+ */
+void Jobserver::commit(pid_t pid, int token) {
+    if (token == noToken) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(stateMutex);
+    held[pid] = token;
+}
+
+/**
+ * @brief Gives back the token of a finished job, nothing if it holds none.
+ * @param pid The job process.
+ */
+void Jobserver::release(pid_t pid) {
+    int token;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        auto job = held.find(pid);
+        if (job == held.end()) {
+            return;
+        }
+        token = job->second;
+        held.erase(job);
+    }
+    giveBack(token);
+}
+
+/**
+ * @brief Gives back a token. Safe to call from any thread.
+ * @param token The token from tryAcquire() or acquire().
+ */
+void Jobserver::giveBack(int token) {
+    if (token == noToken || output == -1) {
+        return;
+    }
+    if (token == ownSlot) {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        ownSlotFree = true;
+        return;
+    }
+
+    // the pipe holds at most as many tokens as were taken from it, so the write never waits
+    unsigned char byte = static_cast<unsigned char>(token);
+    while (write(output, &byte, 1) == -1 && errno == EINTR) {
+    }
+}
+
+/**
+ * @brief Opens a non-blocking read descriptor of the shell on a jobserver pipe or fifo.
+ * @param fd A descriptor of the pipe, the new one gets a file description of its own.
+ * @return int The descriptor, -1 if it cannot be opened.
+ */
+int Jobserver::reopen(int fd) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+/// @brief Closes the descriptors of the shell and forgets the jobserver.
+void Jobserver::disconnect() {
+    if (input != -1) {
+        close(input);
+        input = -1;
+    }
+    if (ownsOutput && output != -1) {
+        close(output);
+    }
+    output = -1;
+    ownsOutput = false;
+    for (int& end : served) {
+        if (end != -1) {
+            close(end);
+            end = -1;
+        }
+    }
+}
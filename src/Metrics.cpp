@@ -0,0 +1,386 @@
+/**
+ * @file Metrics.cpp
+ * @brief File implemets Metrics class
+ *
+ * The shards are owned by a thread_local object that registers the shard when the thread first updates a
+ * metric and folds it into the retired total when the thread exits. Only the owning thread writes a shard,
+ * so an update needs no read-modify-write instruction, readers may see a value a moment old but never a torn
+ * one.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "Metrics.hpp"
+
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "StringUtils.hpp"
+
+namespace {
+
+constexpr size_t counterCount = static_cast<size_t>(Metrics::Counter::Count);
+constexpr size_t gaugeCount = static_cast<size_t>(Metrics::Gauge::Count);
+constexpr size_t histogramCount = static_cast<size_t>(Metrics::Histogram::Count);
+
+/// @brief Bits of a value below its highest bit that select the bucket within a power of two.
+constexpr unsigned subBucketBits = 3;
+
+/// @brief Names of the counters, in the order of Metrics::Counter.
+constexpr std::string_view counterNames[counterCount] = {
+    "lines_read",        "scripts_parsed", "parse_errors",    "commands_composed",
+    "commands_spawned",  "spawn_failures", "builtins_run",    "function_calls",
+    "children_reaped",   "glob_cache_hits", "glob_cache_misses", "commands_timed_out",
+    "coproc_requests",   "coproc_restarts", "jobserver_waits", "prefetch_hits",
+    "prefetch_misses",
+};
+
+/// @brief Names of the gauges, in the order of Metrics::Gauge.
+constexpr std::string_view gaugeNames[gaugeCount] = {"running_jobs", "stopped_jobs", "queued_items"};
+
+/// @brief Names of the histograms, in the order of Metrics::Histogram.
+constexpr std::string_view histogramNames[histogramCount] = {"parse", "spawn", "command"};
+
+/// @brief Metrics updated by a single thread.
+struct Shard {
+    std::array<std::atomic<uint64_t>, counterCount> counters{};
+    std::array<std::array<std::atomic<uint64_t>, Metrics::bucketCount>, histogramCount> buckets{};
+    std::array<std::atomic<uint64_t>, histogramCount> sums{};
+};
+
+/// @brief The shards of the running threads and what the exited ones left.
+struct Registry {
+    std::mutex mutex;
+    std::vector<const Shard*> shards;
+    Metrics::Snapshot retired{};
+    std::array<std::atomic<int64_t>, gaugeCount> gauges{};
+};
+
+/**
+ * @brief Gives the registry, which is never destroyed, as threads may exit after main() returned.
+ * @return Registry& The registry.
+ */
+Registry& registry() {
+    static Registry* instance = new Registry;
+    return *instance;
+}
+
+/**
+ * @brief Adds a shard to a snapshot.
+ * @param shard The shard.
+ * @param snapshot The snapshot.
+ */
+void accumulate(const Shard& shard, Metrics::Snapshot& snapshot) {
+    for (size_t i = 0; i < counterCount; i++) {
+        snapshot.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t h = 0; h < histogramCount; h++) {
+        for (size_t b = 0; b < Metrics::bucketCount; b++) {
+            snapshot.buckets[h][b] += shard.buckets[h][b].load(std::memory_order_relaxed);
+        }
+        snapshot.sums[h] += shard.sums[h].load(std::memory_order_relaxed);
+    }
+}
+
+/// @brief Registers the shard of a thread and retires it when the thread exits.
+struct ShardOwner {
+    Shard shard;
+
+    ShardOwner() {
+        Registry& metrics = registry();
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        metrics.shards.push_back(&shard);
+    }
+
+    ~ShardOwner() {
+        Registry& metrics = registry();
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        accumulate(shard, metrics.retired);
+        metrics.shards.erase(std::find(begin(metrics.shards), end(metrics.shards), &shard));
+    }
+};
+
+/**
+ * @brief Gives the shard of the calling thread.
+ * @return Shard& The shard.
+ */
+Shard& localShard() {
+    thread_local ShardOwner owner;
+    return owner.shard;
+}
+
+/**
+ * @brief Adds to a value only the calling thread writes.
+ * @param value The value.
+ * @param amount The amount.
+ */
+void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Finds the value below which a share of a histogram lies.
+ * @param buckets The buckets.
+ * @param count Number of values.
+ * @param quantile The share, 0 to 1.
+ * @return uint64_t The smallest value of the bucket the quantile falls into.
+ */
+uint64_t quantileOf(const std::array<uint64_t, Metrics::bucketCount>& buckets, uint64_t count,
+                    double quantile) {
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * static_cast<double>(count) + 0.5));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < Metrics::bucketCount; b++) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            return Metrics::bucketFloor(b);
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+/**
+ * @brief Adds to a counter of the calling thread.
+ * @param counter The counter.
+ * @param amount The amount.
+ */
+void Metrics::add(Counter counter, uint64_t amount) {
+    bump(localShard().counters[static_cast<size_t>(counter)], amount);
+}
+
+/**
+ * @brief Records a value in a histogram of the calling thread.
+ * @param histogram The histogram.
+ * @param nanoseconds The value.
+ */
+void Metrics::record(Histogram histogram, uint64_t nanoseconds) {
+    Shard& shard = localShard();
+    size_t index = static_cast<size_t>(histogram);
+    bump(shard.buckets[index][bucketOf(nanoseconds)], 1);
+    bump(shard.sums[index], nanoseconds);
+}
+
+/**
+ * @brief Sets a gauge.
+ * @param gauge The gauge.
+ * @param value The value.
+ */
+void Metrics::set(Gauge gauge, int64_t value) {
+    registry().gauges[static_cast<size_t>(gauge)].store(value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Changes a gauge.
+ * @param gauge The gauge.
+ * @param delta The change.
+ */
+void Metrics::change(Gauge gauge, int64_t delta) {
+    registry().gauges[static_cast<size_t>(gauge)].fetch_add(delta, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Gives the monotonic clock, for measuring the values of the histograms.
+ * @return uint64_t Nanoseconds since an arbitrary point.
+ */
+uint64_t Metrics::now() {
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000ULL + static_cast<uint64_t>(time.tv_nsec);
+}
+
+/**
+ * @brief Sums the shards of all the threads.
+ * @return Snapshot The sums.
+ */
+Metrics::Snapshot Metrics::snapshot() {
+    Registry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+
+    Snapshot snapshot = metrics.retired;
+    for (const Shard* shard : metrics.shards) {
+        accumulate(*shard, snapshot);
+    }
+    for (size_t i = 0; i < gaugeCount; i++) {
+        snapshot.gauges[i] = metrics.gauges[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+/**
+ * @brief Sums a single counter over all the threads, without the cost of a snapshot.
+ * @param counter The counter.
+ * @return uint64_t The sum.
+ */
+uint64_t Metrics::total(Counter counter) {
+    Registry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+
+    size_t index = static_cast<size_t>(counter);
+    uint64_t sum = metrics.retired.counters[index];
+    for (const Shard* shard : metrics.shards) {
+        sum += shard->counters[index].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+/**
+ * @brief Sums the values recorded in a histogram over all the threads, without the cost of a snapshot.
+ * @param histogram The histogram.
+ * @return uint64_t The sum of the values.
+ */
+uint64_t Metrics::total(Histogram histogram) {
+    Registry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+
+    size_t index = static_cast<size_t>(histogram);
+    uint64_t sum = metrics.retired.sums[index];
+    for (const Shard* shard : metrics.shards) {
+        sum += shard->sums[index].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+/**
+ * @brief Formats a snapshot for people: the counters, the gauges and quantiles of the histograms.
+ * @param snapshot The snapshot.
+ * @return std::string The report.
+ */
+std::string Metrics::report(const Snapshot& snapshot) {
+    std::string text;
+    char line[160];
+
+    for (size_t i = 0; i < counterCount; i++) {
+        snprintf(line, sizeof(line), "%-20s %llu\n", counterNames[i].data(),
+                 static_cast<unsigned long long>(snapshot.counters[i]));
+        text += line;
+    }
+    for (size_t i = 0; i < gaugeCount; i++) {
+        snprintf(line, sizeof(line), "%-20s %lld\n", gaugeNames[i].data(),
+                 static_cast<long long>(snapshot.gauges[i]));
+        text += line;
+    }
+
+    snprintf(line, sizeof(line), "%-20s %8s %9s %9s %9s %9s %9s\n", "latency", "count", "mean", "p50", "p90",
+             "p99", "max");
+    text += line;
+    for (size_t h = 0; h < histogramCount; h++) {
+        const auto& buckets = snapshot.buckets[h];
+        uint64_t count = 0;
+        size_t highest = 0;
+        for (size_t b = 0; b < bucketCount; b++) {
+            count += buckets[b];
+            highest = buckets[b] != 0 ? b : highest;
+        }
+        if (count == 0) {
+            snprintf(line, sizeof(line), "%-20s %8d\n", histogramNames[h].data(), 0);
+        } else {
+            using utils::StringUtils;
+            double mean = static_cast<double>(snapshot.sums[h]) / static_cast<double>(count);
+            auto quantile = [&](double share) {
+                return StringUtils::formatDuration(static_cast<double>(quantileOf(buckets, count, share)));
+            };
+            snprintf(line, sizeof(line), "%-20s %8llu %9s %9s %9s %9s %9s\n", histogramNames[h].data(),
+                     static_cast<unsigned long long>(count), StringUtils::formatDuration(mean).c_str(),
+                     quantile(0.5).c_str(), quantile(0.9).c_str(), quantile(0.99).c_str(),
+                     StringUtils::formatDuration(static_cast<double>(bucketFloor(highest))).c_str());
+        }
+        text += line;
+    }
+    return text;
+}
+
+/**
+ * @brief Formats a snapshot in the Prometheus text exposition format, durations in seconds.
+ *
+ * The histograms are exported with a bucket per power of two from 1 us to about 68 s, the finer buckets are
+ * only used for the quantiles of report().
+ *
+ * @param snapshot The snapshot.
+ * @return std::string The exposition.
+ */
+std::string Metrics::prometheus(const Snapshot& snapshot) {
+    using namespace std;
+
+    string text;
+    char line[160];
+
+    for (size_t i = 0; i < counterCount; i++) {
+        string name = "ishell_" + string{counterNames[i]} + "_total";
+        text += "# TYPE " + name + " counter\n";
+        snprintf(line, sizeof(line), "%s %llu\n", name.c_str(),
+                 static_cast<unsigned long long>(snapshot.counters[i]));
+        text += line;
+    }
+    for (size_t i = 0; i < gaugeCount; i++) {
+        string name = "ishell_" + string{gaugeNames[i]};
+        text += "# TYPE " + name + " gauge\n";
+        snprintf(line, sizeof(line), "%s %lld\n", name.c_str(), static_cast<long long>(snapshot.gauges[i]));
+        text += line;
+    }
+
+    const unsigned firstPower = 10;
+    const unsigned lastPower = 36;
+    for (size_t h = 0; h < histogramCount; h++) {
+        string name = "ishell_" + string{histogramNames[h]} + "_duration_seconds";
+        text += "# TYPE " + name + " histogram\n";
+
+        // every power of two starts a bucket, so the cumulative counts are exact at the bounds
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (unsigned power = firstPower; power <= lastPower; power++) {
+            uint64_t bound = 1ULL << power;
+            for (; bucket < bucketCount && bucketFloor(bucket) < bound; bucket++) {
+                cumulative += snapshot.buckets[h][bucket];
+            }
+            snprintf(line, sizeof(line), "%s_bucket{le=\"%.9g\"} %llu\n", name.c_str(),
+                     static_cast<double>(bound) / 1e9, static_cast<unsigned long long>(cumulative));
+            text += line;
+        }
+        for (; bucket < bucketCount; bucket++) {
+            cumulative += snapshot.buckets[h][bucket];
+        }
+        snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9f\n%s_count %llu\n", name.c_str(),
+                 static_cast<unsigned long long>(cumulative), name.c_str(),
+                 static_cast<double>(snapshot.sums[h]) / 1e9, name.c_str(),
+                 static_cast<unsigned long long>(cumulative));
+        text += line;
+    }
+    return text;
+}
+
+/**
+ * @brief Maps a value to its histogram bucket.
+ * @param value The value.
+ * @return size_t The bucket.
+ */
+size_t Metrics::bucketOf(uint64_t value) {
+    const uint64_t subBuckets = 1ULL << subBucketBits;
+    if (value < subBuckets) {
+        return static_cast<size_t>(value);
+    }
+    unsigned highest = 63 - static_cast<unsigned>(__builtin_clzll(value));
+    uint64_t sub = (value >> (highest - subBucketBits)) & (subBuckets - 1);
+    return static_cast<size_t>((highest - subBucketBits + 1) * subBuckets + sub);
+}
+
+/**
+ * @brief Gives the smallest value of a histogram bucket.
+ * @param bucket The bucket.
+ * @return uint64_t The value.
+ */
+uint64_t Metrics::bucketFloor(size_t bucket) {
+    const uint64_t subBuckets = 1ULL << subBucketBits;
+    if (bucket < subBuckets) {
+        return bucket;
+    }
+    unsigned highest = static_cast<unsigned>(bucket / subBuckets) + subBucketBits - 1;
+    return (subBuckets + bucket % subBuckets) << (highest - subBucketBits);
+}
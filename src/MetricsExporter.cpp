@@ -0,0 +1,160 @@
+/**
+ * @file MetricsExporter.cpp
+ * @brief File implemets MetricsExporter class
+ *
+ * The worker polls the listening socket and an eventfd. A client gets a short time to send a request, so a
+ * scraper speaking HTTP can be told apart from one that only reads, and a send timeout keeps a client that
+ * does not read from blocking the worker for long.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "MetricsExporter.hpp"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "Metrics.hpp"
+
+namespace {
+
+/// @brief How long a client has to send its request, in milliseconds.
+constexpr int requestTimeout = 100;
+
+/// @brief How long a client has to read the answer, in seconds.
+constexpr int sendTimeout = 1;
+
+/// @brief Connections waiting to be accepted.
+constexpr int backlog = 16;
+
+/**
+ * @brief Writes all of a text to a socket, without SIGPIPE if the client went away.
+ * @param fd The socket.
+ * @param text The text.
+ */
+void sendAll(int fd, const std::string& text) {
+    for (size_t sent = 0; sent < text.size();) {
+        ssize_t put = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (put <= 0 && errno != EINTR) {
+            return;
+        }
+        sent += put > 0 ? static_cast<size_t>(put) : 0;
+    }
+}
+
+}  // namespace
+
+/**
+ * @brief Binds the socket and starts the worker thread.
+ * @param path Path of the socket, a stale socket there is replaced.
+ * @throws std::runtime_error if the socket cannot be set up.
+ */
+MetricsExporter::MetricsExporter(const std::string& path) : path(path), listenFd(-1), wakeFd(-1) {
+    using namespace std;
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw runtime_error("metrics socket: invalid path \"" + path + "\"");
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // only a socket left by an earlier shell is replaced, never another file
+    struct stat info {};
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (listenFd == -1 || wakeFd == -1 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ||
+        chmod(path.c_str(), 0600) == -1 || listen(listenFd, backlog) == -1) {
+        int error = errno;
+        if (listenFd != -1) {
+            close(listenFd);
+        }
+        if (wakeFd != -1) {
+            close(wakeFd);
+        }
+        throw runtime_error("metrics socket " + path + ": " + strerror(error));
+    }
+
+    // signals are left to the shell thread, a SIGCHLD handled here would reap the commands it waits for
+    sigset_t allSignals;
+    sigset_t previous;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &previous);
+    worker = thread(&MetricsExporter::serve, this);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+/// @brief Stops the worker thread and removes the socket.
+MetricsExporter::~MetricsExporter() {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) == sizeof(one)) {
+        worker.join();
+    } else {
+        worker.detach();
+    }
+
+    close(listenFd);
+    close(wakeFd);
+    unlink(path.c_str());
+}
+
+/// @brief Accepts and answers connections until woken up by the destructor.
+void MetricsExporter::serve() {
+    while (true) {
+        pollfd watched[] = {{listenFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+        if (poll(watched, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (watched[1].revents != 0) {
+            return;
+        }
+
+        int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client != -1) {
+            answer(client);
+            close(client);
+        }
+    }
+}
+
+/**
+ * @brief Answers a single connection.
+ * @param client The accepted connection.
+ */
+void MetricsExporter::answer(int client) {
+    timeval timeout{sendTimeout, 0};
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // a request, if any, is read as far as it arrived, only its first word matters
+    char request[512];
+    ssize_t got = 0;
+    pollfd readable{client, POLLIN, 0};
+    if (poll(&readable, 1, requestTimeout) == 1) {
+        got = recv(client, request, sizeof(request), 0);
+    }
+    bool http = got >= 4 && memcmp(request, "GET ", 4) == 0;
+
+    std::string body = Metrics::prometheus(Metrics::snapshot());
+    if (http) {
+        sendAll(client, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                            std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n");
+    }
+    sendAll(client, body);
+}
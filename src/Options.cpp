@@ -0,0 +1,113 @@
+/**
+ * @file Options.cpp
+ * @brief File implemets parsing of the command line options
+ *
+ * Every option with a value takes it from the next argument, the first argument that is not an option is
+ * the batch file.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+
+#include "Options.hpp"
+
+#include <stdexcept>
+#include <string_view>
+
+/**
+ * @brief Parses the command line.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return Options The parsed options.
+ * @throws std::invalid_argument if an option is unknown, misses its value, there are extra arguments or more
+ * than one of -c, -s, --replay and a batch file are given.
+ */
+Options Options::parse(int argc, char** argv) {
+    using namespace std;
+
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        string_view arg = argv[i];
+
+        auto value = [&]() -> string {
+            if (i + 1 >= argc) {
+                throw invalid_argument("missing value for " + string{arg});
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--placement") {
+            options.placement = value();
+        } else if (arg == "--limits") {
+            options.limits = value();
+        } else if (arg == "--io-engine") {
+            options.ioEngine = value();
+        } else if (arg == "--metrics-socket") {
+            options.metricsSocket = value();
+        } else if (arg == "--startup-profile") {
+            options.startupProfile = true;
+        } else if (arg == "--jobs") {
+            options.jobs = value();
+        } else if (arg == "--explain-deps") {
+            options.explainDependencies = true;
+        } else if (arg == "--line-timeout") {
+            options.lineTimeout = value();
+        } else if (arg == "--batch-deadline") {
+            options.batchDeadline = value();
+        } else if (arg == "--record") {
+            options.record = value();
+        } else if (arg == "--replay") {
+            options.replay = value();
+        } else if (arg == "--speed") {
+            options.speed = value();
+        } else if (arg == "--prefetch") {
+            options.prefetch = value();
+        } else if (arg == "-c") {
+            options.command = value();
+        } else if (arg == "-s") {
+            options.readStdin = true;
+        } else if (arg.size() > 1 && arg.front() == '-') {
+            throw invalid_argument("unknown option " + string{arg});
+        } else if (!options.batchFile) {
+            options.batchFile = string{arg};
+        } else {
+            throw invalid_argument("unexpected argument " + string{arg});
+        }
+    }
+
+    int scripts = options.command.has_value() + options.readStdin + options.replay.has_value() +
+                  options.batchFile.has_value();
+    if (scripts > 1) {
+        throw invalid_argument("only one of -c, -s, --replay and a batch file can be given");
+    }
+    return options;
+}
+
+/**
+ * @brief Composes the usage message.
+ * @param executable The executable name.
+ * @return std::string The usage message.
+ */
+std::string Options::usage(const std::string& executable) {
+    return "Incorrect usage.\n\tcorrect usage:\n\t'" + executable + " [options]' for interactive mode or '" +
+           executable + " [options] <filepath>' for batch mode or '" + executable +
+           " [options] -c COMMANDS' to run COMMANDS and exit or '" + executable +
+           " [options] -s' to run the script on stdin, the default when stdin is not a terminal or '" +
+           executable + " [options] --replay FILE [--speed Nx|max]' to run a recorded session again\n" +
+           "\toptions:\n" +
+           "\t--placement POLICY[:CORES][:numa]\tCPU placement of background jobs (round-robin, "
+           "least-loaded)\n" +
+           "\t--limits memory=SIZE:cpu=PERCENT%:pids=COUNT[:lane]\tresource limits of jobs\n" +
+           "\t--io-engine sync|uring\tengine opening redirect targets and copying files\n" +
+           "\t--metrics-socket PATH\tserve the metrics in the Prometheus text format on a Unix socket\n" +
+           "\t--startup-profile\tprint the time to the first prompt and to the first exec by phase\n" +
+           "\t--jobs N\trun up to N independent lines of a batch script or of -c at once, serve a make "
+           "jobserver of N slots to the commands\n" +
+           "\t--explain-deps\tprint why batch lines wait for each other\n" +
+           "\t--line-timeout DURATION\tterminate the commands of a line running longer than DURATION\n" +
+           "\t--batch-deadline DURATION\tterminate the commands still running DURATION after the start\n" +
+           "\t--record FILE\tlog every line with its timing, spawn latency and exit status for --replay\n" +
+           "\t--prefetch N\tread the executables and input files of the next N batch lines into the page "
+           "cache\n";
+}
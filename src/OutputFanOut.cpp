@@ -0,0 +1,182 @@
+/**
+ * @file OutputFanOut.cpp
+ * @brief File implemets OutputFanOut class
+ *
+ * Every round tees the front of the input pipe into the pipe of every extra target. The pipes may take
+ * different amounts (more data can arrive between the calls), so only the smallest amount is moved to the
+ * targets and the rest of each pipe is dropped, the next round tees it again from the input. Everything the
+ * forked process does after fork() is a plain syscall, the shell may have other threads.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "OutputFanOut.hpp"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+/// @brief Most bytes teed into a pipe at once, a pipe takes what fits anyway.
+constexpr size_t maxChunk = 1 << 20;
+
+/**
+ * @brief Closes the descriptors that are set.
+ * @param fds The descriptors, -1 for the ones that are not.
+ */
+void closeAll(const std::vector<int>& fds) {
+    for (int fd : fds) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+}  // namespace
+
+/**
+ * @brief Starts a process copying a new pipe to all the targets.
+ * @param targets Descriptors to write to, at least two, the caller keeps them.
+ * @param writeEnd Receives the write end of the pipe (close-on-exec), the caller closes it.
+ * @return pid_t The pid of the process, a child of the caller.
+ * @throws std::runtime_error if the pipes or the process cannot be created.
+ */
+pid_t OutputFanOut::start(const std::vector<int>& targets, int& writeEnd) {
+    using namespace std;
+
+    assert(targets.size() >= 2);
+
+    // everything the process needs is allocated before the fork
+    vector<int> input(2, -1);
+    vector<int> pipes(2 * (targets.size() - 1), -1);
+    vector<int> alive = targets;
+
+    bool created = pipe2(input.data(), O_CLOEXEC) == 0;
+    for (size_t i = 0; created && i < pipes.size(); i += 2) {
+        created = pipe2(&pipes[i], O_CLOEXEC) == 0;
+    }
+
+    // bigger pipes mean fewer rounds, the default size is kept if the limit does not allow it
+    for (size_t i = 0; created && i <= pipes.size(); i += 2) {
+        fcntl(i == 0 ? input[0] : pipes[i - 2], F_SETPIPE_SZ, static_cast<int>(maxChunk));
+    }
+    int sink = created ? open("/dev/null", O_WRONLY | O_CLOEXEC) : -1;
+    if (sink == -1) {
+        int error = errno;
+        closeAll(input);
+        closeAll(pipes);
+        throw runtime_error("fan-out: "s + strerror(error));
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // a target that is a closed pipe only fails
+        signal(SIGPIPE, SIG_IGN);
+        close(input[1]);
+        pump(input[0], alive, pipes, sink);
+        _exit(0);
+    }
+
+    int error = errno;
+    close(input[0]);
+    closeAll(pipes);
+    close(sink);
+    if (pid == -1) {
+        close(input[1]);
+        throw runtime_error("fan-out: fork: "s + strerror(error));
+    }
+
+    writeEnd = input[1];
+    return pid;
+}
+
+/**
+ * @brief Copies the input to the targets until the end of the input, runs in the forked process.
+ * @param input Read end of the pipe the command writes to.
+ * @param targets The targets, a failed one is set to -1.
+ * @param pipes Pipes for the targets but the first, as pairs of read and write ends.
+ * @param sink Descriptor of /dev/null, receives the data nobody takes.
+ */
+void OutputFanOut::pump(int input, std::vector<int>& targets, const std::vector<int>& pipes, int sink) {
+    while (true) {
+        // tee() blocks until there is data, 0 means every writer is gone
+        size_t length = maxChunk;
+        for (size_t i = 0; i < pipes.size(); i += 2) {
+            ssize_t teed;
+            while ((teed = tee(input, pipes[i + 1], maxChunk, 0)) == -1 && errno == EINTR) {
+            }
+            if (teed <= 0) {
+                return;
+            }
+            length = std::min(length, static_cast<size_t>(teed));
+        }
+
+        if (!transfer(input, targets[0], length, sink)) {
+            targets[0] = -1;
+        }
+        for (size_t i = 0; i < pipes.size(); i += 2) {
+            int& target = targets[i / 2 + 1];
+            if (!transfer(pipes[i], target, length, sink)) {
+                target = -1;
+            }
+
+            int left = 0;
+            if (ioctl(pipes[i], FIONREAD, &left) == 0 && left > 0) {
+                transfer(pipes[i], -1, static_cast<size_t>(left), sink);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Moves a number of bytes from a pipe to a target.
+ * @param from The pipe.
+ * @param to The target, -1 if it failed before.
+ * @param length Number of bytes, all of them are taken from the pipe.
+ * @param sink Descriptor of /dev/null.
+ * @return bool False if the target failed.
+ */
+bool OutputFanOut::transfer(int from, int to, size_t length, int sink) {
+    bool alive = to != -1;
+    while (length > 0) {
+        ssize_t moved = splice(from, nullptr, alive ? to : sink, nullptr, length, SPLICE_F_MOVE);
+        if (moved > 0) {
+            length -= static_cast<size_t>(moved);
+            continue;
+        }
+        if (moved == -1 && errno == EINTR) {
+            continue;
+        }
+
+        // splice() refused the target, the chunk goes through a buffer
+        char buffer[16384];
+        ssize_t got = read(from, buffer, std::min(length, sizeof(buffer)));
+        if (got == -1 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        length -= static_cast<size_t>(got);
+
+        for (ssize_t written = 0; alive && written < got;) {
+            ssize_t put = write(to, buffer + written, static_cast<size_t>(got - written));
+            if (put > 0) {
+                written += put;
+            } else if (put == 0 || errno != EINTR) {
+                alive = false;
+            }
+        }
+    }
+    return alive;
+}
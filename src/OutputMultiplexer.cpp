@@ -0,0 +1,298 @@
+/**
+ * @file OutputMultiplexer.cpp
+ * @brief File implemets OutputMultiplexer class
+ *
+ * The worker thread owns the stream buffers, the shell thread only registers new streams. Each epoll event
+ * reads at most one buffer worth of data from the stream, so a chatty job cannot starve the others, and
+ * every printed line is a single writev() of the prefix and the line itself, so lines of different jobs
+ * never mix.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "OutputMultiplexer.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+/// @brief Maximum number of events handled by one epoll_wait call.
+constexpr int maxEvents = 64;
+
+/**
+ * @brief Writes all the regions to the descriptor, retrying on partial writes.
+ * @param fd The descriptor to write to.
+ * @param regions The regions to write, modified in place.
+ * @param count Number of regions.
+ */
+void writeFully(int fd, iovec* regions, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, regions, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;  // nowhere to report it, the line is dropped
+        }
+
+        auto left = static_cast<size_t>(written);
+        while (count > 0 && left >= regions->iov_len) {
+            left -= regions->iov_len;
+            regions++;
+            count--;
+        }
+        if (count > 0) {
+            regions->iov_base = static_cast<char*>(regions->iov_base) + left;
+            regions->iov_len -= left;
+        }
+    }
+}
+
+}  // namespace
+
+/**
+ * @brief Constructs a stream record.
+ * @param fd Read end of the capture pipe.
+ * @param sink Descriptor the lines are written to.
+ * @param prefix Text printed in front of every line.
+ * @param capacity Size of the stream buffer.
+ */
+OutputMultiplexer::Stream::Stream(int fd, int sink, std::string prefix, size_t capacity)
+    : fd(fd), sink(sink), prefix(std::move(prefix)), buffer(capacity) {
+}
+
+/**
+ * @brief Constructs an OutputMultiplexer, the worker thread is started on the first capture.
+ * @param streamCapacity Size of the buffer kept for each captured stream.
+ */
+OutputMultiplexer::OutputMultiplexer(size_t streamCapacity)
+    : streamCapacity(streamCapacity), epollFd(-1), wakeFd(-1), stopping(false) {
+    assert(streamCapacity > 0);
+}
+
+/// @brief Prints the remaining buffered output and stops the worker thread.
+OutputMultiplexer::~OutputMultiplexer() {
+    if (worker.joinable()) {
+        stopping = true;
+
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) == sizeof(one)) {
+            worker.join();
+        } else {
+            worker.detach();
+        }
+    }
+
+    for (auto& [fd, stream] : streams) {
+        close(fd);
+    }
+
+    if (epollFd != -1) {
+        close(epollFd);
+    }
+    if (wakeFd != -1) {
+        close(wakeFd);
+    }
+}
+
+/**
+ * @brief Creates capture pipes for a job.
+ * @param jobId The id printed in front of every line of the job.
+ * @return std::pair<int, int> Write ends for the job's stdout and stderr (close-on-exec).
+ * @throws std::runtime_error if the pipes cannot be created.
+ */
+std::pair<int, int> OutputMultiplexer::capture(int jobId) {
+    using namespace std;
+
+    start();
+
+    int outPipe[2];
+    int errPipe[2];
+    if (pipe2(outPipe, O_CLOEXEC) == -1) {
+        throw runtime_error("pipe: "s + strerror(errno));
+    }
+    if (pipe2(errPipe, O_CLOEXEC) == -1) {
+        int error = errno;
+        close(outPipe[0]);
+        close(outPipe[1]);
+        throw runtime_error("pipe: "s + strerror(error));
+    }
+
+    const string prefix = "[" + to_string(jobId) + "] ";
+    const pair<int, int> readEnds[] = {{outPipe[0], STDOUT_FILENO}, {errPipe[0], STDERR_FILENO}};
+
+    lock_guard<std::mutex> lock(mutex);
+    for (const auto& [fd, sink] : readEnds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        streams.emplace(fd, make_unique<Stream>(fd, sink, prefix, streamCapacity));
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    return {outPipe[1], errPipe[1]};
+}
+
+/// @brief Creates the epoll instance and starts the worker thread if it is not running yet.
+void OutputMultiplexer::start() {
+    using namespace std;
+
+    lock_guard<std::mutex> lock(mutex);
+    if (worker.joinable()) {
+        return;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd == -1 || wakeFd == -1) {
+        throw runtime_error("output multiplexer: "s + strerror(errno));
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+    // signals are left to the shell thread, so SIGCHLD never interrupts the draining
+    sigset_t allSignals;
+    sigset_t previous;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &previous);
+    worker = thread(&OutputMultiplexer::loop, this);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+/// @brief Worker thread body, waits for data and prints it until stopped.
+void OutputMultiplexer::loop() {
+    epoll_event events[maxEvents];
+
+    while (!stopping) {
+        int ready = epoll_wait(epollFd, events, maxEvents, -1);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                continue;
+            }
+
+            Stream* stream;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto found = streams.find(fd);
+                if (found == end(streams)) {
+                    continue;
+                }
+                stream = found->second.get();
+            }
+
+            if (fill(*stream) != 0) {
+                emit(*stream, false);
+            } else {
+                release(fd);
+            }
+        }
+    }
+
+    // drain whatever the jobs have written so far, nobody will read the pipes after this
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [fd, stream] : streams) {
+        while (fill(*stream) > 0) {
+            emit(*stream, false);
+        }
+        emit(*stream, true);
+    }
+}
+
+/**
+ * @brief Reads as much data as fits in the stream buffer.
+ * @param stream The stream to read.
+ * @return ssize_t Number of bytes read, 0 if the write end was closed, -1 if there is nothing to read.
+ */
+ssize_t OutputMultiplexer::fill(Stream& stream) {
+    iovec regions[2];
+    int count = stream.buffer.writableRegions(regions);
+    if (count == 0) {
+        return -1;
+    }
+
+    ssize_t received;
+    do {
+        received = readv(stream.fd, regions, count);
+    } while (received == -1 && errno == EINTR);
+
+    if (received > 0) {
+        stream.buffer.commit(received);
+        return received;
+    }
+
+    return received == -1 && errno == EAGAIN ? -1 : 0;
+}
+
+/**
+ * @brief Prints the complete lines of the stream buffer.
+ * @param stream The stream to print.
+ * @param flush Print the incomplete last line as well.
+ */
+void OutputMultiplexer::emit(Stream& stream, bool flush) {
+    utils::RingBuffer& buffer = stream.buffer;
+    static char newLine = '\n';
+
+    while (!buffer.empty()) {
+        std::optional<size_t> lineEnd = buffer.find('\n');
+        bool complete = lineEnd.has_value();
+
+        // a line that does not fit the buffer is broken at the buffer size
+        if (!complete && !buffer.full() && !flush) {
+            return;
+        }
+
+        size_t length = complete ? *lineEnd + 1 : buffer.size();
+
+        iovec regions[4];
+        regions[0] = {stream.prefix.data(), stream.prefix.size()};
+        int count = 1 + buffer.readableRegions(length, regions + 1);
+        if (!complete) {
+            regions[count++] = {&newLine, 1};
+        }
+
+        writeFully(stream.sink, regions, count);
+        buffer.consume(length);
+    }
+}
+
+/**
+ * @brief Prints the rest of the stream and forgets it.
+ * @param fd Read end of the stream pipe.
+ */
+void OutputMultiplexer::release(int fd) {
+    std::unique_ptr<Stream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = streams.find(fd);
+        assert(found != end(streams));
+        stream = std::move(found->second);
+        streams.erase(found);
+    }
+
+    emit(*stream, true);
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+}
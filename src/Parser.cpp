@@ -4,7 +4,11 @@
  *
  * The Parser class splits the input line into jobs, where a job is a single command that can be executed,
  * meaning if there are many parallel commands in the line, they will be split into separate jobs. Each job
- * can have arguments and can be redirected to a file. Then each job is parsed into a Command object.
+ * can have arguments and redirections of its standard streams. Then each job is parsed into a Command object.
+ *
+ * Scripts are split into statements at ; and new lines, the statements starting with a keyword open or close
+ * blocks, which are parsed by recursive descent. The splitting of a statement into jobs and words happens
+ * once, when the tree is built, the expansions happen every time a job is composed.
  *
  * @author Sukhanov Ivan
  * @date 25/5/2025
@@ -13,21 +17,114 @@
 
 #include "Parser.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include "GlobPattern.hpp"
+#include "Metrics.hpp"
 #include "ParseUtils.hpp"
 #include "StringUtils.hpp"
 
-/// @brief Default constructor for Parser.
-Parser::Parser() = default;
+namespace {
+
+/// @brief Keywords followed by a statement on the same line.
+constexpr std::string_view leadingKeywords[] = {"if", "elif", "then", "else", "while", "until", "do", "{"};
+
+/// @brief Keywords that are statements on their own.
+constexpr std::string_view closingKeywords[] = {"fi", "done", "}", "break", "continue"};
+
+/// @brief Keywords opening a block, counted by Parser::nesting().
+constexpr std::string_view openingKeywords[] = {"if", "while", "until", "for", "{"};
+
+/// @brief A redirection operator.
+struct RedirectOperator {
+    std::string_view symbol;
+    Command::Redirect::Stream stream;
+    bool append;
+};
+
+/// @brief Redirection operators, an operator comes before the ones it starts with.
+constexpr RedirectOperator redirectOperators[] = {
+    {"&>>", Command::Redirect::Stream::OutputAndError, true},
+    {"2>>", Command::Redirect::Stream::Error, true},
+    {">>", Command::Redirect::Stream::Output, true},
+    {"&>", Command::Redirect::Stream::OutputAndError, false},
+    {"2>", Command::Redirect::Stream::Error, false},
+    {">", Command::Redirect::Stream::Output, false},
+    {"<", Command::Redirect::Stream::Input, false},
+};
+
+/**
+ * @brief Splits a text at the separators that are neither quoted nor escaped.
+ *
+ * A quote is recognized wherever ParseUtils::splitExpanding() recognizes it, an unclosed one is literal. A
+ * command substitution is a single piece of text as well.
+ *
+ * @param text The text.
+ * @param separatorLength Gives the length of the separator at a position of the text, 0 if there is none.
+ * @param pieces Receives the text between the separators.
+ * @param separators Receives the separators, one less than the pieces.
+ */
+template <typename F>
+void splitOutsideQuotes(const std::string& text, F separatorLength, std::vector<std::string>& pieces,
+                        std::vector<std::string>& separators) {
+    std::string piece;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        size_t close;
+        if (c == '\\' && i + 1 < text.size()) {
+            piece += c;
+            piece += text[++i];
+        } else if ((c == '"' || c == '\'') &&
+                   (close = utils::ParseUtils::findClosingQuote(text, i + 1, c)) != std::string::npos) {
+            piece.append(text, i, close - i + 1);
+            i = close;
+        } else if (c == '$' && i + 1 < text.size() && text[i + 1] == '(' &&
+                   (close = utils::ParseUtils::findSubstitutionEnd(text, i + 2)) != std::string::npos) {
+            piece.append(text, i, close - i + 1);
+            i = close;
+        } else if (size_t length = separatorLength(text, i); length != 0) {
+            pieces.push_back(std::move(piece));
+            piece.clear();
+            separators.push_back(text.substr(i, length));
+            i += length - 1;
+        } else {
+            piece += c;
+        }
+    }
+    pieces.push_back(std::move(piece));
+}
+
+/**
+ * @brief Checks if a word is one of the keywords.
+ * @param word The word.
+ * @param keywords The keywords.
+ * @return true if it is.
+ */
+template <size_t N>
+bool isOneOf(std::string_view word, const std::string_view (&keywords)[N]) {
+    return std::find(std::begin(keywords), std::end(keywords), word) != std::end(keywords);
+}
+
+}  // namespace
 
-/// @brief Regular expression for detecting parallel execution symbols.
-std::regex Parser::parallelSymb{"\\s+&\\s*"};
+/// @brief Default constructor for Parser, $ is left as it is.
+Parser::Parser() : variables(nullptr), substitutionDepth(0) {
+}
+
+/**
+ * @brief Constructs a Parser expanding variables.
+ * @param variables The variables to expand, must outlive the parser.
+ */
+Parser::Parser(const Variables& variables) : variables(&variables), substitutionDepth(0) {
+}
 
-/// @brief Regular expression for detecting output redirection symbols.
-std::regex Parser::redirectSymb{"\\s+>\\s+"};
 
 /// @brief String containing whitespace and space-like symbols for parsing.
 std::string Parser::spaceSymbols{" \n\t"};
 
+
 /**
  * @brief Parses the input command line and returns a vector of Command objects.
  * @param line The input line string to parse.
@@ -35,76 +132,506 @@ std::string Parser::spaceSymbols{" \n\t"};
  * @throws std::invalid_argument if job splitting or redirection parsing fails.
  */
 std::vector<std::unique_ptr<Command>> Parser::parse(const std::string& line) {
+    return compose(lexLine(line));
+}
+
+/**
+ * @brief Parses a script into a syntax tree.
+ *
+ * Supported are if/elif/else/fi, while/do/done, until/do/done, for NAME in WORDS/do/done, break, continue
+ * and commands joined by && and ||, which have the same precedence and group to the left.
+ *
+ * @param script The script, statements are separated by ; or new lines.
+ * @return SyntaxNode The list of the statements of the script.
+ * @throws std::invalid_argument on a syntax error.
+ */
+SyntaxNode Parser::parseScript(const std::string& script) {
+    uint64_t start = Metrics::now();
+    try {
+        std::vector<Token> tokens = tokenize(script);
+        size_t pos = 0;
+        SyntaxNode tree = parseList(tokens, pos, {});
+        Metrics::add(Metrics::Counter::ScriptsParsed);
+        Metrics::record(Metrics::Histogram::ParseLatency, Metrics::now() - start);
+        return tree;
+    } catch (std::invalid_argument&) {
+        Metrics::add(Metrics::Counter::ParseErrors);
+        throw;
+    }
+}
+
+/**
+ * @brief Counts the blocks a line opens less the blocks it closes.
+ * @param line The line.
+ * @return int The difference, 0 if the line cannot be split (the error shows up when it is parsed).
+ */
+int Parser::nesting(const std::string& line) {
+    int depth = 0;
+    try {
+        for (const Token& token : tokenize(line)) {
+            if (isOneOf(token.keyword, openingKeywords)) {
+                depth++;
+            } else if (token.keyword == "fi" || token.keyword == "done" || token.keyword == "}") {
+                depth--;
+            }
+        }
+    } catch (std::invalid_argument&) {
+        return 0;
+    }
+    return depth;
+}
+
+/**
+ * @brief Composes the commands of a line of a syntax tree, expanding their words.
+ * @param line A node of kind Line.
+ * @return std::vector<std::unique_ptr<Command>> The commands.
+ * @throws std::invalid_argument if an expansion fails or leaves a command empty.
+ */
+std::vector<std::unique_ptr<Command>> Parser::compose(const SyntaxNode& line) {
+    std::vector<std::unique_ptr<Command>> commands;
+    commands.reserve(line.jobs.size());
+    for (const SyntaxNode::Job& job : line.jobs) {
+        commands.push_back(composeCommand(job));
+    }
+    Metrics::add(Metrics::Counter::CommandsComposed, commands.size());
+    return commands;
+}
+
+/**
+ * @brief Expands words, e.g. the ones a for iterates over.
+ * @param words The words.
+ * @return std::vector<std::string> The expanded words.
+ * @throws std::invalid_argument if a variable reference or a command substitution is malformed.
+ */
+std::vector<std::string> Parser::expandWords(const std::vector<SyntaxNode::Word>& words) {
+    std::vector<std::string> expanded;
+    for (const SyntaxNode::Word& word : words) {
+        expandWord(word, expanded);
+    }
+    return expanded;
+}
+
+/**
+ * @brief Sets the handler running command substitutions, without one they are an error.
+ * @param handler The handler.
+ */
+void Parser::setSubstitutionHandler(SubstitutionHandler handler) {
+    substitutionHandler = std::move(handler);
+}
+
+/**
+ * @brief Splits a script into statements and keywords.
+ *
+ * A keyword is recognized as the first word of a statement. if, elif, then, else, while, until, do and { may
+ * be followed by a statement, the header of a for and the status of a return take the rest of the statement.
+ * A function definition (NAME(), NAME () or function NAME) becomes a "function" token with the name as text.
+ *
+ * @param script The script.
+ * @return std::vector<Token> The tokens.
+ * @throws std::invalid_argument if a closing keyword is followed by anything or a function name is invalid.
+ */
+std::vector<Parser::Token> Parser::tokenize(const std::string& script) {
     using namespace std;
 
-    // split the input line into jobs based on the parallel execution symbol
-    vector<string> jobs;
-    auto retrieveStringFromIters([](auto it1, auto it2) { return string{it1, it2}; });
-    bool isLastParallel = utils::ParseUtils::splitByRegex(begin(line), end(line), back_inserter(jobs),
-                                                          parallelSymb, retrieveStringFromIters);
+    vector<string> statements;
+    vector<string> separators;
+    splitOutsideQuotes(
+        script, [](const string& text, size_t i) { return text[i] == ';' || text[i] == '\n' ? 1 : 0; },
+        statements, separators);
 
-    // parse each job into a Command object
-    vector<unique_ptr<Command>> parsedCommands;
-    size_t numberOfJobs = jobs.size();
-    for (int i = 0; i < numberOfJobs; i++) {
-        const string& job(jobs.at(i));
+    vector<Token> tokens;
+    for (const string& statement : statements) {
+        string rest = utils::StringUtils::trim(statement, spaceSymbols);
+        while (!rest.empty()) {
+            size_t wordEnd = rest.find_first_of(spaceSymbols);
+            string_view word = string_view{rest}.substr(0, wordEnd);
+            string remainder =
+                wordEnd == string::npos ? "" : utils::StringUtils::trim(rest.substr(wordEnd), spaceSymbols);
 
-        bool inParallel = i < numberOfJobs - 1 || isLastParallel;
-        bool withRedirection;
-        try {
-            withRedirection = utils::ParseUtils::isPresent(begin(job), end(job), redirectSymb);
-        } catch (invalid_argument& e) {
-            throw e;
+            if (word == "for" || word == "return") {
+                tokens.push_back({string{word}, move(remainder)});
+                break;
+            }
+
+            string_view name = word;
+            string body = remainder;
+            bool definition = false;
+            if (word == "function") {
+                size_t nameEnd = remainder.find_first_of(spaceSymbols);
+                name = string_view{remainder}.substr(0, nameEnd);
+                body = nameEnd == string::npos ? ""
+                                               : utils::StringUtils::trim(remainder.substr(nameEnd), spaceSymbols);
+                definition = true;
+            }
+            if (name.size() > 2 && name.substr(name.size() - 2) == "()") {
+                name.remove_suffix(2);
+                definition = true;
+            } else if (body.rfind("()", 0) == 0) {
+                body = utils::StringUtils::trim(body.substr(2), spaceSymbols);
+                definition = true;
+            }
+            if (definition) {
+                if (!Variables::isValidName(name)) {
+                    throw invalid_argument("invalid function name '" + string{name} + "'");
+                }
+                tokens.push_back({"function", string{name}});
+                rest = move(body);
+                continue;
+            }
+
+            if (isOneOf(word, closingKeywords)) {
+                if (!remainder.empty()) {
+                    throw invalid_argument("syntax error near '" + remainder + "'");
+                }
+                tokens.push_back({string{word}, ""});
+                break;
+            }
+            if (!isOneOf(word, leadingKeywords)) {
+                tokens.push_back({"", move(rest)});
+                break;
+            }
+
+            tokens.push_back({string{word}, ""});
+            rest = move(remainder);
+        }
+    }
+    return tokens;
+}
+
+/**
+ * @brief Parses statements until one of the terminators.
+ * @param tokens The tokens.
+ * @param pos Position in the tokens, left at the terminator.
+ * @param terminators Keywords ending the list, the last one is the one closing the block.
+ * @return SyntaxNode The list.
+ * @throws std::invalid_argument on a syntax error.
+ */
+SyntaxNode Parser::parseList(const std::vector<Token>& tokens, size_t& pos,
+                             std::initializer_list<std::string_view> terminators) {
+    using namespace std;
+
+    // takes the keyword the list before it stopped at
+    auto expect = [&](string_view keyword) {
+        if (pos == tokens.size() || tokens[pos].keyword != keyword) {
+            throw invalid_argument("syntax error: missing '" + string{keyword} + "'");
         }
+        pos++;
+    };
 
-        parsedCommands.push_back(move(composeCommand(job, withRedirection, inParallel)));
+    // parses a condition or a body, which cannot be empty
+    auto part = [&](initializer_list<string_view> partTerminators) {
+        SyntaxNode nested = parseList(tokens, pos, partTerminators);
+        if (nested.children.empty()) {
+            throw invalid_argument("syntax error near unexpected '" + tokens[pos].keyword + "'");
+        }
+        return nested;
+    };
+
+    SyntaxNode list{SyntaxNode::Kind::List};
+    while (pos < tokens.size()) {
+        const Token& token = tokens[pos];
+        bool terminates = find(begin(terminators), end(terminators), token.keyword) != end(terminators);
+        if (!token.keyword.empty() && terminates) {
+            return list;
+        }
+        pos++;
+
+        if (token.keyword.empty()) {
+            list.children.push_back(parseAndOr(token.text));
+        } else if (token.keyword == "if") {
+            SyntaxNode block{SyntaxNode::Kind::If};
+            string_view next = "elif";
+            while (next == "elif") {
+                block.children.push_back(part({"then"}));
+                expect("then");
+                block.children.push_back(part({"elif", "else", "fi"}));
+                next = tokens[pos++].keyword;
+            }
+            if (next == "else") {
+                block.children.push_back(part({"fi"}));
+                expect("fi");
+            }
+            list.children.push_back(move(block));
+        } else if (token.keyword == "while" || token.keyword == "until") {
+            SyntaxNode loop{token.keyword == "while" ? SyntaxNode::Kind::While : SyntaxNode::Kind::Until};
+            loop.children.push_back(part({"do"}));
+            expect("do");
+            loop.children.push_back(part({"done"}));
+            expect("done");
+            list.children.push_back(move(loop));
+        } else if (token.keyword == "for") {
+            vector<string> header;
+            utils::ParseUtils::splitKeepingQuotes(token.text, back_inserter(header));
+            if (header.size() < 2 || !Variables::isValidName(header[0]) || header[1] != "in") {
+                throw invalid_argument("syntax error: expected 'for NAME in WORDS...'");
+            }
+
+            SyntaxNode loop{SyntaxNode::Kind::For};
+            loop.variable = header[0];
+            for (auto word = next(begin(header), 2); word != end(header); word++) {
+                loop.words.push_back(lexWord(move(*word)));
+            }
+            expect("do");
+            loop.children.push_back(part({"done"}));
+            expect("done");
+            list.children.push_back(move(loop));
+        } else if (token.keyword == "{") {
+            list.children.push_back(part({"}"}));
+            expect("}");
+        } else if (token.keyword == "function") {
+            SyntaxNode function{SyntaxNode::Kind::Function};
+            function.variable = token.text;
+            if (pos == tokens.size() || tokens[pos].keyword != "{") {
+                throw invalid_argument("syntax error: expected '{' after " + token.text + "()");
+            }
+            pos++;
+            function.children.push_back(part({"}"}));
+            expect("}");
+            list.children.push_back(move(function));
+        } else if (token.keyword == "return") {
+            SyntaxNode exit{SyntaxNode::Kind::Return};
+            vector<string> status;
+            utils::ParseUtils::splitKeepingQuotes(token.text, back_inserter(status));
+            if (status.size() > 1) {
+                throw invalid_argument("syntax error: return takes at most one status");
+            }
+            for (string& word : status) {
+                exit.words.push_back(lexWord(move(word)));
+            }
+            list.children.push_back(move(exit));
+        } else if (token.keyword == "break" || token.keyword == "continue") {
+            list.children.push_back(
+                SyntaxNode{token.keyword == "break" ? SyntaxNode::Kind::Break : SyntaxNode::Kind::Continue});
+        } else {
+            throw invalid_argument("syntax error near unexpected '" + token.keyword + "'");
+        }
+    }
+
+    if (terminators.size() != 0) {
+        throw invalid_argument("syntax error: missing '" + string{*prev(end(terminators))} + "'");
+    }
+    return list;
+}
+
+/**
+ * @brief Parses a statement of commands joined by && and ||.
+ * @param text The statement.
+ * @return SyntaxNode The tree of the statement, left-associative.
+ * @throws std::invalid_argument if a side of an operator is empty.
+ */
+SyntaxNode Parser::parseAndOr(const std::string& text) {
+    using namespace std;
+
+    vector<string> operands;
+    vector<string> operators;
+    splitOutsideQuotes(
+        text,
+        [](const string& input, size_t i) {
+            bool isOperator =
+                i + 1 < input.size() && (input[i] == '&' || input[i] == '|') && input[i + 1] == input[i];
+            return isOperator ? 2 : 0;
+        },
+        operands, operators);
+
+    auto operand = [&](size_t i) {
+        if (operands[i].find_first_not_of(spaceSymbols) == string::npos) {
+            throw invalid_argument("syntax error near '" + operators[i == 0 ? 0 : i - 1] + "'");
+        }
+        return lexLine(operands[i]);
+    };
+
+    SyntaxNode tree = operand(0);
+    for (size_t i = 0; i < operators.size(); i++) {
+        SyntaxNode joined{operators[i] == "&&" ? SyntaxNode::Kind::And : SyntaxNode::Kind::Or};
+        joined.children.push_back(move(tree));
+        joined.children.push_back(operand(i + 1));
+        tree = move(joined);
+    }
+    return tree;
+}
+
+/**
+ * @brief Splits a line into its commands and their words.
+ * @param line The line.
+ * @return SyntaxNode A node of kind Line.
+ * @throws std::invalid_argument if job splitting or redirection parsing fails.
+ */
+SyntaxNode Parser::lexLine(const std::string& line) {
+    using namespace std;
+
+    // split the input line into jobs at a & after white space, &> is a redirection
+    vector<string> pieces;
+    vector<string> separators;
+    splitOutsideQuotes(
+        line,
+        [](const string& text, size_t i) {
+            bool afterSpace = i > 0 && isspace(static_cast<unsigned char>(text[i - 1]));
+            return text[i] == '&' && afterSpace && (i + 1 == text.size() || text[i + 1] != '>') ? 1 : 0;
+        },
+        pieces, separators);
+
+    // a job is parallel if a & follows it, the last piece is empty if the line ends with one
+    SyntaxNode lexed{SyntaxNode::Kind::Line};
+    for (size_t i = 0; i < pieces.size(); i++) {
+        if (pieces[i].find_first_not_of(spaceSymbols) != string::npos) {
+            lexed.jobs.push_back(lexJob(pieces[i], i + 1 < pieces.size()));
+        }
     }
 
-    return move(parsedCommands);
+    return lexed;
 }
 
 /**
- * @brief Composes a Command object from the given job string.
+ * @brief Splits a job string into words and redirections.
+ *
+ * A redirection is an unquoted word starting with <, >, >>, 2>, 2>>, &> or &>>, the target is either the
+ * rest of the word or the next word.
+ *
  * @param job The job string to parse.
- * @param redirect Indicates if output redirection is present.
  * @param parallel Indicates if the command should be run in parallel.
- * @return std::unique_ptr<Command> The composed Command object.
- * @throws std::invalid_argument if redirection parsing fails.
- * @throws std::runtime_error if redirection is set but command parts are missing.
+ * @return SyntaxNode::Job The job.
+ * @throws std::invalid_argument if a redirection has no target.
  */
-std::unique_ptr<Command> Parser::composeCommand(const std::string& job, bool redirect, bool parallel) {
+SyntaxNode::Job Parser::lexJob(const std::string& job, bool parallel) {
     using namespace std;
 
-    // in case of redirection, separate the command and the redirection part
-    unique_ptr<pair<string, string>> commandAndRedirection;
-    if (redirect) {
-        pair<string, string> commandWithRedirection;
-        try {
-            commandWithRedirection = utils::ParseUtils::cleaveByRegex(begin(job), end(job), redirectSymb);
-        } catch (invalid_argument& e) {
-            throw e;
+    SyntaxNode::Job lexed{};
+    lexed.parallel = parallel;
+
+    vector<string> words;
+    utils::ParseUtils::splitKeepingQuotes(job, back_inserter(words));
+    for (size_t i = 0; i < words.size(); i++) {
+        string_view word = words[i];
+        auto redirect = find_if(begin(redirectOperators), end(redirectOperators),
+                                [word](const RedirectOperator& op) { return word.rfind(op.symbol, 0) == 0; });
+        if (redirect == end(redirectOperators)) {
+            lexed.words.push_back(lexWord(move(words[i])));
+            continue;
         }
 
-        commandAndRedirection = make_unique<pair<string, string>>(move(commandWithRedirection));
+        string target = words[i].substr(redirect->symbol.size());
+        if (target.empty()) {
+            if (i + 1 == words.size()) {
+                throw invalid_argument("syntax error: missing target after '" + string{redirect->symbol} + "'");
+            }
+            target = move(words[++i]);
+        }
+        if (target.front() == '&') {
+            throw invalid_argument("syntax error: duplicating descriptors (" + words[i] + ") is not supported");
+        }
+        lexed.redirects.push_back({redirect->stream, redirect->append, lexWord(move(target))});
     }
 
-    if (redirect && !commandAndRedirection) {
-        throw runtime_error("parse: nullptr commandParts with set redirection flag");
-    }
+    return lexed;
+}
+
+/**
+ * @brief Makes a word, marking it literal if there is nothing to expand in it.
+ * @param text The word as written.
+ * @return SyntaxNode::Word The word.
+ */
+SyntaxNode::Word Parser::lexWord(std::string text) {
+    bool literal = text.find_first_of("\"'\\$*?[") == std::string::npos;
+    return SyntaxNode::Word{std::move(text), literal};
+}
+
+/**
+ * @brief Composes a Command object from a job.
+ * @param job The job.
+ * @return std::unique_ptr<Command> The composed Command object.
+ * @throws std::invalid_argument if the command is empty after the expansions or a redirect is ambiguous.
+ */
+std::unique_ptr<Command> Parser::composeCommand(const SyntaxNode::Job& job) {
+    using namespace std;
 
-    // split the job into command pieces (words, arguments, etc.)
-    const string& command = redirect ? commandAndRedirection->first : job;
     vector<string> pieces;
-    utils::ParseUtils::splitRespectingQuotes(command, back_inserter(pieces));
+    pieces.reserve(job.words.size());
+    for (const SyntaxNode::Word& word : job.words) {
+        expandWord(word, pieces);
+    }
+    if (pieces.empty()) {
+        throw invalid_argument("empty command");
+    }
 
     // combine the command pieces into a Command object
     unique_ptr<Command> currCommand(
         make_unique<Command>(pieces.front(), vector<string>{next(begin(pieces)), end(pieces)}));
 
-    if (redirect) {
-        currCommand->setOutputRedirect(utils::StringUtils::trim(commandAndRedirection->second, spaceSymbols));
+    // a target is a single word after expansion
+    for (const SyntaxNode::Redirect& redirect : job.redirects) {
+        vector<string> target;
+        expandWord(redirect.target, target);
+        if (target.size() != 1 || target.front().empty()) {
+            throw invalid_argument("ambiguous redirect " + redirect.target.text);
+        }
+        currCommand->addRedirect({redirect.stream, move(target.front()), redirect.append});
     }
-    currCommand->setParallel(parallel);
+    currCommand->setParallel(job.parallel);
 
-    return move(currCommand);
+    return currCommand;
+}
+
+/**
+ * @brief Expands a word, performing the expansions if the parser has variables.
+ *
+ * A word with glob characters that matches nothing is kept as it is, like in sh. A word that is just $@ or
+ * "$@" gives every positional parameter as a word of its own.
+ *
+ * @param word The word.
+ * @param output Receives the resulting words, none if the word expands to nothing.
+ * @throws std::invalid_argument if a variable reference or a command substitution is malformed.
+ */
+void Parser::expandWord(const SyntaxNode::Word& word, std::vector<std::string>& output) {
+    using namespace std;
+
+    if (word.literal) {
+        output.push_back(word.text);
+        return;
+    }
+    if (variables == nullptr) {
+        utils::ParseUtils::splitRespectingQuotes(word.text, back_inserter(output));
+        return;
+    }
+
+    if (word.text == "$@" || word.text == "\"$@\"") {
+        const vector<string>& arguments = variables->arguments();
+        output.insert(end(output), begin(arguments), end(arguments));
+        return;
+    }
+
+    // every level of nesting has a buffer of its own, the output is used before the next substitution
+    auto substitute = [this](const string& commands) -> const string& {
+        if (!substitutionHandler) {
+            throw invalid_argument("command substitution is not supported here");
+        }
+        if (substitutionDepth == substitutionBuffers.size()) {
+            substitutionBuffers.emplace_back();
+        }
+        string& buffer = substitutionBuffers[substitutionDepth++];
+        buffer.clear();
+        try {
+            substitutionHandler(commands, buffer);
+        } catch (...) {
+            substitutionDepth--;
+            throw;
+        }
+        substitutionDepth--;
+        return buffer;
+    };
+
+    vector<string> words;
+    utils::ParseUtils::splitExpanding(
+        word.text, back_inserter(words), [this](string_view name) { return variables->get(name); }, substitute,
+        true);
+
+    for (string& expanded : words) {
+        if (utils::GlobPattern::hasMagic(expanded)) {
+            vector<string> matches = glob.expand(expanded);
+            if (!matches.empty()) {
+                output.insert(end(output), make_move_iterator(begin(matches)), make_move_iterator(end(matches)));
+                continue;
+            }
+        }
+        output.push_back(utils::GlobPattern::unescape(expanded));
+    }
 }
@@ -0,0 +1,293 @@
+/**
+ * @file PlacementPolicy.cpp
+ * @brief File implemets PlacementPolicy class
+ *
+ * The topology is read from sysfs (/sys/devices/system/node), memory binding is done with the raw
+ * set_mempolicy syscall, so there is no dependency on libnuma. Without NUMA information all CPUs are
+ * treated as a single node.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "PlacementPolicy.hpp"
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+
+#include "StringUtils.hpp"
+
+namespace {
+
+/// @brief Directory describing the NUMA nodes.
+constexpr const char* nodesDirectory = "/sys/devices/system/node";
+
+/**
+ * @brief Parses a sysfs CPU list like "0-3,8,10-11".
+ * @param list The CPU list.
+ * @return std::vector<int> The listed CPUs.
+ */
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<std::string> ranges;
+    const std::string separators{",\n"};
+    utils::StringUtils::split(begin(list), end(list), begin(separators), end(separators),
+                              back_inserter(ranges), [](auto it1, auto it2) { return std::string{it1, it2}; });
+
+    std::vector<int> cpus;
+    for (const std::string& range : ranges) {
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * @brief Reads the NUMA node of every CPU.
+ * @return std::map<int, int> Node by CPU, empty if the system does not describe its nodes.
+ */
+std::map<int, int> readCpuNodes() {
+    std::map<int, int> nodes;
+
+    DIR* directory = opendir(nodesDirectory);
+    if (directory == nullptr) {
+        return nodes;
+    }
+
+    while (dirent* entry = readdir(directory)) {
+        std::string name = entry->d_name;
+        if (name.rfind("node", 0) != 0 || name.size() == 4 ||
+            name.find_first_not_of("0123456789", 4) != std::string::npos) {
+            continue;
+        }
+
+        std::ifstream cpuList{std::string{nodesDirectory} + "/" + name + "/cpulist"};
+        std::string list;
+        if (!std::getline(cpuList, list)) {
+            continue;
+        }
+
+        int node = std::stoi(name.substr(4));
+        for (int cpu : parseCpuList(list)) {
+            nodes[cpu] = node;
+        }
+    }
+
+    closedir(directory);
+    return nodes;
+}
+
+}  // namespace
+
+/// @brief Constructs a disabled PlacementPolicy.
+PlacementPolicy::PlacementPolicy() : mode(Mode::None), coresPerJob(1), bindMemory(false), next(0) {
+}
+
+/**
+ * @brief Configures the policy from a spec.
+ * @param spec "none" or "POLICY[:CORES][:numa]" with POLICY being round-robin or least-loaded.
+ * @throws std::invalid_argument if the spec is malformed.
+ */
+void PlacementPolicy::configure(const std::string& spec) {
+    using namespace std;
+
+    vector<string> parts;
+    const string separator{":"};
+    utils::StringUtils::split(begin(spec), end(spec), begin(separator), end(separator), back_inserter(parts),
+                              [](auto it1, auto it2) { return string{it1, it2}; });
+
+    if (parts.empty()) {
+        throw invalid_argument("empty placement spec");
+    }
+
+    Mode newMode;
+    if (parts[0] == "none") {
+        newMode = Mode::None;
+    } else if (parts[0] == "round-robin") {
+        newMode = Mode::RoundRobin;
+    } else if (parts[0] == "least-loaded") {
+        newMode = Mode::LeastLoaded;
+    } else {
+        throw invalid_argument("unknown placement policy \"" + parts[0] + "\"");
+    }
+
+    size_t newCores = 1;
+    bool newBind = false;
+    for (auto part = std::next(begin(parts)); part != end(parts); part++) {
+        if (*part == "numa") {
+            newBind = true;
+        } else if (part->find_first_not_of("0123456789") == string::npos && part->size() < 6 &&
+                   stoi(*part) > 0) {
+            newCores = stoi(*part);
+        } else {
+            throw invalid_argument("invalid placement option \"" + *part + "\"");
+        }
+    }
+
+    mode = newMode;
+    coresPerJob = newCores;
+    bindMemory = newBind;
+    buildSlots();
+}
+
+/**
+ * @brief Describes the current configuration as a spec.
+ * @return std::string The spec.
+ */
+std::string PlacementPolicy::describe() const {
+    if (mode == Mode::None) {
+        return "none";
+    }
+
+    std::string spec = mode == Mode::RoundRobin ? "round-robin" : "least-loaded";
+    spec += ":" + std::to_string(coresPerJob);
+    if (bindMemory) {
+        spec += ":numa";
+    }
+    return spec;
+}
+
+/**
+ * @brief Chooses the core set for the next job.
+ * @return Assignment The placement, with slot -1 if the policy is disabled.
+ */
+PlacementPolicy::Assignment PlacementPolicy::assign() {
+    Assignment assignment{};
+    assignment.slot = -1;
+
+    if (mode == Mode::None || slots.empty()) {
+        return assignment;
+    }
+
+    if (mode == Mode::RoundRobin) {
+        assignment.slot = static_cast<int>(next++ % slots.size());
+    } else {
+        assignment.slot = static_cast<int>(std::distance(begin(load), std::min_element(begin(load), end(load))));
+    }
+
+    const Slot& slot = slots[assignment.slot];
+    CPU_ZERO(&assignment.cpus);
+    for (int cpu : slot.cpus) {
+        CPU_SET(cpu, &assignment.cpus);
+    }
+    if (bindMemory && slot.node >= 0 && slot.node < static_cast<int>(sizeof(unsigned long) * 8)) {
+        assignment.nodeMask = 1UL << slot.node;
+    }
+
+    return assignment;
+}
+
+/**
+ * @brief Records that a job was placed according to an assignment.
+ * @param pid The job process.
+ * @param assignment The placement returned by assign().
+ */
+void PlacementPolicy::commit(pid_t pid, const Assignment& assignment) {
+    if (assignment.slot < 0 || assignment.slot >= static_cast<int>(slots.size())) {
+        return;
+    }
+
+    load[assignment.slot]++;
+    placedJobs[pid] = assignment.slot;
+}
+
+/**
+ * @brief Forgets a finished job, freeing its core set for the least-loaded policy.
+ * @param pid The job process.
+ */
+void PlacementPolicy::release(pid_t pid) {
+    auto found = placedJobs.find(pid);
+    if (found == end(placedJobs)) {
+        return;
+    }
+
+    if (found->second < static_cast<int>(load.size()) && load[found->second] > 0) {
+        load[found->second]--;
+    }
+    placedJobs.erase(found);
+}
+
+/**
+ * @brief Applies an assignment to the calling process, only async-signal-safe calls are made.
+ * @param assignment The placement.
+ */
+void PlacementPolicy::apply(const Assignment& assignment) {
+    if (assignment.slot < 0) {
+        return;
+    }
+
+    if (sched_setaffinity(0, sizeof(assignment.cpus), &assignment.cpus) == -1) {
+        const char message[] = "placement: sched_setaffinity failed\n";
+        write(STDERR_FILENO, message, sizeof(message) - 1);
+    }
+
+    if (assignment.nodeMask != 0 &&
+        syscall(SYS_set_mempolicy, MPOL_BIND, &assignment.nodeMask, sizeof(assignment.nodeMask) * 8) == -1) {
+        const char message[] = "placement: set_mempolicy failed\n";
+        write(STDERR_FILENO, message, sizeof(message) - 1);
+    }
+}
+
+/// @brief Discovers the allowed CPUs and their nodes, then cuts them into core sets.
+void PlacementPolicy::buildSlots() {
+    slots.clear();
+    load.clear();
+    placedJobs.clear();
+    next = 0;
+
+    if (mode == Mode::None) {
+        return;
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        return;
+    }
+
+    // allowed CPUs grouped by node
+    std::map<int, int> cpuNodes = readCpuNodes();
+    std::map<int, std::vector<int>> nodeCpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            auto node = cpuNodes.find(cpu);
+            nodeCpus[node != end(cpuNodes) ? node->second : 0].push_back(cpu);
+        }
+    }
+
+    // every node is cut separately, so that a core set never spans two nodes
+    std::vector<std::vector<Slot>> nodeSlots;
+    for (const auto& [node, cpus] : nodeCpus) {
+        std::vector<Slot>& current = nodeSlots.emplace_back();
+        for (size_t first = 0; first < cpus.size(); first += coresPerJob) {
+            size_t last = std::min(first + coresPerJob, cpus.size());
+            current.push_back({{begin(cpus) + first, begin(cpus) + last}, node});
+        }
+    }
+
+    // alternating the nodes spreads consecutive jobs over all of them
+    bool added = true;
+    for (size_t index = 0; added; index++) {
+        added = false;
+        for (const std::vector<Slot>& current : nodeSlots) {
+            if (index < current.size()) {
+                slots.push_back(current[index]);
+                added = true;
+            }
+        }
+    }
+
+    load.assign(slots.size(), 0);
+}
@@ -0,0 +1,113 @@
+/**
+ * @file Prefetcher.cpp
+ * @brief File implemets Prefetcher class
+ *
+ * A file is marked loaded once readahead(2) returns, which may be before its last pages arrive; a command
+ * faulting one of those in waits for the read in flight instead of starting one of its own.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "Prefetcher.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "Metrics.hpp"
+
+/// @brief Starts the thread.
+Prefetcher::Prefetcher() : stopping(false) {
+    // signals are left to the shell thread, a SIGCHLD handled here would reap the foreground command
+    sigset_t allSignals;
+    sigset_t previous;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &previous);
+    worker = std::thread(&Prefetcher::work, this);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+/// @brief Stops the thread, the files still queued are not read.
+Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    queued.notify_one();
+    worker.join();
+}
+
+/**
+ * @brief Queues a file to be read, unless it was queued before.
+ * @param path The absolute path of the file.
+ */
+void Prefetcher::prefetch(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (!states.emplace(path, State::Queued).second) {
+            return;
+        }
+        queue.push_back(path);
+    }
+    queued.notify_one();
+}
+
+/**
+ * @brief Counts a file of a line about to run as a hit or a miss.
+ * @param path The path given to prefetch().
+ */
+void Prefetcher::used(const std::string& path) {
+    State state;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        auto file = states.find(path);
+        if (file == states.end()) {
+            return;
+        }
+        state = file->second;
+    }
+
+    if (state == State::Loaded) {
+        Metrics::add(Metrics::Counter::PrefetchHits);
+    } else if (state == State::Queued) {
+        Metrics::add(Metrics::Counter::PrefetchMisses);
+    }
+}
+
+/// @brief Reads the queued files until the Prefetcher is destroyed.
+void Prefetcher::work() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    while (true) {
+        queued.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+        std::string path = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        // O_NOATIME spares an inode write per file, it is only allowed on the files of the user
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+        if (fd == -1) {
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        struct stat status {};
+        bool loaded = fd != -1 && fstat(fd, &status) == 0 && S_ISREG(status.st_mode);
+        if (loaded) {
+            size_t length = std::min(static_cast<size_t>(status.st_size), fileLimit);
+            if (readahead(fd, 0, length) == -1) {
+                loaded = posix_fadvise(fd, 0, static_cast<off_t>(length), POSIX_FADV_WILLNEED) == 0;
+            }
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+
+        lock.lock();
+        states[path] = loaded ? State::Loaded : State::Skipped;
+    }
+}
@@ -0,0 +1,505 @@
+/**
+ * @file ResourceLimits.cpp
+ * @brief File implemets ResourceLimits class
+ *
+ * The cgroup hierarchy is probed lazily on the first job after limits were configured. The shell creates
+ * "ishell-<pid>" next to itself and the job cgroups below it. Controllers can only be enabled for children of
+ * a cgroup without processes, so if the cgroup of the shell has processes, the shell moves itself into the
+ * "ishell-<pid>-shell" leaf first and moves back when it is done.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "ResourceLimits.hpp"
+
+#include <fcntl.h>
+#include <linux/sched.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "StringUtils.hpp"
+
+namespace {
+
+/**
+ * @brief Reads the first line of a file.
+ * @param path The file.
+ * @return std::optional<std::string> The line, std::nullopt if the file cannot be read.
+ */
+std::optional<std::string> readLine(const std::string& path) {
+    std::ifstream file{path};
+    std::string line;
+    if (!std::getline(file, line)) {
+        return std::nullopt;
+    }
+    return line;
+}
+
+/**
+ * @brief Writes a value into a cgroup file.
+ * @param path The file.
+ * @param value The value.
+ * @return true on success, errno is set otherwise.
+ */
+bool writeValue(const std::string& path, const std::string& value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    bool written = write(fd, value.data(), value.size()) == static_cast<ssize_t>(value.size());
+    int error = errno;
+    close(fd);
+    errno = error;
+    return written;
+}
+
+/**
+ * @brief Reads a keyed value from a flat keyed cgroup file like cpu.stat.
+ * @param path The file.
+ * @param key The key.
+ * @return long long The value, -1 if it is missing.
+ */
+long long readKeyed(const std::string& path, const std::string& key) {
+    std::ifstream file{path};
+    std::string name;
+    long long value;
+    while (file >> name >> value) {
+        if (name == key) {
+            return value;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Finds the mount point of the cgroup v2 hierarchy.
+ * @return std::string The mount point, empty if there is none.
+ */
+std::string findCgroup2Mount() {
+    std::ifstream mountInfo{"/proc/self/mountinfo"};
+    std::string line;
+    while (std::getline(mountInfo, line)) {
+        size_t separator = line.find(" - ");
+        if (separator == std::string::npos || line.compare(separator + 3, 8, "cgroup2 ") != 0) {
+            continue;
+        }
+
+        // id parent major:minor root mountpoint ...
+        std::istringstream fields{line.substr(0, separator)};
+        std::string skipped;
+        std::string mountPoint;
+        fields >> skipped >> skipped >> skipped >> skipped >> mountPoint;
+        return mountPoint;
+    }
+    return "";
+}
+
+/**
+ * @brief Parses a positive count.
+ * @param value The count, a trailing suffix character may be given to be ignored.
+ * @param suffix Allowed trailing character, '\0' for none.
+ * @return long long The count.
+ * @throws std::invalid_argument if the count is malformed.
+ */
+long long parseCount(std::string value, char suffix) {
+    if (suffix != '\0' && !value.empty() && value.back() == suffix) {
+        value.pop_back();
+    }
+    if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos ||
+        std::stoll(value) == 0) {
+        throw std::invalid_argument("invalid count \"" + value + "\"");
+    }
+    return std::stoll(value);
+}
+
+/**
+ * @brief Formats a byte count with a binary suffix.
+ * @param bytes The byte count.
+ * @return std::string The formatted count.
+ */
+std::string formatSize(long long bytes) {
+    const char* suffixes[] = {"", "K", "M", "G"};
+    int suffix = 0;
+    while (suffix < 3 && bytes >= 1024 && bytes % 1024 == 0) {
+        bytes /= 1024;
+        suffix++;
+    }
+    return std::to_string(bytes) + suffixes[suffix];
+}
+
+}  // namespace
+
+/// @brief Constructs ResourceLimits without any limits.
+ResourceLimits::ResourceLimits()
+    : lane(false),
+      enabled(false),
+      probed(false),
+      hasMemory(false),
+      hasCpu(false),
+      hasPids(false),
+      nextCgroupId(1) {
+}
+
+/// @brief Removes the cgroups created by the shell.
+ResourceLimits::~ResourceLimits() {
+    for (const auto& [pid, path] : jobCgroups) {
+        rmdir(path.c_str());
+    }
+    if (!laneCgroup.empty()) {
+        rmdir(laneCgroup.c_str());
+    }
+    if (!shellCgroup.empty()) {
+        rmdir(shellCgroup.c_str());
+    }
+    if (!shellLeaf.empty()) {
+        writeValue(originalCgroup + "/cgroup.procs", std::to_string(getpid()));
+        rmdir(shellLeaf.c_str());
+    }
+}
+
+/**
+ * @brief Configures the limits from a spec.
+ * @param spec "none" or "memory=SIZE:cpu=PERCENT%:pids=COUNT[:lane]".
+ * @throws std::invalid_argument if the spec is malformed.
+ */
+void ResourceLimits::configure(const std::string& spec) {
+    using namespace std;
+
+    vector<string> parts;
+    const string separator{":"};
+    utils::StringUtils::split(begin(spec), end(spec), begin(separator), end(separator), back_inserter(parts),
+                              [](auto it1, auto it2) { return string{it1, it2}; });
+
+    if (parts.empty()) {
+        throw invalid_argument("empty limits spec");
+    }
+
+    optional<long long> newMemory;
+    optional<long long> newCpu;
+    optional<long long> newPids;
+    bool newLane = false;
+
+    if (parts.size() != 1 || parts[0] != "none") {
+        for (const string& part : parts) {
+            size_t equals = part.find('=');
+            string key = part.substr(0, equals);
+            string value = equals == string::npos ? "" : part.substr(equals + 1);
+
+            if (key == "lane" && equals == string::npos) {
+                newLane = true;
+            } else if (key == "memory") {
+                newMemory = utils::StringUtils::parseSize(value);
+            } else if (key == "cpu") {
+                newCpu = parseCount(value, '%');
+            } else if (key == "pids") {
+                newPids = parseCount(value, '\0');
+            } else {
+                throw invalid_argument("invalid limit \"" + part + "\"");
+            }
+        }
+    }
+
+    memoryMax = newMemory;
+    cpuPercent = newCpu;
+    pidsMax = newPids;
+    lane = newLane;
+    enabled = memoryMax || cpuPercent || pidsMax;
+
+    // the running lane keeps going with the new limits
+    if (!laneCgroup.empty()) {
+        createLimited(laneCgroup);
+    }
+}
+
+/**
+ * @brief Describes the current configuration and how it is enforced.
+ * @return std::string The description.
+ */
+std::string ResourceLimits::describe() const {
+    if (!enabled) {
+        return "none";
+    }
+
+    std::vector<std::string> parts;
+    std::vector<std::string> fallbacks;
+    if (memoryMax) {
+        parts.push_back("memory=" + formatSize(*memoryMax));
+        if (!hasMemory) {
+            fallbacks.emplace_back("memory");
+        }
+    }
+    if (cpuPercent) {
+        parts.push_back("cpu=" + std::to_string(*cpuPercent) + "%");
+        if (!hasCpu) {
+            fallbacks.emplace_back("cpu (not enforced)");
+        }
+    }
+    if (pidsMax) {
+        parts.push_back("pids=" + std::to_string(*pidsMax));
+        if (!hasPids) {
+            fallbacks.emplace_back("pids (not enforced)");
+        }
+    }
+    if (lane) {
+        parts.emplace_back("lane");
+    }
+
+    std::string description;
+    for (const std::string& part : parts) {
+        description += (description.empty() ? "" : ":") + part;
+    }
+
+    if (!probed) {
+        return description;
+    }
+
+    description += shellCgroup.empty() ? "\n\tcgroups: not available" : "\n\tcgroups: " + shellCgroup;
+    if (!fallbacks.empty()) {
+        description += "\n\tsetrlimit fallback:";
+        for (const std::string& fallback : fallbacks) {
+            description += " " + fallback;
+        }
+    }
+
+    if (!laneCgroup.empty()) {
+        long long cpuUsec = readKeyed(laneCgroup + "/cpu.stat", "usage_usec");
+        std::optional<std::string> peak = readLine(laneCgroup + "/memory.peak");
+        description += "\n\tlane usage: cpu " + (cpuUsec < 0 ? "?" : std::to_string(cpuUsec / 1000) + "ms") +
+                       ", memory peak " + (peak ? formatSize(std::stoll(*peak)) : "?");
+    }
+
+    return description;
+}
+
+/**
+ * @brief Prepares the placement of the next job, creating its cgroup if needed.
+ * @return Assignment The placement, with cgroupFd -1 if cgroups are not used.
+ */
+ResourceLimits::Assignment ResourceLimits::prepare() {
+    Assignment assignment{-1, "", "", std::nullopt};
+    if (!enabled) {
+        return assignment;
+    }
+
+    if (!probed && !setupHierarchy()) {
+        std::cerr << "limits: cgroup v2 is not writable, falling back to setrlimit\n";
+    }
+
+    if (!shellCgroup.empty()) {
+        std::string path;
+        if (lane) {
+            if (laneCgroup.empty() && createLimited(shellCgroup + "/lane")) {
+                laneCgroup = shellCgroup + "/lane";
+            }
+            path = laneCgroup;
+        } else {
+            path = shellCgroup + "/job" + std::to_string(nextCgroupId++);
+            if (createLimited(path)) {
+                assignment.jobCgroup = path;
+            } else {
+                path.clear();
+            }
+        }
+
+        if (!path.empty()) {
+            assignment.cgroupFd = open(path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+            assignment.procsPath = path + "/cgroup.procs";
+        }
+    }
+
+    bool inCgroup = assignment.cgroupFd != -1;
+    if (memoryMax && !(inCgroup && hasMemory)) {
+        assignment.memory = rlimit{static_cast<rlim_t>(*memoryMax), static_cast<rlim_t>(*memoryMax)};
+    }
+
+    return assignment;
+}
+
+/**
+ * @brief Spawns a child process into the assigned cgroup, like fork() does.
+ *
+ * clone3() is called directly, without the fork handlers of the C library, so the child must stick to
+ * async-signal-safe calls until it execs.
+ *
+ * @param assignment The placement returned by prepare().
+ * @return pid_t 0 in the child, the child pid in the parent, -1 on error.
+ */
+pid_t ResourceLimits::spawn(const Assignment& assignment) {
+    if (assignment.cgroupFd != -1) {
+        clone_args args{};
+        args.flags = CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = assignment.cgroupFd;
+
+        auto pid = static_cast<pid_t>(syscall(SYS_clone3, &args, sizeof(args)));
+        if (pid != -1) {
+            return pid;
+        }
+    }
+
+    // no clone3() or no permission for it, the child moves itself as early as possible
+    pid_t pid = fork();
+    if (pid == 0 && assignment.cgroupFd != -1) {
+        int fd = open(assignment.procsPath.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd != -1) {
+            write(fd, "0", 1);
+            close(fd);
+        }
+    }
+    return pid;
+}
+
+/**
+ * @brief Applies the setrlimit() fallbacks to the calling process, only async-signal-safe calls are made.
+ * @param assignment The placement returned by prepare().
+ */
+void ResourceLimits::apply(const Assignment& assignment) {
+    if (assignment.memory && setrlimit(RLIMIT_AS, &*assignment.memory) == -1) {
+        const char message[] = "limits: setrlimit(RLIMIT_AS) failed\n";
+        write(STDERR_FILENO, message, sizeof(message) - 1);
+    }
+}
+
+/**
+ * @brief Records the spawned job and releases the cgroup descriptor.
+ * @param pid The job process, -1 if the spawn failed and the job cgroup is to be removed.
+ * @param assignment The placement returned by prepare().
+ */
+void ResourceLimits::commit(pid_t pid, Assignment& assignment) {
+    if (assignment.cgroupFd != -1) {
+        close(assignment.cgroupFd);
+        assignment.cgroupFd = -1;
+    }
+
+    if (assignment.jobCgroup.empty()) {
+        return;
+    }
+
+    if (pid > 0) {
+        jobCgroups[pid] = assignment.jobCgroup;
+    } else {
+        rmdir(assignment.jobCgroup.c_str());
+    }
+}
+
+/**
+ * @brief Reads the resources used by a finished job and removes its cgroup.
+ * @param pid The job process.
+ * @return Usage The used resources.
+ */
+ResourceLimits::Usage ResourceLimits::release(pid_t pid) {
+    Usage usage{-1, -1};
+
+    auto found = jobCgroups.find(pid);
+    if (found == end(jobCgroups)) {
+        return usage;
+    }
+
+    const std::string& path = found->second;
+    usage.cpuUsec = readKeyed(path + "/cpu.stat", "usage_usec");
+    if (std::optional<std::string> peak = readLine(path + "/memory.peak")) {
+        usage.memoryPeak = std::stoll(*peak);
+    }
+
+    rmdir(path.c_str());
+    jobCgroups.erase(found);
+    return usage;
+}
+
+/**
+ * @brief Finds the cgroup of the shell and creates the cgroup of the shell below it.
+ * @return true if cgroups can be used.
+ */
+bool ResourceLimits::setupHierarchy() {
+    probed = true;
+
+    std::string mountPoint = findCgroup2Mount();
+    std::string ownPath;
+    std::ifstream membership{"/proc/self/cgroup"};
+    for (std::string line; std::getline(membership, line);) {
+        if (line.rfind("0::", 0) == 0) {
+            ownPath = line.substr(3);
+        }
+    }
+    if (mountPoint.empty() || ownPath.empty()) {
+        return false;
+    }
+
+    std::string base = mountPoint + (ownPath == "/" ? "" : ownPath);
+    std::string shell = base + "/ishell-" + std::to_string(getpid());
+    if (mkdir(shell.c_str(), 0755) == -1 && errno != EEXIST) {
+        return false;
+    }
+
+    // enabling only the controllers that exist, the rest falls back to setrlimit()
+    std::string controllers;
+    std::istringstream available{readLine(base + "/cgroup.controllers").value_or("")};
+    for (std::string controller; available >> controller;) {
+        if (controller == "memory" || controller == "cpu" || controller == "pids") {
+            controllers += (controllers.empty() ? "+" : " +") + controller;
+        }
+    }
+
+    if (!controllers.empty() && !writeValue(base + "/cgroup.subtree_control", controllers) && errno == EBUSY) {
+        // the cgroup has processes (the shell), they have to live in a leaf for the controllers
+        std::string leaf = shell + "-shell";
+        if (mkdir(leaf.c_str(), 0755) == 0 || errno == EEXIST) {
+            if (writeValue(leaf + "/cgroup.procs", std::to_string(getpid()))) {
+                originalCgroup = base;
+                shellLeaf = leaf;
+                writeValue(base + "/cgroup.subtree_control", controllers);
+            } else {
+                rmdir(leaf.c_str());
+            }
+        }
+    }
+
+    if (!controllers.empty()) {
+        writeValue(shell + "/cgroup.subtree_control", controllers);
+    }
+
+    std::istringstream enabledControllers{readLine(shell + "/cgroup.subtree_control").value_or("")};
+    for (std::string controller; enabledControllers >> controller;) {
+        hasMemory = hasMemory || controller == "memory";
+        hasCpu = hasCpu || controller == "cpu";
+        hasPids = hasPids || controller == "pids";
+    }
+
+    shellCgroup = shell;
+    return true;
+}
+
+/**
+ * @brief Creates a cgroup with the configured limits.
+ * @param path Path of the cgroup.
+ * @return true on success.
+ */
+bool ResourceLimits::createLimited(const std::string& path) const {
+    if (mkdir(path.c_str(), 0755) == -1 && errno != EEXIST) {
+        return false;
+    }
+
+    const long long cpuPeriod = 100000;
+    if (hasMemory) {
+        writeValue(path + "/memory.max", memoryMax ? std::to_string(*memoryMax) : "max");
+    }
+    if (hasCpu) {
+        writeValue(path + "/cpu.max", (cpuPercent ? std::to_string(*cpuPercent * cpuPeriod / 100) : "max") + " " +
+                                          std::to_string(cpuPeriod));
+    }
+    if (hasPids) {
+        writeValue(path + "/pids.max", pidsMax ? std::to_string(*pidsMax) : "max");
+    }
+    return true;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file SessionLog.cpp
+ * @brief File implemets SessionLog class
+ *
+ * Varints are LEB128: seven bits per byte, least significant first, the high bit set on all but the last
+ * byte. A line of a few milliseconds costs about 15 bytes besides its text.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "SessionLog.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "StringUtils.hpp"
+
+namespace {
+
+/**
+ * @brief Appends a varint.
+ * @param output The string to append to.
+ * @param value The value.
+ */
+void putVarint(std::string& output, uint64_t value) {
+    while (value >= 0x80) {
+        output += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    output += static_cast<char>(value);
+}
+
+/**
+ * @brief Reads a varint.
+ * @param input The bytes, advanced past the varint.
+ * @param end End of the bytes.
+ * @param value Receives the value.
+ * @return true unless the bytes end inside the varint or it is longer than 64 bits.
+ */
+bool getVarint(const char*& input, const char* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; input != end && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*input++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief Latencies of a set of lines or spawns, summarized for compare().
+struct Latencies {
+    std::vector<uint64_t> values;
+
+    /**
+     * @brief Formats a row of the comparison table.
+     * @param label The row label.
+     * @return std::string The row.
+     */
+    std::string row(const char* label) {
+        using utils::StringUtils;
+
+        char text[160];
+        if (values.empty()) {
+            snprintf(text, sizeof(text), "%-16s %8d\n", label, 0);
+            return text;
+        }
+
+        std::sort(values.begin(), values.end());
+        double sum = 0;
+        for (uint64_t value : values) {
+            sum += static_cast<double>(value);
+        }
+        auto quantile = [&](double share) {
+            size_t rank = static_cast<size_t>(share * static_cast<double>(values.size() - 1) + 0.5);
+            return StringUtils::formatDuration(static_cast<double>(values[rank]));
+        };
+        snprintf(text, sizeof(text), "%-16s %8zu %9s %9s %9s %9s %9s\n", label, values.size(),
+                 StringUtils::formatDuration(sum / static_cast<double>(values.size())).c_str(),
+                 quantile(0.5).c_str(), quantile(0.9).c_str(), quantile(0.99).c_str(),
+                 StringUtils::formatDuration(static_cast<double>(values.back())).c_str());
+        return text;
+    }
+};
+
+/**
+ * @brief Describes the outcome of a line for the list of differences.
+ * @param record The line.
+ * @return std::string e.g. "status 1" or "parse error".
+ */
+std::string describe(const SessionLog::Record& record) {
+    switch (record.outcome) {
+        case SessionLog::Outcome::Ran:
+            return "status " + std::to_string(record.status);
+        case SessionLog::Outcome::Pending:
+            return "block open";
+        case SessionLog::Outcome::ParseError:
+            return "parse error";
+    }
+    return "";
+}
+
+}  // namespace
+
+/**
+ * @brief Creates or truncates a log and writes its magic.
+ * @param path The file.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+SessionLog::SessionLog(const std::string& path) : previousOffset(0) {
+    using namespace std;
+
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw runtime_error(path + ": " + strerror(errno));
+    }
+    if (write(fd, magic, sizeof(magic)) != static_cast<ssize_t>(sizeof(magic))) {
+        int error = errno;
+        close(fd);
+        throw runtime_error(path + ": " + strerror(error));
+    }
+}
+
+/// @brief Closes the file.
+SessionLog::~SessionLog() {
+    close(fd);
+}
+
+/**
+ * @brief Appends a record, its offset must not be below the one of the previous record.
+ * @param record The record.
+ * @throws std::runtime_error if the record cannot be written.
+ */
+void SessionLog::append(const Record& record) {
+    std::string payload;
+    payload.reserve(record.line.size() + 32);
+    putVarint(payload, record.offset - previousOffset);
+    putVarint(payload, static_cast<uint64_t>(record.outcome));
+    putVarint(payload, record.duration);
+    putVarint(payload, record.spawns);
+    putVarint(payload, record.spawnLatency);
+    putVarint(payload, record.status);
+    putVarint(payload, record.line.size());
+    payload += record.line;
+
+    encoded.clear();
+    putVarint(encoded, payload.size());
+    encoded += payload;
+
+    ssize_t written;
+    while ((written = write(fd, encoded.data(), encoded.size())) == -1 && errno == EINTR) {
+    }
+    if (written != static_cast<ssize_t>(encoded.size())) {
+        const char* reason = written == -1 ? strerror(errno) : "short write";
+        throw std::runtime_error(std::string{"session log: "} + reason);
+    }
+    previousOffset = record.offset;
+}
+
+/**
+ * @brief Reads all the records of a log.
+ * @param path The file.
+ * @return std::vector<Record> The records in the order they were written, without a torn last one.
+ * @throws std::runtime_error if the file cannot be read or is not a session log.
+ */
+std::vector<SessionLog::Record> SessionLog::load(const std::string& path) {
+    using namespace std;
+
+    ifstream file{path, ios::binary};
+    if (!file) {
+        throw runtime_error(path + ": " + strerror(errno));
+    }
+    string content{istreambuf_iterator<char>{file}, istreambuf_iterator<char>{}};
+    if (content.size() < sizeof(magic) || content.compare(0, sizeof(magic), magic, sizeof(magic)) != 0) {
+        throw runtime_error(path + ": not a session log");
+    }
+
+    vector<Record> records;
+    uint64_t offset = 0;
+    const char* input = content.data() + sizeof(magic);
+    const char* end = content.data() + content.size();
+    while (input != end) {
+        uint64_t size;
+        if (!getVarint(input, end, size) || size > static_cast<uint64_t>(end - input)) {
+            break;  // torn by a crash
+        }
+        const char* recordEnd = input + size;
+
+        Record record{};
+        uint64_t delta;
+        uint64_t outcome;
+        uint64_t status;
+        uint64_t length;
+        bool complete = getVarint(input, recordEnd, delta) && getVarint(input, recordEnd, outcome) &&
+                        getVarint(input, recordEnd, record.duration) &&
+                        getVarint(input, recordEnd, record.spawns) &&
+                        getVarint(input, recordEnd, record.spawnLatency) &&
+                        getVarint(input, recordEnd, status) && getVarint(input, recordEnd, length) &&
+                        length <= static_cast<uint64_t>(recordEnd - input) &&
+                        outcome <= static_cast<uint64_t>(Outcome::ParseError);
+        if (!complete) {
+            throw runtime_error(path + ": malformed record " + to_string(records.size() + 1));
+        }
+
+        offset += delta;
+        record.offset = offset;
+        record.outcome = static_cast<Outcome>(outcome);
+        record.status = static_cast<uint32_t>(status);
+        record.line.assign(input, length);
+        records.push_back(move(record));
+
+        // fields added by later versions are skipped
+        input = recordEnd;
+    }
+    return records;
+}
+
+/**
+ * @brief Compares the latencies of a replay with the ones of the recording.
+ *
+ * Spawn latencies are compared per spawn: a line starting several commands counts with its mean spawn
+ * latency once per command.
+ *
+ * @param recorded The records of the log.
+ * @param replayed The records of the replay, in the same order.
+ * @return std::string The report: line and spawn latency quantiles, the total time and the lines whose
+ * outcome or status differ.
+ */
+std::string SessionLog::compare(const std::vector<Record>& recorded, const std::vector<Record>& replayed) {
+    using namespace std;
+    using utils::StringUtils;
+
+    size_t count = min(recorded.size(), replayed.size());
+    Latencies lines[2];
+    Latencies spawns[2];
+    string differences;
+    size_t differing = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Record* pair[2] = {&recorded[i], &replayed[i]};
+        for (size_t side = 0; side < 2; side++) {
+            const Record& record = *pair[side];
+            if (record.outcome == Outcome::Ran) {
+                lines[side].values.push_back(record.duration);
+            }
+            for (uint64_t spawn = 0; spawn < record.spawns; spawn++) {
+                spawns[side].values.push_back(record.spawnLatency / record.spawns);
+            }
+        }
+
+        if (recorded[i].outcome == replayed[i].outcome &&
+            (recorded[i].outcome != Outcome::Ran || recorded[i].status == replayed[i].status)) {
+            continue;
+        }
+        if (++differing <= listedDifferences) {
+            differences += "  line " + to_string(i + 1) + ": " + describe(recorded[i]) + " recorded, " +
+                           describe(replayed[i]) + " replayed: " + recorded[i].line + '\n';
+        }
+    }
+
+    auto span = [](const vector<Record>& records, size_t end) -> uint64_t {
+        if (end == 0) {
+            return 0;
+        }
+        const Record& last = records[end - 1];
+        return last.offset + last.duration - records.front().offset;
+    };
+
+    string replayTime = StringUtils::formatDuration(static_cast<double>(span(replayed, count)));
+    string recordTime = StringUtils::formatDuration(static_cast<double>(span(recorded, count)));
+    string report = "replayed " + to_string(count) + " of " + to_string(recorded.size()) + " lines in " +
+                    replayTime + ", recorded in " + recordTime + '\n';
+    char header[160];
+    snprintf(header, sizeof(header), "%-16s %8s %9s %9s %9s %9s %9s\n", "latency", "count", "mean", "p50",
+             "p90", "p99", "max");
+    report += header;
+    report += lines[0].row("line recorded");
+    report += lines[1].row("line replayed");
+    report += spawns[0].row("spawn recorded");
+    report += spawns[1].row("spawn replayed");
+    if (differing != 0) {
+        report += to_string(differing) + (differing == 1 ? " line differs" : " lines differ") +
+                  " in outcome or status:\n" + differences;
+        if (differing > listedDifferences) {
+            report += "  ...\n";
+        }
+    }
+    return report;
+}
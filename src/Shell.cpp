@@ -8,6 +8,10 @@
  * user), it parses the line into commands and executes them one by one. Parsing and executing are delegated
  * to Parser and Executor classes respectively.
  *
+ * A line opening a block is kept until the lines closing it arrive, then the whole block is parsed into a
+ * syntax tree and run from it: conditions and loop bodies run from the same tree on every iteration, only
+ * the words of their commands are expanded again.
+ *
  * @author Sukhanov Ivan
  * @date 25/5/2025
  * @version 1.0
@@ -15,14 +19,92 @@
 
 #include "Shell.hpp"
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+#include "FdStreamBuffer.hpp"
+#include "Metrics.hpp"
+#include "ParseUtils.hpp"
+#include "StartupProfile.hpp"
+#include "StringUtils.hpp"
+
+namespace {
+
+/// @brief Asks the terminal to mark pasted text, and stops it.
+constexpr std::string_view pasteModeOn = "\033[?2004h";
+constexpr std::string_view pasteModeOff = "\033[?2004l";
+
+/// @brief Markers the terminal puts around pasted text.
+constexpr std::string_view pasteStart = "\033[200~";
+constexpr std::string_view pasteEnd = "\033[201~";
+
+/// @brief Keywords followed by a command, the word after them is looked up as one.
+constexpr std::string_view commandKeywords[] = {"if", "elif", "then", "else", "while", "until", "do", "{"};
+
+/**
+ * @brief Parses the speed of a replay.
+ * @param value A factor with an optional x suffix, e.g. 2x or 0.5x, or max.
+ * @return double The factor, 0 for as fast as possible.
+ * @throws std::invalid_argument if the speed is malformed.
+ */
+double parseSpeed(const std::string& value) {
+    if (value == "max") {
+        return 0;
+    }
+
+    std::string factor = !value.empty() && value.back() == 'x' ? value.substr(0, value.size() - 1) : value;
+    size_t parsed = 0;
+    double speed = 0;
+    try {
+        speed = std::stod(factor, &parsed);
+    } catch (std::exception&) {
+        parsed = 0;
+    }
+    if (factor.empty() || parsed != factor.size() || !(speed > 0) || speed > 1e6) {
+        throw std::invalid_argument("invalid speed \"" + value + "\", e.g. 2x, 0.5x or max");
+    }
+    return speed;
+}
+
+}  // namespace
 
 /// @brief Constructs a new Shell instance, initializing the parser and executor.
-Shell::Shell() {
-    this->parser = std::make_unique<Parser>();
-    this->executor = std::make_unique<Executor>();
+Shell::Shell()
+    : promptTitle("ishell"),
+      pendingDepth(0),
+      loopDepth(0),
+      functionDepth(0),
+      loopControl(LoopControl::None),
+      returnStatus(0),
+      lastStatus(0),
+      batchWorkers(1),
+      explainDependencies(false),
+      bracketedPaste(false),
+      sessionStart(Metrics::now()),
+      replaySpeed(1),
+      replayedLines(nullptr),
+      prefetchWindow(0) {
+    this->variables = std::make_unique<Variables>();
+    this->parser = std::make_unique<Parser>(*variables);
+    this->executor = std::make_unique<Executor>(*variables);
+
+    executor->setFunctionHandler(
+        [this](const SyntaxNode& body, const Command& call) { return callFunction(body, call); });
+    parser->setSubstitutionHandler(
+        [this](const std::string& commands, std::string& output) { substitute(commands, output); });
 };
 
 /**
@@ -35,38 +117,108 @@ Shell::Shell(const char* prompt) : Shell() {
     const char* lastSlash = strrchr(prompt, '/');
 
     if ((lastSlash != nullptr) && *(lastSlash + 1) != '\0') {
-        PROMPT_TITLE = lastSlash + 1;
+        promptTitle = lastSlash + 1;
     }
 }
 
 /**
- * @brief The prompt title displayed to the user.
+ * @brief Applies the command line options.
+ * @param options The parsed options.
+ * @throws std::invalid_argument if an option value is invalid.
+ * @throws std::runtime_error if the metrics socket or the session log cannot be set up.
  */
-const char* Shell::PROMPT_TITLE = "ishell";
+void Shell::configure(const Options& options) {
+    if (options.placement) {
+        executor->setPlacement(*options.placement);
+    }
+    if (options.limits) {
+        executor->setLimits(*options.limits);
+    }
+    if (options.ioEngine) {
+        executor->setIoEngine(*options.ioEngine);
+    }
+    if (options.metricsSocket) {
+        metricsExporter = std::make_unique<MetricsExporter>(*options.metricsSocket);
+    }
+    if (options.jobs) {
+        const std::string& jobs = *options.jobs;
+        if (jobs.empty() || jobs.size() > 4 || jobs.find_first_not_of("0123456789") != std::string::npos ||
+            std::stoul(jobs) == 0) {
+            throw std::invalid_argument("--jobs needs a positive number");
+        }
+        batchWorkers = std::stoul(jobs);
+        executor->serveJobs(batchWorkers);
+    }
+    explainDependencies = options.explainDependencies;
+    if (options.lineTimeout) {
+        executor->setLineTimeout(utils::StringUtils::parseDuration(*options.lineTimeout));
+    }
+    if (options.batchDeadline) {
+        executor->setDeadline(Metrics::now() + utils::StringUtils::parseDuration(*options.batchDeadline));
+    }
+
+    // a recorded or replayed line is one handled line, the lines of --jobs are handled as graphs
+    if ((options.record || options.replay) && (batchWorkers > 1 || explainDependencies)) {
+        throw std::invalid_argument("--record and --replay run the lines one by one, not with --jobs");
+    }
+    if (options.speed) {
+        if (!options.replay) {
+            throw std::invalid_argument("--speed needs --replay");
+        }
+        replaySpeed = parseSpeed(*options.speed);
+    }
+    if (options.record) {
+        sessionLog = std::make_unique<SessionLog>(*options.record);
+        sessionStart = Metrics::now();
+    }
+
+    if (options.prefetch) {
+        const std::string& window = *options.prefetch;
+        if (window.empty() || window.size() > 4 ||
+            window.find_first_not_of("0123456789") != std::string::npos || std::stoul(window) == 0) {
+            throw std::invalid_argument("--prefetch needs a positive number");
+        }
+        if (!options.batchFile || batchWorkers > 1 || explainDependencies) {
+            throw std::invalid_argument("--prefetch reads ahead of a batch file run line by line");
+        }
+        prefetchWindow = std::stoul(window);
+        prefetcher = std::make_unique<Prefetcher>();
+    }
+}
 
 /**
  * @brief Runs the shell interactively, reading and executing user input in a loop.
+ *
+ * On a terminal, bracketed paste is on while the shell waits for input, so a paste of many lines is read up
+ * to its end marker without a prompt per line and parsed as one script. The commands run with it off, they
+ * do not expect the markers.
  */
 void Shell::run() {
     using namespace std;
 
+    bracketedPaste = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
     while (true) {
         displayPrompt();
-        const string& line = readInput();
+        optional<string> input = readInput();
+        if (!input) {
+            cout << endl;
+            return;
+        }
 
-        if (line.find_first_not_of(Parser::spaceSymbols) == string::npos) {
+        if (input->find_first_not_of(Parser::spaceSymbols) == string::npos) {
             continue;  // Skip empty lines
         }
 
-        handleInputLine(line);
+        handleInputLine(*input);
     }
 }
 
 /**
  * @brief Runs the shell with commands read from a file.
  * @param filename The path to the file containing shell commands.
+ * @return int The exit status of the last command, 1 if the file cannot be read or ends inside a block.
  */
-void Shell::run(const std::string& filename) {
+int Shell::run(const std::string& filename) {
     assert(!filename.empty());
 
     using namespace std;
@@ -74,65 +226,794 @@ void Shell::run(const std::string& filename) {
     fstream file{filename, std::ios::in};
     if (!file) {
         cerr << "There is no file '" << filename << "'" << '\n';
-        return;
+        return 1;
+    }
+    return prefetcher ? runPrefetching(file) : runScript(file);
+}
+
+/**
+ * @brief Runs the shell with commands given as a string, like sh -c.
+ * @param commands The commands, lines are separated by newlines.
+ * @return int The exit status of the last command, 1 if the commands end inside a block.
+ */
+int Shell::runCommand(const std::string& commands) {
+    std::istringstream input{commands};
+    return runScript(input);
+}
+
+/**
+ * @brief Runs the shell with a script read from stdin, like sh -s, without prompts.
+ *
+ * The script is read in large blocks instead of through std::cin, a command reading stdin itself does not
+ * get the part of the script the shell has read ahead.
+ *
+ * @return int The exit status of the last command, 1 if the script ends inside a block.
+ */
+int Shell::runStdin() {
+    utils::FdStreamBuffer buffer{STDIN_FILENO};
+    std::istream input{&buffer};
+    return runScript(input);
+}
+
+/**
+ * @brief Runs the lines of a stream one by one.
+ * @param input The stream.
+ * @return int The exit status of the last command, 1 if the stream ends inside a block.
+ */
+int Shell::runScript(std::istream& input) {
+    using namespace std;
+
+    if (batchWorkers > 1 || explainDependencies) {
+        return runScheduled(input);
     }
 
     string line;
-    vector<unique_ptr<Command>> commands;
-    while (getline(file >> ws, line, '\n')) {
+    while (getline(input >> ws, line, '\n')) {
         if (line.empty()) {
             continue;
         }
+        if (executor->pastDeadline()) {
+            cerr << "error: batch deadline exceeded" << '\n';
+            return timedOutStatus;
+        }
         handleInputLine(line);
     }
+
+    if (pendingDepth > 0) {
+        cerr << "error: syntax error: unexpected end of file" << '\n';
+        return 1;
+    }
+    return lastStatus;
+}
+
+/**
+ * @brief Runs the lines of a stream one by one, prefetching the files of the lines ahead of them.
+ *
+ * Up to prefetchWindow lines are read ahead of the running one. The files of a line are queued when it is
+ * read, so they are read in while the lines before it run, and counted as hits or misses right before it
+ * runs. The commands of the window are looked up again after the search path changed, a script usually sets
+ * it on its first line.
+ *
+ * @param input The stream.
+ * @return int The exit status of the last command, 1 if the stream ends inside a block, 124 if the batch
+ * deadline passed.
+ */
+int Shell::runPrefetching(std::istream& input) {
+    using namespace std;
+
+    struct Upcoming {
+        string line;
+        vector<string> paths;
+    };
+    deque<Upcoming> window;
+    size_t searchPathVersion = executor->searchPathVersion();
+
+    string line;
+    while (true) {
+        while (window.size() <= prefetchWindow && getline(input >> ws, line, '\n')) {
+            if (!line.empty()) {
+                window.push_back({line, prefetchLine(line)});
+            }
+        }
+        if (window.empty()) {
+            break;
+        }
+
+        if (searchPathVersion != executor->searchPathVersion()) {
+            searchPathVersion = executor->searchPathVersion();
+            for (Upcoming& upcoming : window) {
+                upcoming.paths = prefetchLine(upcoming.line);
+            }
+        }
+        Upcoming current = move(window.front());
+        window.pop_front();
+
+        if (executor->pastDeadline()) {
+            cerr << "error: batch deadline exceeded" << '\n';
+            return timedOutStatus;
+        }
+        for (const string& path : current.paths) {
+            prefetcher->used(path);
+        }
+        handleInputLine(current.line);
+    }
+
+    if (pendingDepth > 0) {
+        cerr << "error: syntax error: unexpected end of file" << '\n';
+        return 1;
+    }
+    return lastStatus;
 }
 
 /**
- * @brief Parses and executes a single line of input.
+ * @brief Queues the executables and the literal argument paths of a line for prefetching.
+ *
+ * A word is a command if it starts the line, follows ;, &, &&, || or a keyword opening a block; the other
+ * words are taken as paths relative to the current directory unless they are options or output redirects.
+ * The prefetcher skips the ones that are not regular files.
+ *
+ * @param line The line, it is not expanded: words with quotes, variables, substitutions or globs are left
+ * out.
+ * @return std::vector<std::string> The queued paths, absolute.
+ */
+std::vector<std::string> Shell::prefetchLine(const std::string& line) {
+    using namespace std;
+
+    vector<string> words;
+    utils::ParseUtils::splitKeepingQuotes(line, back_inserter(words));
+    char cwd[PATH_MAX];
+    string directory = getcwd(cwd, sizeof(cwd)) != nullptr ? string{cwd} + '/' : "/";
+
+    vector<string> paths;
+    bool command = true;
+    bool redirectTarget = false;
+    for (string& word : words) {
+        if (word == ";" || word == "&" || word == "&&" || word == "||") {
+            command = true;
+            continue;
+        }
+        bool output = redirectTarget;
+        redirectTarget = false;
+        if (word.find('>') != string::npos) {
+            redirectTarget = word.back() == '>';  // the target is the next word
+            continue;
+        }
+        if (word.front() == '<' && word.erase(0, 1).empty()) {
+            continue;  // the source is the next word
+        }
+
+        bool ends = word.back() == ';' || word.back() == '&';
+        if (ends) {
+            word.pop_back();
+        }
+        bool literal = !word.empty() && word.find_first_of("'\"\\$`*?[~") == string::npos;
+        if (literal && command) {
+            if (find(begin(commandKeywords), end(commandKeywords), word) != end(commandKeywords)) {
+                continue;
+            }
+            string executable = executor->findExecutable(word);
+            if (!executable.empty()) {
+                paths.push_back(move(executable));
+            }
+        } else if (literal && !output && word.front() != '-') {
+            paths.push_back(word.front() == '/' ? word : directory + word);
+        }
+        command = ends;
+    }
+
+    for (const string& path : paths) {
+        prefetcher->prefetch(path);
+    }
+    return paths;
+}
+
+/**
+ * @brief Runs the lines of a session log again, then compares their latencies with the recorded ones.
+ *
+ * Every line is issued at its recorded offset divided by the speed, or as soon as the previous one is done
+ * if the speed is 0 or the previous one took longer. The comparison goes to stderr, apart from the output of
+ * the commands.
+ *
+ * @param filename The log written by --record.
+ * @return int The exit status of the last command, 1 if the log cannot be read or ends inside a block.
+ */
+int Shell::replay(const std::string& filename) {
+    using namespace std;
+
+    vector<SessionLog::Record> recorded;
+    try {
+        recorded = SessionLog::load(filename);
+    } catch (runtime_error& e) {
+        cerr << "error: " << e.what() << '\n';
+        return 1;
+    }
+
+    vector<SessionLog::Record> replayed;
+    replayed.reserve(recorded.size());
+    replayedLines = &replayed;
+
+    uint64_t start = Metrics::now();
+    uint64_t firstOffset = recorded.empty() ? 0 : recorded.front().offset;
+    for (const SessionLog::Record& record : recorded) {
+        if (executor->pastDeadline()) {
+            cerr << "error: batch deadline exceeded" << '\n';
+            break;
+        }
+        if (replaySpeed > 0) {
+            uint64_t due = start + static_cast<uint64_t>(static_cast<double>(record.offset - firstOffset) /
+                                                         replaySpeed);
+            uint64_t now = Metrics::now();
+            if (due > now) {
+                this_thread::sleep_for(chrono::nanoseconds(due - now));
+            }
+        }
+        handleInputLine(record.line);
+    }
+    replayedLines = nullptr;
+
+    cerr << SessionLog::compare(recorded, replayed);
+    if (replayed.size() < recorded.size()) {
+        return timedOutStatus;
+    }
+    if (pendingDepth > 0) {
+        cerr << "error: syntax error: unexpected end of file" << '\n';
+        return 1;
+    }
+    return lastStatus;
+}
+
+/**
+ * @brief Parses and executes a single line of input, or keeps it if it leaves a block open.
+ *
+ * When recording or replaying, the line is measured: its wall time, the spawns it made and their latency,
+ * summed from the metrics of all threads so the lines of foreach and batchargs count as well.
+ *
  * @param line The input line to process.
  */
 void Shell::handleInputLine(const std::string& line) {
+    if (!sessionLog && replayedLines == nullptr) {
+        evaluateInput(line);
+        return;
+    }
+
+    uint64_t start = Metrics::now();
+    uint64_t spawns = Metrics::total(Metrics::Counter::CommandsSpawned);
+    uint64_t spawnLatency = Metrics::total(Metrics::Histogram::SpawnLatency);
+    SessionLog::Outcome outcome = evaluateInput(line);
+    SessionLog::Record record{start - sessionStart,
+                              outcome,
+                              Metrics::now() - start,
+                              Metrics::total(Metrics::Counter::CommandsSpawned) - spawns,
+                              Metrics::total(Metrics::Histogram::SpawnLatency) - spawnLatency,
+                              static_cast<uint32_t>(lastStatus),
+                              line};
+
+    if (sessionLog) {
+        try {
+            sessionLog->append(record);
+        } catch (std::runtime_error& e) {
+            std::cerr << "error: " << e.what() << ", recording stopped" << '\n';
+            sessionLog.reset();
+        }
+    }
+    if (replayedLines != nullptr) {
+        record.line.clear();
+        replayedLines->push_back(std::move(record));
+    }
+}
+
+/**
+ * @brief Parses and runs a line, or keeps it if it leaves a block open.
+ * @param line The input line.
+ * @return SessionLog::Outcome What became of the line.
+ */
+SessionLog::Outcome Shell::evaluateInput(const std::string& line) {
+    std::optional<SyntaxNode> tree = parseInput(line);
+    if (!tree) {
+        return pendingDepth > 0 ? SessionLog::Outcome::Pending : SessionLog::Outcome::ParseError;
+    }
+
+    lastStatus = evaluate(*tree);
+    loopControl = LoopControl::None;
+    return SessionLog::Outcome::Ran;
+}
+
+/**
+ * @brief Adds a line to the pending block and parses the block once it is closed.
+ * @param line The input line.
+ * @return std::optional<SyntaxNode> The tree, nothing while the block is open or if it cannot be parsed.
+ */
+std::optional<SyntaxNode> Shell::parseInput(const std::string& line) {
+    using namespace std;
+
+    Metrics::add(Metrics::Counter::LinesRead);
+    StartupProfile::mark(StartupProfile::Phase::Read);
+
+    pendingScript += line;
+    pendingScript += '\n';
+    pendingDepth += Parser::nesting(line);
+    if (pendingDepth > 0) {
+        return nullopt;
+    }
+
+    string script = move(pendingScript);
+    pendingScript.clear();
+    pendingDepth = 0;
+
+    optional<SyntaxNode> tree;
+    try {
+        tree = Parser::parseScript(script);
+    } catch (exception& e) {
+        cerr << "error: " << e.what() << '\n';
+        lastStatus = 2;
+        return nullopt;
+    }
+    StartupProfile::mark(StartupProfile::Phase::Parse);
+    return tree;
+}
+
+/**
+ * @brief Runs the lines of a stream, the independent ones at the same time.
+ *
+ * Consecutive lines that are a single external command each are collected into a BatchScheduler, which
+ * runs them by their file dependencies once a line that has to run alone comes: a builtin such as cd or
+ * path, an assignment, a function or alias call, a block, a background job, or a line with globs or command
+ * substitutions, which expand only when the line runs. The words of the collected lines are expanded as
+ * they are read, no line changing the variables can be among them. A prio CLASS COMMAND line is collected as
+ * its command, in the class.
+ *
+ * @param input The stream.
+ * @return int The exit status of the last command, 1 if the stream ends inside a block.
+ */
+int Shell::runScheduled(std::istream& input) {
+    using namespace std;
+
+    unique_ptr<BatchScheduler> batch;
+    auto runBatch = [&]() {
+        if (!batch) {
+            return;
+        }
+        if (explainDependencies) {
+            batch->explain(cerr);
+        }
+        lastStatus = executor->runBatch(*batch, batchWorkers);
+        batch.reset();
+    };
+
+    string line;
+    size_t lineNumber = 0;
+    size_t firstLine = 0;
+    while (getline(input, line)) {
+        lineNumber++;
+        if (line.find_first_not_of(Parser::spaceSymbols) == string::npos) {
+            continue;
+        }
+        if (executor->pastDeadline()) {
+            runBatch();
+            cerr << "error: batch deadline exceeded" << '\n';
+            return timedOutStatus;
+        }
+        if (pendingScript.empty()) {
+            firstLine = lineNumber;
+        }
+
+        optional<SyntaxNode> tree = parseInput(line);
+        if (!tree) {
+            continue;
+        }
+
+        string reason;
+        JobPriority::Class priority;
+        unique_ptr<Command> command = schedulable(*tree, reason, priority);
+        if (command) {
+            if (!batch) {
+                unique_ptr<char, decltype(&free)> directory{getcwd(nullptr, 0), free};
+                batch = make_unique<BatchScheduler>(directory ? directory.get() : "/");
+            }
+            batch->add(move(command), firstLine, priority);
+            continue;
+        }
+
+        runBatch();
+        if (explainDependencies) {
+            cerr << "line " << firstLine << ": runs alone, " << reason << '\n';
+        }
+        lastStatus = evaluate(*tree);
+        loopControl = LoopControl::None;
+    }
+    runBatch();
+
+    if (pendingDepth > 0) {
+        cerr << "error: syntax error: unexpected end of file" << '\n';
+        return 1;
+    }
+    return lastStatus;
+}
+
+/**
+ * @brief Composes the command of a tree if the tree can run next to other lines.
+ * @param tree The parsed lines.
+ * @param reason Receives why it cannot.
+ * @param priority Receives the priority class of the command, of prio CLASS COMMAND or of later jobs.
+ * @return std::unique_ptr<Command> The command, nullptr if the tree has to run alone.
+ */
+std::unique_ptr<Command> Shell::schedulable(const SyntaxNode& tree, std::string& reason,
+                                           JobPriority::Class& priority) {
+    using namespace std;
+
+    if (tree.children.size() != 1 || tree.children.front().kind != SyntaxNode::Kind::Line ||
+        tree.children.front().jobs.size() != 1) {
+        reason = "it is not a single command";
+        return nullptr;
+    }
+    const SyntaxNode& line = tree.children.front();
+    const SyntaxNode::Job& job = line.jobs.front();
+    if (job.parallel) {
+        reason = "it is a background job";
+        return nullptr;
+    }
+
+    auto expandsLate = [](const SyntaxNode::Word& word) {
+        return word.text.find("$(") != string::npos || word.text.find_first_of("*?[") != string::npos;
+    };
+    if (any_of(begin(job.words), end(job.words), expandsLate) ||
+        any_of(begin(job.redirects), end(job.redirects),
+               [&](const SyntaxNode::Redirect& redirect) { return expandsLate(redirect.target); })) {
+        reason = "its globs or command substitutions expand when it runs";
+        return nullptr;
+    }
+
+    vector<unique_ptr<Command>> commands;
+    try {
+        commands = parser->compose(line);
+    } catch (exception&) {
+        reason = "it cannot be expanded";
+        return nullptr;
+    }
+    unique_ptr<Command>& command = commands.front();
+    priority = executor->unwrapPriority(*command).value_or(executor->getPriority());
+    if (!executor->isExternal(*command)) {
+        reason = command->getName() + " runs in the shell";
+        return nullptr;
+    }
+
+    // the scheduler writes a stream to its last target only
+    size_t outputs = 0;
+    size_t errors = 0;
+    for (const Command::Redirect& redirect : command->getRedirects()) {
+        outputs += redirect.stream == Command::Redirect::Stream::Output ||
+                   redirect.stream == Command::Redirect::Stream::OutputAndError;
+        errors += redirect.stream == Command::Redirect::Stream::Error ||
+                  redirect.stream == Command::Redirect::Stream::OutputAndError;
+    }
+    if (outputs > 1 || errors > 1) {
+        reason = "it writes a stream to several files";
+        return nullptr;
+    }
+    return move(command);
+}
+
+/**
+ * @brief Runs a node of a syntax tree.
+ *
+ * A list stops early when a break or continue is pending, a loop consumes it. && and || look at the status
+ * of their left side only.
+ *
+ * @param node The node.
+ * @return int The exit status of the node.
+ */
+int Shell::evaluate(const SyntaxNode& node) {
+    using namespace std;
+
+    int status = 0;
+    switch (node.kind) {
+        case SyntaxNode::Kind::Line:
+            return evaluateLine(node);
+
+        case SyntaxNode::Kind::List:
+            for (const SyntaxNode& child : node.children) {
+                status = evaluate(child);
+                if (loopControl != LoopControl::None) {
+                    break;
+                }
+            }
+            return status;
+
+        case SyntaxNode::Kind::And:
+        case SyntaxNode::Kind::Or:
+            status = evaluate(node.children[0]);
+            if (loopControl == LoopControl::None && (status == 0) == (node.kind == SyntaxNode::Kind::And)) {
+                status = evaluate(node.children[1]);
+            }
+            return status;
+
+        case SyntaxNode::Kind::If:
+            for (size_t i = 0; i + 1 < node.children.size(); i += 2) {
+                int condition = evaluate(node.children[i]);
+                if (loopControl != LoopControl::None) {
+                    return condition;
+                }
+                if (condition == 0) {
+                    return evaluate(node.children[i + 1]);
+                }
+            }
+            return node.children.size() % 2 == 1 ? evaluate(node.children.back()) : 0;
+
+        case SyntaxNode::Kind::While:
+        case SyntaxNode::Kind::Until:
+            loopDepth++;
+            while (true) {
+                int condition = evaluate(node.children[0]);
+                if (loopControl == LoopControl::Continue) {
+                    loopControl = LoopControl::None;
+                    continue;
+                }
+                if (loopControl != LoopControl::None) {
+                    loopControl = loopControl == LoopControl::Break ? LoopControl::None : loopControl;
+                    break;
+                }
+                if ((condition == 0) != (node.kind == SyntaxNode::Kind::While) ||
+                    !evaluateBody(node.children[1], status)) {
+                    break;
+                }
+            }
+            loopDepth--;
+            return status;
+
+        case SyntaxNode::Kind::For: {
+            vector<string> words;
+            try {
+                words = parser->expandWords(node.words);
+            } catch (exception& e) {
+                cerr << "error: " << e.what() << '\n';
+                return 1;
+            }
+
+            loopDepth++;
+            for (const string& word : words) {
+                variables->set(node.variable, word);
+                if (!evaluateBody(node.children[0], status)) {
+                    break;
+                }
+            }
+            loopDepth--;
+            return status;
+        }
+
+        case SyntaxNode::Kind::Break:
+        case SyntaxNode::Kind::Continue:
+            if (loopDepth == 0) {
+                cerr << (node.kind == SyntaxNode::Kind::Break ? "break" : "continue")
+                     << ": only meaningful in a loop" << '\n';
+                return 0;
+            }
+            loopControl = node.kind == SyntaxNode::Kind::Break ? LoopControl::Break : LoopControl::Continue;
+            return 0;
+
+        case SyntaxNode::Kind::Function:
+            executor->defineFunction(node.variable, make_shared<const SyntaxNode>(node.children[0]));
+            return 0;
+
+        case SyntaxNode::Kind::Return: {
+            if (functionDepth == 0) {
+                cerr << "return: can only be used in a function" << '\n';
+                return 1;
+            }
+
+            returnStatus = lastStatus;
+            vector<string> words;
+            try {
+                words = parser->expandWords(node.words);
+            } catch (exception& e) {
+                cerr << "error: " << e.what() << '\n';
+            }
+            if (!words.empty()) {
+                const string& value = words.front();
+                if (value.empty() || value.size() > 3 || value.find_first_not_of("0123456789") != string::npos) {
+                    cerr << "return: " << value << ": numeric argument required" << '\n';
+                    returnStatus = 2;
+                } else {
+                    returnStatus = stoi(value) & 0xff;
+                }
+            }
+            loopControl = LoopControl::Return;
+            return returnStatus;
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Runs the commands of a line, the redirect targets of the line are opened in one batch first.
+ * @param line A node of kind Line.
+ * @return int The exit status of the last command, 1 if the line cannot be composed or a command fails to
+ * start.
+ */
+int Shell::evaluateLine(const SyntaxNode& line) {
     using namespace std;
 
     vector<unique_ptr<Command>> commands;
     try {
-        commands = parser->parse(line);
+        commands = parser->compose(line);
     } catch (exception& e) {
         cerr << "error: " << e.what() << '\n';
-        return;
+        return 1;
     } catch (...) {
         cerr << "unknown exception" << '\n';
-        return;
+        return 1;
     }
 
+    try {
+        executor->prepareRedirects(commands);
+    } catch (exception& e) {
+        cerr << "error: " << e.what() << '\n';
+    }
+
+    int status = 0;
     for (const auto& command : commands) {
         assert(command);
 
         try {
-            executor->execute(*command);
+            status = executor->execute(*command);
         } catch (exception& e) {
             cerr << "error: " << e.what() << '\n';
+            status = 1;
             continue;
         } catch (...) {
             cerr << "unknown exception" << '\n';
+            status = 1;
             continue;
         }
     }
+
+    lastStatus = status;
+    return status;
 }
 
 /**
- * @brief Reads a line of input from the user.
- * @return The input line as a string.
+ * @brief Runs a loop body and consumes a break or continue coming out of it.
+ * @param body The body.
+ * @param status Receives the exit status of the body.
+ * @return true if the loop goes on.
  */
-std::string Shell::readInput() {
-    std::string input;
-    std::getline(std::cin, input);
+bool Shell::evaluateBody(const SyntaxNode& body, int& status) {
+    status = evaluate(body);
+    if (loopControl == LoopControl::Return) {
+        return false;  // left for the function
+    }
+
+    bool stop = loopControl == LoopControl::Break;
+    loopControl = LoopControl::None;
+    return !stop;
+}
+
+/**
+ * @brief Runs a function body with the arguments of the call as the positional parameters.
+ *
+ * The body runs in the shell process from the tree parsed when the function was defined. Loops around the
+ * call are not visible to break and continue in the body.
+ *
+ * @param body The body.
+ * @param call The call.
+ * @return int The exit status of the function, the status given to return if it returned.
+ */
+int Shell::callFunction(const SyntaxNode& body, const Command& call) {
+    using namespace std;
+
+    if (functionDepth >= maxFunctionDepth) {
+        cerr << "error: " << call.getName() << ": maximum function nesting exceeded" << '\n';
+        return 1;
+    }
+
+    vector<string> callerArguments = variables->swapArguments(call.getArgs());
+    size_t callerLoopDepth = loopDepth;
+    loopDepth = 0;
+    functionDepth++;
+
+    int status = evaluate(body);
+    if (loopControl == LoopControl::Return) {
+        status = returnStatus;
+    }
+    loopControl = LoopControl::None;
+
+    functionDepth--;
+    loopDepth = callerLoopDepth;
+    variables->swapArguments(move(callerArguments));
+    return status;
+}
+
+/**
+ * @brief Runs the commands of a $(...) substitution and collects what they print.
+ *
+ * The commands run in the shell process from a cached syntax tree, with the output of the executor captured
+ * into the buffer: builtins print into it directly, external commands through a pipe. A break, continue or
+ * return inside does not leave the substitution.
+ *
+ * @param commands The commands between the parentheses.
+ * @param output Receives the output.
+ * @throws std::invalid_argument if the commands cannot be parsed.
+ */
+void Shell::substitute(const std::string& commands, std::string& output) {
+    using namespace std;
+
+    shared_ptr<const SyntaxNode> tree;
+    auto cached = substitutionTrees.find(commands);
+    if (cached != substitutionTrees.end()) {
+        tree = cached->second;
+    } else {
+        tree = make_shared<const SyntaxNode>(Parser::parseScript(commands));
+        if (substitutionTrees.size() >= maxSubstitutionTrees) {
+            substitutionTrees.clear();  // trees being run are kept alive by their callers
+        }
+        substitutionTrees.emplace(commands, tree);
+    }
+
+    string* outerCapture = executor->captureOutput(&output);
+    LoopControl outerControl = loopControl;
+    auto restore = [&]() {
+        executor->captureOutput(outerCapture);
+        loopControl = outerControl;
+    };
+
+    try {
+        lastStatus = evaluate(*tree);
+    } catch (...) {
+        restore();
+        throw;
+    }
+    restore();
+}
+
+/**
+ * @brief Reads a line of input from the user, or all the lines of a bracketed paste.
+ * @return std::optional<std::string> The input, the lines of a paste separated by newlines, nothing at the
+ * end of the input.
+ */
+std::optional<std::string> Shell::readInput() const {
+    using namespace std;
+
+    if (bracketedPaste) {
+        cout << pasteModeOn << flush;
+    }
+
+    string input;
+    bool read = static_cast<bool>(getline(cin, input));
+    size_t start = read && bracketedPaste ? input.find(pasteStart) : string::npos;
+    if (start != string::npos) {
+        // the terminal passes a paste on line by line, its last line is complete once the user presses enter
+        string line = input.erase(start, pasteStart.size());
+        input.clear();
+        while (true) {
+            size_t end = line.find(pasteEnd);
+            if (end != string::npos) {
+                input += line.erase(end, pasteEnd.size());
+                break;
+            }
+            input += line;
+            input += '\n';
+            if (!getline(cin, line)) {
+                break;
+            }
+        }
+    }
+
+    if (bracketedPaste) {
+        cout << pasteModeOff << flush;
+    }
+    if (!read) {
+        return nullopt;
+    }
     return input;
 }
 
 /**
- * @brief Displays the shell prompt to the user.
+ * @brief Displays the shell prompt to the user, a continuation prompt inside a block.
  */
-void Shell::displayPrompt() {
-    std::cout << Shell::PROMPT_TITLE << "> " << std::flush;
+void Shell::displayPrompt() const {
+    if (pendingDepth > 0) {
+        std::cout << "> " << std::flush;
+        return;
+    }
+    std::cout << promptTitle << "> " << std::flush;
+    StartupProfile::mark(StartupProfile::Phase::Prompt);
 }
@@ -0,0 +1,101 @@
+/**
+ * @file StartupProfile.cpp
+ * @brief File implemets StartupProfile class
+ *
+ * The end of every phase is kept as the monotonic time it was first marked at, a report lists the phases
+ * ended so far in the order they ended, each with the time since the previous one.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "StartupProfile.hpp"
+
+#include <time.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+#include "Metrics.hpp"
+
+namespace {
+
+constexpr size_t phaseCount = static_cast<size_t>(StartupProfile::Phase::Count);
+
+/// @brief Names of the phases, in the order of StartupProfile::Phase.
+constexpr const char* phaseNames[phaseCount] = {
+    "options", "shell", "configure", "read", "parse", "prompt", "exec",
+};
+
+/// @brief Whether the reports are enabled.
+bool enabled = false;
+
+/// @brief When main() started.
+uint64_t started = 0;
+
+/// @brief CPU time of the process when main() started, in nanoseconds.
+uint64_t beforeMain = 0;
+
+/// @brief When every phase ended, 0 while it did not.
+std::array<uint64_t, phaseCount> ended{};
+
+}  // namespace
+
+/// @brief Starts the clock, called first thing in main().
+void StartupProfile::start() {
+    started = Metrics::now();
+
+    timespec cpu{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    beforeMain = static_cast<uint64_t>(cpu.tv_sec) * 1000000000ULL + static_cast<uint64_t>(cpu.tv_nsec);
+}
+
+/// @brief Enables the reports.
+void StartupProfile::enable() {
+    enabled = true;
+}
+
+/**
+ * @brief Marks the end of a phase, only its first end counts.
+ * @param phase The phase.
+ */
+void StartupProfile::mark(Phase phase) {
+    size_t index = static_cast<size_t>(phase);
+    if (!enabled || ended[index] != 0) {
+        return;
+    }
+
+    ended[index] = Metrics::now();
+    if (phase == Phase::Prompt || phase == Phase::Exec) {
+        report(phase);
+    }
+}
+
+/**
+ * @brief Prints the phases ended so far.
+ * @param until The phase that triggers the report.
+ */
+void StartupProfile::report(Phase until) {
+    std::array<size_t, phaseCount> order{};
+    size_t count = 0;
+    for (size_t i = 0; i < phaseCount; i++) {
+        if (ended[i] != 0) {
+            order[count++] = i;
+        }
+    }
+    std::sort(order.begin(), order.begin() + count, [](size_t a, size_t b) { return ended[a] < ended[b]; });
+
+    auto milliseconds = [](uint64_t nanoseconds) { return static_cast<double>(nanoseconds) / 1e6; };
+
+    std::fprintf(stderr, "startup: first %s %.3f ms after main, %.3f ms of CPU before main\n",
+                 phaseNames[static_cast<size_t>(until)], milliseconds(ended[static_cast<size_t>(until)] - started),
+                 milliseconds(beforeMain));
+
+    uint64_t previous = started;
+    for (size_t i = 0; i < count; i++) {
+        std::fprintf(stderr, "  %-10s %9.3f ms\n", phaseNames[order[i]], milliseconds(ended[order[i]] - previous));
+        previous = ended[order[i]];
+    }
+}
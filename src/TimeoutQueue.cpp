@@ -0,0 +1,238 @@
+/**
+ * @file TimeoutQueue.cpp
+ * @brief File implemets TimeoutQueue class
+ *
+ * A cancelled deadline is only removed from the map, its heap entry is skipped when it comes up. So that a
+ * long timeout on many short commands does not grow the heap, it is rebuilt from the live deadlines once
+ * the stale entries outnumber them, which keeps the cost of a cancel amortized O(1).
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "TimeoutQueue.hpp"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "Metrics.hpp"
+
+namespace {
+
+/// @brief Number of stale heap entries tolerated on top of the live ones before the heap is rebuilt.
+constexpr size_t staleSlack = 64;
+
+/**
+ * @brief Checks if a process is still running.
+ * @param pidfd Pidfd of the process, -1 if not available.
+ * @return true if it is, or if it cannot be told.
+ */
+bool alive(int pidfd) {
+    pollfd exited{pidfd, POLLIN, 0};
+    return pidfd == -1 || poll(&exited, 1, 0) == 0;
+}
+
+}  // namespace
+
+/// @brief Constructs an empty queue, the worker thread is started with the first deadline.
+TimeoutQueue::TimeoutQueue() : nextId(1), armed(0), timerFd(-1), wakeFd(-1) {
+}
+
+/// @brief Stops the worker thread, the pending deadlines are dropped.
+TimeoutQueue::~TimeoutQueue() {
+    if (worker.joinable()) {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) == sizeof(one)) {
+            worker.join();
+        } else {
+            worker.detach();
+        }
+    }
+
+    for (auto& [id, timeout] : timeouts) {
+        if (timeout.pidfd != -1) {
+            close(timeout.pidfd);
+        }
+    }
+    if (timerFd != -1) {
+        close(timerFd);
+    }
+    if (wakeFd != -1) {
+        close(wakeFd);
+    }
+}
+
+/**
+ * @brief Sets a deadline for a process group.
+ * @param pgid The group, its leader has the same pid.
+ * @param deadline Monotonic time of the deadline in nanoseconds, see Metrics::now().
+ * @param grace Time between SIGTERM and SIGKILL in nanoseconds.
+ * @return uint64_t The id to cancel the deadline with, never 0.
+ * @throws std::runtime_error if the timer cannot be set up.
+ */
+uint64_t TimeoutQueue::add(pid_t pgid, uint64_t deadline, uint64_t grace) {
+    std::lock_guard<std::mutex> lock(mutex);
+    start();
+
+    uint64_t id = nextId++;
+    int pidfd = static_cast<int>(syscall(SYS_pidfd_open, pgid, 0));
+    timeouts.emplace(id, Timeout{pgid, pidfd, grace, deadline, false});
+    heap.push({deadline, id});
+    if (armed == 0 || deadline < armed) {
+        arm();
+    }
+    return id;
+}
+
+/**
+ * @brief Drops a deadline, to be called once the group leader is reaped.
+ * @param id The id given by add(), 0 is ignored.
+ * @return true if the group was signalled because of the deadline.
+ */
+bool TimeoutQueue::cancel(uint64_t id) {
+    if (id == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto timeout = timeouts.find(id);
+    if (timeout == timeouts.end()) {
+        return false;
+    }
+
+    bool terminated = timeout->second.terminated;
+    if (timeout->second.pidfd != -1) {
+        close(timeout->second.pidfd);
+    }
+    timeouts.erase(timeout);
+    compact();
+    return terminated;
+}
+
+/**
+ * @brief Creates the descriptors and starts the worker thread if it is not running yet.
+ * @throws std::runtime_error if the descriptors cannot be created.
+ */
+void TimeoutQueue::start() {
+    using namespace std;
+
+    if (worker.joinable()) {
+        return;
+    }
+
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (timerFd == -1 || wakeFd == -1) {
+        int error = errno;
+        if (timerFd != -1) {
+            close(timerFd);
+        }
+        if (wakeFd != -1) {
+            close(wakeFd);
+        }
+        timerFd = -1;
+        wakeFd = -1;
+        throw runtime_error("timeouts: "s + strerror(error));
+    }
+
+    // signals are for the thread running the shell, blocked before the thread exists so it never takes one
+    sigset_t allSignals;
+    sigset_t previous;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &previous);
+    worker = thread(&TimeoutQueue::loop, this);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+/// @brief Worker thread body, signals the groups whose deadlines passed.
+void TimeoutQueue::loop() {
+    while (true) {
+        pollfd watched[] = {{timerFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+        if (poll(watched, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (watched[1].revents != 0) {
+            return;
+        }
+
+        uint64_t expirations;
+        if (read(timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        armed = 0;
+        expire(Metrics::now());
+        arm();
+    }
+}
+
+/**
+ * @brief Signals the groups whose deadlines passed, the mutex must be held.
+ * @param now The current time.
+ */
+void TimeoutQueue::expire(uint64_t now) {
+    while (!heap.empty() && heap.top().due <= now) {
+        Expiry expiry = heap.top();
+        heap.pop();
+
+        auto found = timeouts.find(expiry.id);
+        if (found == timeouts.end() || found->second.due != expiry.due) {
+            continue;  // cancelled or escalated since
+        }
+
+        Timeout& timeout = found->second;
+        if (!alive(timeout.pidfd)) {
+            timeout.due = 0;  // the leader exited in time, its pid may be reused before it is cancelled
+        } else if (!timeout.terminated) {
+            ::kill(-timeout.pgid, SIGTERM);
+            ::kill(-timeout.pgid, SIGCONT);
+            Metrics::add(Metrics::Counter::CommandsTimedOut);
+            timeout.terminated = true;
+            timeout.due = now + timeout.grace;
+            heap.push({timeout.due, expiry.id});
+        } else {
+            ::kill(-timeout.pgid, SIGKILL);
+            timeout.due = 0;
+        }
+    }
+}
+
+/// @brief Arms the timerfd to the earliest deadline, the mutex must be held.
+void TimeoutQueue::arm() {
+    itimerspec when{};
+    if (!heap.empty()) {
+        uint64_t due = heap.top().due;
+        when.it_value.tv_sec = static_cast<time_t>(due / 1000000000ULL);
+        when.it_value.tv_nsec = static_cast<long>(due % 1000000000ULL);
+    }
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &when, nullptr);
+    armed = heap.empty() ? 0 : heap.top().due;
+}
+
+/// @brief Rebuilds the heap without its stale entries once they outnumber the live ones.
+void TimeoutQueue::compact() {
+    if (heap.size() <= 2 * timeouts.size() + staleSlack) {
+        return;
+    }
+
+    std::vector<Expiry> live;
+    live.reserve(timeouts.size());
+    for (const auto& [id, timeout] : timeouts) {
+        if (timeout.due != 0) {
+            live.push_back({timeout.due, id});
+        }
+    }
+    heap = decltype(heap){std::greater<Expiry>{}, std::move(live)};
+}
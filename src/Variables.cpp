@@ -0,0 +1,179 @@
+/**
+ * @file Variables.cpp
+ * @brief File implemets Variables class
+ *
+ * Only changes of exported variables drop the cached envp block, setting a plain shell variable keeps it.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "Variables.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+extern char** environ;
+
+/// @brief Constructs Variables holding the environment of the process.
+Variables::Variables() : positionalCount("0") {
+    for (char** entry = environ; entry != nullptr && *entry != nullptr; entry++) {
+        const char* separator = std::strchr(*entry, '=');
+        if (separator == nullptr) {
+            continue;
+        }
+
+        std::string name(*entry, separator - *entry);
+        if (isValidName(name)) {
+            variables.emplace(std::move(name), Variable{separator + 1, true});
+        }
+    }
+}
+
+/**
+ * @brief Looks a variable up.
+ * @param name The variable name, digits for a positional parameter or # for their number.
+ * @return const std::string* The value, nullptr if the variable is not set.
+ */
+const std::string* Variables::get(std::string_view name) const {
+    if (name == "#") {
+        return &positionalCount;
+    }
+    if (!name.empty() && std::isdigit(static_cast<unsigned char>(name.front()))) {
+        // the index stops growing once it is out of range, so it cannot overflow
+        size_t index = 0;
+        for (char c : name) {
+            index = index < positional.size() + 1 ? index * 10 + (c - '0') : index;
+        }
+        return index >= 1 && index <= positional.size() ? &positional[index - 1] : nullptr;
+    }
+
+    auto found = variables.find(name);
+    return found != variables.end() ? &found->second.value : nullptr;
+}
+
+/**
+ * @brief Replaces the positional parameters.
+ * @param arguments The new parameters, $1 first.
+ * @return std::vector<std::string> The previous parameters.
+ */
+std::vector<std::string> Variables::swapArguments(std::vector<std::string> arguments) {
+    std::swap(positional, arguments);
+    positionalCount = std::to_string(positional.size());
+    return arguments;
+}
+
+/**
+ * @brief Gives the positional parameters.
+ * @return const std::vector<std::string>& The parameters, $1 first.
+ */
+const std::vector<std::string>& Variables::arguments() const {
+    return positional;
+}
+
+/**
+ * @brief Sets a variable, keeping it exported if it was.
+ * @param name The variable name.
+ * @param value The value.
+ * @throws std::invalid_argument if the name is not a valid variable name.
+ */
+void Variables::set(const std::string& name, std::string value) {
+    if (!isValidName(name)) {
+        throw std::invalid_argument("invalid variable name " + name);
+    }
+
+    auto [variable, inserted] = variables.try_emplace(name, Variable{"", false});
+    variable->second.value = std::move(value);
+    if (variable->second.exported) {
+        cachedEnvironment.reset();
+    }
+}
+
+/**
+ * @brief Marks a variable as exported, creating it empty if it is not set.
+ * @param name The variable name.
+ * @throws std::invalid_argument if the name is not a valid variable name.
+ */
+void Variables::exportVariable(const std::string& name) {
+    if (!isValidName(name)) {
+        throw std::invalid_argument("invalid variable name " + name);
+    }
+
+    auto [variable, inserted] = variables.try_emplace(name, Variable{"", false});
+    if (!variable->second.exported) {
+        variable->second.exported = true;
+        cachedEnvironment.reset();
+    }
+}
+
+/**
+ * @brief Removes a variable.
+ * @param name The variable name.
+ */
+void Variables::unset(const std::string& name) {
+    auto found = variables.find(name);
+    if (found == variables.end()) {
+        return;
+    }
+
+    if (found->second.exported) {
+        cachedEnvironment.reset();
+    }
+    variables.erase(found);
+}
+
+/**
+ * @brief Gives the envp block of the exported variables, building it only if they changed.
+ * @return std::shared_ptr<const Environment> The block, valid for as long as it is held.
+ */
+std::shared_ptr<const Variables::Environment> Variables::environment() {
+    if (cachedEnvironment) {
+        return cachedEnvironment;
+    }
+
+    auto built = std::make_shared<Environment>();
+    for (const auto& [name, variable] : variables) {
+        if (variable.exported) {
+            built->entries.push_back(name + "=" + variable.value);
+        }
+    }
+
+    // the entries are complete, so the pointers into them stay valid
+    built->envp.reserve(built->entries.size() + 1);
+    for (std::string& entry : built->entries) {
+        built->envp.push_back(entry.data());
+    }
+    built->envp.push_back(nullptr);
+
+    cachedEnvironment = std::move(built);
+    return cachedEnvironment;
+}
+
+/**
+ * @brief Checks if a string is a valid variable name ([A-Za-z_][A-Za-z0-9_]*).
+ * @param name The string to check.
+ * @return true if it is.
+ */
+bool Variables::isValidName(std::string_view name) {
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name.front()))) {
+        return false;
+    }
+
+    for (char c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Iterator to the first variable.
+std::map<std::string, Variables::Variable, std::less<>>::const_iterator Variables::begin() const {
+    return variables.begin();
+}
+
+/// @brief Iterator past the last variable.
+std::map<std::string, Variables::Variable, std::less<>>::const_iterator Variables::end() const {
+    return variables.end();
+}
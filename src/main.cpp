@@ -6,9 +6,13 @@
  * @version 1.0
  */
 
+#include <unistd.h>
+
 #include <iostream>
 
+#include "Options.hpp"
 #include "Shell.hpp"
+#include "StartupProfile.hpp"
 
 /**
  * @brief Main function that initializes and runs the shell.
@@ -17,16 +21,43 @@
  * @return int Exit status of the program.
  */
 int main(int argc, char** argv) {
+    StartupProfile::start();
+
+    Options options;
+    try {
+        options = Options::parse(argc, argv);
+    } catch (std::invalid_argument& e) {
+        std::cout << "error: " << e.what() << '\n' << Options::usage(argv[0]) << std::flush;
+        return 0;
+    }
+    if (options.startupProfile) {
+        StartupProfile::enable();
+    }
+    StartupProfile::mark(StartupProfile::Phase::Options);
+
     Shell shell(argv[0]);
+    StartupProfile::mark(StartupProfile::Phase::Shell);
+    try {
+        shell.configure(options);
+    } catch (std::exception& e) {
+        std::cerr << "error: " << e.what() << '\n';
+        return 1;
+    }
+    StartupProfile::mark(StartupProfile::Phase::Configure);
 
-    if (argc == 1) {
-        shell.run();
-    } else if (argc == 2) {
-        shell.run(argv[1]);
-    } else {
-        std::cout << "Incorrect usage.\n\tcorrect usage:\n\t'" << argv[0] << "' for interactive mode or '"
-                  << argv[0] << " <filepath>' for batch mode" << std::endl;
+    if (options.replay) {
+        return shell.replay(*options.replay);
+    }
+    if (options.command) {
+        return shell.runCommand(*options.command);
+    }
+    if (options.batchFile) {
+        return shell.run(*options.batchFile);
+    }
+    if (options.readStdin || !isatty(STDIN_FILENO)) {
+        return shell.runStdin();
     }
 
+    shell.run();
     return 0;
 }
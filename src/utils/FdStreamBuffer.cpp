@@ -0,0 +1,45 @@
+/**
+ * @file FdStreamBuffer.cpp
+ * @brief Implements a stream buffer reading a file descriptor in large blocks
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "FdStreamBuffer.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace utils {
+
+/**
+ * @brief Constructs a buffer reading a descriptor, which stays open afterwards.
+ * @param fd The descriptor.
+ * @param blockSize Maximum number of bytes read at once.
+ */
+FdStreamBuffer::FdStreamBuffer(int fd, size_t blockSize) : fd(fd), block(blockSize) {
+    setg(block.data(), block.data(), block.data());
+}
+
+/**
+ * @brief Reads the next block once the current one is consumed.
+ * @return int_type The next character, eof at the end of the input or on an error.
+ */
+FdStreamBuffer::int_type FdStreamBuffer::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    ssize_t length;
+    while ((length = read(fd, block.data(), block.size())) == -1 && errno == EINTR) {
+    }
+    if (length <= 0) {
+        return traits_type::eof();
+    }
+
+    setg(block.data(), block.data(), block.data() + length);
+    return traits_type::to_int_type(*gptr());
+}
+
+}  // namespace utils
@@ -0,0 +1,250 @@
+/**
+ * @file GlobPattern.cpp
+ * @brief Implements the compiled glob pattern
+ *
+ * Literal runs at both ends of the pattern are taken out of the tokens and compared first, which rejects
+ * most names of a large directory with two memcmp() calls. The rest is matched left to right, returning to
+ * the last * on a mismatch, so a name is matched in O(name * pattern) at worst without recursion.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "GlobPattern.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <utility>
+
+/// @brief Namespace for utility functions.
+namespace utils {
+
+namespace {
+
+/// @brief Character classes accepted in bracket expressions.
+const std::pair<std::string_view, int (*)(int)> characterClasses[] = {
+    {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank}, {"cntrl", iscntrl},
+    {"digit", isdigit}, {"graph", isgraph}, {"lower", islower}, {"print", isprint},
+    {"punct", ispunct}, {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+};
+
+}  // namespace
+
+/**
+ * @brief Compiles a pattern, an unclosed [ is taken literally.
+ * @param pattern The pattern, must not contain /.
+ */
+GlobPattern::GlobPattern(std::string_view pattern) : matchesHidden(!pattern.empty() && pattern.front() == '.') {
+    auto appendLiteral = [this](char c) {
+        if (tokens.empty() || tokens.back().kind != Token::Kind::Literal) {
+            tokens.push_back({Token::Kind::Literal, {}, {}});
+        }
+        tokens.back().literal += c;
+    };
+
+    for (size_t pos = 0; pos < pattern.size();) {
+        char c = pattern[pos];
+        if (c == '\\' && pos + 1 < pattern.size()) {
+            appendLiteral(pattern[pos + 1]);
+            pos += 2;
+        } else if (c == '*') {
+            // consecutive stars are the same as one
+            if (tokens.empty() || tokens.back().kind != Token::Kind::AnyMany) {
+                tokens.push_back({Token::Kind::AnyMany, {}, {}});
+            }
+            pos++;
+        } else if (c == '?') {
+            tokens.push_back({Token::Kind::AnyOne, {}, {}});
+            pos++;
+        } else if (c == '[') {
+            Token token{Token::Kind::Set, {}, {}};
+            if (compileSet(pattern, pos, token.set)) {
+                tokens.push_back(std::move(token));
+            } else {
+                appendLiteral(c);
+                pos++;
+            }
+        } else {
+            appendLiteral(c);
+            pos++;
+        }
+    }
+
+    if (!tokens.empty() && tokens.front().kind == Token::Kind::Literal) {
+        prefix = std::move(tokens.front().literal);
+        tokens.erase(tokens.begin());
+    }
+    if (!tokens.empty() && tokens.back().kind == Token::Kind::Literal) {
+        suffix = std::move(tokens.back().literal);
+        tokens.pop_back();
+    }
+}
+
+/**
+ * @brief Matches a name against the pattern, a leading dot must be matched literally.
+ * @param name The name.
+ * @return true if the name matches.
+ */
+bool GlobPattern::matches(std::string_view name) const {
+    if (!name.empty() && name.front() == '.' && !matchesHidden) {
+        return false;
+    }
+    if (name.size() < prefix.size() + suffix.size() ||
+        std::memcmp(name.data(), prefix.data(), prefix.size()) != 0 ||
+        std::memcmp(name.data() + name.size() - suffix.size(), suffix.data(), suffix.size()) != 0) {
+        return false;
+    }
+
+    std::string_view middle = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+
+    size_t token = 0;
+    size_t pos = 0;
+    size_t starToken = std::string::npos;
+    size_t starPos = 0;
+    while (pos < middle.size()) {
+        if (token < tokens.size()) {
+            const Token& current = tokens[token];
+            if (current.kind == Token::Kind::AnyMany) {
+                starToken = token++;
+                starPos = pos;
+                continue;
+            }
+
+            size_t length = 0;
+            switch (current.kind) {
+                case Token::Kind::Literal:
+                    if (middle.compare(pos, current.literal.size(), current.literal) == 0) {
+                        length = current.literal.size();
+                    }
+                    break;
+                case Token::Kind::AnyOne:
+                    length = 1;
+                    break;
+                case Token::Kind::Set:
+                    length = current.set.test(static_cast<unsigned char>(middle[pos])) ? 1 : 0;
+                    break;
+                case Token::Kind::AnyMany:
+                    break;
+            }
+            if (length != 0) {
+                token++;
+                pos += length;
+                continue;
+            }
+        }
+
+        // mismatch, the last star takes one more character
+        if (starToken == std::string::npos) {
+            return false;
+        }
+        token = starToken + 1;
+        pos = ++starPos;
+    }
+
+    while (token < tokens.size() && tokens[token].kind == Token::Kind::AnyMany) {
+        token++;
+    }
+    return token == tokens.size();
+}
+
+/**
+ * @brief Checks if a string has unescaped glob characters.
+ * @param text The string.
+ * @return true if it has *, ? or [.
+ */
+bool GlobPattern::hasMagic(std::string_view text) {
+    for (size_t pos = 0; pos < text.size(); pos++) {
+        if (text[pos] == '\\') {
+            pos++;
+        } else if (text[pos] == '*' || text[pos] == '?' || text[pos] == '[') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Removes the \ escapes from a string.
+ * @param text The string.
+ * @return std::string The string without the escapes.
+ */
+std::string GlobPattern::unescape(std::string_view text) {
+    std::string result;
+    result.reserve(text.size());
+    for (size_t pos = 0; pos < text.size(); pos++) {
+        if (text[pos] == '\\' && pos + 1 < text.size()) {
+            pos++;
+        }
+        result += text[pos];
+    }
+    return result;
+}
+
+/**
+ * @brief Compiles a bracket expression starting at pos.
+ * @param pattern The pattern.
+ * @param pos Position of [, moved past ] on success.
+ * @param set Receives the accepted bytes.
+ * @return true if the expression is closed.
+ */
+bool GlobPattern::compileSet(std::string_view pattern, size_t& pos, std::bitset<256>& set) {
+    size_t current = pos + 1;
+    bool negate = current < pattern.size() && (pattern[current] == '!' || pattern[current] == '^');
+    if (negate) {
+        current++;
+    }
+
+    bool first = true;
+    while (current < pattern.size() && (pattern[current] != ']' || first)) {
+        first = false;
+
+        // [:class:]
+        if (pattern.compare(current, 2, "[:") == 0) {
+            size_t close = pattern.find(":]", current + 2);
+            if (close != std::string_view::npos) {
+                std::string_view name = pattern.substr(current + 2, close - current - 2);
+                for (const auto& [className, predicate] : characterClasses) {
+                    if (className == name) {
+                        for (int c = 0; c < 256; c++) {
+                            set[c] = set[c] || predicate(c) != 0;
+                        }
+                    }
+                }
+                current = close + 2;
+                continue;
+            }
+        }
+
+        unsigned char low = static_cast<unsigned char>(pattern[current]);
+        if (low == '\\' && current + 1 < pattern.size()) {
+            low = static_cast<unsigned char>(pattern[++current]);
+        }
+        current++;
+
+        unsigned char high = low;
+        if (current + 1 < pattern.size() && pattern[current] == '-' && pattern[current + 1] != ']') {
+            high = static_cast<unsigned char>(pattern[current + 1]);
+            if (high == '\\' && current + 2 < pattern.size()) {
+                high = static_cast<unsigned char>(pattern[current + 2]);
+                current++;
+            }
+            current += 2;
+        }
+        for (int c = low; c <= high; c++) {
+            set.set(c);
+        }
+    }
+
+    if (current >= pattern.size()) {
+        set.reset();
+        return false;
+    }
+
+    if (negate) {
+        set.flip();
+    }
+    pos = current + 1;
+    return true;
+}
+
+}  // namespace utils
@@ -0,0 +1,78 @@
+/**
+ * @file PathUtils.cpp
+ * @brief Implements utility functions related to file system paths
+ *
+ * Contains generic utility functions related to file system paths.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "PathUtils.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <string_view>
+
+/// @brief Namespace for utility functions.
+namespace utils {
+
+/**
+ * @brief Looks up the full path of an executable in the search path.
+ *
+ * @param searchPath Directories to search, in order.
+ * @param cmd The command name to look up.
+ * @return std::string The full path to the executable if found, otherwise the command name.
+ */
+std::string PathUtils::lookup(const std::vector<std::string>& searchPath, const std::string& cmd) {
+    assert(!cmd.empty());
+
+    // a name with a slash is a path already
+    if (cmd.find('/') != std::string::npos) {
+        return cmd;
+    }
+
+    for (const auto& path : searchPath) {
+        std::string fullPath = path + "/" + cmd;
+        if (access(fullPath.c_str(), X_OK) == 0) {
+            return fullPath;
+        }
+    }
+    return cmd;
+}
+
+/**
+ * @brief Makes a path absolute and removes ., .. and repeated slashes from it, without touching the disk.
+ *
+ * Symlinks are not resolved, so two spellings of a path through a symlink stay different.
+ *
+ * @param base The absolute directory a relative path is relative to.
+ * @param path The path.
+ * @return std::string The path without a trailing slash, "/" for the root.
+ */
+std::string PathUtils::normalize(const std::string& base, const std::string& path) {
+    std::string joined = !path.empty() && path.front() == '/' ? path : base + "/" + path;
+
+    std::string normal;
+    normal.reserve(joined.size());
+    for (size_t begin = 0; begin < joined.size();) {
+        size_t end = joined.find('/', begin);
+        if (end == std::string::npos) {
+            end = joined.size();
+        }
+
+        std::string_view component{joined.data() + begin, end - begin};
+        if (component == "..") {
+            normal.erase(std::min(normal.size(), normal.rfind('/')));
+        } else if (!component.empty() && component != ".") {
+            normal += '/';
+            normal += component;
+        }
+        begin = end + 1;
+    }
+    return normal.empty() ? "/" : normal;
+}
+
+}  // namespace utils
@@ -0,0 +1,137 @@
+/**
+ * @file RingBuffer.cpp
+ * @brief Implements a fixed capacity byte ring buffer
+ *
+ * The stored data starts at head and may wrap around the end of the storage, so every view of it is given
+ * as at most two regions.
+ *
+ * @author Sukhanov Ivan
+ * @date 25/5/2025
+ * @version 1.0
+ */
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+/// @brief Namespace for utility functions.
+namespace utils {
+
+/**
+ * @brief Constructs a ring buffer that can hold up to capacity bytes.
+ * @param capacity Maximum number of bytes stored at once.
+ */
+RingBuffer::RingBuffer(size_t capacity) : storage(capacity), head(0), used(0) {
+    assert(capacity > 0);
+}
+
+/// @brief Returns the number of stored bytes.
+size_t RingBuffer::size() const {
+    return used;
+}
+
+/// @brief Returns the maximum number of stored bytes.
+size_t RingBuffer::capacity() const {
+    return storage.size();
+}
+
+/// @brief Checks if there is no free space left.
+bool RingBuffer::full() const {
+    return used == storage.size();
+}
+
+/// @brief Checks if there are no stored bytes.
+bool RingBuffer::empty() const {
+    return used == 0;
+}
+
+/**
+ * @brief Describes the free space as up to two regions.
+ * @param regions Array receiving the regions.
+ * @return int Number of filled regions (0 if the buffer is full).
+ */
+int RingBuffer::writableRegions(iovec regions[2]) {
+    size_t freeBytes = storage.size() - used;
+    if (freeBytes == 0) {
+        return 0;
+    }
+
+    size_t tail = (head + used) % storage.size();
+    size_t firstLength = std::min(freeBytes, storage.size() - tail);
+
+    regions[0] = {storage.data() + tail, firstLength};
+    if (firstLength == freeBytes) {
+        return 1;
+    }
+
+    regions[1] = {storage.data(), freeBytes - firstLength};
+    return 2;
+}
+
+/**
+ * @brief Marks bytes written into the writable regions as stored.
+ * @param length Number of bytes written.
+ */
+void RingBuffer::commit(size_t length) {
+    assert(length <= storage.size() - used);
+
+    used += length;
+}
+
+/**
+ * @brief Describes the first length stored bytes as up to two regions.
+ * @param length Number of bytes to describe, must not exceed size().
+ * @param regions Array receiving the regions.
+ * @return int Number of filled regions.
+ */
+int RingBuffer::readableRegions(size_t length, iovec regions[2]) const {
+    assert(length <= used);
+
+    size_t firstLength = std::min(length, storage.size() - head);
+
+    regions[0] = {const_cast<char*>(storage.data()) + head, firstLength};
+    if (firstLength == length) {
+        return 1;
+    }
+
+    regions[1] = {const_cast<char*>(storage.data()), length - firstLength};
+    return 2;
+}
+
+/**
+ * @brief Drops the first length stored bytes.
+ * @param length Number of bytes to drop.
+ */
+void RingBuffer::consume(size_t length) {
+    assert(length <= used);
+
+    head = (head + length) % storage.size();
+    used -= length;
+    if (used == 0) {
+        head = 0;  // keeps the next read contiguous
+    }
+}
+
+/**
+ * @brief Finds the first occurrence of a byte in the stored data.
+ * @param byte The byte to look for.
+ * @return std::optional<size_t> Offset of the byte from the beginning of the stored data.
+ */
+std::optional<size_t> RingBuffer::find(char byte) const {
+    iovec regions[2];
+    int count = readableRegions(used, regions);
+
+    size_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        const void* found = std::memchr(regions[i].iov_base, byte, regions[i].iov_len);
+        if (found != nullptr) {
+            return offset + (static_cast<const char*>(found) - static_cast<const char*>(regions[i].iov_base));
+        }
+        offset += regions[i].iov_len;
+    }
+
+    return std::nullopt;
+}
+
+}  // namespace utils
@@ -10,6 +10,8 @@
  */
 #include "StringUtils.hpp"
 
+#include <cstdio>
+#include <stdexcept>
 #include <string>
 
 /// @brief Namespace for utility functions.
@@ -32,4 +34,99 @@ std::string StringUtils::trim(const std::string& str, std::string_view unwantedS
     return str.substr(first, last - first + 1);
 }
 
+/**
+ * @brief Parses a size with an optional K, M or G suffix.
+ * @param value The size.
+ * @return long long The size in bytes.
+ * @throws std::invalid_argument if the size is malformed.
+ */
+long long StringUtils::parseSize(const std::string& value) {
+    size_t digits = value.find_first_not_of("0123456789");
+    if (digits == 0 || (digits != std::string::npos && digits + 1 != value.size()) || value.size() > 15) {
+        throw std::invalid_argument("invalid size \"" + value + "\"");
+    }
+
+    long long size = std::stoll(value.substr(0, digits));
+    switch (digits == std::string::npos ? '\0' : value.back()) {
+        case 'G':
+            size *= 1024;
+            [[fallthrough]];
+        case 'M':
+            size *= 1024;
+            [[fallthrough]];
+        case 'K':
+            size *= 1024;
+            [[fallthrough]];
+        case '\0':
+            return size;
+        default:
+            throw std::invalid_argument("invalid size \"" + value + "\"");
+    }
+}
+
+/**
+ * @brief Parses a duration in seconds, with an optional fraction and an ms, s, m or h suffix.
+ * @param value The duration, e.g. 1.5, 500ms or 2m.
+ * @return uint64_t The duration in nanoseconds.
+ * @throws std::invalid_argument if the duration is malformed or zero.
+ */
+uint64_t StringUtils::parseDuration(const std::string& value) {
+    size_t digits = value.find_first_not_of("0123456789.");
+    std::string_view number{value.data(), digits == std::string::npos ? value.size() : digits};
+    std::string_view unit{value.data() + number.size(), value.size() - number.size()};
+
+    uint64_t scale;
+    if (unit.empty() || unit == "s") {
+        scale = 1000000000ULL;
+    } else if (unit == "ms") {
+        scale = 1000000ULL;
+    } else if (unit == "m") {
+        scale = 60 * 1000000000ULL;
+    } else if (unit == "h") {
+        scale = 3600 * 1000000000ULL;
+    } else {
+        throw std::invalid_argument("invalid duration \"" + value + "\"");
+    }
+
+    // at most a day of seconds in front of the point, at most nanoseconds after it
+    size_t point = number.find('.');
+    std::string_view whole = number.substr(0, point);
+    std::string_view fraction = point == std::string_view::npos ? "" : number.substr(point + 1);
+    if ((whole.empty() && fraction.empty()) || whole.size() > 6 || fraction.size() > 9 ||
+        fraction.find('.') != std::string_view::npos) {
+        throw std::invalid_argument("invalid duration \"" + value + "\"");
+    }
+
+    uint64_t duration = whole.empty() ? 0 : std::stoull(std::string{whole}) * scale;
+    uint64_t fractionScale = scale;
+    for (char digit : fraction) {
+        fractionScale /= 10;
+        duration += static_cast<uint64_t>(digit - '0') * fractionScale;
+    }
+    if (duration == 0) {
+        throw std::invalid_argument("invalid duration \"" + value + "\"");
+    }
+    return duration;
+}
+
+/**
+ * @brief Formats a duration with a unit that keeps it short.
+ *
+ * @param nanoseconds The duration.
+ * @return std::string e.g. "850ns", "12.3us", "4.56ms" or "1.20s".
+ */
+std::string StringUtils::formatDuration(double nanoseconds) {
+    char text[32];
+    if (nanoseconds < 1e3) {
+        snprintf(text, sizeof(text), "%.0fns", nanoseconds);
+    } else if (nanoseconds < 1e6) {
+        snprintf(text, sizeof(text), "%.1fus", nanoseconds / 1e3);
+    } else if (nanoseconds < 1e9) {
+        snprintf(text, sizeof(text), "%.2fms", nanoseconds / 1e6);
+    } else {
+        snprintf(text, sizeof(text), "%.2fs", nanoseconds / 1e9);
+    }
+    return text;
+}
+
 }  // namespace utils